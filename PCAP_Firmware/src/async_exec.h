@@ -0,0 +1,367 @@
+/**
+ * @file async_exec.h
+ * @brief C++20 coroutine tasks and a single-threaded executor
+ *
+ * Building blocks for asynchronous driver code that reads sequentially:
+ *
+ *   - async::Task<T>   a lazily started coroutine returning T; co_await it
+ *                      from another task to run it and get the result.
+ *   - async::Executor  resumes ready coroutines and expired timers on one
+ *                      thread. Other contexts (the bus task) only post
+ *                      wake-ups, under the lock hook.
+ *   - async::spawn()   starts a Task<void> on the executor, detached.
+ *   - async::WaitGroup waits for a set of spawned tasks.
+ *   - async::sleep_us() / sleep_ms() suspend on the executor's timers.
+ *   - async::bus()     submits a bus batch (bus_scheduler.h) and suspends
+ *                      until the scheduler reports it complete.
+ *
+ * Nothing here allocates beyond the coroutine frames: wake-ups and timers
+ * are intrusive nodes inside the awaiting frames. The core has no ESP-IDF or
+ * FreeRTOS dependency; the clock, lock and wake-up come in through
+ * async_ops_t, as for the bus scheduler, so the executor runs in a FreeRTOS
+ * task (pcap_async.cpp) or a host event loop alike.
+ */
+
+#ifndef ASYNC_EXEC_H
+#define ASYNC_EXEC_H
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <utility>
+#include "bus_scheduler.h"
+
+namespace async {
+
+/// Executor run(): nothing ready and no timer pending
+constexpr uint32_t IDLE_WAIT_US = UINT32_MAX;
+
+/**
+ * @brief Platform hooks
+ */
+struct async_ops_t {
+    int64_t (*now_us)(void);    ///< Monotonic clock
+    void    (*lock)(void);      ///< Enter the ready-list critical section
+    void    (*unlock)(void);    ///< Leave the ready-list critical section
+    void    (*wake)(void);      ///< Wake the executor thread after a post
+};
+
+/// A suspended coroutine waiting to be resumed, linked into the executor
+struct Waiter {
+    std::coroutine_handle<> handle;
+    Waiter* next = nullptr;
+    int64_t due_us = 0;
+};
+
+class Executor {
+public:
+    explicit Executor(const async_ops_t* ops) : ops_(ops) {}
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    /// Queue a waiter for resumption; callable from any context
+    void post(Waiter* w)
+    {
+        w->next = nullptr;
+        ops_->lock();
+        if (ready_tail_) {
+            ready_tail_->next = w;
+        } else {
+            ready_head_ = w;
+        }
+        ready_tail_ = w;
+        ops_->unlock();
+        ops_->wake();
+    }
+
+    /// Queue a waiter for resumption at due_us; executor thread only
+    void add_timer(Waiter* w)
+    {
+        Waiter** p = &timers_;
+        while (*p && (*p)->due_us <= w->due_us) {
+            p = &(*p)->next;
+        }
+        w->next = *p;
+        *p = w;
+    }
+
+    /**
+     * @brief Resume everything ready or due, until nothing is
+     * @return Microseconds until the next timer, or IDLE_WAIT_US. A post
+     *         calls ops->wake, so the thread can sleep until either.
+     */
+    uint32_t run()
+    {
+        while (true) {
+            ops_->lock();
+            Waiter* w = ready_head_;
+            ready_head_ = ready_tail_ = nullptr;
+            ops_->unlock();
+
+            bool resumed = (w != nullptr);
+            while (w) {
+                Waiter* next = w->next;     // w may be gone once resumed
+                w->handle.resume();
+                w = next;
+            }
+
+            int64_t now = ops_->now_us();
+            while (timers_ && timers_->due_us <= now) {
+                Waiter* t = timers_;
+                timers_ = t->next;
+                t->handle.resume();
+                resumed = true;
+            }
+
+            if (!resumed) {
+                if (!timers_) {
+                    return IDLE_WAIT_US;
+                }
+                int64_t wait = timers_->due_us - ops_->now_us();
+                return wait <= 0 ? 0 : (wait > INT32_MAX ? INT32_MAX : (uint32_t)wait);
+            }
+        }
+    }
+
+    int64_t now_us() const { return ops_->now_us(); }
+
+private:
+    const async_ops_t* ops_;
+    Waiter* ready_head_ = nullptr;
+    Waiter* ready_tail_ = nullptr;
+    Waiter* timers_ = nullptr;
+};
+
+namespace detail {
+
+// Resumes whoever awaited the finished task
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+    {
+        auto cont = h.promise().continuation;
+        return cont ? cont : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+};
+
+} // namespace detail
+
+/**
+ * @brief Lazily started coroutine producing a T
+ *
+ * Starts when awaited; the awaiting coroutine resumes when it finishes.
+ */
+template <typename T = void>
+class Task {
+public:
+    struct promise_type : detail::PromiseBase {
+        T value{};
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_value(T v) { value = std::move(v); }
+    };
+
+    Task(Task&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+    Task(const Task&) = delete;
+    ~Task() { if (h_) h_.destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        h_.promise().continuation = awaiting;
+        return h_;
+    }
+    T await_resume() { return std::move(h_.promise().value); }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+    std::coroutine_handle<promise_type> h_;
+};
+
+template <>
+class Task<void> {
+public:
+    struct promise_type : detail::PromiseBase {
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_void() {}
+    };
+
+    Task(Task&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+    Task(const Task&) = delete;
+    ~Task() { if (h_) h_.destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        h_.promise().continuation = awaiting;
+        return h_;
+    }
+    void await_resume() {}
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+    std::coroutine_handle<promise_type> h_;
+};
+
+/**
+ * @brief Counts spawned tasks and lets one coroutine wait for all of them
+ *
+ * Executor thread only.
+ */
+class WaitGroup {
+public:
+    void add(int n = 1) { count_ += n; }
+
+    void done()
+    {
+        if (--count_ == 0 && waiter_) {
+            auto h = std::exchange(waiter_, {});
+            h.resume();
+        }
+    }
+
+    auto wait()
+    {
+        struct Awaiter {
+            WaitGroup* group;
+            bool await_ready() const noexcept { return group->count_ == 0; }
+            void await_suspend(std::coroutine_handle<> h) noexcept { group->waiter_ = h; }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{this};
+    }
+
+private:
+    int count_ = 0;
+    std::coroutine_handle<> waiter_;
+};
+
+/**
+ * @brief Move the awaiting coroutine onto the executor thread
+ */
+inline auto schedule(Executor& exec)
+{
+    struct Awaiter {
+        Executor& exec;
+        Waiter waiter;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h) noexcept
+        {
+            waiter.handle = h;
+            exec.post(&waiter);
+        }
+        void await_resume() const noexcept {}
+    };
+    return Awaiter{exec, {}};
+}
+
+/**
+ * @brief Suspend for at least us microseconds; executor thread only
+ */
+inline auto sleep_us(Executor& exec, uint32_t us)
+{
+    struct Awaiter {
+        Executor& exec;
+        uint32_t us;
+        Waiter waiter;
+        bool await_ready() const noexcept { return us == 0; }
+        void await_suspend(std::coroutine_handle<> h) noexcept
+        {
+            waiter.handle = h;
+            waiter.due_us = exec.now_us() + us;
+            exec.add_timer(&waiter);
+        }
+        void await_resume() const noexcept {}
+    };
+    return Awaiter{exec, us, {}};
+}
+
+inline auto sleep_ms(Executor& exec, uint32_t ms)
+{
+    return sleep_us(exec, ms * 1000);
+}
+
+/**
+ * @brief Run a batch of bus ops; resumes on the executor once it completes
+ * @return (from co_await) false if the scheduler rejected the batch
+ *
+ * The ops and their buffers must stay valid until the co_await returns.
+ */
+inline auto bus(Executor& exec, bus_prio_t prio, bus_op_t* ops, uint16_t count)
+{
+    struct Awaiter {
+        Executor& exec;
+        bus_batch_t batch;
+        Waiter waiter;
+        bool submitted = false;
+
+        bool await_ready() const noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h) noexcept
+        {
+            waiter.handle = h;
+            batch.ctx = this;
+            batch.on_done = [](bus_batch_t* b) {
+                auto* self = static_cast<Awaiter*>(b->ctx);
+                self->exec.post(&self->waiter);
+            };
+            submitted = bus_sched_submit(&batch);
+            return submitted;       // Rejected: resume at once
+        }
+        bool await_resume() const noexcept { return submitted; }
+    };
+    bus_batch_t batch = {};
+    batch.ops = ops;
+    batch.count = count;
+    batch.prio = prio;
+    return Awaiter{exec, batch, {}};
+}
+
+namespace detail {
+
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+inline Detached run_detached(Executor& exec, Task<void> task, WaitGroup* group)
+{
+    co_await schedule(exec);
+    co_await task;
+    if (group) {
+        group->done();
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Start a task on the executor without waiting for it
+ * @param group Counts the task until it finishes (may be nullptr)
+ *
+ * Callable from any thread without a group, and from the executor thread
+ * with one. The task itself only runs on the executor.
+ */
+inline void spawn(Executor& exec, Task<void> task, WaitGroup* group = nullptr)
+{
+    if (group) {
+        group->add();
+    }
+    detail::run_detached(exec, std::move(task), group);
+}
+
+} // namespace async
+
+#endif // ASYNC_EXEC_H
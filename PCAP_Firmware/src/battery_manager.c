@@ -11,6 +11,7 @@
 #include "freertos/task.h"
 
 static esp_adc_cal_characteristics_t adc_chars;
+static float filtered_v = 4.2f;   // simple smoothing
 
 void battery_adc_init(void)
 {
@@ -26,17 +27,17 @@ void battery_adc_init(void)
     );
 }
 
-static uint8_t voltage_to_percent(float v)
+float battery_voltage_to_percent(float v)
 {
-    if (v >= 4.20f) return 100;
-    if (v <= 3.30f) return 0;
+    if (v >= 4.20f) return 100.0f;
+    if (v <= 3.30f) return 0.0f;
 
-    if (v > 4.00f) return (uint8_t)(80 + (v - 4.00f) * 100.0f);
-    if (v > 3.85f) return (uint8_t)(60 + (v - 3.85f) * 133.3f);
-    if (v > 3.70f) return (uint8_t)(40 + (v - 3.70f) * 133.3f);
-    if (v > 3.55f) return (uint8_t)(20 + (v - 3.55f) * 133.3f);
+    if (v > 4.00f) return 80.0f + (v - 4.00f) * 100.0f;
+    if (v > 3.85f) return 60.0f + (v - 3.85f) * 133.3f;
+    if (v > 3.70f) return 40.0f + (v - 3.70f) * 133.3f;
+    if (v > 3.55f) return 20.0f + (v - 3.55f) * 133.3f;
 
-    return (uint8_t)((v - 3.30f) * 80.0f);
+    return (v - 3.30f) * 80.0f;
 }
 
 float read_battery_voltage(void)
@@ -57,11 +58,15 @@ float read_battery_voltage(void)
 
 uint8_t battery_get_percentage(void)
 {
-    static float filtered_v = 4.2f;   // simple smoothing
     float v = read_battery_voltage();
 
     // Low-pass filter to reduce ADC noise
     filtered_v = 0.8f * filtered_v + 0.2f * v;
 
-    return voltage_to_percent(filtered_v);
-}
\ No newline at end of file
+    return (uint8_t)battery_voltage_to_percent(filtered_v);
+}
+
+float battery_get_filtered_voltage(void)
+{
+    return filtered_v;
+}
@@ -26,6 +26,7 @@ extern "C" {
 #define DEFAULT_VREF        1100               // mV
 #define NUM_SAMPLES         16
 #define DIVIDER_RATIO       2.0f               // 1:1 divider
+#define BATTERY_CAPACITY_MAH 500               // LiPo capacity used for runtime prediction
 
 /**
  * @brief Initialize ADC and calibration for battery voltage measurement.
@@ -42,6 +43,25 @@ void battery_adc_init(void);
  */
 uint8_t battery_get_percentage(void);
 
+/**
+ * @brief Map a battery voltage to state of charge on the discharge curve.
+ *
+ * Unlike battery_get_percentage() the result is not truncated, so small
+ * discharges show up as small changes.
+ *
+ * @param v Battery voltage in volts
+ * @return State of charge, 0.0–100.0 %
+ */
+float battery_voltage_to_percent(float v);
+
+/**
+ * @brief Get the low-pass filtered battery voltage in volts.
+ *
+ * Returns the filter state last updated by battery_get_percentage()
+ * without taking a new ADC sample.
+ */
+float battery_get_filtered_voltage(void);
+
 /**
  * @brief Read battery voltage in volts.
  *
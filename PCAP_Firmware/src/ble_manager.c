@@ -5,6 +5,7 @@
 
 #include "ble_manager.h"
 #include "pcap_driver.h"
+#include "signal_fixed.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_nimble_hci.h"
@@ -34,25 +35,183 @@ static const ble_uuid128_t status_uuid =
     BLE_UUID128_INIT(0xa9, 0x26, 0x1b, 0x36, 0x07, 0xea, 0xf5, 0xb7,
                      0x88, 0x46, 0xe1, 0x36, 0x3e, 0x48, 0xb5, 0xbe);
 
+// Control UUID: beb5483e-36e1-4688-b7f5-ea07361b26aa
+static const ble_uuid128_t control_uuid =
+    BLE_UUID128_INIT(0xaa, 0x26, 0x1b, 0x36, 0x07, 0xea, 0xf5, 0xb7,
+                     0x88, 0x46, 0xe1, 0x36, 0x3e, 0x48, 0xb5, 0xbe);
+
+// OTA UUID: beb5483e-36e1-4688-b7f5-ea07361b26ab
+static const ble_uuid128_t ota_uuid =
+    BLE_UUID128_INIT(0xab, 0x26, 0x1b, 0x36, 0x07, 0xea, 0xf5, 0xb7,
+                     0x88, 0x46, 0xe1, 0x36, 0x3e, 0x48, 0xb5, 0xbe);
+
 // Thread safety
 static SemaphoreHandle_t ble_mutex = NULL;
 
-// Connection state
-static bool device_connected = false;
-static uint16_t conn_handle = BLE_HS_CONN_HANDLE_NONE;
+// Connection state, one slot per central
+#define BLE_MAX_CONNECTIONS CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+
+typedef struct {
+    uint16_t handle;            // BLE_HS_CONN_HANDLE_NONE = free slot
+    bool data_subscribed;       // Notifications enabled on sensor data
+    bool status_subscribed;     // Notifications enabled on status
+    uint8_t encoding_pref;      // ble_encoding_t, or BLE_ENCODING_AUTO
+    uint16_t itvl;              // Negotiated connection interval (1.25 ms units)
+    uint32_t notifications;     // Notifications queued since the last report
+    uint32_t bytes;             // Payload bytes queued since the last report
+    uint32_t congested;         // Notifications refused (no mbuf / host queue full)
+} ble_conn_t;
+
+static ble_conn_t conns[BLE_MAX_CONNECTIONS];
+static uint8_t conn_count = 0;
+static TickType_t last_report_tick = 0;
+static uint32_t notify_total = 0;
+static uint32_t congested_total = 0;
 static uint16_t sensor_data_handle;
 static uint16_t status_handle;
-
-// Characteristic values
-static uint8_t sensor_data_val[25] = {0};
+static uint16_t control_handle;
+static uint16_t ota_handle;
+
+// Link preferences
+static ble_encoding_t payload_encoding = BLE_ENCODING_FLOAT32;
+static uint16_t preferred_conn_itvl = 0;     // 0 = leave to the central
+static ble_control_handler_t control_handler = NULL;
+static ble_ota_handler_t ota_handler = NULL;
+
+// Characteristic values; the last chip packet is kept per encoding
+static uint8_t sensor_data_val[BLE_ENCODING_COUNT][25] = {{0}};
+static uint16_t sensor_data_len[BLE_ENCODING_COUNT] = {0};
 static char status_val[64] = "Ready";
 
+// Dedicated notification mbuf pool. Every notification is built in a block
+// from this statically sized pool instead of the shared msys pool, so the
+// send path never competes with the host stack and never touches the heap.
+// When the pool runs dry the notification is dropped and counted.
+#define BLE_NOTIFY_MBUF_TOTAL       (BLE_NOTIFY_MBUF_COUNT * BLE_MAX_CONNECTIONS)
+#define BLE_NOTIFY_MBUF_BLOCK_SIZE  (sizeof(struct os_mbuf) + sizeof(struct os_mbuf_pkthdr) + \
+                                     BLE_NOTIFY_LEADING_SPACE + BLE_NOTIFY_PAYLOAD_MAX)
+static os_membuf_t notify_mbuf_mem[
+    OS_MEMPOOL_SIZE(BLE_NOTIFY_MBUF_TOTAL, BLE_NOTIFY_MBUF_BLOCK_SIZE)];
+static struct os_mempool notify_mempool;
+static struct os_mbuf_pool notify_mbuf_pool;
+static uint32_t notify_drops = 0;
+
 // Forward declarations
 static int ble_gap_event(struct ble_gap_event *event, void *arg);
 static void ble_host_task(void *param);
 static void ble_on_sync(void);
 static void ble_on_reset(int reason);
 
+static void notify_pool_init(void)
+{
+    int rc = os_mempool_init(&notify_mempool, BLE_NOTIFY_MBUF_TOTAL,
+                             BLE_NOTIFY_MBUF_BLOCK_SIZE, notify_mbuf_mem, "ble_notify");
+    if (rc == 0) {
+        rc = os_mbuf_pool_init(&notify_mbuf_pool, &notify_mempool,
+                               BLE_NOTIFY_MBUF_BLOCK_SIZE, BLE_NOTIFY_MBUF_TOTAL);
+    }
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Error initializing notification pool; rc=%d", rc);
+    }
+}
+
+// Build a notification mbuf from the static pool, reserving room for the
+// HCI/L2CAP/ATT headers the host prepends.
+static struct os_mbuf* notify_mbuf_from_flat(const void* buf, uint16_t len)
+{
+    struct os_mbuf *om = os_mbuf_get_pkthdr(&notify_mbuf_pool, 0);
+    if (om == NULL) {
+        notify_drops++;
+        return NULL;
+    }
+
+    om->om_data += BLE_NOTIFY_LEADING_SPACE;
+    if (os_mbuf_append(om, buf, len) != 0) {
+        os_mbuf_free_chain(om);
+        notify_drops++;
+        return NULL;
+    }
+    return om;
+}
+
+// Find the slot of a connection, NULL if unknown. Caller holds ble_mutex.
+static ble_conn_t* conn_find(uint16_t handle)
+{
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (conns[i].handle == handle) {
+            return &conns[i];
+        }
+    }
+    return NULL;
+}
+
+// Encrypted with keys from an authenticated (passkey) pairing
+static bool link_authenticated(uint16_t handle)
+{
+    struct ble_gap_conn_desc desc;
+    return ble_gap_conn_find(handle, &desc) == 0 &&
+           desc.sec_state.encrypted && desc.sec_state.authenticated;
+}
+
+static ble_encoding_t conn_encoding(const ble_conn_t* c)
+{
+    return c->encoding_pref == BLE_ENCODING_AUTO ? payload_encoding : (ble_encoding_t)c->encoding_pref;
+}
+
+// Queue one notification to one connection. Each connection gets its own
+// mbuf: the host prepends its headers in place and frees the chain once
+// sent, so a chain cannot be handed to more than one connection. Caller
+// holds ble_mutex.
+static void notify_conn(ble_conn_t* c, uint16_t attr_handle, const void* buf, uint16_t len)
+{
+    struct os_mbuf *om = notify_mbuf_from_flat(buf, len);
+    if (om == NULL) {
+        c->congested++;
+        congested_total++;
+        return;
+    }
+    if (ble_gatts_notify_custom(c->handle, attr_handle, om) != 0) {
+        c->congested++;
+        congested_total++;
+        return;
+    }
+    c->notifications++;
+    c->bytes += len;
+    notify_total++;
+}
+
+// Pack one chip's calibrated readings, returns the packet length
+static uint16_t encode_chip(ble_encoding_t encoding, uint8_t chip_num, const pcap_data_t* data, uint8_t* out)
+{
+    int idx = 1;
+
+    if (encoding == BLE_ENCODING_INT16) {
+        // Format: [chip_num | 0x40][sensor0_2B]...[sensor5_2B] = 13 bytes
+        out[0] = chip_num | BLE_INT16_CHIP_FLAG;
+
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            // Fixed point: no soft-float multiply or divide per value
+            int16_t packed = signal_encode_int16(data->raw[i], data->offset[i]);
+
+            memcpy(&out[idx], &packed, sizeof(int16_t));
+            idx += sizeof(int16_t);
+        }
+    } else {
+        // Format: [chip_num][sensor0_4B]...[sensor5_4B] = 25 bytes
+        out[0] = chip_num;
+
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            // Calculate calibrated value
+            float calibrated = (PCAP_SCALING_NUM * (float)(data->raw[i] - data->offset[i])/PCAP_CONVERSION_NUMBER);
+
+            // Pack float as 4 bytes (IEEE 754, little-endian)
+            memcpy(&out[idx], &calibrated, sizeof(float));
+            idx += sizeof(float);
+        }
+    }
+    return idx;
+}
+
 // GATT access callback
 static int gatt_chr_access(uint16_t conn_handle, uint16_t attr_handle,
                            struct ble_gatt_access_ctxt *ctxt, void *arg)
@@ -62,7 +221,17 @@ static int gatt_chr_access(uint16_t conn_handle, uint16_t attr_handle,
     // Handle sensor data characteristic
     if (ble_uuid_cmp(uuid, &sensor_data_uuid.u) == 0) {
         if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
-            int rc = os_mbuf_append(ctxt->om, sensor_data_val, sizeof(sensor_data_val));
+            // Last packet in the reader's encoding
+            ble_encoding_t encoding = payload_encoding;
+            int rc = BLE_ATT_ERR_UNLIKELY;
+            if (xSemaphoreTake(ble_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
+                ble_conn_t* c = conn_find(conn_handle);
+                if (c) {
+                    encoding = conn_encoding(c);
+                }
+                rc = os_mbuf_append(ctxt->om, sensor_data_val[encoding], sensor_data_len[encoding]);
+                xSemaphoreGive(ble_mutex);
+            }
             return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
         }
     }
@@ -75,9 +244,79 @@ static int gatt_chr_access(uint16_t conn_handle, uint16_t attr_handle,
         }
     }
 
+    // Handle control characteristic
+    if (ble_uuid_cmp(uuid, &control_uuid.u) == 0) {
+        if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+            uint8_t buf[BLE_CONTROL_MAX_LEN];
+            uint16_t len = 0;
+            if (ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len) != 0) {
+                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            }
+            if (len >= 2 && buf[0] == BLE_CTRL_SET_ENCODING) {
+                // Payload preference of the writing connection only
+                if (buf[1] >= BLE_ENCODING_COUNT && buf[1] != BLE_ENCODING_AUTO) {
+                    return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+                }
+                if (xSemaphoreTake(ble_mutex, portMAX_DELAY) == pdTRUE) {
+                    ble_conn_t* c = conn_find(conn_handle);
+                    if (c) {
+                        c->encoding_pref = buf[1];
+                    }
+                    xSemaphoreGive(ble_mutex);
+                }
+                return 0;
+            }
+            if (len > 0 && (buf[0] == BLE_CTRL_OTA_BEGIN || buf[0] == BLE_CTRL_OTA_ABORT) &&
+                !link_authenticated(conn_handle)) {
+                // Same bar as the OTA characteristic; the central pairs and retries
+                return BLE_ATT_ERR_INSUFFICIENT_AUTHEN;
+            }
+            if (control_handler != NULL && len > 0) {
+                control_handler(buf, len);
+            }
+            return 0;
+        }
+    }
+
+    // Handle OTA characteristic
+    if (ble_uuid_cmp(uuid, &ota_uuid.u) == 0) {
+        if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+            uint8_t buf[BLE_OTA_MAX_WRITE];
+            uint16_t len = 0;
+            if (ble_hs_mbuf_to_flat(ctxt->om, buf, sizeof(buf), &len) != 0) {
+                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            }
+            if (ota_handler != NULL && len > 0) {
+                ota_handler(buf, len);
+            }
+            return 0;
+        }
+    }
+
     return BLE_ATT_ERR_UNLIKELY;
 }
 
+// Ask the central for the preferred connection interval
+static void apply_conn_interval(uint16_t handle)
+{
+    if (preferred_conn_itvl == 0 || handle == BLE_HS_CONN_HANDLE_NONE) {
+        return;
+    }
+
+    struct ble_gap_upd_params params = {
+        .itvl_min = preferred_conn_itvl,
+        .itvl_max = preferred_conn_itvl,
+        .latency = 0,
+        .supervision_timeout = 400,     // 4 s
+        .min_ce_len = 0,
+        .max_ce_len = 0,
+    };
+    int rc = ble_gap_update_params(handle, &params);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "Connection interval update failed; rc=%d", rc);
+    }
+}
+
 // GATT service definition
 static const struct ble_gatt_svc_def gatt_svcs[] = {
     {
@@ -98,6 +337,22 @@ static const struct ble_gatt_svc_def gatt_svcs[] = {
                 .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
                 .val_handle = &status_handle,
             },
+            {
+                // Control characteristic
+                .uuid = &control_uuid.u,
+                .access_cb = gatt_chr_access,
+                .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP,
+                .val_handle = &control_handle,
+            },
+            {
+                // OTA characteristic: firmware patch data, only over a
+                // link paired with BLE_OTA_PASSKEY
+                .uuid = &ota_uuid.u,
+                .access_cb = gatt_chr_access,
+                .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP |
+                         BLE_GATT_CHR_F_WRITE_ENC | BLE_GATT_CHR_F_WRITE_AUTHEN,
+                .val_handle = &ota_handle,
+            },
             {
                 0, // Terminator
             },
@@ -108,43 +363,107 @@ static const struct ble_gatt_svc_def gatt_svcs[] = {
     },
 };
 
+// Record the negotiated interval of a connection
+static void update_conn_itvl(uint16_t handle)
+{
+    struct ble_gap_conn_desc desc;
+    if (ble_gap_conn_find(handle, &desc) != 0) {
+        return;
+    }
+    if (xSemaphoreTake(ble_mutex, portMAX_DELAY) == pdTRUE) {
+        ble_conn_t* c = conn_find(handle);
+        if (c) {
+            c->itvl = desc.conn_itvl;
+        }
+        xSemaphoreGive(ble_mutex);
+    }
+}
+
+// Keep advertising while a connection slot is free
+static void advertise_if_room(void)
+{
+    if (conn_count < BLE_MAX_CONNECTIONS && !ble_gap_adv_active()) {
+        ble_on_sync();
+    }
+}
+
 static int ble_gap_event(struct ble_gap_event *event, void *arg)
 {
     switch (event->type) {
     case BLE_GAP_EVENT_CONNECT:
-        ESP_LOGI(TAG, "BLE connection %s; status=%d",
+        ESP_LOGI(TAG, "BLE connection %s; status=%d handle=%d",
                  event->connect.status == 0 ? "established" : "failed",
-                 event->connect.status);
+                 event->connect.status, event->connect.conn_handle);
         if (event->connect.status == 0) {
             if (xSemaphoreTake(ble_mutex, portMAX_DELAY) == pdTRUE) {
-                device_connected = true;
-                conn_handle = event->connect.conn_handle;
+                ble_conn_t* c = conn_find(BLE_HS_CONN_HANDLE_NONE);
+                if (c) {
+                    memset(c, 0, sizeof(*c));
+                    c->handle = event->connect.conn_handle;
+                    c->encoding_pref = BLE_ENCODING_AUTO;
+                    conn_count++;
+                }
                 xSemaphoreGive(ble_mutex);
             }
-        } else {
-            // Connection failed, restart advertising
-            ble_on_sync();
+            update_conn_itvl(event->connect.conn_handle);
+            apply_conn_interval(event->connect.conn_handle);
         }
+        // Advertising stops on connect; resume for the remaining slots
+        advertise_if_room();
         break;
 
     case BLE_GAP_EVENT_DISCONNECT:
-        ESP_LOGI(TAG, "BLE disconnect; reason=%d", event->disconnect.reason);
+        ESP_LOGI(TAG, "BLE disconnect; reason=%d handle=%d",
+                 event->disconnect.reason, event->disconnect.conn.conn_handle);
         if (xSemaphoreTake(ble_mutex, portMAX_DELAY) == pdTRUE) {
-            device_connected = false;
-            conn_handle = BLE_HS_CONN_HANDLE_NONE;
+            ble_conn_t* c = conn_find(event->disconnect.conn.conn_handle);
+            if (c) {
+                c->handle = BLE_HS_CONN_HANDLE_NONE;
+                conn_count--;
+            }
             xSemaphoreGive(ble_mutex);
         }
-        // Restart advertising
-        ble_on_sync();
+        advertise_if_room();
         break;
 
     case BLE_GAP_EVENT_ADV_COMPLETE:
         ESP_LOGI(TAG, "Advertising complete");
-        ble_on_sync();
+        advertise_if_room();
         break;
 
     case BLE_GAP_EVENT_SUBSCRIBE:
-        ESP_LOGI(TAG, "Subscribe event; attr_handle=%d", event->subscribe.attr_handle);
+        ESP_LOGI(TAG, "Subscribe event; handle=%d attr_handle=%d notify=%d",
+                 event->subscribe.conn_handle, event->subscribe.attr_handle,
+                 event->subscribe.cur_notify);
+        if (xSemaphoreTake(ble_mutex, portMAX_DELAY) == pdTRUE) {
+            ble_conn_t* c = conn_find(event->subscribe.conn_handle);
+            if (c && event->subscribe.attr_handle == sensor_data_handle) {
+                c->data_subscribed = event->subscribe.cur_notify;
+            } else if (c && event->subscribe.attr_handle == status_handle) {
+                c->status_subscribed = event->subscribe.cur_notify;
+            }
+            xSemaphoreGive(ble_mutex);
+        }
+        break;
+
+    case BLE_GAP_EVENT_CONN_UPDATE:
+        ESP_LOGI(TAG, "Connection params updated; status=%d", event->conn_update.status);
+        update_conn_itvl(event->conn_update.conn_handle);
+        break;
+
+    case BLE_GAP_EVENT_PASSKEY_ACTION:
+        // No display: the central enters the passkey set for the deployment
+        if (event->passkey.params.action == BLE_SM_IOACT_DISP) {
+            struct ble_sm_io io = {0};
+            io.action = BLE_SM_IOACT_DISP;
+            io.passkey = BLE_OTA_PASSKEY;
+            ble_sm_inject_io(event->passkey.conn_handle, &io);
+        }
+        break;
+
+    case BLE_GAP_EVENT_ENC_CHANGE:
+        ESP_LOGI(TAG, "Encryption change; status=%d handle=%d",
+                 event->enc_change.status, event->enc_change.conn_handle);
         break;
 
     case BLE_GAP_EVENT_MTU:
@@ -220,6 +539,9 @@ void ble_manager_init(void)
         ESP_LOGE(TAG, "Failed to create BLE mutex");
         return;
     }
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        conns[i].handle = BLE_HS_CONN_HANDLE_NONE;
+    }
 
     // Initialize NVS (required for BLE)
     esp_err_t ret = nvs_flash_init();
@@ -236,10 +558,19 @@ void ble_manager_init(void)
         return;
     }
 
+    notify_pool_init();
+
     // Configure NimBLE host
     ble_hs_cfg.sync_cb = ble_on_sync;
     ble_hs_cfg.reset_cb = ble_on_reset;
 
+    // Passkey pairing (MITM-protected) for the OTA path; nothing is bonded,
+    // so each connection that updates firmware pairs again
+    ble_hs_cfg.sm_io_cap = BLE_HS_IO_DISPLAY_ONLY;
+    ble_hs_cfg.sm_mitm = 1;
+    ble_hs_cfg.sm_sc = 1;
+    ble_hs_cfg.sm_bonding = 0;
+
     // Initialize GAP and GATT services
     ble_svc_gap_init();
     ble_svc_gatt_init();
@@ -263,14 +594,21 @@ void ble_manager_init(void)
     // Start NimBLE host task
     nimble_port_freertos_init(ble_host_task);
 
-    ESP_LOGI(TAG, "BLE manager initialized, device name: %s", BLE_DEVICE_NAME);
+    ESP_LOGI(TAG, "BLE manager initialized, device name: %s, up to %d connections",
+             BLE_DEVICE_NAME, BLE_MAX_CONNECTIONS);
 }
 
 bool ble_is_connected(void)
 {
     bool connected;
+
+    // BLE is not started in every build (QEMU, low-rate wake path)
+    if (ble_mutex == NULL) {
+        return false;
+    }
+
     if (xSemaphoreTake(ble_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-        connected = device_connected;
+        connected = conn_count > 0;
         xSemaphoreGive(ble_mutex);
     } else {
         connected = false;
@@ -284,31 +622,30 @@ void ble_send_chip_data(uint8_t chip_num, pcap_data_t* data)
     if (xSemaphoreTake(ble_mutex, pdMS_TO_TICKS(10)) != pdTRUE) {
         return;
     }
+    latency_lap(LATENCY_STAGE_WAIT);
 
-    if (!device_connected || conn_handle == BLE_HS_CONN_HANDLE_NONE) {
-        xSemaphoreGive(ble_mutex);
-        return;
+    // Encode once per format some subscriber wants, then fan out
+    bool wanted[BLE_ENCODING_COUNT] = {false};
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (conns[i].handle != BLE_HS_CONN_HANDLE_NONE && conns[i].data_subscribed) {
+            wanted[conn_encoding(&conns[i])] = true;
+        }
     }
-
-    // Create data packet
-    // Format: [chip_num][sensor0_4B]...[sensor5_4B] = 25 bytes
-    sensor_data_val[0] = chip_num;
-    
-    int idx = 1;
-    for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
-        // Calculate calibrated value
-        float calibrated = (PCAP_SCALING_NUM * (float)(data->raw[i] - data->offset[i])/PCAP_CONVERSION_NUMBER);
-    
-        // Pack float as 4 bytes (IEEE 754, little-endian)
-        memcpy(&sensor_data_val[idx], &calibrated, sizeof(float));
-        idx += sizeof(float);
+    for (int e = 0; e < BLE_ENCODING_COUNT; e++) {
+        if (wanted[e]) {
+            sensor_data_len[e] = encode_chip((ble_encoding_t)e, chip_num, data, sensor_data_val[e]);
+        }
     }
-    
-    // Send notification
-    struct os_mbuf *om = ble_hs_mbuf_from_flat(sensor_data_val, sizeof(sensor_data_val));
-    if (om) {
-        ble_gatts_notify_custom(conn_handle, sensor_data_handle, om);
+    latency_lap(LATENCY_STAGE_ENCODE);
+
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        ble_conn_t* c = &conns[i];
+        if (c->handle != BLE_HS_CONN_HANDLE_NONE && c->data_subscribed) {
+            ble_encoding_t e = conn_encoding(c);
+            notify_conn(c, sensor_data_handle, sensor_data_val[e], sensor_data_len[e]);
+        }
     }
+    latency_lap(LATENCY_STAGE_HANDOFF);
 
     xSemaphoreGive(ble_mutex);
 }
@@ -319,18 +656,14 @@ void ble_send_status(const char* status)
         return;
     }
 
-    if (!device_connected || conn_handle == BLE_HS_CONN_HANDLE_NONE) {
-        xSemaphoreGive(ble_mutex);
-        return;
-    }
-
     strncpy(status_val, status, sizeof(status_val) - 1);
     status_val[sizeof(status_val) - 1] = '\0';
 
-    // Send notification
-    struct os_mbuf *om = ble_hs_mbuf_from_flat(status_val, strlen(status_val));
-    if (om) {
-        ble_gatts_notify_custom(conn_handle, status_handle, om);
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        ble_conn_t* c = &conns[i];
+        if (c->handle != BLE_HS_CONN_HANDLE_NONE && c->status_subscribed) {
+            notify_conn(c, status_handle, status_val, strlen(status_val));
+        }
     }
 
     xSemaphoreGive(ble_mutex);
@@ -342,11 +675,6 @@ void ble_send_battery(uint8_t battery_percentage)
         return;
     }
 
-    if (!device_connected || conn_handle == BLE_HS_CONN_HANDLE_NONE) {
-        xSemaphoreGive(ble_mutex);
-        return;
-    }
-
     // Create battery packet
     // Format: [0xFF][battery_percentage] = 2 bytes
     uint8_t battery_data[2];
@@ -354,10 +682,209 @@ void ble_send_battery(uint8_t battery_percentage)
     battery_data[1] = battery_percentage;
 
     // Send notification using sensor data characteristic
-    struct os_mbuf *om = ble_hs_mbuf_from_flat(battery_data, sizeof(battery_data));
-    if (om) {
-        ble_gatts_notify_custom(conn_handle, sensor_data_handle, om);
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        ble_conn_t* c = &conns[i];
+        if (c->handle != BLE_HS_CONN_HANDLE_NONE && c->data_subscribed) {
+            notify_conn(c, sensor_data_handle, battery_data, sizeof(battery_data));
+        }
     }
 
     xSemaphoreGive(ble_mutex);
-}
\ No newline at end of file
+}
+
+void ble_send_gesture(uint8_t type, uint8_t x, uint8_t y, uint16_t duration_ms)
+{
+    if (xSemaphoreTake(ble_mutex, pdMS_TO_TICKS(10)) != pdTRUE) {
+        return;
+    }
+
+    // Format: [0xFE][type][x][y][duration_lo][duration_hi] = 6 bytes
+    uint8_t gesture_data[6] = {
+        GESTURE_OP_CODE, type, x, y,
+        (uint8_t)duration_ms, (uint8_t)(duration_ms >> 8),
+    };
+
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        ble_conn_t* c = &conns[i];
+        if (c->handle != BLE_HS_CONN_HANDLE_NONE && c->data_subscribed) {
+            notify_conn(c, sensor_data_handle, gesture_data, sizeof(gesture_data));
+        }
+    }
+
+    xSemaphoreGive(ble_mutex);
+}
+
+void ble_send_latency(const latency_record_t* record)
+{
+    if (xSemaphoreTake(ble_mutex, pdMS_TO_TICKS(10)) != pdTRUE) {
+        return;
+    }
+
+    // Format: [0xFD][seq u16][t0_us u32][stage_us u16 x LATENCY_STAGE_COUNT], little-endian
+    uint8_t latency_data[7 + 2 * LATENCY_STAGE_COUNT];
+    latency_data[0] = LATENCY_OP_CODE;
+    memcpy(&latency_data[1], &record->seq, sizeof(uint16_t));
+    memcpy(&latency_data[3], &record->t0_us, sizeof(uint32_t));
+    memcpy(&latency_data[7], record->stage_us, sizeof(record->stage_us));
+
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        ble_conn_t* c = &conns[i];
+        if (c->handle != BLE_HS_CONN_HANDLE_NONE && c->data_subscribed) {
+            notify_conn(c, sensor_data_handle, latency_data, sizeof(latency_data));
+        }
+    }
+
+    xSemaphoreGive(ble_mutex);
+}
+
+void ble_send_frame_marker(uint16_t seq, uint32_t t0_us)
+{
+    if (xSemaphoreTake(ble_mutex, pdMS_TO_TICKS(10)) != pdTRUE) {
+        return;
+    }
+
+    // Format: [0xFC][seq u16][t0_us u32] = 7 bytes, little-endian
+    uint8_t frame_data[7];
+    frame_data[0] = FRAME_OP_CODE;
+    memcpy(&frame_data[1], &seq, sizeof(uint16_t));
+    memcpy(&frame_data[3], &t0_us, sizeof(uint32_t));
+
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        ble_conn_t* c = &conns[i];
+        if (c->handle != BLE_HS_CONN_HANDLE_NONE && c->data_subscribed) {
+            notify_conn(c, sensor_data_handle, frame_data, sizeof(frame_data));
+        }
+    }
+
+    xSemaphoreGive(ble_mutex);
+}
+
+void ble_send_compensated(uint16_t seq, uint8_t chip_num, const pcap_data_t* data)
+{
+    if (xSemaphoreTake(ble_mutex, pdMS_TO_TICKS(10)) != pdTRUE) {
+        return;
+    }
+
+    // Format: [0xFB][seq u16][chip][sensor0_4B]...[sensor5_4B] = 28 bytes
+    uint8_t comp_data[4 + NUM_SENSORS_PER_CHIP * sizeof(float)];
+    comp_data[0] = COMPENSATED_OP_CODE;
+    memcpy(&comp_data[1], &seq, sizeof(uint16_t));
+    comp_data[3] = chip_num;
+    memcpy(&comp_data[4], data->final_val, NUM_SENSORS_PER_CHIP * sizeof(float));
+
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        ble_conn_t* c = &conns[i];
+        if (c->handle != BLE_HS_CONN_HANDLE_NONE && c->data_subscribed) {
+            notify_conn(c, sensor_data_handle, comp_data, sizeof(comp_data));
+        }
+    }
+
+    xSemaphoreGive(ble_mutex);
+}
+
+uint32_t ble_get_notify_drops(void)
+{
+    return notify_drops;
+}
+
+void ble_set_encoding(ble_encoding_t encoding)
+{
+    if (xSemaphoreTake(ble_mutex, portMAX_DELAY) == pdTRUE) {
+        payload_encoding = encoding;
+        xSemaphoreGive(ble_mutex);
+    }
+}
+
+void ble_request_conn_interval(uint16_t itvl)
+{
+    uint16_t handles[BLE_MAX_CONNECTIONS];
+
+    if (xSemaphoreTake(ble_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+    preferred_conn_itvl = itvl;
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        handles[i] = conns[i].handle;
+    }
+    xSemaphoreGive(ble_mutex);
+
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        apply_conn_interval(handles[i]);
+    }
+}
+
+void ble_set_control_handler(ble_control_handler_t handler)
+{
+    control_handler = handler;
+}
+
+void ble_set_ota_handler(ble_ota_handler_t handler)
+{
+    ota_handler = handler;
+}
+
+void ble_get_notify_totals(uint32_t* sent, uint32_t* congested)
+{
+    *sent = notify_total;
+    *congested = congested_total;
+}
+
+uint8_t ble_get_link_info(uint16_t* conn_itvl)
+{
+    uint8_t subscribers = 0;
+
+    *conn_itvl = 0;
+    if (ble_mutex == NULL || xSemaphoreTake(ble_mutex, pdMS_TO_TICKS(10)) != pdTRUE) {
+        return 0;
+    }
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        if (conns[i].handle != BLE_HS_CONN_HANDLE_NONE && conns[i].data_subscribed) {
+            subscribers++;
+            if (conns[i].itvl > *conn_itvl) {
+                *conn_itvl = conns[i].itvl;
+            }
+        }
+    }
+    xSemaphoreGive(ble_mutex);
+    return subscribers;
+}
+
+bool ble_is_data_subscribed(void)
+{
+    uint16_t conn_itvl;
+    return ble_get_link_info(&conn_itvl) > 0;
+}
+
+void ble_report_connections(void)
+{
+    if (ble_mutex == NULL || xSemaphoreTake(ble_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    uint32_t elapsed_ms = pdTICKS_TO_MS(now - last_report_tick);
+    last_report_tick = now;
+    if (elapsed_ms == 0) {
+        elapsed_ms = 1;
+    }
+
+    for (int i = 0; i < BLE_MAX_CONNECTIONS; i++) {
+        ble_conn_t* c = &conns[i];
+        if (c->handle == BLE_HS_CONN_HANDLE_NONE) {
+            continue;
+        }
+        ESP_LOGI(TAG, "Conn %d: %lu notify/s, %lu B/s, congested %lu, data %s, status %s, %s",
+                 c->handle,
+                 (unsigned long)((uint64_t)c->notifications * 1000 / elapsed_ms),
+                 (unsigned long)((uint64_t)c->bytes * 1000 / elapsed_ms),
+                 c->congested,
+                 c->data_subscribed ? "on" : "off",
+                 c->status_subscribed ? "on" : "off",
+                 conn_encoding(c) == BLE_ENCODING_INT16 ? "int16" : "float32");
+        c->notifications = 0;
+        c->bytes = 0;
+        c->congested = 0;
+    }
+
+    xSemaphoreGive(ble_mutex);
+}
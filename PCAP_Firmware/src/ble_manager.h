@@ -12,6 +12,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "pcap04_defs.h"
+#include "latency_probe.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,8 +25,64 @@ extern "C" {
  */
 #define BLE_DEVICE_NAME         "PCAP-Sensor"
 #define BATTERY_OP_CODE         0xFF
+#define GESTURE_OP_CODE         0xFE    ///< [0xFE][type][x][y][duration u16 LE] on the sensor data characteristic
+#define LATENCY_OP_CODE         0xFD    ///< [0xFD][seq u16][t0_us u32][5 x stage_us u16] on the sensor data characteristic
+#define FRAME_OP_CODE           0xFC    ///< [0xFC][seq u16][t0_us u32], opens a frame of chip packets (dual stream)
+#define COMPENSATED_OP_CODE     0xFB    ///< [0xFB][seq u16][chip][6 x float32], compensated values (dual stream)
+#define BLE_INT16_CHIP_FLAG     0x40    ///< Set in byte 0 of int16-encoded chip packets
+#define BLE_INT16_SCALE         100.0f  ///< int16 packets carry value * 100, rounded (0.01 resolution)
+
+#define BLE_CONTROL_MAX_LEN         32   ///< Largest accepted control write
+#define BLE_CTRL_SET_SESSION_TARGET 0x01 ///< Control write: [op][minutes u16 LE]
+#define BLE_CTRL_SET_ENCODING       0x02 ///< Control write: [op][ble_encoding_t or BLE_ENCODING_AUTO], per connection
+#define BLE_ENCODING_AUTO           0xFF ///< Follow the device encoding (ble_set_encoding())
+#define BLE_CTRL_SET_CONFIG         0x03 ///< Control write: [op][period ms u16 LE][NN divider][encoding][flags]
+#define BLE_CTRL_CONFIG_DOWNGRADE   0x01 ///< BLE_CTRL_SET_CONFIG flag: accept a downgraded configuration
+#define BLE_CTRL_SET_COMPENSATION   0x04 ///< Control write: [op][BLE_COMPENSATION_DEVICE or _HOST]
+#define BLE_COMPENSATION_DEVICE     0x00 ///< NN compensation runs on the device
+#define BLE_COMPENSATION_HOST       0x01 ///< Raw readings go to serial, the host compensates
+#define BLE_CTRL_TIME_PING          0x05 ///< Control write: [op][token], answered "T,<token>,<device_us>"
+#define BLE_CTRL_DUMP_HISTORY       0x06 ///< Control write: [op], flight recorder dump ("H,"/"h," lines) on serial
+#define BLE_CTRL_SUBSCRIBE          0x07 ///< Control write: [op][demand_consumer_t][demand_repr_t][channel mask, 6 bytes LE]
+#define BLE_CTRL_TIME_SYNC          0x08 ///< Control write: [op][token], answered "U,<token>,<rx_us>,<tx_us>" (tools/timesync)
+#define BLE_CTRL_OTA_BEGIN          0x09 ///< Control write: [op][patch size u32 LE], then the patch on the OTA characteristic (tools/ota)
+#define BLE_CTRL_OTA_ABORT          0x0A ///< Control write: [op], drop the update in progress
+#define BLE_CTRL_PROFILE            0x0B ///< Control write: [op][rate Hz u16 LE][samples u16 LE], sampling profile on serial (tools/profiler)
+#define BLE_OTA_MAX_WRITE           512  ///< Largest accepted OTA characteristic write (ATT maximum)
+#define BLE_OTA_PASSKEY             246810 ///< Passkey the central enters to pair for OTA; set per deployment
+
+#define BLE_NOTIFY_PAYLOAD_MAX      64   ///< Largest notification payload (status string)
+#define BLE_NOTIFY_LEADING_SPACE    16   ///< HCI ACL (4) + L2CAP (4) + ATT notify (3) headers, rounded up
+#define BLE_NOTIFY_MBUF_COUNT       24   ///< Notification mbufs in flight per connection (3 frames of 8 chips)
 /** @} */
 
+/**
+ * @brief Payload encoding for chip data notifications
+ */
+typedef enum {
+    BLE_ENCODING_FLOAT32 = 0,   ///< [chip][6 x float32] = 25 bytes
+    BLE_ENCODING_INT16   = 1,   ///< [chip | 0x40][6 x int16, 0.01 units] = 13 bytes
+    BLE_ENCODING_COUNT
+} ble_encoding_t;
+
+/**
+ * @brief Handler for writes to the control characteristic
+ * @param data Written bytes (first byte is the opcode)
+ * @param len  Number of bytes written
+ *
+ * Runs in the NimBLE host task; must not block.
+ */
+typedef void (*ble_control_handler_t)(const uint8_t* data, uint16_t len);
+
+/**
+ * @brief Handler for writes to the OTA characteristic
+ * @param data Next piece of the firmware patch
+ * @param len  Number of bytes written
+ *
+ * Runs in the NimBLE host task; must not block.
+ */
+typedef void (*ble_ota_handler_t)(const uint8_t* data, uint16_t len);
+
 /**
  * @brief Initialize BLE server and characteristics
  *
@@ -35,18 +92,25 @@ extern "C" {
 void ble_manager_init(void);
 
 /**
- * @brief Check if a BLE client is connected
- * @return true if client connected, false otherwise
+ * @brief Check if any BLE client is connected
+ * @return true if at least one client is connected, false otherwise
  */
 bool ble_is_connected(void);
 
+/**
+ * @brief Check if any client has enabled sensor data notifications
+ * @return true if at least one connection is subscribed to sensor data
+ */
+bool ble_is_data_subscribed(void);
+
 /**
  * @brief Send sensor data for a single chip over BLE
  * @param chip_num The chip number (0-7)
  * @param data Pointer to the sensor data structure
  *
- * Transmits the calibrated sensor readings from one chip
- * to the connected BLE client.
+ * Encodes the calibrated readings once per encoding in use and notifies
+ * every client subscribed to the sensor data characteristic. Nothing is
+ * encoded when no client is subscribed.
  */
 void ble_send_chip_data(uint8_t chip_num, pcap_data_t* data);
 
@@ -54,7 +118,8 @@ void ble_send_chip_data(uint8_t chip_num, pcap_data_t* data);
  * @brief Send status message over BLE
  * @param status Status string to transmit
  *
- * Sends a status or diagnostic message to the connected client.
+ * Sends a status or diagnostic message to the clients subscribed to the
+ * status characteristic.
  */
 void ble_send_status(const char* status);
 
@@ -66,6 +131,96 @@ void ble_send_status(const char* status);
  */
 void ble_send_battery(uint8_t battery_percentage);
 
+/**
+ * @brief Send a gesture event
+ * @param type        Gesture type (gesture_type_t)
+ * @param x           Touch-down position, 0-255 across the chips
+ * @param y           Touch-down position, 0-255 across the sensor inputs
+ * @param duration_ms Touch duration
+ *
+ * Goes to the clients subscribed to the sensor data characteristic.
+ */
+void ble_send_gesture(uint8_t type, uint8_t x, uint8_t y, uint16_t duration_ms);
+
+/**
+ * @brief Send a frame's latency record (LATENCY_OP_CODE packet)
+ *
+ * Goes to the clients subscribed to the sensor data characteristic.
+ */
+void ble_send_latency(const latency_record_t* record);
+
+/**
+ * @brief Open a frame of chip packets (FRAME_OP_CODE packet)
+ * @param seq   Frame sequence number
+ * @param t0_us Acquisition time, low 32 bits of esp_timer
+ *
+ * The chip packets that follow carry that frame's offset-corrected values.
+ */
+void ble_send_frame_marker(uint16_t seq, uint32_t t0_us);
+
+/**
+ * @brief Send a chip's compensated values (COMPENSATED_OP_CODE packet)
+ * @param seq      Sequence number of the frame the values were acquired in
+ * @param chip_num Chip number
+ * @param data     Chip data, final_val holds the compensated values
+ */
+void ble_send_compensated(uint16_t seq, uint8_t chip_num, const pcap_data_t* data);
+
+/**
+ * @brief Select the default payload encoding used by ble_send_chip_data()
+ * @param encoding Encoding for connections that have not chosen their own
+ *                 with BLE_CTRL_SET_ENCODING
+ */
+void ble_set_encoding(ble_encoding_t encoding);
+
+/**
+ * @brief Request a connection interval from the connected centrals
+ * @param itvl Interval in 1.25 ms units
+ *
+ * Applied immediately to every connection and remembered for later ones.
+ */
+void ble_request_conn_interval(uint16_t itvl);
+
+/**
+ * @brief Register the handler for control characteristic writes
+ * @param handler Callback, or NULL to ignore writes
+ */
+void ble_set_control_handler(ble_control_handler_t handler);
+
+/**
+ * @brief Register the handler for OTA characteristic writes
+ * @param handler Callback, or NULL to ignore writes
+ */
+void ble_set_ota_handler(ble_ota_handler_t handler);
+
+/**
+ * @brief Get the number of notifications dropped because the pool was empty
+ * @return Dropped notification count since boot
+ */
+uint32_t ble_get_notify_drops(void);
+
+/**
+ * @brief Get notification totals over all connections since boot
+ * @param sent      Receives the notifications queued
+ * @param congested Receives the notifications refused (pool empty or host queue full)
+ */
+void ble_get_notify_totals(uint32_t* sent, uint32_t* congested);
+
+/**
+ * @brief Describe the data link
+ * @param conn_itvl Receives the longest negotiated connection interval
+ *                  (1.25 ms units, 0 if none)
+ * @return Number of centrals subscribed to sensor data
+ */
+uint8_t ble_get_link_info(uint16_t* conn_itvl);
+
+/**
+ * @brief Log throughput, congestion and subscriptions of each connection
+ *
+ * Rates cover the time since the previous call; counters are reset.
+ */
+void ble_report_connections(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,218 @@
+/**
+ * @file bus_scheduler.c
+ * @brief Priority-aware transaction scheduler for the shared PCAP SPI bus
+ */
+
+#include <string.h>
+#include "bus_scheduler.h"
+
+typedef struct {
+    bus_batch_t* head;
+    bus_batch_t* tail;
+    uint64_t     latency_total_us;
+    bus_class_stats_t stats;
+} bus_queue_t;
+
+static const bus_ops_t* bus;
+static uint32_t byte_time_ns;
+static bus_queue_t queues[BUS_PRIO_COUNT];
+
+// Frame budget: realtime batches arrive every frame_period_us
+static uint32_t frame_period_us = 0;
+static int64_t last_frame_us = 0;
+static bool gap_started = false;    // A realtime batch ran since the last non-realtime op
+static uint64_t busy_us = 0;
+
+void bus_sched_init(const bus_ops_t* ops, uint32_t byte_ns)
+{
+    bus = ops;
+    byte_time_ns = byte_ns;
+    memset(queues, 0, sizeof(queues));
+    frame_period_us = 0;
+    last_frame_us = 0;
+    gap_started = false;
+    busy_us = 0;
+}
+
+void bus_sched_set_frame_period(uint32_t period_us)
+{
+    bus->lock();
+    frame_period_us = period_us;
+    bus->unlock();
+}
+
+bool bus_sched_submit(bus_batch_t* batch)
+{
+    if (batch == NULL || batch->count == 0 || batch->prio >= BUS_PRIO_COUNT) {
+        return false;
+    }
+
+    batch->done = false;
+    batch->next = 0;
+    batch->link = NULL;
+    batch->submit_us = bus->now_us();
+
+    bus->lock();
+    bus_queue_t* q = &queues[batch->prio];
+    if (q->tail) {
+        q->tail->link = batch;
+    } else {
+        q->head = batch;
+    }
+    q->tail = batch;
+    if (++q->stats.depth > q->stats.depth_max) {
+        q->stats.depth_max = q->stats.depth;
+    }
+    // A frame may be several realtime batches (one per chip); its first
+    // batch anchors the budget for the next frame
+    if (batch->prio == BUS_PRIO_REALTIME && batch->submit_us - last_frame_us >= frame_period_us / 2) {
+        last_frame_us = batch->submit_us;
+    }
+    bus->unlock();
+
+    bus->kick();
+    return true;
+}
+
+// chain: the next op is a quick select too, which moves CS straight over
+static void run_op(const bus_op_t* op, bool chain)
+{
+    int64_t start = bus->now_us();
+    if ((op->flags & BUS_OP_QUICK_SELECT) && bus->select_quick) {
+        bus->select_quick(op->chip);
+    } else {
+        bus->select(op->chip);
+    }
+    if (op->cmd_len > 0 && op->cmd_len < op->len) {
+        bus->transfer(op->tx, op->rx, op->cmd_len);
+        bus->delay_us(BUS_SCHED_CMD_GAP_US);
+        bus->transfer(op->tx ? op->tx + op->cmd_len : NULL,
+                      op->rx ? op->rx + op->cmd_len : NULL,
+                      op->len - op->cmd_len);
+    } else {
+        bus->transfer(op->tx, op->rx, op->len);
+    }
+    if (!chain) {
+        bus->deselect();
+    }
+
+    uint32_t elapsed = (uint32_t)(bus->now_us() - start);
+    bus->lock();
+    busy_us += elapsed;
+    bus->unlock();
+}
+
+static uint32_t op_estimate_us(const bus_op_t* op)
+{
+    return BUS_SCHED_OP_OVERHEAD_US + (uint32_t)(((uint64_t)op->len * byte_time_ns) / 1000);
+}
+
+// Pop a finished batch, account for it and notify the client
+static void complete(bus_queue_t* q, bus_batch_t* batch)
+{
+    batch->end_us = bus->now_us();
+    uint32_t latency = (uint32_t)(batch->end_us - batch->submit_us);
+
+    bus->lock();
+    q->head = batch->link;
+    if (q->head == NULL) {
+        q->tail = NULL;
+    }
+    q->stats.depth--;
+    q->stats.batches++;
+    q->latency_total_us += latency;
+    if (latency > q->stats.latency_max_us) {
+        q->stats.latency_max_us = latency;
+    }
+    bus->unlock();
+
+    batch->done = true;
+    if (batch->on_done) {
+        batch->on_done(batch);
+    }
+}
+
+uint32_t bus_sched_run(void)
+{
+    while (1) {
+        // Realtime work first, each batch whole
+        bus->lock();
+        bus_batch_t* batch = queues[BUS_PRIO_REALTIME].head;
+        bus->unlock();
+        if (batch) {
+            batch->run_us = bus->now_us();
+            for (uint16_t i = 0; i < batch->count; i++) {
+                bool chain = i + 1 < batch->count &&
+                             (batch->ops[i].flags & batch->ops[i + 1].flags & BUS_OP_QUICK_SELECT);
+                run_op(&batch->ops[i], chain);
+            }
+            complete(&queues[BUS_PRIO_REALTIME], batch);
+            gap_started = true;
+            continue;
+        }
+
+        // Then the highest non-empty class, one op at a time
+        bus_queue_t* q = NULL;
+        bus->lock();
+        for (int p = BUS_PRIO_CONTROL; p < BUS_PRIO_COUNT && q == NULL; p++) {
+            if (queues[p].head) {
+                q = &queues[p];
+            }
+        }
+        batch = q ? q->head : NULL;
+        uint32_t period = frame_period_us;
+        int64_t due = last_frame_us + period;
+        bus->unlock();
+
+        if (batch == NULL) {
+            return BUS_SCHED_IDLE_WAIT_US;
+        }
+
+        // While frames are arriving, only start an op that ends before the
+        // next one is due. An op too long for a typical gap may start right
+        // after a frame so it cannot starve.
+        const bus_op_t* op = &batch->ops[batch->next];
+        uint32_t estimate = op_estimate_us(op);
+        int64_t now = bus->now_us();
+        bool acquiring = period > 0 && now < due + period;
+        bool oversized = estimate + BUS_SCHED_GUARD_US > period / 2;
+        if (acquiring && now + estimate + BUS_SCHED_GUARD_US > due && !(oversized && gap_started)) {
+            bus->lock();
+            q->stats.deferrals++;
+            bus->unlock();
+            return (uint32_t)(due + period - now);
+        }
+
+        if (batch->next == 0) {
+            batch->run_us = now;
+        }
+        run_op(op, false);
+        gap_started = false;
+        if (++batch->next >= batch->count) {
+            complete(q, batch);
+        }
+    }
+}
+
+uint64_t bus_sched_busy_us(void)
+{
+    bus->lock();
+    uint64_t total = busy_us;
+    bus->unlock();
+    return total;
+}
+
+void bus_sched_get_stats(bus_prio_t prio, bus_class_stats_t* stats)
+{
+    bus_queue_t* q = &queues[prio];
+
+    bus->lock();
+    *stats = q->stats;
+    stats->latency_avg_us = q->stats.batches ? (uint32_t)(q->latency_total_us / q->stats.batches) : 0;
+    q->stats.batches = 0;
+    q->stats.latency_max_us = 0;
+    q->stats.depth_max = q->stats.depth;
+    q->stats.deferrals = 0;
+    q->latency_total_us = 0;
+    bus->unlock();
+}
@@ -0,0 +1,175 @@
+/**
+ * @file bus_scheduler.h
+ * @brief Priority-aware transaction scheduler for the shared PCAP SPI bus
+ *
+ * The scheduler owns the SPI device and the mux. Clients describe their
+ * traffic as batches of chip-select frames (ops) and submit them with a
+ * priority class:
+ *  - REALTIME batches (sensor acquisition) run whole, ahead of anything else.
+ *  - CONTROL and BACKGROUND batches run one op at a time, re-checking for
+ *    realtime work after each op, and an op only starts if it can finish
+ *    before the next acquisition frame is due. Background work therefore
+ *    never delays a frame by more than the guard time.
+ *
+ * The core has no ESP-IDF or FreeRTOS dependency: the bus, clock and lock
+ * come in through bus_ops_t, so it runs on the host against a mock bus (for
+ * example pcap_emulator.c) with a simulated clock;
+ * tools/bus/check_bus_scheduler.py checks its ordering, preemption and frame
+ * budget that way. pcap_driver.c binds it to the SPI master, the mux and a
+ * bus task.
+ */
+
+#ifndef BUS_SCHEDULER_H
+#define BUS_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup BusSchedConfig Bus Scheduler Configuration
+ * @{
+ */
+#define BUS_SCHED_GUARD_US          300     ///< Margin kept free before a frame is due
+#define BUS_SCHED_OP_OVERHEAD_US    30      ///< Mux settling and transaction setup per op
+#define BUS_SCHED_CMD_GAP_US        1       ///< Pause between command and data bytes
+#define BUS_SCHED_IDLE_WAIT_US      UINT32_MAX  ///< bus_sched_run(): nothing queued
+/** @} */
+
+/**
+ * @defgroup BusOpFlags Bus Op Flags
+ * @{
+ */
+#define BUS_OP_QUICK_SELECT 0x01    ///< Select with ops->select_quick; chained to the next quick op of a realtime batch without deselecting
+/** @} */
+
+/**
+ * @brief Priority classes, highest first
+ */
+typedef enum {
+    BUS_PRIO_REALTIME = 0,  ///< Acquisition reads, run whole and first
+    BUS_PRIO_CONTROL,       ///< Configuration changes, CDC/RDC start, tuning
+    BUS_PRIO_BACKGROUND,    ///< Health checks, NVRAM store/recall
+    BUS_PRIO_COUNT
+} bus_prio_t;
+
+/**
+ * @brief One chip-select frame
+ */
+typedef struct {
+    uint8_t        chip;        ///< Mux channel (pcap_chip_select_t)
+    uint8_t        cmd_len;     ///< Bytes sent before the command gap (0 = no gap)
+    uint16_t       len;         ///< Total bytes clocked
+    const uint8_t* tx;          ///< Bytes to send (NULL sends zeros)
+    uint8_t*       rx;          ///< Received bytes (may be NULL)
+    uint8_t        flags;       ///< BUS_OP_* flags
+} bus_op_t;
+
+typedef struct bus_batch bus_batch_t;
+
+/**
+ * @brief Completion callback, called from the context running the scheduler
+ */
+typedef void (*bus_done_fn_t)(bus_batch_t* batch);
+
+/**
+ * @brief A batch of ops submitted as one unit
+ *
+ * Owned by the caller until on_done runs; the fields after ctx are managed
+ * by the scheduler.
+ */
+struct bus_batch {
+    bus_op_t*      ops;         ///< Ops, executed in order
+    uint16_t       count;       ///< Number of ops
+    bus_prio_t     prio;        ///< Priority class
+    bus_done_fn_t  on_done;     ///< Completion callback (may be NULL)
+    void*          ctx;         ///< Client data for on_done
+
+    volatile bool  done;        ///< Set once every op has run
+    uint16_t       next;        ///< Next op to run
+    int64_t        submit_us;   ///< Submission time
+    int64_t        run_us;      ///< When the first op started
+    int64_t        end_us;      ///< When the last op ended
+    bus_batch_t*   link;        ///< Queue link
+};
+
+/**
+ * @brief Platform hooks
+ */
+typedef struct {
+    void    (*select)(uint8_t chip);                                ///< Route CS to a chip
+    void    (*deselect)(void);                                      ///< Release CS
+    void    (*transfer)(const uint8_t* tx, uint8_t* rx, size_t len);///< Full-duplex transfer
+    void    (*delay_us)(uint32_t us);                               ///< Busy wait
+    int64_t (*now_us)(void);                                        ///< Monotonic clock
+    void    (*lock)(void);                                          ///< Enter queue critical section
+    void    (*unlock)(void);                                        ///< Leave queue critical section
+    void    (*kick)(void);                                          ///< Wake the runner after a submit
+    void    (*select_quick)(uint8_t chip);                          ///< Route CS with minimal settling (may be NULL)
+} bus_ops_t;
+
+/**
+ * @brief Per-class statistics
+ */
+typedef struct {
+    uint32_t batches;           ///< Completed batches
+    uint32_t latency_avg_us;    ///< Mean submit-to-completion latency
+    uint32_t latency_max_us;    ///< Worst submit-to-completion latency
+    uint16_t depth;             ///< Batches queued now
+    uint16_t depth_max;         ///< Most batches queued at once
+    uint32_t deferrals;         ///< Ops held back because a frame was due
+} bus_class_stats_t;
+
+/**
+ * @brief Initialize the scheduler
+ * @param ops     Platform hooks (must stay valid)
+ * @param byte_ns Time to clock one byte, used to estimate op duration
+ */
+void bus_sched_init(const bus_ops_t* ops, uint32_t byte_ns);
+
+/**
+ * @brief Tell the scheduler the acquisition frame period
+ * @param period_us Period between realtime batches (0 = no frame budget)
+ */
+void bus_sched_set_frame_period(uint32_t period_us);
+
+/**
+ * @brief Queue a batch
+ * @param batch Batch with ops, count, prio and on_done filled in
+ * @return false if the batch is empty or has an invalid class
+ */
+bool bus_sched_submit(bus_batch_t* batch);
+
+/**
+ * @brief Run queued work that is allowed to run now
+ *
+ * Called in a loop by the context that owns the bus.
+ *
+ * @return Microseconds until deferred work may become eligible, or
+ *         BUS_SCHED_IDLE_WAIT_US when the queues are empty. A submit
+ *         calls ops->kick, so the runner can sleep until either.
+ */
+uint32_t bus_sched_run(void);
+
+/**
+ * @brief Total time the bus has spent clocking ops since init
+ * @return Busy time in microseconds, monotonic
+ */
+uint64_t bus_sched_busy_us(void);
+
+/**
+ * @brief Get and reset the statistics of a class
+ * @param prio  Class
+ * @param stats Receives the statistics since the previous call
+ */
+void bus_sched_get_stats(bus_prio_t prio, bus_class_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUS_SCHEDULER_H
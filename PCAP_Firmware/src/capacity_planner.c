@@ -0,0 +1,238 @@
+/**
+ * @file capacity_planner.c
+ * @brief Capacity model and admission control implementation
+ */
+
+#include "capacity_planner.h"
+
+// Starting costs at 160 MHz, from stage profiles of the 8-chip board
+#define DEFAULT_ACQUIRE_CYCLES      45000.0f    // Six polled SPI frames plus unpacking
+#define DEFAULT_BUS_US              250.0f      // 36 bytes at 4 MHz plus per-frame setup
+#define DEFAULT_NN_CYCLES           15000.0f
+#define DEFAULT_ENCODE_F32_CYCLES   1500.0f
+#define DEFAULT_ENCODE_I16_CYCLES   1200.0f
+#define DEFAULT_NOTIFY_CYCLES       6000.0f
+#define DEFAULT_SERIAL_CYCLES       4000.0f
+
+// Measurements move a cost a quarter of the way to the measured value
+#define LEARN_DIV                   4.0f
+
+// Link load a run without congestion proves sustainable
+#define LINK_PROVEN_PCT             90.0f
+
+static capacity_costs_t costs;
+
+void capacity_init(void)
+{
+    costs.acquire_cycles_per_chip = DEFAULT_ACQUIRE_CYCLES;
+    costs.bus_us_per_chip = DEFAULT_BUS_US;
+    costs.nn_cycles_per_invoke = DEFAULT_NN_CYCLES;
+    costs.encode_cycles_per_chip[BLE_ENCODING_FLOAT32] = DEFAULT_ENCODE_F32_CYCLES;
+    costs.encode_cycles_per_chip[BLE_ENCODING_INT16] = DEFAULT_ENCODE_I16_CYCLES;
+    costs.notify_cycles = DEFAULT_NOTIFY_CYCLES;
+    costs.serial_cycles_per_chip = DEFAULT_SERIAL_CYCLES;
+    costs.link_scale = 1.0f;
+}
+
+const capacity_costs_t* capacity_get_costs(void)
+{
+    return &costs;
+}
+
+const char* capacity_verdict_name(capacity_verdict_t verdict)
+{
+    switch (verdict) {
+    case CAPACITY_ACCEPT:    return "accept";
+    case CAPACITY_DOWNGRADE: return "downgrade";
+    default:                 return "reject";
+    }
+}
+
+static uint16_t to_pct(float v)
+{
+    v *= 100.0f;
+    return v <= 0.0f ? 0 : v >= 65535.0f ? 65535 : (uint16_t)(v + 0.5f);
+}
+
+static float nn_invokes_per_frame(const capacity_config_t* cfg)
+{
+    if (cfg->nn_refresh_divider == 0) {
+        return 0.0f;
+    }
+    float period = (float)cfg->nn_refresh_divider * (cfg->nn_output_steps > 1 ? cfg->nn_output_steps : 1);
+    return (float)(cfg->chips * NUM_SENSORS_PER_CHIP) / period;
+}
+
+// Transmit cycles per chip: one encode, one notification per central
+static float transmit_cycles_per_chip(const capacity_config_t* cfg)
+{
+    if (cfg->connections == 0) {
+        return costs.serial_cycles_per_chip;
+    }
+    return costs.encode_cycles_per_chip[cfg->encoding] + cfg->connections * costs.notify_cycles;
+}
+
+// Link load before the measured correction, as a fraction. A notification
+// costs its airtime plus the ack exchange, and a connection event carries
+// a bounded number of them.
+static float link_load(const capacity_config_t* cfg, float notify_per_s_per_conn)
+{
+    if (cfg->connections == 0) {
+        return 0.0f;
+    }
+
+    float payload = (cfg->encoding == BLE_ENCODING_INT16) ? 13.0f : 25.0f;
+    float airtime_us = (payload + CAPACITY_LINK_PKT_OVERHEAD) * 8.0f + CAPACITY_LINK_EXCHANGE_US;
+    float load = cfg->connections * notify_per_s_per_conn * airtime_us / 1e6f;
+
+    if (cfg->conn_itvl > 0) {
+        float events_per_s = 1e6f / (cfg->conn_itvl * 1250.0f);
+        float event_load = notify_per_s_per_conn / (CAPACITY_LINK_MAX_PER_EVENT * events_per_s);
+        if (event_load > load) {
+            load = event_load;
+        }
+    }
+    return load;
+}
+
+void capacity_predict(const capacity_config_t* cfg, capacity_util_t* util)
+{
+    float fps = 1000.0f / (float)cfg->sample_period_ms;
+
+    float cycles = cfg->chips * (costs.acquire_cycles_per_chip + transmit_cycles_per_chip(cfg))
+                 + nn_invokes_per_frame(cfg) * costs.nn_cycles_per_invoke;
+
+    util->cpu_pct = to_pct(fps * cycles / (cfg->cpu_mhz * 1e6f));
+    util->bus_pct = to_pct(fps * cfg->chips * costs.bus_us_per_chip / 1e6f);
+    util->link_pct = to_pct(link_load(cfg, fps * cfg->chips) * costs.link_scale);
+    util->rate_pct = 100;
+}
+
+bool capacity_fits(const capacity_util_t* util)
+{
+    return util->cpu_pct <= CAPACITY_LIMIT_CPU_PCT &&
+           util->bus_pct <= CAPACITY_LIMIT_BUS_PCT &&
+           util->link_pct <= CAPACITY_LIMIT_LINK_PCT;
+}
+
+uint16_t capacity_min_period_ms(const capacity_config_t* cfg)
+{
+    capacity_config_t probe = *cfg;
+    capacity_util_t util;
+
+    // Utilization falls with the period, so the first fit is the fastest
+    for (probe.sample_period_ms = 1; probe.sample_period_ms <= CAPACITY_PERIOD_MAX_MS;
+         probe.sample_period_ms++) {
+        capacity_predict(&probe, &util);
+        if (capacity_fits(&util)) {
+            return probe.sample_period_ms;
+        }
+    }
+    return 0;
+}
+
+capacity_verdict_t capacity_admit(const capacity_config_t* request, bool downgrade,
+                                  capacity_config_t* granted, capacity_util_t* util)
+{
+    capacity_config_t cfg = *request;
+
+    capacity_predict(&cfg, util);
+    if (capacity_fits(util)) {
+        *granted = cfg;
+        return CAPACITY_ACCEPT;
+    }
+    if (!downgrade || cfg.sample_period_ms == 0) {
+        return CAPACITY_REJECT;
+    }
+
+    // Cheapest loss first: NN refresh, then payload precision, then rate
+    while (1) {
+        bool cpu_over = util->cpu_pct > CAPACITY_LIMIT_CPU_PCT;
+        bool link_over = util->link_pct > CAPACITY_LIMIT_LINK_PCT;
+
+        if (cpu_over && cfg.nn_refresh_divider != 0) {
+            cfg.nn_refresh_divider = cfg.nn_refresh_divider >= 8 ? 0 : cfg.nn_refresh_divider * 2;
+        } else if ((cpu_over || link_over) && cfg.connections > 0 &&
+                   cfg.encoding == BLE_ENCODING_FLOAT32) {
+            cfg.encoding = BLE_ENCODING_INT16;
+        } else if (cfg.sample_period_ms < CAPACITY_PERIOD_MAX_MS) {
+            uint16_t step = cfg.sample_period_ms / 4;
+            step = step < CAPACITY_PERIOD_STEP_MS ? CAPACITY_PERIOD_STEP_MS
+                                                  : step - step % CAPACITY_PERIOD_STEP_MS;
+            cfg.sample_period_ms += step;
+            if (cfg.sample_period_ms > CAPACITY_PERIOD_MAX_MS) {
+                cfg.sample_period_ms = CAPACITY_PERIOD_MAX_MS;
+            }
+        } else {
+            capacity_predict(request, util);
+            return CAPACITY_REJECT;
+        }
+
+        capacity_predict(&cfg, util);
+        if (capacity_fits(util)) {
+            *granted = cfg;
+            return CAPACITY_DOWNGRADE;
+        }
+    }
+}
+
+static void learn(float* cost, float measured)
+{
+    *cost += (measured - *cost) / LEARN_DIV;
+}
+
+void capacity_observe(const capacity_config_t* active, const capacity_sample_t* sample,
+                      capacity_util_t* measured)
+{
+    float seconds = sample->elapsed_ms / 1000.0f;
+    if (seconds <= 0.0f) {
+        *measured = (capacity_util_t){0};
+        return;
+    }
+
+    float fps = sample->frames / seconds;
+    uint64_t cycles = sample->acquire_cycles + sample->compensate_cycles +
+                      sample->transmit_cycles + sample->other_cycles;
+
+    measured->cpu_pct = to_pct((float)cycles / (seconds * active->cpu_mhz * 1e6f));
+    measured->bus_pct = to_pct((float)sample->bus_busy_us / (seconds * 1e6f));
+    measured->rate_pct = to_pct(fps * active->sample_period_ms / 1000.0f);
+
+    // Link: the model's load at the rate actually sent. Congestion means the
+    // link was full, a clean run that the model calls heavy proves otherwise.
+    float link = 0.0f;
+    if (active->connections > 0) {
+        float sent_per_conn = sample->notifications / seconds / active->connections;
+        link = link_load(active, sent_per_conn);
+        if (link > 0.0f && sample->congested > 0) {
+            costs.link_scale = 1.0f / link;
+        } else if (link * costs.link_scale * 100.0f > LINK_PROVEN_PCT) {
+            costs.link_scale = LINK_PROVEN_PCT / 100.0f / link;
+        }
+    }
+    measured->link_pct = sample->congested > 0 ? 100 : to_pct(link * costs.link_scale);
+
+    if (sample->frames < CAPACITY_MIN_FRAMES || active->chips == 0) {
+        return;
+    }
+
+    float per_chip = (float)sample->frames * active->chips;
+    learn(&costs.acquire_cycles_per_chip, sample->acquire_cycles / per_chip);
+    learn(&costs.bus_us_per_chip, sample->bus_busy_us / per_chip);
+
+    // Invokes that actually ran: with partial subscriptions far fewer than
+    // nn_invokes_per_frame() assumes, which would understate the cost
+    if (sample->nn_invokes > 0) {
+        learn(&costs.nn_cycles_per_invoke, (float)sample->compensate_cycles / sample->nn_invokes);
+    }
+
+    // One stage covers encode and notify; scale both by the same ratio
+    float ratio = (sample->transmit_cycles / per_chip) / transmit_cycles_per_chip(active);
+    if (active->connections == 0) {
+        learn(&costs.serial_cycles_per_chip, costs.serial_cycles_per_chip * ratio);
+    } else {
+        learn(&costs.encode_cycles_per_chip[active->encoding],
+              costs.encode_cycles_per_chip[active->encoding] * ratio);
+        learn(&costs.notify_cycles, costs.notify_cycles * ratio);
+    }
+}
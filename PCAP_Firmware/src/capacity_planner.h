@@ -0,0 +1,170 @@
+/**
+ * @file capacity_planner.h
+ * @brief Capacity model and admission control for pipeline configurations
+ *
+ * Predicts CPU, SPI bus and BLE link utilization of a configuration (sample
+ * rate, chips, NN refresh, payload encoding, centrals, connection interval,
+ * CPU clock) from per-unit costs: acquisition per chip, NN per invoke,
+ * encoding and notification per packet, and airtime per notification.
+ * The costs start from defaults and are refined from measurements of the
+ * running configuration, so the prediction tracks the board it runs on.
+ *
+ * Requested configurations go through capacity_admit() before they are
+ * applied: feasible ones pass, others are downgraded (NN refresh, payload
+ * encoding, then sample rate) or rejected.
+ *
+ * The model has no ESP-IDF dependency; tools/capacity/validate_capacity.py
+ * builds it on the host and checks its verdicts against simulated runs.
+ */
+
+#ifndef CAPACITY_PLANNER_H
+#define CAPACITY_PLANNER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble_manager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup CapacityConfig Capacity Planner Configuration
+ * @{
+ */
+#define CAPACITY_LIMIT_CPU_PCT      80      ///< Pipeline share of the CPU left for BLE host, logging
+#define CAPACITY_LIMIT_BUS_PCT      70      ///< Realtime share of the bus left for control traffic
+#define CAPACITY_LIMIT_LINK_PCT     80      ///< Link share that keeps notification queues short
+
+#define CAPACITY_PERIOD_STEP_MS     10      ///< Sample period step when downgrading
+#define CAPACITY_PERIOD_MAX_MS      1000    ///< Slowest period a downgrade may reach
+
+#define CAPACITY_LINK_PKT_OVERHEAD  17      ///< LL header, MIC, L2CAP and ATT bytes per notification
+#define CAPACITY_LINK_EXCHANGE_US   380     ///< Two IFS plus the empty ack per notification (1M PHY)
+#define CAPACITY_LINK_MAX_PER_EVENT 8       ///< Notifications a connection event carries at most
+
+#define CAPACITY_MIN_FRAMES         100     ///< Frames needed before a measurement refines costs
+/** @} */
+
+/**
+ * @brief A pipeline configuration
+ */
+typedef struct {
+    uint16_t sample_period_ms;      ///< Acquisition period
+    uint8_t  chips;                 ///< Chips read per frame
+    uint8_t  nn_refresh_divider;    ///< NN invoke every Nth sample per channel (0 = NN off)
+    ble_encoding_t encoding;        ///< Chip data payload encoding
+    uint8_t  connections;           ///< Subscribed centrals (0 = data goes to serial)
+    uint16_t conn_itvl;             ///< Connection interval (1.25 ms units)
+    uint16_t cpu_mhz;               ///< CPU clock
+    uint8_t  nn_output_steps;       ///< Samples each NN invoke covers (0 is taken as 1)
+} capacity_config_t;
+
+/**
+ * @brief Utilization of each resource, in percent (may exceed 100)
+ */
+typedef struct {
+    uint16_t cpu_pct;
+    uint16_t bus_pct;
+    uint16_t link_pct;
+    uint16_t rate_pct;              ///< Achieved share of the requested frame rate (measured only)
+} capacity_util_t;
+
+/**
+ * @brief Per-unit costs the model is built from
+ */
+typedef struct {
+    float acquire_cycles_per_chip;                      ///< CPU per chip read
+    float bus_us_per_chip;                              ///< Bus occupancy per chip read
+    float nn_cycles_per_invoke;                         ///< CPU per NN invoke
+    float encode_cycles_per_chip[BLE_ENCODING_COUNT];   ///< Encode one chip packet
+    float notify_cycles;                                ///< Queue one notification
+    float serial_cycles_per_chip;                       ///< Format and write one CSV line
+    float link_scale;                                   ///< Measured/modelled link load
+} capacity_costs_t;
+
+/**
+ * @brief Measurements of the running configuration over one interval
+ */
+typedef struct {
+    uint32_t elapsed_ms;            ///< Length of the interval
+    uint32_t frames;                ///< Frames completed
+    uint64_t acquire_cycles;        ///< Stage cycles over the interval (stage_profiler.h)
+    uint64_t compensate_cycles;
+    uint64_t transmit_cycles;
+    uint64_t other_cycles;          ///< Remaining pipeline stages
+    uint64_t bus_busy_us;           ///< Bus occupancy (bus_sched_busy_us())
+    uint32_t notifications;         ///< Notifications queued
+    uint32_t congested;             ///< Notifications refused
+    uint32_t nn_invokes;            ///< NN invokes run (nn_get_inference_count()); fewer than the
+                                    ///< configuration allows when demand narrows the compensated channels
+} capacity_sample_t;
+
+/**
+ * @brief Outcome of an admission check
+ */
+typedef enum {
+    CAPACITY_ACCEPT = 0,            ///< Feasible as requested
+    CAPACITY_DOWNGRADE,             ///< Feasible after downgrading
+    CAPACITY_REJECT,                ///< Infeasible
+} capacity_verdict_t;
+
+/**
+ * @brief Reset the costs to their defaults
+ */
+void capacity_init(void);
+
+/**
+ * @brief Predict the utilization of a configuration
+ */
+void capacity_predict(const capacity_config_t* cfg, capacity_util_t* util);
+
+/**
+ * @brief Check whether a configuration fits the limits
+ */
+bool capacity_fits(const capacity_util_t* util);
+
+/**
+ * @brief Shortest sample period at which a configuration fits
+ * @param cfg Configuration (its sample period is ignored)
+ * @return Period in ms, 0 if it does not fit even at CAPACITY_PERIOD_MAX_MS
+ */
+uint16_t capacity_min_period_ms(const capacity_config_t* cfg);
+
+/**
+ * @brief Admission check for a requested configuration
+ * @param request   Requested configuration
+ * @param downgrade Allow a downgraded configuration instead of rejecting
+ * @param granted   Receives the configuration to apply (the request when
+ *                  accepted, the downgrade, or unchanged on reject)
+ * @param util      Receives the predicted utilization of granted (or of the
+ *                  request when rejected)
+ * @return Verdict
+ */
+capacity_verdict_t capacity_admit(const capacity_config_t* request, bool downgrade,
+                                  capacity_config_t* granted, capacity_util_t* util);
+
+/**
+ * @brief Compute the measured utilization and refine the costs
+ * @param active   Configuration that ran during the interval
+ * @param sample   Measurements over the interval
+ * @param measured Receives the measured utilization
+ */
+void capacity_observe(const capacity_config_t* active, const capacity_sample_t* sample,
+                      capacity_util_t* measured);
+
+/**
+ * @brief Get the current cost estimates
+ */
+const capacity_costs_t* capacity_get_costs(void);
+
+/**
+ * @brief Name of a verdict
+ */
+const char* capacity_verdict_name(capacity_verdict_t verdict);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAPACITY_PLANNER_H
@@ -0,0 +1,300 @@
+/**
+ * @file delta_patch.c
+ * @brief Streaming delta patch decoder implementation
+ */
+
+#include <string.h>
+#include "delta_patch.h"
+
+typedef enum {
+    STATE_HEADER = 0,
+    STATE_CONTROL,          // Reading the three varints of a block
+    STATE_RUN,              // Reading a difference run's varint
+    STATE_DIFF_BYTES,       // Inside a run of difference bytes
+    STATE_EXTRA,            // Inside the literal bytes
+    STATE_END,
+} state_t;
+
+static delta_io_t io;
+static delta_status_t status;
+static state_t state;
+
+static uint8_t header_buf[DELTA_HEADER_LEN];
+static uint32_t header_len;
+static delta_header_t header;
+
+// Varint being read, and the block's control values
+static uint64_t varint;
+static uint8_t varint_shift;
+static uint8_t control_idx;
+static uint32_t control[3];
+
+static uint32_t diff_left;      // Target bytes left in the block's diff part
+static uint32_t run_left;       // Bytes left in the current difference run
+static uint32_t extra_left;
+static uint32_t source_pos;
+static uint32_t source_next;    // Source position after the block's diff part and seek
+
+static uint8_t source_buf[DELTA_SOURCE_CHUNK];
+static uint32_t source_buf_pos;
+static uint32_t source_buf_len;
+
+static uint8_t target_buf[DELTA_TARGET_CHUNK];
+static uint32_t target_buf_len;
+static uint32_t written;        // Target bytes produced (buffered or written)
+
+static uint32_t get_le32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void delta_patch_begin(const delta_io_t* patch_io)
+{
+    io = *patch_io;
+    status = DELTA_MORE;
+    state = STATE_HEADER;
+    header_len = 0;
+    varint = 0;
+    varint_shift = 0;
+    control_idx = 0;
+    source_pos = 0;
+    source_buf_len = 0;
+    target_buf_len = 0;
+    written = 0;
+}
+
+uint32_t delta_patch_written(void)
+{
+    return written;
+}
+
+static bool flush_target(void)
+{
+    if (target_buf_len > 0 && !io.write_target(io.ctx, target_buf, target_buf_len)) {
+        return false;
+    }
+    target_buf_len = 0;
+    return true;
+}
+
+static bool put_target(uint8_t byte)
+{
+    target_buf[target_buf_len++] = byte;
+    written++;
+    return target_buf_len < DELTA_TARGET_CHUNK || flush_target();
+}
+
+// Source byte at source_pos, through the chunk buffer
+static bool get_source(uint8_t* byte)
+{
+    if (source_pos < source_buf_pos || source_pos >= source_buf_pos + source_buf_len) {
+        uint32_t len = header.source_size - source_pos;
+        if (len > DELTA_SOURCE_CHUNK) {
+            len = DELTA_SOURCE_CHUNK;
+        }
+        if (!io.read_source(io.ctx, source_pos, source_buf, len)) {
+            return false;
+        }
+        source_buf_pos = source_pos;
+        source_buf_len = len;
+    }
+    *byte = source_buf[source_pos++ - source_buf_pos];
+    return true;
+}
+
+// One diff byte: source plus difference
+static bool put_diff(uint8_t difference)
+{
+    uint8_t byte;
+    if (!get_source(&byte)) {
+        return false;
+    }
+    diff_left--;
+    run_left--;
+    return put_target((uint8_t)(byte + difference));
+}
+
+// Read one varint byte; true once the varint is complete
+static bool take_varint(uint8_t byte)
+{
+    varint |= (uint64_t)(byte & 0x7F) << varint_shift;
+    varint_shift += 7;
+    return !(byte & 0x80);
+}
+
+static void start_block(void)
+{
+    uint32_t diff_len = control[0];
+    uint32_t extra_len = control[1];
+
+    // Zigzag-decoded seek
+    int32_t seek = (int32_t)(control[2] >> 1) ^ -(int32_t)(control[2] & 1);
+
+    if ((uint64_t)written + diff_len + extra_len > header.target_size ||
+        (uint64_t)source_pos + diff_len > header.source_size) {
+        status = DELTA_ERR_RANGE;
+        return;
+    }
+    diff_left = diff_len;
+    extra_left = extra_len;
+    run_left = 0;
+    state = diff_left ? STATE_RUN : (extra_left ? STATE_EXTRA : STATE_CONTROL);
+
+    int64_t next = (int64_t)source_pos + diff_len + seek;
+    if (next < 0 || next > header.source_size) {
+        status = DELTA_ERR_RANGE;
+        return;
+    }
+    source_next = (uint32_t)next;
+}
+
+// The block's diff part and extra part are both done
+static void end_block(void)
+{
+    source_pos = source_next;
+    state = STATE_CONTROL;
+    if (written == header.target_size) {
+        state = STATE_END;
+        status = flush_target() ? DELTA_DONE : DELTA_ERR_IO;
+    }
+}
+
+static void after_diff(void)
+{
+    if (diff_left == 0) {
+        if (extra_left) {
+            state = STATE_EXTRA;
+        } else {
+            end_block();
+        }
+    } else {
+        state = STATE_RUN;
+    }
+}
+
+delta_status_t delta_patch_feed(const uint8_t* data, uint32_t len)
+{
+    uint32_t i = 0;
+
+    while (status == DELTA_MORE && i < len) {
+        switch (state) {
+        case STATE_HEADER: {
+            uint32_t n = DELTA_HEADER_LEN - header_len;
+            if (n > len - i) {
+                n = len - i;
+            }
+            memcpy(header_buf + header_len, data + i, n);
+            header_len += n;
+            i += n;
+            if (header_len < DELTA_HEADER_LEN) {
+                break;
+            }
+            if (get_le32(header_buf) != DELTA_MAGIC) {
+                status = DELTA_ERR_FORMAT;
+                break;
+            }
+            header.source_size = get_le32(header_buf + 4);
+            memcpy(header.source_sha256, header_buf + 8, 32);
+            header.target_size = get_le32(header_buf + 40);
+            memcpy(header.target_sha256, header_buf + 44, 32);
+            if (io.begin && !io.begin(io.ctx, &header)) {
+                status = DELTA_ERR_IO;
+                break;
+            }
+            state = STATE_CONTROL;
+            if (header.target_size == 0) {
+                end_block();
+            }
+            break;
+        }
+
+        case STATE_CONTROL:
+            if (varint_shift > 28) {
+                status = DELTA_ERR_FORMAT;
+                break;
+            }
+            if (take_varint(data[i++])) {
+                if (varint > UINT32_MAX) {
+                    status = DELTA_ERR_FORMAT;
+                    break;
+                }
+                control[control_idx++] = (uint32_t)varint;
+                varint = 0;
+                varint_shift = 0;
+                if (control_idx == 3) {
+                    control_idx = 0;
+                    start_block();
+                    if (status == DELTA_MORE && state == STATE_CONTROL) {
+                        end_block();    // Empty block: only a seek
+                    }
+                }
+            }
+            break;
+
+        case STATE_RUN:
+            if (varint_shift > 28) {
+                status = DELTA_ERR_FORMAT;
+                break;
+            }
+            if (take_varint(data[i++])) {
+                uint64_t run = (varint >> 1) + 1;
+                bool literal = varint & 1;
+                varint = 0;
+                varint_shift = 0;
+                if (run > diff_left) {
+                    status = DELTA_ERR_FORMAT;
+                    break;
+                }
+                run_left = (uint32_t)run;
+                if (literal) {
+                    state = STATE_DIFF_BYTES;
+                    break;
+                }
+                // Zero differences need no patch bytes
+                while (run_left) {
+                    if (!put_diff(0)) {
+                        status = DELTA_ERR_IO;
+                        break;
+                    }
+                }
+                if (status == DELTA_MORE) {
+                    after_diff();
+                }
+            }
+            break;
+
+        case STATE_DIFF_BYTES:
+            while (run_left && i < len) {
+                if (!put_diff(data[i++])) {
+                    status = DELTA_ERR_IO;
+                    break;
+                }
+            }
+            if (status == DELTA_MORE && run_left == 0) {
+                after_diff();
+            }
+            break;
+
+        case STATE_EXTRA:
+            while (extra_left && i < len) {
+                extra_left--;
+                if (!put_target(data[i++])) {
+                    status = DELTA_ERR_IO;
+                    break;
+                }
+            }
+            if (status == DELTA_MORE && extra_left == 0) {
+                end_block();
+            }
+            break;
+
+        case STATE_END:
+            status = DELTA_ERR_FORMAT;
+            break;
+        }
+    }
+    if (status == DELTA_DONE && i < len) {
+        status = DELTA_ERR_FORMAT;     // Bytes after the target is complete
+    }
+    return status;
+}
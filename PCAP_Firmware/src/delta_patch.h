@@ -0,0 +1,102 @@
+/**
+ * @file delta_patch.h
+ * @brief Streaming decoder for binary delta firmware patches
+ *
+ * A patch rebuilds the new firmware image from the installed one
+ * (tools/ota/delta_ota.py writes them). After a fixed header it is a
+ * series of blocks, each
+ *
+ *   varint diff_len, varint extra_len, zigzag varint seek
+ *   diff_len target bytes: source bytes plus a difference, the
+ *            differences as runs (varint n: n odd -> (n >> 1) + 1 bytes
+ *            follow, n even -> (n >> 1) + 1 zero differences)
+ *   extra_len target bytes, literal
+ *
+ * after which the source position moves on by diff_len + seek. Moved code
+ * differs from the installed image mostly in relocated addresses, so its
+ * differences are long zero runs; new code and data are literal.
+ *
+ * The decoder takes the patch in pieces of any size, reads the source
+ * through a callback in DELTA_SOURCE_CHUNK pieces and writes the target in
+ * DELTA_TARGET_CHUNK pieces, so its RAM is fixed whatever the image size.
+ * It checks sizes and ranges only; the caller compares the hashes of the
+ * header against the installed and the written image.
+ *
+ * No ESP-IDF dependency: tools/ota/delta_ota.py check runs it on the host.
+ */
+
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup DeltaConfig Delta Patch Configuration
+ * @{
+ */
+#define DELTA_MAGIC             0x31504450  ///< "PDP1"
+#define DELTA_HEADER_LEN        76          ///< magic, source size and SHA-256, target size and SHA-256
+#define DELTA_SOURCE_CHUNK      256         ///< Source bytes read per callback
+#define DELTA_TARGET_CHUNK      1024        ///< Target bytes written per callback
+/** @} */
+
+/**
+ * @brief Patch header
+ */
+typedef struct {
+    uint32_t source_size;
+    uint8_t  source_sha256[32];     ///< Of the image the patch applies to
+    uint32_t target_size;
+    uint8_t  target_sha256[32];     ///< Of the image it produces
+} delta_header_t;
+
+/**
+ * @brief Where the decoder gets the source and puts the target
+ *
+ * Each callback returns false to abort the patch.
+ */
+typedef struct {
+    bool (*begin)(void* ctx, const delta_header_t* header);     ///< Header parsed, before any output
+    bool (*read_source)(void* ctx, uint32_t offset, uint8_t* dst, uint32_t len);
+    bool (*write_target)(void* ctx, const uint8_t* data, uint32_t len);
+    void* ctx;
+} delta_io_t;
+
+/**
+ * @brief Decoder state after a piece of patch
+ */
+typedef enum {
+    DELTA_MORE = 0,         ///< Waiting for more patch
+    DELTA_DONE,             ///< Target complete and written
+    DELTA_ERR_FORMAT,       ///< Bad magic, varint or trailing bytes
+    DELTA_ERR_RANGE,        ///< A block reads past the source or writes past the target
+    DELTA_ERR_IO,           ///< A callback failed
+} delta_status_t;
+
+/**
+ * @brief Start decoding a patch
+ */
+void delta_patch_begin(const delta_io_t* io);
+
+/**
+ * @brief Decode the next piece of the patch
+ * @return DELTA_MORE until the target is complete, then DELTA_DONE. Errors
+ *         stick until delta_patch_begin().
+ */
+delta_status_t delta_patch_feed(const uint8_t* data, uint32_t len);
+
+/**
+ * @brief Target bytes written so far
+ */
+uint32_t delta_patch_written(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DELTA_PATCH_H
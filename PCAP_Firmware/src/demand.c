@@ -0,0 +1,178 @@
+/**
+ * @file demand.c
+ * @brief Demand-driven pipeline evaluation implementation
+ */
+
+#include <string.h>
+#include "demand.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+static const char* TAG = "DEMAND";
+
+typedef struct {
+    demand_repr_t repr;
+    uint64_t channels;
+    bool enabled;
+} subscription_t;
+
+static subscription_t subs[DEMAND_CONSUMER_COUNT];
+static demand_plan_t plan;
+static bool plan_changed = true;
+static portMUX_TYPE demand_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Work done and the full-evaluation equivalent since the last report
+static struct {
+    uint32_t frames;
+    uint32_t chips_read, chips_usable;
+    uint32_t channels_compensated, channels_usable;
+    uint32_t chips_sent, chips_sendable;
+} work;
+
+static bool is_passive(demand_consumer_t consumer)
+{
+    return consumer == DEMAND_CONSUMER_RECORDER;
+}
+
+static void add_demand(demand_plan_t* p, demand_repr_t repr, uint64_t channels)
+{
+    for (int r = 0; r <= (int)repr; r++) {
+        p->channels[r] |= channels;
+    }
+}
+
+// Resolve the subscriptions into the plan; called with the lock held
+static void resolve(void)
+{
+    demand_plan_t p;
+    memset(&p, 0, sizeof(p));
+
+    for (int c = 0; c < DEMAND_CONSUMER_COUNT; c++) {
+        if (subs[c].enabled && !is_passive((demand_consumer_t)c)) {
+            add_demand(&p, subs[c].repr, subs[c].channels);
+            p.sent[c] = subs[c].channels;
+        }
+    }
+
+    // Passive consumers get the channels of chips read anyway
+    uint64_t acquired = 0;
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        if (p.channels[DEMAND_RAW] & DEMAND_CHIP_CHANNELS(chip)) {
+            acquired |= DEMAND_CHIP_CHANNELS(chip);
+        }
+    }
+    for (int c = 0; c < DEMAND_CONSUMER_COUNT; c++) {
+        if (subs[c].enabled && is_passive((demand_consumer_t)c)) {
+            add_demand(&p, subs[c].repr, subs[c].channels & acquired);
+            p.sent[c] = subs[c].channels & acquired;
+        }
+    }
+
+    if (memcmp(&p, &plan, sizeof(p)) != 0) {
+        plan = p;
+        plan_changed = true;
+    }
+}
+
+void demand_init(void)
+{
+    portENTER_CRITICAL(&demand_lock);
+    for (int c = 0; c < DEMAND_CONSUMER_COUNT; c++) {
+        subs[c] = (subscription_t){ .repr = DEMAND_RAW, .channels = 0, .enabled = true };
+    }
+    resolve();
+    portEXIT_CRITICAL(&demand_lock);
+    memset(&work, 0, sizeof(work));
+}
+
+void demand_subscribe(demand_consumer_t consumer, demand_repr_t repr, uint64_t channels)
+{
+    // BLE packets always carry the calibrated value (encode_chip)
+    if (consumer == DEMAND_CONSUMER_BLE && repr > DEMAND_CALIBRATED) {
+        repr = DEMAND_CALIBRATED;
+    }
+    portENTER_CRITICAL(&demand_lock);
+    subs[consumer].repr = repr;
+    subs[consumer].channels = channels & DEMAND_ALL_CHANNELS;
+    resolve();
+    portEXIT_CRITICAL(&demand_lock);
+}
+
+void demand_enable(demand_consumer_t consumer, bool enabled)
+{
+    portENTER_CRITICAL(&demand_lock);
+    if (subs[consumer].enabled != enabled) {
+        subs[consumer].enabled = enabled;
+        resolve();
+    }
+    portEXIT_CRITICAL(&demand_lock);
+}
+
+uint64_t demand_get_subscription(demand_consumer_t consumer, demand_repr_t* repr)
+{
+    portENTER_CRITICAL(&demand_lock);
+    uint64_t channels = subs[consumer].channels;
+    if (repr != NULL) {
+        *repr = subs[consumer].repr;
+    }
+    portEXIT_CRITICAL(&demand_lock);
+    return channels;
+}
+
+bool demand_get_plan(demand_plan_t* out)
+{
+    portENTER_CRITICAL(&demand_lock);
+    *out = plan;
+    bool changed = plan_changed;
+    plan_changed = false;
+    portEXIT_CRITICAL(&demand_lock);
+    return changed;
+}
+
+void demand_account(const demand_plan_t* p, uint8_t usable_chips, uint8_t sent_chips, uint8_t sendable_chips)
+{
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        if (!(usable_chips & (1u << chip))) continue;
+        work.chips_usable++;
+        work.channels_usable += NUM_SENSORS_PER_CHIP;
+        if (p->channels[DEMAND_RAW] & DEMAND_CHIP_CHANNELS(chip)) {
+            work.chips_read++;
+        }
+        work.channels_compensated += __builtin_popcountll(p->channels[DEMAND_COMPENSATED] & DEMAND_CHIP_CHANNELS(chip));
+    }
+    work.chips_sent += sent_chips;
+    work.chips_sendable += sendable_chips;
+    work.frames++;
+}
+
+void demand_report(const capacity_costs_t* costs, const capacity_config_t* active)
+{
+    if (work.frames == 0) {
+        return;
+    }
+
+    float frames = (float)work.frames;
+    float invokes_per_channel = 0.0f;
+    if (active->nn_refresh_divider != 0) {
+        invokes_per_channel = 1.0f / ((float)active->nn_refresh_divider *
+                                      (active->nn_output_steps > 1 ? active->nn_output_steps : 1));
+    }
+    float transmit = (active->connections == 0)
+                   ? costs->serial_cycles_per_chip
+                   : costs->encode_cycles_per_chip[active->encoding] + active->connections * costs->notify_cycles;
+
+    float full = (work.chips_usable * costs->acquire_cycles_per_chip + work.chips_sendable * transmit +
+                  work.channels_usable * invokes_per_channel * costs->nn_cycles_per_invoke) / frames;
+    float done = (work.chips_read * costs->acquire_cycles_per_chip + work.chips_sent * transmit +
+                  work.channels_compensated * invokes_per_channel * costs->nn_cycles_per_invoke) / frames;
+    float saved = full - done;
+
+    ESP_LOGI(TAG, "Per frame: %.1f/%.1f chips read, %.1f/%.1f channels compensated, %.1f/%.1f chips sent",
+             work.chips_read / frames, work.chips_usable / frames,
+             work.channels_compensated / frames, work.channels_usable / frames,
+             work.chips_sent / frames, work.chips_sendable / frames);
+    ESP_LOGI(TAG, "Saved ~%.0f of %.0f cycles/frame (%.0f%%) against evaluating every channel",
+             saved, full, full > 0.0f ? 100.0f * saved / full : 0.0f);
+
+    memset(&work, 0, sizeof(work));
+}
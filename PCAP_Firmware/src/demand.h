@@ -0,0 +1,154 @@
+/**
+ * @file demand.h
+ * @brief Demand-driven evaluation of the sample pipeline
+ *
+ * Consumers (serial, BLE, gesture classifier, flight recorder) subscribe
+ * to the channels and representations they use. Each frame the sensor task
+ * takes a plan, the resolved union of the subscriptions, and evaluates
+ * only what it asks for:
+ *
+ *   DEMAND_RAW          the chip is read
+ *   DEMAND_CALIBRATED   offset-corrected value (final_val when not compensated)
+ *   DEMAND_HISTORY      the sample enters the history store
+ *   DEMAND_COMPENSATED  NN compensation
+ *
+ * Each representation implies the ones before it. Results are computed once
+ * per frame into pcap_data_t, which the transmit paths read instead of
+ * recomputing.
+ *
+ * Passive consumers (the flight recorder) take what active consumers
+ * already cause to be acquired, and never cause a chip to be read.
+ * Transports send a chip when any of its channels is subscribed; the
+ * other channels of that chip carry their calibrated value.
+ */
+
+#ifndef DEMAND_H
+#define DEMAND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcap04_defs.h"
+#include "capacity_planner.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup DemandConfig Demand Configuration
+ * @{
+ */
+#define DEMAND_NUM_CHANNELS     (NUM_PCAP_CHIPS * NUM_SENSORS_PER_CHIP)
+#define DEMAND_ALL_CHANNELS     ((1ULL << DEMAND_NUM_CHANNELS) - 1)
+#define DEMAND_CHIP_SHIFT(chip) ((chip) * NUM_SENSORS_PER_CHIP)
+#define DEMAND_CHIP_CHANNELS(chip) (((1ULL << NUM_SENSORS_PER_CHIP) - 1) << DEMAND_CHIP_SHIFT(chip))
+/** @} */
+
+/**
+ * @brief Representations of a channel, each implying the ones before it
+ */
+typedef enum {
+    DEMAND_RAW = 0,
+    DEMAND_CALIBRATED,
+    DEMAND_HISTORY,
+    DEMAND_COMPENSATED,
+    DEMAND_REPR_COUNT
+} demand_repr_t;
+
+/**
+ * @brief Consumers of the pipeline output
+ */
+typedef enum {
+    DEMAND_CONSUMER_SERIAL = 0,     ///< CSV lines (when no central is connected)
+    DEMAND_CONSUMER_BLE,            ///< Chip packets to connected centrals
+    DEMAND_CONSUMER_GESTURE,        ///< On-device gesture classifier
+    DEMAND_CONSUMER_RECORDER,       ///< Flight recorder (passive)
+    DEMAND_CONSUMER_COUNT
+} demand_consumer_t;
+
+/**
+ * @brief Resolved demand for one frame
+ *
+ * channels[r] has bit chip * NUM_SENSORS_PER_CHIP + sensor set for every
+ * channel needed in representation r or a representation derived from it.
+ */
+typedef struct {
+    uint64_t channels[DEMAND_REPR_COUNT];
+    uint64_t sent[DEMAND_CONSUMER_COUNT];   ///< Channels each enabled consumer receives
+} demand_plan_t;
+
+/**
+ * @brief Clear all subscriptions; every consumer starts enabled
+ */
+void demand_init(void);
+
+/**
+ * @brief Set the channels a consumer wants in one representation
+ * @param consumer Consumer
+ * @param repr     Representation, replacing the consumer's previous one
+ * @param channels Channel mask (0 unsubscribes)
+ *
+ * BLE packets carry calibrated values, so a BLE subscription above
+ * DEMAND_CALIBRATED is clamped to it rather than running the NN for nothing.
+ */
+void demand_subscribe(demand_consumer_t consumer, demand_repr_t repr, uint64_t channels);
+
+/**
+ * @brief Enable or disable a consumer without losing its subscription
+ *
+ * The transports use this to follow the BLE connection.
+ */
+void demand_enable(demand_consumer_t consumer, bool enabled);
+
+/**
+ * @brief Get a consumer's subscription
+ * @param repr Receives the representation (may be NULL)
+ * @return Channel mask
+ */
+uint64_t demand_get_subscription(demand_consumer_t consumer, demand_repr_t* repr);
+
+/**
+ * @brief Take the current plan
+ * @param plan Receives the plan
+ * @return true if it changed since the previous call
+ */
+bool demand_get_plan(demand_plan_t* plan);
+
+/**
+ * @brief Six-bit sensor mask of a chip in a plan
+ */
+static inline uint8_t demand_chip_sensors(const demand_plan_t* plan, demand_repr_t repr, int chip)
+{
+    return (uint8_t)((plan->channels[repr] >> DEMAND_CHIP_SHIFT(chip)) & ((1u << NUM_SENSORS_PER_CHIP) - 1));
+}
+
+/**
+ * @brief Check whether a consumer receives any channel of a chip
+ */
+static inline bool demand_chip_sent(const demand_plan_t* plan, demand_consumer_t consumer, int chip)
+{
+    return (plan->sent[consumer] & DEMAND_CHIP_CHANNELS(chip)) != 0;
+}
+
+/**
+ * @brief Account one frame's evaluated work against full evaluation
+ * @param plan           Plan the frame ran
+ * @param usable_chips   Chips that could have been evaluated (bit per chip)
+ * @param sent_chips     Chip packets or lines the frame sent
+ * @param sendable_chips Chip packets or lines full evaluation would have sent
+ */
+void demand_account(const demand_plan_t* plan, uint8_t usable_chips, uint8_t sent_chips,
+                    uint8_t sendable_chips);
+
+/**
+ * @brief Log the work skipped since the last report, in cycles via the capacity model
+ * @param costs  Per-unit costs
+ * @param active Running configuration (NN refresh and steps, transport)
+ */
+void demand_report(const capacity_costs_t* costs, const capacity_config_t* active);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEMAND_H
@@ -0,0 +1,174 @@
+/**
+ * @file gesture.c
+ * @brief On-device gesture classifier implementation
+ */
+
+#include <string.h>
+#include "gesture.h"
+
+static float baseline[GESTURE_NUM_PADS];
+static bool baseline_valid = false;
+
+// Current touch
+static bool touching = false;
+static bool long_press_sent = false;
+static uint32_t touch_start_ms = 0;
+static float start_x, start_y;
+static float last_x, last_y;
+
+// A tap waiting to see whether a second one follows
+static bool tap_pending = false;
+static uint32_t tap_release_ms = 0;
+static gesture_event_t pending_tap;
+
+void gesture_init(void)
+{
+    baseline_valid = false;
+    touching = false;
+    long_press_sent = false;
+    tap_pending = false;
+}
+
+const char* gesture_name(gesture_type_t type)
+{
+    static const char* names[] = {
+        "none", "tap", "double-tap", "long-press",
+        "swipe-left", "swipe-right", "swipe-up", "swipe-down",
+    };
+    return (unsigned)type < sizeof(names) / sizeof(names[0]) ? names[type] : "?";
+}
+
+static uint8_t grid_to_u8(float pos, int cells)
+{
+    float v = pos * 255.0f / (float)(cells - 1);
+    return v < 0.0f ? 0 : v > 255.0f ? 255 : (uint8_t)(v + 0.5f);
+}
+
+static void fill_event(gesture_event_t* event, gesture_type_t type, uint32_t duration_ms,
+                       uint32_t latency_ms)
+{
+    event->type = type;
+    event->x = grid_to_u8(start_x, GESTURE_GRID_COLS);
+    event->y = grid_to_u8(start_y, GESTURE_GRID_ROWS);
+    event->duration_ms = duration_ms > UINT16_MAX ? UINT16_MAX : (uint16_t)duration_ms;
+    event->latency_ms = latency_ms > UINT16_MAX ? UINT16_MAX : (uint16_t)latency_ms;
+}
+
+static gesture_type_t swipe_direction(float dx, float dy)
+{
+    if (dx * dx >= dy * dy) {
+        return dx > 0.0f ? GESTURE_SWIPE_RIGHT : GESTURE_SWIPE_LEFT;
+    }
+    return dy > 0.0f ? GESTURE_SWIPE_DOWN : GESTURE_SWIPE_UP;
+}
+
+// Release the pending tap as a single tap
+static bool flush_tap(uint32_t now_ms, gesture_event_t* event)
+{
+    *event = pending_tap;
+    uint32_t latency = now_ms - tap_release_ms;
+    event->latency_ms = latency > UINT16_MAX ? UINT16_MAX : (uint16_t)latency;
+    tap_pending = false;
+    return true;
+}
+
+bool gesture_process_frame(const float values[GESTURE_NUM_PADS], uint32_t now_ms,
+                           gesture_event_t* event)
+{
+    if (!baseline_valid) {
+        memcpy(baseline, values, sizeof(baseline));
+        baseline_valid = true;
+        return false;
+    }
+
+    // Activation and its centroid
+    float total = 0.0f;
+    float sum_x = 0.0f;
+    float sum_y = 0.0f;
+    for (int chip = 0; chip < GESTURE_GRID_COLS; chip++) {
+        for (int sensor = 0; sensor < GESTURE_GRID_ROWS; sensor++) {
+            int i = chip * NUM_SENSORS_PER_CHIP + sensor;
+            float a = values[i] - baseline[i] - GESTURE_PAD_THRESHOLD;
+            if (a > 0.0f) {
+                total += a;
+                sum_x += a * (float)chip;
+                sum_y += a * (float)sensor;
+            }
+        }
+    }
+
+    if (!touching) {
+        if (total < GESTURE_TOUCH_ON) {
+            // Follow slow drift only while nothing is touching
+            for (int i = 0; i < GESTURE_NUM_PADS; i++) {
+                baseline[i] += (values[i] - baseline[i]) * GESTURE_BASELINE_ALPHA;
+            }
+            if (tap_pending && now_ms - tap_release_ms > GESTURE_DOUBLE_TAP_MS) {
+                return flush_tap(now_ms, event);
+            }
+            return false;
+        }
+
+        touching = true;
+        long_press_sent = false;
+        touch_start_ms = now_ms;
+        start_x = last_x = sum_x / total;
+        start_y = last_y = sum_y / total;
+        if (tap_pending && now_ms - tap_release_ms > GESTURE_DOUBLE_TAP_MS) {
+            return flush_tap(now_ms, event);
+        }
+        return false;
+    }
+
+    uint32_t duration = now_ms - touch_start_ms;
+
+    if (total >= GESTURE_TOUCH_OFF) {
+        last_x = sum_x / total;
+        last_y = sum_y / total;
+        float dx = last_x - start_x;
+        float dy = last_y - start_y;
+        bool moved = dx * dx + dy * dy >= GESTURE_SWIPE_MIN_PADS * GESTURE_SWIPE_MIN_PADS;
+
+        // A second touch that is no longer a tap releases the first one
+        if (tap_pending && (moved || duration > GESTURE_TAP_MAX_MS)) {
+            return flush_tap(now_ms, event);
+        }
+        if (!long_press_sent && !moved && duration >= GESTURE_LONG_PRESS_MS) {
+            long_press_sent = true;
+            fill_event(event, GESTURE_LONG_PRESS, duration, 0);
+            return true;
+        }
+        return false;
+    }
+
+    // Touch-up: the gesture is decided on this frame
+    touching = false;
+    if (long_press_sent) {
+        return false;
+    }
+
+    float dx = last_x - start_x;
+    float dy = last_y - start_y;
+    if (dx * dx + dy * dy >= GESTURE_SWIPE_MIN_PADS * GESTURE_SWIPE_MIN_PADS) {
+        if (duration > GESTURE_SWIPE_MAX_MS) {
+            return false;
+        }
+        fill_event(event, swipe_direction(dx, dy), duration, 0);
+        return true;
+    }
+    if (duration > GESTURE_TAP_MAX_MS) {
+        return false;
+    }
+    if (tap_pending) {
+        *event = pending_tap;
+        event->type = GESTURE_DOUBLE_TAP;
+        event->latency_ms = 0;
+        tap_pending = false;
+        return true;
+    }
+
+    fill_event(&pending_tap, GESTURE_TAP, duration, 0);
+    tap_pending = true;
+    tap_release_ms = now_ms;
+    return false;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file gesture.h
+ * @brief On-device gesture classifier over the spatial sensor frame
+ *
+ * Treats the 48 sensors as a grid (x = chip, y = sensor input) and tracks
+ * the touch as a weighted centroid of the activation above a drifting
+ * baseline. A small state machine on touch-down/touch-up timing and
+ * centroid travel turns the frame sequence into tap, double-tap,
+ * long-press and swipe events, so HMI deployments send a few bytes per
+ * event instead of every frame.
+ *
+ * The classifier is hand-written rather than a TFLM model: it needs no
+ * arena, runs in a few microseconds per frame and its thresholds can be
+ * tuned on a capture with tools/gesture/replay_gesture.py, which builds
+ * this file on the host and replays "D," lines through it.
+ */
+
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcap04_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup GestureConfig Gesture Classifier Configuration
+ * @brief Thresholds in pF and ms
+ * @{
+ */
+#define GESTURE_NUM_PADS        (NUM_PCAP_CHIPS * NUM_SENSORS_PER_CHIP)
+#define GESTURE_GRID_COLS       NUM_PCAP_CHIPS          ///< x: chip index
+#define GESTURE_GRID_ROWS       NUM_SENSORS_PER_CHIP    ///< y: sensor input
+
+#define GESTURE_PAD_THRESHOLD   0.05f   ///< Per-pad rise over baseline counted as activation
+#define GESTURE_TOUCH_ON        0.50f   ///< Total activation that starts a touch
+#define GESTURE_TOUCH_OFF       0.30f   ///< Total activation that ends it
+#define GESTURE_BASELINE_ALPHA  0.01f   ///< Baseline tracking rate while untouched
+
+#define GESTURE_TAP_MAX_MS      250     ///< Longest touch that counts as a tap
+#define GESTURE_DOUBLE_TAP_MS   250     ///< Largest gap between the taps of a double-tap
+#define GESTURE_LONG_PRESS_MS   800     ///< Hold time of a long-press
+#define GESTURE_SWIPE_MAX_MS    600     ///< Longest touch that counts as a swipe
+#define GESTURE_SWIPE_MIN_PADS  2.0f    ///< Centroid travel of a swipe, in pads
+/** @} */
+
+/**
+ * @brief Gesture types
+ *
+ * Swipe directions are in grid coordinates: right is towards higher chip
+ * numbers, down towards higher sensor inputs.
+ */
+typedef enum {
+    GESTURE_NONE = 0,
+    GESTURE_TAP,
+    GESTURE_DOUBLE_TAP,
+    GESTURE_LONG_PRESS,
+    GESTURE_SWIPE_LEFT,
+    GESTURE_SWIPE_RIGHT,
+    GESTURE_SWIPE_UP,
+    GESTURE_SWIPE_DOWN,
+} gesture_type_t;
+
+/**
+ * @brief A classified gesture
+ */
+typedef struct {
+    gesture_type_t type;
+    uint8_t  x;             ///< Touch-down centroid, 0-255 across the grid
+    uint8_t  y;             ///< Touch-down centroid, 0-255 across the grid
+    uint16_t duration_ms;   ///< Touch duration (first touch for a double-tap)
+    uint16_t latency_ms;    ///< From the moment the gesture was decidable to emission
+} gesture_event_t;
+
+/**
+ * @brief Reset the classifier; the next frame seeds the baseline
+ */
+void gesture_init(void);
+
+/**
+ * @brief Feed one frame
+ * @param values Calibrated values in pF, index chip * NUM_SENSORS_PER_CHIP + sensor
+ *               (0 for unusable chips)
+ * @param now_ms Frame timestamp
+ * @param event  Receives the gesture if one completes on this frame
+ * @return true if event was filled in
+ */
+bool gesture_process_frame(const float values[GESTURE_NUM_PADS], uint32_t now_ms,
+                           gesture_event_t* event);
+
+/**
+ * @brief Name of a gesture type
+ */
+const char* gesture_name(gesture_type_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GESTURE_H
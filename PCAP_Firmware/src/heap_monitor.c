@@ -0,0 +1,173 @@
+/**
+ * @file heap_monitor.c
+ * @brief Heap usage monitoring and steady-state allocation tracing implementation
+ */
+
+#include <string.h>
+#include "heap_monitor.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char* TAG = "HEAP";
+
+// Per-task record of allocations made after the steady-state marker
+typedef struct {
+    TaskHandle_t task;                          ///< NULL marks the ISR slot / unused entry
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t allocs;
+    uint32_t bytes;
+} heap_task_record_t;
+
+static portMUX_TYPE heap_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool steady_state = false;
+static uint32_t baseline_free = 0;
+static uint32_t steady_free = 0;
+
+static heap_task_record_t task_records[HEAP_MONITOR_MAX_TASKS];
+static int task_record_count = 0;
+static uint32_t steady_allocs = 0;
+static uint32_t steady_alloc_bytes = 0;
+static uint32_t untracked_allocs = 0;           // Allocations that found no free record slot
+static uint32_t reported_allocs = 0;            // steady_allocs at the previous report
+
+void heap_monitor_init(void)
+{
+    baseline_free = esp_get_free_heap_size();
+#if !CONFIG_HEAP_USE_HOOKS
+    ESP_LOGW(TAG, "CONFIG_HEAP_USE_HOOKS disabled - steady-state allocations will not be traced");
+#endif
+}
+
+void heap_monitor_mark_steady_state(void)
+{
+    portENTER_CRITICAL_SAFE(&heap_lock);
+    task_record_count = 0;
+    steady_allocs = 0;
+    steady_alloc_bytes = 0;
+    untracked_allocs = 0;
+    reported_allocs = 0;
+    steady_state = true;
+    portEXIT_CRITICAL_SAFE(&heap_lock);
+
+    steady_free = esp_get_free_heap_size();
+    ESP_LOGI(TAG, "Steady state marked; free heap %lu bytes (%ld since boot)",
+             steady_free, (long)steady_free - (long)baseline_free);
+}
+
+bool heap_monitor_in_steady_state(void)
+{
+    return steady_state;
+}
+
+#if CONFIG_HEAP_USE_HOOKS
+// Called by the heap component on every successful allocation. May run in ISR
+// context or with the cache disabled, so it must not allocate or log.
+void IRAM_ATTR esp_heap_trace_alloc_hook(void* ptr, size_t size, uint32_t caps)
+{
+    (void)ptr;
+    (void)caps;
+
+    if (!steady_state) {
+        return;
+    }
+
+    TaskHandle_t task = xPortInIsrContext() ? NULL : xTaskGetCurrentTaskHandle();
+
+    portENTER_CRITICAL_SAFE(&heap_lock);
+    steady_allocs++;
+    steady_alloc_bytes += size;
+
+    heap_task_record_t* rec = NULL;
+    for (int i = 0; i < task_record_count; i++) {
+        if (task_records[i].task == task) {
+            rec = &task_records[i];
+            break;
+        }
+    }
+    if (rec == NULL && task_record_count < HEAP_MONITOR_MAX_TASKS) {
+        rec = &task_records[task_record_count++];
+        rec->task = task;
+        rec->allocs = 0;
+        rec->bytes = 0;
+        if (task != NULL) {
+            strncpy(rec->name, pcTaskGetName(task), sizeof(rec->name) - 1);
+            rec->name[sizeof(rec->name) - 1] = '\0';
+        } else {
+            strcpy(rec->name, "ISR");
+        }
+    }
+    if (rec != NULL) {
+        rec->allocs++;
+        rec->bytes += size;
+    } else {
+        untracked_allocs++;
+    }
+    portEXIT_CRITICAL_SAFE(&heap_lock);
+}
+
+void IRAM_ATTR esp_heap_trace_free_hook(void* ptr)
+{
+    (void)ptr;
+}
+#endif
+
+void heap_monitor_get_stats(heap_monitor_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    stats->free_bytes = esp_get_free_heap_size();
+    stats->min_free_bytes = esp_get_minimum_free_heap_size();
+    stats->largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    portENTER_CRITICAL_SAFE(&heap_lock);
+    stats->steady_allocs = steady_allocs;
+    stats->steady_alloc_bytes = steady_alloc_bytes;
+    portEXIT_CRITICAL_SAFE(&heap_lock);
+}
+
+void heap_monitor_report(void)
+{
+    heap_monitor_stats_t stats;
+    heap_monitor_get_stats(&stats);
+
+    ESP_LOGI(TAG, "Free: %lu  Min free: %lu  Largest block: %lu",
+             stats.free_bytes, stats.min_free_bytes, stats.largest_free_block);
+
+    if (!steady_state) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Drift since steady state: %ld bytes",
+             (long)stats.free_bytes - (long)steady_free);
+
+    if (stats.steady_allocs == reported_allocs) {
+        return;
+    }
+    reported_allocs = stats.steady_allocs;
+
+    // Copy records out so logging happens outside the critical section
+    heap_task_record_t records[HEAP_MONITOR_MAX_TASKS];
+    int count;
+    uint32_t untracked;
+    portENTER_CRITICAL_SAFE(&heap_lock);
+    count = task_record_count;
+    memcpy(records, task_records, count * sizeof(heap_task_record_t));
+    untracked = untracked_allocs;
+    portEXIT_CRITICAL_SAFE(&heap_lock);
+
+    ESP_LOGW(TAG, "Steady-state violation: %lu allocations (%lu bytes)",
+             stats.steady_allocs, stats.steady_alloc_bytes);
+    for (int i = 0; i < count; i++) {
+        ESP_LOGW(TAG, "  %-16s %6lu allocs %8lu bytes",
+                 records[i].name, records[i].allocs, records[i].bytes);
+    }
+    if (untracked > 0) {
+        ESP_LOGW(TAG, "  %lu allocations from untracked tasks", untracked);
+    }
+}
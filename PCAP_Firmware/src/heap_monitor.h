@@ -0,0 +1,80 @@
+/**
+ * @file heap_monitor.h
+ * @brief Heap usage monitoring and steady-state allocation tracing
+ *
+ * After boot every hot-path buffer (frames, mbufs, encoder scratch) is drawn
+ * from statically sized pools, so once the system reaches steady state the
+ * heap must not be touched. This module tracks heap watermarks and, when
+ * CONFIG_HEAP_USE_HOOKS is enabled, counts every allocation made after the
+ * steady-state marker per task so violations can be reported.
+ */
+
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup HeapMonitorConfig Heap Monitor Configuration
+ * @{
+ */
+#define HEAP_MONITOR_MAX_TASKS          12      ///< Distinct tasks tracked after steady state
+#define HEAP_MONITOR_REPORT_INTERVAL_S  60      ///< Period of the heap report in app_main
+/** @} */
+
+/**
+ * @brief Snapshot of heap usage
+ */
+typedef struct {
+    uint32_t free_bytes;            ///< Currently free heap
+    uint32_t min_free_bytes;        ///< Lowest free heap since boot
+    uint32_t largest_free_block;    ///< Largest allocatable block (fragmentation indicator)
+    uint32_t steady_allocs;         ///< Allocations since the steady-state marker
+    uint32_t steady_alloc_bytes;    ///< Bytes allocated since the steady-state marker
+} heap_monitor_stats_t;
+
+/**
+ * @brief Initialize the heap monitor
+ *
+ * Records the boot-time heap baseline. Safe to call before any task exists.
+ */
+void heap_monitor_init(void);
+
+/**
+ * @brief Mark the start of steady state
+ *
+ * Every allocation from now on is counted as a violation and attributed to
+ * the allocating task. Call once the pipeline has run long enough for
+ * one-time lazy initialization (stdio buffers, NimBLE host) to complete.
+ */
+void heap_monitor_mark_steady_state(void);
+
+/**
+ * @brief Check whether the steady-state marker has been set
+ * @return true after heap_monitor_mark_steady_state() was called
+ */
+bool heap_monitor_in_steady_state(void);
+
+/**
+ * @brief Fill a heap usage snapshot
+ * @param stats Pointer to structure receiving the snapshot
+ */
+void heap_monitor_get_stats(heap_monitor_stats_t* stats);
+
+/**
+ * @brief Log heap watermarks and any steady-state allocation violations
+ *
+ * Intended to be called periodically from a low-priority context.
+ */
+void heap_monitor_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HEAP_MONITOR_H
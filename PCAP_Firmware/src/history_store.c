@@ -0,0 +1,325 @@
+/**
+ * @file history_store.c
+ * @brief Per-channel sample history implementation
+ */
+
+#include <math.h>
+#include <string.h>
+#include "history_store.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char* TAG = "HISTORY";
+
+#define STATS_ALPHA (1.0f / (1 << HISTORY_STATS_SHIFT))
+
+// The row after the newest is never part of a window, so a write after
+// history_save_state() leaves the saved windows intact
+#define RING_ROWS   (HISTORY_DEPTH + 1)
+
+static history_channel_t channels[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+static __NOINIT_ATTR uint8_t rings[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP][RING_ROWS * HISTORY_ROW_BYTES];
+static uint32_t row_sum = 0;    // Sum of the CRC-32s of every stored row
+
+static history_view_t* views[HISTORY_MAX_VIEWS];
+static int num_views = 0;
+
+static const float scaler_mean[NN_NUM_FEATURES] = NN_FEATURE_SCALER_MEAN;
+static const float scaler_scale[NN_NUM_FEATURES] = NN_FEATURE_SCALER_SCALE;
+
+static nn_feature_type_t store_type = NN_FEATURE_FLOAT32;
+static uint8_t elem_bytes = sizeof(float);
+static float quant_step = 1.0f;
+static float inv_q_scale = 1.0f;
+static int32_t zero_point = 0;
+
+bool history_configure(nn_feature_type_t type, float q_scale, int32_t q_zero)
+{
+    uint8_t bytes = (type == NN_FEATURE_INT8) ? 1 : (type == NN_FEATURE_INT16) ? 2 : sizeof(float);
+    if (bytes > NN_FEATURE_STORAGE_BYTES) {
+        // The rings are sized for the model nn_feature_config.h was generated from
+        ESP_LOGE(TAG, "Element needs %u bytes, rings hold %d; regenerate nn_feature_config.h",
+                 bytes, NN_FEATURE_STORAGE_BYTES);
+        return false;
+    }
+    if (type != NN_FEATURE_FLOAT32 && q_scale <= 0.0f) {
+        ESP_LOGE(TAG, "Invalid quantization scale %f", q_scale);
+        return false;
+    }
+
+    store_type = type;
+    elem_bytes = bytes;
+    quant_step = (type == NN_FEATURE_FLOAT32) ? 1.0f : q_scale;
+    inv_q_scale = 1.0f / quant_step;
+    zero_point = q_zero;
+    history_reset();
+    return true;
+}
+
+void history_reset(void)
+{
+    memset(channels, 0, sizeof(channels));
+    row_sum = 0;
+    for (int v = 0; v < num_views; v++) {
+        memset(views[v]->cursor, 0, sizeof(views[v]->cursor));
+    }
+}
+
+uint32_t history_row_bytes(void)
+{
+    return NN_NUM_FEATURES * elem_bytes;
+}
+
+bool history_add_view(history_view_t* view)
+{
+    for (int v = 0; v < num_views; v++) {
+        if (views[v] == view) {
+            return true;
+        }
+    }
+    if (view->length == 0 || view->length > HISTORY_DEPTH || num_views >= HISTORY_MAX_VIEWS) {
+        ESP_LOGE(TAG, "Cannot add view %s (length %u, %d of %d views)",
+                 view->name, view->length, num_views, HISTORY_MAX_VIEWS);
+        return false;
+    }
+
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            view->cursor[chip][i] = channels[chip][i].stats.written;
+        }
+    }
+    views[num_views++] = view;
+    return true;
+}
+
+// Normalize and quantize one feature into a row
+static inline void store_feature(uint8_t* row, int idx, float value)
+{
+    float norm = (value - scaler_mean[idx]) / scaler_scale[idx];
+
+    switch (store_type) {
+    case NN_FEATURE_INT8: {
+        int32_t q = (int32_t)lroundf(norm * inv_q_scale) + zero_point;
+        ((int8_t*)row)[idx] = (int8_t)(q < INT8_MIN ? INT8_MIN : (q > INT8_MAX ? INT8_MAX : q));
+        break;
+    }
+    case NN_FEATURE_INT16: {
+        int32_t q = (int32_t)lroundf(norm * inv_q_scale) + zero_point;
+        ((int16_t*)row)[idx] = (int16_t)(q < INT16_MIN ? INT16_MIN : (q > INT16_MAX ? INT16_MAX : q));
+        break;
+    }
+    default:
+        ((float*)row)[idx] = norm;
+        break;
+    }
+}
+
+// First feature of a row, normalized
+static inline float load_normalized(const uint8_t* row)
+{
+    switch (store_type) {
+    case NN_FEATURE_INT8:
+        return (float)(((const int8_t*)row)[0] - zero_point) * quant_step;
+    case NN_FEATURE_INT16:
+        return (float)(((const int16_t*)row)[0] - zero_point) * quant_step;
+    default: {
+        float norm;
+        memcpy(&norm, row, sizeof(norm));
+        return norm;
+    }
+    }
+}
+
+static inline float load_value(const uint8_t* row, history_format_t format)
+{
+    float norm = load_normalized(row);
+    return (format == HISTORY_FORMAT_RAW) ? norm * scaler_scale[0] + scaler_mean[0] : norm;
+}
+
+static inline uint16_t next_row(uint16_t idx)
+{
+    return (idx + 1 >= RING_ROWS) ? 0 : idx + 1;
+}
+
+void history_write(int chip, int sensor, const float features[NN_NUM_FEATURES])
+{
+    history_channel_t* ch = &channels[chip][sensor];
+    uint32_t row_bytes = NN_NUM_FEATURES * elem_bytes;
+    uint8_t* ring = rings[chip][sensor];
+    uint8_t* row = &ring[ch->head * row_bytes];
+
+    for (int idx = 0; idx < NN_NUM_FEATURES; idx++) {
+        store_feature(row, idx, features[idx]);
+    }
+    row_sum += esp_rom_crc32_le(0, row, row_bytes);
+
+    // Once full, the oldest row leaves the window (it stays until the next write)
+    if (ch->count < HISTORY_DEPTH) {
+        ch->count++;
+    } else {
+        row_sum -= esp_rom_crc32_le(0, &ring[next_row(ch->head) * row_bytes], row_bytes);
+    }
+    ch->head = next_row(ch->head);
+
+    // Statistics of the exact input, seeded by the first sample
+    history_stats_t* st = &ch->stats;
+    float x = features[0];
+    if (st->written == 0) {
+        st->mean = x;
+        st->var = 0.0f;
+    } else {
+        float d = x - st->mean;
+        st->mean += d * STATS_ALPHA;
+        st->var += (d * d - st->var) * STATS_ALPHA;
+    }
+    st->last = x;
+    st->written++;
+}
+
+bool history_view_ready(const history_view_t* view, int chip, int sensor)
+{
+    return channels[chip][sensor].count >= view->length;
+}
+
+// Ring index of the sample `age` rows before the newest (age 0)
+static inline uint16_t row_index(const history_channel_t* ch, uint16_t age)
+{
+    int idx = (int)ch->head - 1 - age;
+    return (uint16_t)(idx < 0 ? idx + RING_ROWS : idx);
+}
+
+bool history_read_window(const history_view_t* view, int chip, int sensor, void* dst)
+{
+    const history_channel_t* ch = &channels[chip][sensor];
+    const uint8_t* ring = rings[chip][sensor];
+    uint32_t row_bytes = NN_NUM_FEATURES * elem_bytes;
+
+    if (ch->count < view->length) {
+        return false;
+    }
+
+    uint16_t first = row_index(ch, view->length - 1);
+    if (view->format == HISTORY_FORMAT_STORED) {
+        // Rows first..end, then wrapped rows from 0
+        uint32_t tail = RING_ROWS - first;
+        if (tail >= view->length) {
+            memcpy(dst, ring + first * row_bytes, view->length * row_bytes);
+        } else {
+            memcpy(dst, ring + first * row_bytes, tail * row_bytes);
+            memcpy((uint8_t*)dst + tail * row_bytes, ring, (view->length - tail) * row_bytes);
+        }
+        return true;
+    }
+
+    float* out = (float*)dst;
+    uint16_t idx = first;
+    for (uint16_t n = 0; n < view->length; n++) {
+        out[n] = load_value(ring + idx * row_bytes, view->format);
+        idx = next_row(idx);
+    }
+    return true;
+}
+
+uint16_t history_read_new(history_view_t* view, int chip, int sensor, float* dst, uint16_t max)
+{
+    const history_channel_t* ch = &channels[chip][sensor];
+    const uint8_t* ring = rings[chip][sensor];
+    uint32_t row_bytes = NN_NUM_FEATURES * elem_bytes;
+    uint32_t written = ch->stats.written;
+
+    if (view->format == HISTORY_FORMAT_STORED) {
+        return 0;
+    }
+
+    // Samples the ring no longer holds, or the view does not span, are skipped
+    uint32_t pending = written - view->cursor[chip][sensor];
+    uint16_t span = (ch->count < view->length) ? ch->count : view->length;
+    if (pending > span) {
+        pending = span;
+    }
+
+    uint16_t n = (pending < max) ? (uint16_t)pending : max;
+    if (n == 0) {
+        return 0;
+    }
+    uint16_t idx = row_index(ch, (uint16_t)(pending - 1));
+    for (uint16_t k = 0; k < n; k++) {
+        dst[k] = load_value(ring + idx * row_bytes, view->format);
+        idx = next_row(idx);
+    }
+    view->cursor[chip][sensor] = written - (uint32_t)(pending - n);
+    return n;
+}
+
+void history_get_stats(int chip, int sensor, history_stats_t* stats)
+{
+    *stats = channels[chip][sensor].stats;
+}
+
+void history_save_state(history_state_t* state)
+{
+    memcpy(state->channels, channels, sizeof(channels));
+    state->row_sum = row_sum;
+    state->type = (uint8_t)store_type;
+    state->elem_bytes = elem_bytes;
+}
+
+bool history_restore_state(const history_state_t* state)
+{
+    if (state->type != store_type || state->elem_bytes != elem_bytes) {
+        ESP_LOGW(TAG, "Saved rows are type %u, store is configured for %u", state->type, (unsigned)store_type);
+        return false;
+    }
+
+    // The saved windows' rows, as the saved positions place them
+    uint32_t row_bytes = NN_NUM_FEATURES * elem_bytes;
+    uint32_t sum = 0;
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            const history_channel_t* ch = &state->channels[chip][i];
+            if (ch->head >= RING_ROWS || ch->count > HISTORY_DEPTH) {
+                ESP_LOGW(TAG, "Saved position of channel %d/%d out of range", chip, i);
+                return false;
+            }
+            for (uint16_t age = 0; age < ch->count; age++) {
+                sum += esp_rom_crc32_le(0, &rings[chip][i][row_index(ch, age) * row_bytes], row_bytes);
+            }
+        }
+    }
+    if (sum != state->row_sum) {
+        ESP_LOGW(TAG, "Stored rows do not match the saved checksum");
+        return false;
+    }
+
+    memcpy(channels, state->channels, sizeof(channels));
+    row_sum = sum;
+    for (int v = 0; v < num_views; v++) {
+        for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+            for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+                views[v]->cursor[chip][i] = channels[chip][i].stats.written;
+            }
+        }
+    }
+    return true;
+}
+
+void history_report_ram(void)
+{
+    uint32_t shared = sizeof(rings) + sizeof(channels);
+    uint32_t separate = 0;
+    const uint32_t num_channels = NUM_PCAP_CHIPS * NUM_SENSORS_PER_CHIP;
+
+    for (int v = 0; v < num_views; v++) {
+        const history_view_t* view = views[v];
+        uint32_t elem = (view->format == HISTORY_FORMAT_STORED) ? HISTORY_ROW_BYTES : sizeof(float);
+        shared += sizeof(view->cursor);
+        separate += num_channels * (view->length * elem + sizeof(uint16_t) * 2);
+        ESP_LOGI(TAG, "View %s: %u samples", view->name, view->length);
+    }
+    // Separate consumers would each keep the statistics they need
+    separate += sizeof(channels) - num_channels * sizeof(uint16_t) * 2;
+
+    ESP_LOGI(TAG, "History: %lu bytes for %d view(s), %lu bytes as separate rings",
+             (unsigned long)shared, num_views, (unsigned long)separate);
+}
@@ -0,0 +1,189 @@
+/**
+ * @file history_store.h
+ * @brief Per-channel sample history shared by all history-based consumers
+ *
+ * Each channel's samples are stored once, as a ring of feature rows in the
+ * NN input tensor's representation (normalized with the per-feature
+ * scalers, then quantized to int8/int16 or kept as float). Consumers read
+ * the ring through views. Each view sets its own window length, format and
+ * per-channel read cursor:
+ *
+ *   HISTORY_FORMAT_STORED      whole rows as stored (NN input windows)
+ *   HISTORY_FORMAT_NORMALIZED  first feature, normalized, as float
+ *   HISTORY_FORMAT_RAW         first feature in input units (calibrated pF)
+ *
+ * The float formats are decoded on read, so a quantized store returns raw
+ * values to within one quantization step. Each write also updates running
+ * statistics of the exact input (last value, EMA mean and variance) for
+ * drift and activity tracking, so those consumers need no history at all.
+ *
+ * One task writes. Readers on other tasks may see a row that is being
+ * overwritten, which is acceptable for post-mortem dumps.
+ *
+ * The rows live in no-init RAM and survive a soft reset. Each ring has one
+ * row beyond HISTORY_DEPTH, so a write never overwrites a row of the last
+ * saved state (history_save_state()); restoring that state after the reset
+ * gives back the windows as they were, checked against a running checksum
+ * of the stored rows.
+ */
+
+#ifndef HISTORY_STORE_H
+#define HISTORY_STORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "nn_features.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup HistoryConfig History Store Configuration
+ * @{
+ */
+#define HISTORY_DEPTH           NN_WINDOW_SIZE  ///< Rows kept per channel, the longest view
+#define HISTORY_MAX_VIEWS       4               ///< Views that can be registered
+#define HISTORY_STATS_SHIFT     7               ///< Statistics EMA weight 1/2^n (~1.3 s at 100Hz)
+#define HISTORY_ROW_BYTES       (NN_NUM_FEATURES * NN_FEATURE_STORAGE_BYTES)   ///< Reserved per row, the model's input element size
+/** @} */
+
+/**
+ * @brief Representation a view reads the history in
+ */
+typedef enum {
+    HISTORY_FORMAT_STORED = 0,      ///< Feature rows as stored
+    HISTORY_FORMAT_NORMALIZED,      ///< First feature, normalized float
+    HISTORY_FORMAT_RAW,             ///< First feature, input units float
+} history_format_t;
+
+/**
+ * @brief A consumer's view of the history
+ */
+typedef struct {
+    const char* name;
+    uint16_t length;                ///< Samples the view spans (1..HISTORY_DEPTH)
+    history_format_t format;
+    uint32_t cursor[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];  ///< Write count at the last history_read_new()
+} history_view_t;
+
+/**
+ * @brief Running statistics of a channel's input
+ */
+typedef struct {
+    uint32_t written;               ///< Samples written since the last reset
+    float last;                     ///< Latest input
+    float mean;                     ///< EMA of the input
+    float var;                      ///< EMA of the squared deviation from mean
+} history_stats_t;
+
+/**
+ * @brief Ring position and statistics of a channel
+ */
+typedef struct {
+    uint16_t head;                  ///< Next row to write
+    uint16_t count;                 ///< Rows stored (0..HISTORY_DEPTH)
+    history_stats_t stats;
+} history_channel_t;
+
+/**
+ * @brief Everything but the rows, to restore the store over rows kept in place
+ */
+typedef struct {
+    history_channel_t channels[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+    uint32_t row_sum;               ///< Sum of the stored rows' CRC-32s
+    uint8_t type;                   ///< nn_feature_type_t of the rows
+    uint8_t elem_bytes;
+} history_state_t;
+
+/**
+ * @brief Set the stored representation and reset all channels
+ * @param type    Element type of the rows
+ * @param q_scale Quantization scale (ignored for float)
+ * @param q_zero  Quantization zero point (ignored for float)
+ * @return false if the type does not fit NN_FEATURE_STORAGE_BYTES
+ */
+bool history_configure(nn_feature_type_t type, float q_scale, int32_t q_zero);
+
+/**
+ * @brief Empty every channel, keeping the representation
+ */
+void history_reset(void);
+
+/**
+ * @brief Bytes of one stored row
+ */
+uint32_t history_row_bytes(void);
+
+/**
+ * @brief Register a view; read cursors start at the current write position
+ * @return false if the length exceeds HISTORY_DEPTH or no slot is left
+ *
+ * Registering an already registered view is a no-op.
+ */
+bool history_add_view(history_view_t* view);
+
+/**
+ * @brief Append one sample to a channel
+ * @param chip     Chip index
+ * @param sensor   Sensor index on the chip
+ * @param features Feature values in input units, the input first
+ */
+void history_write(int chip, int sensor, const float features[NN_NUM_FEATURES]);
+
+/**
+ * @brief Check whether a channel holds a full window of a view
+ */
+bool history_view_ready(const history_view_t* view, int chip, int sensor);
+
+/**
+ * @brief Copy the newest window of a view, oldest sample first
+ * @param view   View
+ * @param chip   Chip index
+ * @param sensor Sensor index on the chip
+ * @param dst    view->length rows (STORED) or floats
+ * @return false if the window is not full yet
+ */
+bool history_read_window(const history_view_t* view, int chip, int sensor, void* dst);
+
+/**
+ * @brief Read the samples written since the view's last read, oldest first
+ * @param view   View with a float format
+ * @param chip   Chip index
+ * @param sensor Sensor index on the chip
+ * @param dst    Receives up to max floats
+ * @param max    Capacity of dst
+ * @return Samples read. Samples older than the view's length are skipped;
+ *         the cursor advances past what was read, so a short dst reads in chunks.
+ */
+uint16_t history_read_new(history_view_t* view, int chip, int sensor, float* dst, uint16_t max);
+
+/**
+ * @brief Get a channel's running statistics
+ */
+void history_get_stats(int chip, int sensor, history_stats_t* stats);
+
+/**
+ * @brief Copy the ring positions, statistics and row checksum
+ */
+void history_save_state(history_state_t* state);
+
+/**
+ * @brief Restore a saved state over the rows still in place
+ * @return false, leaving the store unchanged, if the representation differs
+ *         from the configured one or the rows no longer match the checksum
+ *
+ * Views continue from the restored samples without reading them again.
+ */
+bool history_restore_state(const history_state_t* state);
+
+/**
+ * @brief Log the store's RAM against separate per-view rings
+ */
+void history_report_ram(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HISTORY_STORE_H
@@ -0,0 +1,47 @@
+/**
+ * @file latency_probe.c
+ * @brief Per-frame latency instrumentation implementation
+ */
+
+#include <string.h>
+#include "latency_probe.h"
+#include "esp_timer.h"
+
+static bool frame_open = false;
+static uint16_t next_seq = 0;
+static int64_t last_lap_us = 0;
+static uint32_t frame_us[LATENCY_STAGE_COUNT];
+static latency_record_t current;
+
+void latency_frame_start(void)
+{
+    last_lap_us = esp_timer_get_time();
+    current.seq = next_seq++;
+    current.t0_us = (uint32_t)last_lap_us;
+    memset(frame_us, 0, sizeof(frame_us));
+    frame_open = true;
+}
+
+void latency_lap(latency_stage_t stage)
+{
+    if (!frame_open) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    frame_us[stage] += (uint32_t)(now - last_lap_us);
+    last_lap_us = now;
+}
+
+bool latency_frame_done(latency_record_t* record)
+{
+    if (!frame_open) {
+        return false;
+    }
+    frame_open = false;
+
+    for (int s = 0; s < LATENCY_STAGE_COUNT; s++) {
+        current.stage_us[s] = frame_us[s] > UINT16_MAX ? UINT16_MAX : (uint16_t)frame_us[s];
+    }
+    *record = current;
+    return true;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file latency_probe.h
+ * @brief Per-frame latency instrumentation from SPI read to transport hand-off
+ *
+ * A frame opens with the time its first chip read starts (the acquisition
+ * timestamp) and collects the microseconds spent in each stage up to the
+ * moment the transport took the data. The record goes out after the
+ * frame's data ("L,..." on serial, a LATENCY_OP_CODE packet on BLE). The
+ * host maps the device clock with BLE_CTRL_TIME_PING round trips and adds
+ * the delivery time, see tools/latency/latency_report.py.
+ *
+ * Stages are charged with laps like stage_profiler.h, but in microseconds
+ * of the system timer so they add up to wall-clock latency. Laps outside an
+ * open frame are ignored, so the transports can lap unconditionally.
+ */
+
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Stages of a frame's latency, in pipeline order
+ */
+typedef enum {
+    LATENCY_STAGE_ACQUIRE = 0,      ///< SPI reads
+    LATENCY_STAGE_COMPENSATE,       ///< NN compensation
+    LATENCY_STAGE_WAIT,             ///< From the last compensation to the first encode
+    LATENCY_STAGE_ENCODE,           ///< Packet or line formatting
+    LATENCY_STAGE_HANDOFF,          ///< Notification queueing or serial write
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+/**
+ * @brief Latency record of one frame
+ */
+typedef struct {
+    uint16_t seq;                               ///< Frame sequence number
+    uint32_t t0_us;                             ///< Acquisition timestamp (low 32 bits of esp_timer)
+    uint16_t stage_us[LATENCY_STAGE_COUNT];     ///< Time per stage, saturating
+} latency_record_t;
+
+/**
+ * @brief Open a frame; call right before its first chip read
+ */
+void latency_frame_start(void);
+
+/**
+ * @brief Charge the time since the previous lap (or the frame start) to a stage
+ */
+void latency_lap(latency_stage_t stage);
+
+/**
+ * @brief Close the frame
+ * @param record Receives the frame's record
+ * @return false if no frame was open
+ */
+bool latency_frame_done(latency_record_t* record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LATENCY_PROBE_H
@@ -0,0 +1,184 @@
+/**
+ * @file low_power.c
+ * @brief Deep-sleep duty cycling implementation (ESP-IDF)
+ */
+
+#include <string.h>
+#include <sys/time.h>
+#include "low_power.h"
+#include "mux_control.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+
+static const char* TAG = "LOWPWR";
+
+#define LOW_POWER_MAGIC 0x50434150  // "PCAP"
+
+// State retained in RTC memory across deep sleep
+typedef struct {
+    uint32_t magic;
+    uint32_t wake_count;
+    uint8_t  usable_mask;
+    float    offset[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+    int64_t  boot_time_us;          // Wall time of the cold boot
+    int64_t  sleep_enter_us;        // Wall time when the last sleep started
+    uint16_t batch_head;            // Next write index
+    uint16_t batch_count;
+    uint32_t next_seq;              // Sequence number of the next sample
+    uint16_t retry_wait;            // Wakes left before the next upload attempt
+    uint16_t retry_backoff;         // Wait after the next failed attempt
+    low_rate_sample_t batch[LOW_RATE_BATCH_SAMPLES];
+} low_power_state_t;
+
+static RTC_DATA_ATTR low_power_state_t rtc_state;
+
+// Wall time at which this wake's timer expired (start of wake-to-sample)
+static int64_t wake_time_us = 0;
+static uint32_t wake_to_sample_us = 0;
+
+// gettimeofday is backed by the RTC timer and keeps counting through deep
+// sleep, so it can span the ROM, bootloader and app startup of a wake.
+static int64_t wall_time_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+bool low_power_is_wake(void)
+{
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP || rtc_state.magic != LOW_POWER_MAGIC) {
+        return false;
+    }
+
+    rtc_state.wake_count++;
+    wake_time_us = rtc_state.sleep_enter_us + (int64_t)LOW_RATE_SAMPLE_PERIOD_S * 1000000LL;
+    return true;
+}
+
+void low_power_save_calibration(const bool usable[NUM_PCAP_CHIPS],
+                                const pcap_data_t data[NUM_PCAP_CHIPS])
+{
+    memset(&rtc_state, 0, sizeof(rtc_state));
+
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        if (usable[chip]) {
+            rtc_state.usable_mask |= (uint8_t)(1u << chip);
+        }
+        memcpy(rtc_state.offset[chip], data[chip].offset, sizeof(rtc_state.offset[chip]));
+    }
+
+    rtc_state.boot_time_us = wall_time_us();
+    rtc_state.retry_backoff = LOW_RATE_RETRY_WAKES;
+    rtc_state.magic = LOW_POWER_MAGIC;
+
+    ESP_LOGI(TAG, "Low-rate mode: %d s period, %d-sample batch",
+             LOW_RATE_SAMPLE_PERIOD_S, LOW_RATE_BATCH_SAMPLES);
+}
+
+void low_power_restore_calibration(bool usable[NUM_PCAP_CHIPS],
+                                   pcap_data_t data[NUM_PCAP_CHIPS])
+{
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        usable[chip] = (rtc_state.usable_mask & (1u << chip)) != 0;
+        memcpy(data[chip].offset, rtc_state.offset[chip], sizeof(data[chip].offset));
+    }
+}
+
+bool low_power_append_sample(const bool usable[NUM_PCAP_CHIPS],
+                             const pcap_data_t data[NUM_PCAP_CHIPS])
+{
+    int64_t now = wall_time_us();
+    wake_to_sample_us = (uint32_t)(now - wake_time_us);
+
+    low_rate_sample_t* sample = &rtc_state.batch[rtc_state.batch_head];
+    sample->seq = rtc_state.next_seq++;
+    sample->timestamp_s = (uint32_t)((now - rtc_state.boot_time_us) / 1000000LL);
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            sample->delta[chip][i] = usable[chip]
+                ? (int32_t)(data[chip].raw[i] - data[chip].offset[i]) : 0;
+        }
+    }
+
+    rtc_state.batch_head = (rtc_state.batch_head + 1) % LOW_RATE_BATCH_SAMPLES;
+    if (rtc_state.batch_count < LOW_RATE_BATCH_SAMPLES) {
+        rtc_state.batch_count++;
+    }
+
+    if (rtc_state.batch_count < LOW_RATE_BATCH_SAMPLES) {
+        return false;
+    }
+    if (rtc_state.retry_wait > 0) {
+        rtc_state.retry_wait--;
+        return false;
+    }
+    return true;
+}
+
+uint16_t low_power_batch_count(void)
+{
+    return rtc_state.batch_count;
+}
+
+const low_rate_sample_t* low_power_batch_get(uint16_t index)
+{
+    if (index >= rtc_state.batch_count) {
+        return NULL;
+    }
+
+    uint16_t oldest = (rtc_state.batch_head + LOW_RATE_BATCH_SAMPLES - rtc_state.batch_count)
+                      % LOW_RATE_BATCH_SAMPLES;
+    return &rtc_state.batch[(oldest + index) % LOW_RATE_BATCH_SAMPLES];
+}
+
+void low_power_batch_clear(void)
+{
+    rtc_state.batch_head = 0;
+    rtc_state.batch_count = 0;
+    rtc_state.retry_wait = 0;
+    rtc_state.retry_backoff = LOW_RATE_RETRY_WAKES;
+}
+
+void low_power_upload_failed(void)
+{
+    rtc_state.retry_wait = rtc_state.retry_backoff;
+    if (rtc_state.retry_backoff < LOW_RATE_RETRY_MAX_WAKES / 2) {
+        rtc_state.retry_backoff *= 2;
+    } else {
+        rtc_state.retry_backoff = LOW_RATE_RETRY_MAX_WAKES;
+    }
+    ESP_LOGW(TAG, "Upload failed, next attempt in %u wakes", rtc_state.retry_wait);
+}
+
+void low_power_enter_sleep(bool radio_used)
+{
+    int64_t now = wall_time_us();
+
+    // Energy per sample: awake period at active (or radio) current plus one
+    // sleep period. uA * us * mV = fJ, reported in uJ.
+    if (wake_time_us != 0) {
+        uint64_t awake_us = (uint64_t)(now - wake_time_us);
+        uint64_t active_ua = radio_used ? LOW_POWER_RADIO_UA : LOW_POWER_ACTIVE_UA;
+        uint64_t charge = active_ua * awake_us +
+                          (uint64_t)LOW_POWER_SLEEP_UA * LOW_RATE_SAMPLE_PERIOD_S * 1000000ULL;
+        uint32_t energy_uj = (uint32_t)(charge * LOW_POWER_BATTERY_MV / 1000000000ULL);
+
+        ESP_LOGI(TAG, "Wake %lu: wake-to-sample %lu us, awake %lu us, ~%lu uJ/sample%s",
+                 rtc_state.wake_count, wake_to_sample_us, (uint32_t)awake_us,
+                 energy_uj, radio_used ? " (upload)" : "");
+    }
+
+    // Keep every PCAP deselected while the select lines are unpowered
+    mux_deselect_chip();
+    gpio_hold_en(MUX_S0_PIN);
+    gpio_hold_en(MUX_S1_PIN);
+    gpio_hold_en(MUX_S2_PIN);
+    gpio_hold_en(MUX_S3_PIN);
+    gpio_deep_sleep_hold_en();
+
+    rtc_state.sleep_enter_us = wall_time_us();
+    esp_deep_sleep((uint64_t)LOW_RATE_SAMPLE_PERIOD_S * 1000000ULL);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file low_power.h
+ * @brief Deep-sleep duty cycling for low-rate logging deployments (ESP-IDF)
+ *
+ * In low-rate mode the MCU deep sleeps between acquisitions. The PCAP04
+ * chips stay powered and keep their firmware, configuration and CDC state,
+ * and the usable-chip mask plus calibration offsets are retained in RTC
+ * memory, so a wake only has to bring up SPI, read one sample, append it to
+ * an RTC-memory batch and go back to sleep. BLE is started only when the
+ * batch is due for upload. After an upload no central picked up, the next
+ * attempt waits LOW_RATE_RETRY_WAKES wakes, doubling up to
+ * LOW_RATE_RETRY_MAX_WAKES, while the ring keeps the newest samples.
+ */
+
+#ifndef LOW_POWER_H
+#define LOW_POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcap04_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup LowPowerConfig Low-Rate Mode Configuration
+ * @{
+ */
+#define LOW_RATE_SAMPLE_PERIOD_S    5       ///< Deep sleep between acquisitions
+#define LOW_RATE_BATCH_SAMPLES      12      ///< Samples retained in RTC memory
+#define LOW_RATE_UPLOAD_WINDOW_MS   8000    ///< How long BLE waits for a central per upload
+#define LOW_RATE_RETRY_WAKES        6       ///< Wakes after a failed upload before the next attempt
+#define LOW_RATE_RETRY_MAX_WAKES    96      ///< Longest wait between attempts, in wakes
+
+// Energy model used for the per-sample estimate
+#define LOW_POWER_BATTERY_MV        3700    ///< Nominal LiPo voltage
+#define LOW_POWER_ACTIVE_UA         25000   ///< CPU at 160 MHz, radio off
+#define LOW_POWER_RADIO_UA          80000   ///< CPU plus BLE radio active
+#define LOW_POWER_SLEEP_UA          5       ///< ESP32-C3 deep sleep (PCAP supply excluded)
+/** @} */
+
+/**
+ * @brief One retained acquisition
+ */
+typedef struct {
+    uint32_t seq;                                           ///< Acquisition number since the cold boot
+    uint32_t timestamp_s;                                   ///< Seconds since the cold boot
+    int32_t  delta[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];   ///< raw - offset counts
+} low_rate_sample_t;
+
+/**
+ * @brief Check whether this boot is a deep-sleep wake with valid retained state
+ * @return true if the minimal wake path can be used, false for a cold boot
+ */
+bool low_power_is_wake(void);
+
+/**
+ * @brief Retain the chip configuration result for subsequent wakes
+ * @param usable Per-chip usable flags from the communication test
+ * @param data   Per-chip data holding the calibration offsets
+ *
+ * Called once on cold boot after calibration. Resets the batch.
+ */
+void low_power_save_calibration(const bool usable[NUM_PCAP_CHIPS],
+                                const pcap_data_t data[NUM_PCAP_CHIPS]);
+
+/**
+ * @brief Restore the chip configuration result after a wake
+ * @param usable Receives per-chip usable flags
+ * @param data   Receives calibration offsets
+ */
+void low_power_restore_calibration(bool usable[NUM_PCAP_CHIPS],
+                                   pcap_data_t data[NUM_PCAP_CHIPS]);
+
+/**
+ * @brief Append the current acquisition to the RTC-memory batch
+ * @param usable Per-chip usable flags
+ * @param data   Per-chip data with fresh raw values
+ * @return true if the batch is due for upload: full, and not waiting out
+ *         the backoff of a failed upload
+ *
+ * Also records the wake-to-sample time. When the batch is full the oldest
+ * sample is overwritten; the sequence numbers show the gap.
+ */
+bool low_power_append_sample(const bool usable[NUM_PCAP_CHIPS],
+                             const pcap_data_t data[NUM_PCAP_CHIPS]);
+
+/**
+ * @brief Number of samples currently held in the batch
+ */
+uint16_t low_power_batch_count(void);
+
+/**
+ * @brief Get a batched sample, oldest first
+ * @param index Sample index (0 .. low_power_batch_count() - 1)
+ * @return Pointer to the sample, or NULL if index is out of range
+ */
+const low_rate_sample_t* low_power_batch_get(uint16_t index);
+
+/**
+ * @brief Discard all batched samples after a successful upload
+ *
+ * Also ends any retry backoff.
+ */
+void low_power_batch_clear(void);
+
+/**
+ * @brief Keep the batch after a failed upload and back off the next attempt
+ */
+void low_power_upload_failed(void);
+
+/**
+ * @brief Report timing and energy for this wake and enter deep sleep
+ * @param radio_used true if BLE was brought up during this wake
+ *
+ * Holds the mux select lines at "no chip" through sleep so the PCAP bus
+ * stays idle. Does not return.
+ */
+void low_power_enter_sleep(bool radio_used);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOW_POWER_H
@@ -9,20 +9,41 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_chip_info.h"
 #include "esp_flash.h"
 #include "esp_task_wdt.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 
 #include "pcap_driver.h"
 #include "battery_manager.h"
 #include "nn_inference.h"
 #include "ble_manager.h"
+#include "heap_monitor.h"
+#include "low_power.h"
+#include "power_governor.h"
+#include "stage_profiler.h"
+#include "serial_stream.h"
+#include "tlog.h"
+#include "gesture.h"
+#include "capacity_planner.h"
+#include "latency_probe.h"
+#include "history_store.h"
+#include "signal_fixed.h"
+#include "demand.h"
+#include "replay_input.h"
+#include "pcap_async.h"
+#include "retained_state.h"
+#include "ota_delta.h"
+#include "sample_profiler.h"
 
 // Add battery header if available
 // #include "battery.h"  // Uncomment when battery.h exists
@@ -37,6 +58,81 @@ static const char* TAG = "MAIN";
 // The host sends '\n' as a nudge; the MCU replies "OK\n" then starts.
 #define HANDSHAKE_MODE 0
 
+// Set to 1 for low-rate logging: deep sleep between acquisitions, batch
+// samples in RTC memory and bring up BLE only to upload the batch.
+#define LOW_RATE_MODE 0
+
+// Set to 1 to run the battery-aware performance governor. Needs the battery
+// ADC, which shares GPIO4 with MUX_S1 on the old board revision.
+#define POWER_GOVERNOR_MODE 0
+
+// Set to 1 to print per-stage cost profiles ("P,..." lines) on serial.
+// Always on in QEMU builds, where profiles are in instructions.
+#define STAGE_PROFILE_MODE PCAP_QEMU_BUILD
+
+// Set to 1 to take statistical CPU profiles on request (BLE_CTRL_PROFILE):
+// sampled PCs go out on serial for tools/profiler/sample_profile.py. QEMU
+// builds always have it and take one capture at startup.
+#define SAMPLE_PROFILE_MODE PCAP_QEMU_BUILD
+
+// Set to 1 for HMI deployments: classify gestures on the device and send
+// only gesture events ("E,..." on serial, GESTURE_OP_CODE packets on BLE)
+// instead of every frame.
+#define GESTURE_MODE 0
+
+// Set to 1 to follow each data frame with its latency record ("L,..." on
+// serial, LATENCY_OP_CODE packets on BLE) for tools/latency/latency_report.py.
+#define LATENCY_PROBE_MODE 0
+
+// Set to 1 to split the output into two streams keyed by frame sequence
+// number: offset-corrected values right after acquisition ("S,..." on serial,
+// FRAME_OP_CODE plus the usual chip packets on BLE), and NN-compensated
+// values from a lower-priority task ("C,..." / COMPENSATED_OP_CODE).
+#define DUAL_STREAM_MODE 0
+
+// Set to 1 to time the fixed-point signal stages (q_format.h) against
+// their soft-float versions at startup. Costs are cycles, or instructions in QEMU.
+#define Q_FORMAT_BENCH_MODE 0
+
+// Set to 1 for hardware-in-the-loop replay: frames come from a capture the
+// host streams on serial ("I,..." lines, tools/replay/hil_replay.py) instead
+// of the chips, and run through the unchanged pipeline at the configured rate.
+#define REPLAY_MODE 0
+
+// Set to 1 to bring the chips up concurrently with the asynchronous driver
+// (pcap_async.h): one chip's settle waits overlap the others' uploads.
+#define ASYNC_BRINGUP_MODE 0
+
+// Set to 1 to sample all chips at the same instant: each frame starts one
+// conversion on every chip back to back, then reads after the conversion time.
+#define TRIGGERED_MODE 0
+
+// Set to 1 to keep the offsets, NN windows and compensation state across
+// panics and watchdog resets (retained_state.h), so compensation resumes on
+// the first frame after the reboot. Only where the sensor task runs the
+// whole pipeline on its own acquisitions.
+#define RETAINED_STATE_MODE (!DUAL_STREAM_MODE && !REPLAY_MODE && !LOW_RATE_MODE)
+
+#if POWER_GOVERNOR_MODE && OLD_PCAP_BOARD
+#error "POWER_GOVERNOR_MODE needs the battery ADC, which conflicts with MUX_S1 on the old board"
+#endif
+
+#if LATENCY_PROBE_MODE && GESTURE_MODE
+#error "LATENCY_PROBE_MODE measures data frames, which GESTURE_MODE does not send"
+#endif
+
+#if DUAL_STREAM_MODE && (GESTURE_MODE || LATENCY_PROBE_MODE)
+#error "DUAL_STREAM_MODE sends data frames and measures each stream's latency itself"
+#endif
+
+#if REPLAY_MODE && LOW_RATE_MODE
+#error "REPLAY_MODE needs the serial host, which LOW_RATE_MODE sleeps away from"
+#endif
+
+#if TRIGGERED_MODE && (LOW_RATE_MODE || REPLAY_MODE)
+#error "TRIGGERED_MODE starts the chips' conversions from the sensor task's frames"
+#endif
+
 // Storage for sensor data from all chips
 static pcap_data_t chip_data[NUM_PCAP_CHIPS];
 
@@ -46,6 +142,60 @@ static bool pcap_usable[NUM_PCAP_CHIPS];
 // Number of communication attempts before marking a chip as unusable
 #define PCAP_COMM_RETRY_MAX 5
 
+// Start command to results ready in triggered mode, for standard_config
+// (10 averages of 6 ports), with margin
+#define TRIGGER_CONVERSION_US 2500
+
+// Frames processed before the pipeline is declared steady (1 s at 100Hz).
+// Lazy one-time allocations (stdio buffers, NimBLE host) happen before this.
+#define STEADY_STATE_FRAMES 100
+
+// Largest magnitude printed on the CSV path; keeps value * 10000 within int32
+#define SERIAL_VALUE_LIMIT 200000.0f
+
+// Pipeline settings requested over BLE (BLE_CTRL_SET_CONFIG), after
+// admission control. The governor owns them in POWER_GOVERNOR_MODE.
+static volatile uint16_t sample_period_ms = 10;   // 100Hz
+static uint8_t nn_divider = 1;
+static ble_encoding_t data_encoding = BLE_ENCODING_FLOAT32;
+
+// Where NN compensation runs, switched with BLE_CTRL_SET_COMPENSATION. With
+// the host compensating, serial carries raw readings ("R,..." lines) for
+// tools/nn/host_compensator.py and the device skips the NN. BLE data is the
+// calibrated, uncompensated value either way.
+static volatile bool offload_requested = false;
+static volatile bool offload_header_due = false;
+static int64_t sample_time_us[NUM_PCAP_CHIPS];     // When each chip was read
+
+// Flight recorder: the last HISTORY_DEPTH samples of every channel, read
+// from the shared history store. BLE_CTRL_DUMP_HISTORY prints what was
+// recorded since the previous dump.
+static history_view_t recorder_view = {
+    .name = "recorder",
+    .length = HISTORY_DEPTH,
+    .format = HISTORY_FORMAT_RAW,
+};
+static volatile bool history_dump_due = false;
+
+// Channels each consumer subscribes at startup; BLE_CTRL_SUBSCRIBE narrows
+// them at run time. The sensor task reads, records and compensates only what
+// the current demand plan asks for (demand.h).
+static void demand_subscribe_defaults(void)
+{
+    demand_init();
+#if GESTURE_MODE
+    // Gestures go out as events; the chip streams are not sent
+    demand_subscribe(DEMAND_CONSUMER_GESTURE, DEMAND_COMPENSATED, DEMAND_ALL_CHANNELS);
+#else
+    demand_subscribe(DEMAND_CONSUMER_SERIAL, DEMAND_COMPENSATED, DEMAND_ALL_CHANNELS);
+    demand_subscribe(DEMAND_CONSUMER_BLE, DEMAND_CALIBRATED, DEMAND_ALL_CHANNELS);
+#endif
+    demand_subscribe(DEMAND_CONSUMER_RECORDER, DEMAND_HISTORY, DEMAND_ALL_CHANNELS);
+}
+
+// Frames between repeats of the offload header, so a host can join mid-stream
+#define OFFLOAD_HEADER_FRAMES 1000
+
 // Battery monitoring configuration
 #define BATTERY_UPDATE_INTERVAL_MS 5000  // Update every 5 seconds
 
@@ -129,10 +279,21 @@ static const uint8_t standard_firmware[PCAP_FW_SIZE] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
 
+// Where a control command came from; replies go back the same way
+typedef enum {
+    CTRL_ORIGIN_BLE,
+    CTRL_ORIGIN_SERIAL,
+} ctrl_origin_t;
+
 // Function declarations
 static void print_diagnostics(void);
 static void sensor_task(void *pvParameters);
 static void battery_task(void *pvParameters);
+static void handle_control(const uint8_t* data, uint16_t len, ctrl_origin_t origin);
+static void control_reply(ctrl_origin_t origin, const char* reply);
+#if LOW_RATE_MODE
+static void low_rate_wake_cycle(void);
+#endif
 
 #if HANDSHAKE_MODE
 /**
@@ -157,6 +318,25 @@ static void wait_for_handshake(void)
 }
 #endif
 
+/**
+ * @brief Restore offsets retained from before a soft reset
+ * @return true if they replace calibration
+ */
+static bool restore_calibration(void)
+{
+#if RETAINED_STATE_MODE
+    uint8_t usable_mask = 0;
+    for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+        if (pcap_usable[pcap_num]) {
+            usable_mask |= 1u << pcap_num;
+        }
+    }
+    return retained_state_check(usable_mask, chip_data);
+#else
+    return false;
+#endif
+}
+
 static void print_diagnostics(void)
 {
     esp_chip_info_t chip_info;
@@ -176,6 +356,8 @@ static void print_diagnostics(void)
 
     ESP_LOGI(TAG, "Free heap: %lu bytes", esp_get_free_heap_size());
     ESP_LOGI(TAG, "Minimum free heap: %lu bytes", esp_get_minimum_free_heap_size());
+    ESP_LOGI(TAG, "Largest free block: %lu bytes",
+             (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
 
     ESP_LOGI(TAG, "--- Pin Configuration ---");
     ESP_LOGI(TAG, "MUX_S0_PIN: GPIO %d", MUX_S0_PIN);
@@ -189,29 +371,507 @@ static void print_diagnostics(void)
     ESP_LOGI(TAG, "Number of PCAP chips: %d", NUM_PCAP_CHIPS);
     ESP_LOGI(TAG, "Sensors per chip: %d", NUM_SENSORS_PER_CHIP);
     ESP_LOGI(TAG, "NN inference ready: %s", nn_is_ready() ? "YES" : "NO");
+    history_report_ram();
+#if TOKEN_LOG_MODE
+    tlog_report_cost();
+#endif
     ESP_LOGI(TAG, "========================================");
 }
 
+// Line buffer for the CSV serial path. Lines are formatted by hand so the
+// per-frame path never reaches newlib's float printf and its dtoa scratch
+// allocations.
+static char serial_line[16 + NUM_SENSORS_PER_CHIP * 16];
+
+static char* append_uint(char* p, uint32_t value)
+{
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + (value % 10));
+        value /= 10;
+    } while (value != 0);
+    while (n > 0) {
+        *p++ = digits[--n];
+    }
+    return p;
+}
+
+// Append value with four decimals, equivalent to printf("%.4f")
+static char* append_fixed4(char* p, float value)
+{
+    if (value > SERIAL_VALUE_LIMIT) value = SERIAL_VALUE_LIMIT;
+    if (value < -SERIAL_VALUE_LIMIT) value = -SERIAL_VALUE_LIMIT;
+
+    int32_t scaled = (int32_t)lroundf(value * 10000.0f);
+    if (scaled < 0) {
+        *p++ = '-';
+        scaled = -scaled;
+    }
+
+    p = append_uint(p, (uint32_t)scaled / 10000);
+    *p++ = '.';
+
+    uint32_t frac = (uint32_t)scaled % 10000;
+    p[0] = (char)('0' + frac / 1000);
+    p[1] = (char)('0' + (frac / 100) % 10);
+    p[2] = (char)('0' + (frac / 10) % 10);
+    p[3] = (char)('0' + frac % 10);
+    return p + 4;
+}
+
 /**
  * @brief Send chip sensor data to serial in place of BLE (Serial mode).
  *
  * Format: "D,<chip>,<s0>,<s1>,<s2>,<s3>,<s4>,<s5>\n"
  * Mirrors the same 20Hz cadence as the BLE send path.
  */
-static void serial_send_chip_data(uint8_t chip_num, pcap_data_t* data)
+static void serial_send_chip_data(uint8_t chip_num, const pcap_data_t* data)
 {
-    printf("D,%d", chip_num);
+    char* p = serial_line;
+    *p++ = 'D';
+    *p++ = ',';
+    p = append_uint(p, chip_num);
+
     for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
-        if(!nn_is_ready()) {
-            data->final_val[i] = (PCAP_SCALING_NUM * (float)(data->raw[i] - data->offset[i])/PCAP_CONVERSION_NUMBER);
+        *p++ = ',';
+        p = append_fixed4(p, data->final_val[i]);
+    }
+    *p++ = '\n';
+    latency_lap(LATENCY_STAGE_ENCODE);
+
+    serial_stream_write_line(serial_line, p - serial_line);
+    latency_lap(LATENCY_STAGE_HANDOFF);
+}
+
+static char* append_hex8(char* p, uint32_t value)
+{
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        *p++ = "0123456789abcdef"[(value >> shift) & 0xF];
+    }
+    return p;
+}
+
+static uint32_t float_bits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/**
+ * @brief Send what a host needs to compensate the raw stream, when due
+ *
+ * Due after a switch to host compensation, after a divider change (including
+ * a governor tier change) and every OFFLOAD_HEADER_FRAMES frames after that.
+ *
+ * Format: "F,<fingerprint>,<nn_divider>\n", then per usable chip
+ * "O,<chip>,<offset0>..<offset5>\n" with offsets as float bits in hex.
+ * The fingerprint covers model, feature configuration and scaler
+ * (nn_get_fingerprint()); a host running anything else must not compensate.
+ */
+static void serial_send_offload_header(void)
+{
+    static uint32_t frames = 0;
+#if POWER_GOVERNOR_MODE
+    // The governor changes the divider on its own; the host follows at once
+    static uint8_t sent_tier = UINT8_MAX;
+    uint8_t tier = governor_get_tier_index();
+    if (tier != sent_tier) {
+        offload_header_due = true;
+    }
+#endif
+    if (!offload_header_due && ++frames < OFFLOAD_HEADER_FRAMES) {
+        return;
+    }
+    offload_header_due = false;
+    frames = 0;
+
+#if POWER_GOVERNOR_MODE
+    sent_tier = tier;
+    uint8_t divider = governor_get_tier()->nn_refresh_divider;
+#else
+    uint8_t divider = nn_divider;
+#endif
+    serial_stream_printf("F,%08lx,%u\n", nn_get_fingerprint(), divider);
+
+    for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+        if (!pcap_usable[pcap_num]) continue;
+        char* p = serial_line;
+        *p++ = 'O';
+        *p++ = ',';
+        p = append_uint(p, pcap_num);
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            *p++ = ',';
+            p = append_hex8(p, float_bits(chip_data[pcap_num].offset[i]));
         }
+        *p++ = '\n';
+        serial_stream_write_line(serial_line, p - serial_line);
+    }
+}
+
+/**
+ * @brief Send one chip's raw readings for host compensation
+ *
+ * Format: "R,<chip>,<t_us>,<raw0>..<raw5>\n", raw values as float bits in
+ * hex so the host computes the NN input from exactly the same operands.
+ * t_us is the low 32 bits of the read time in microseconds.
+ */
+static void serial_send_chip_raw(uint8_t chip_num, const pcap_data_t* data)
+{
+    char* p = serial_line;
+    *p++ = 'R';
+    *p++ = ',';
+    p = append_uint(p, chip_num);
+    *p++ = ',';
+    p = append_uint(p, (uint32_t)sample_time_us[chip_num]);
 
-        float val = data->final_val[i];
-        printf(",%.4f", val);
+    for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+        *p++ = ',';
+        p = append_hex8(p, float_bits(data->raw[i]));
     }
-    printf("\n");
+    *p++ = '\n';
+    latency_lap(LATENCY_STAGE_ENCODE);
+
+    serial_stream_write_line(serial_line, p - serial_line);
+    latency_lap(LATENCY_STAGE_HANDOFF);
+}
+
+#if DUAL_STREAM_MODE
+// A frame handed from the acquisition to the compensation task
+typedef struct {
+    uint16_t seq;
+    int64_t  t0_us;                             // Start of the first chip read
+    int64_t  read_us[NUM_PCAP_CHIPS];
+    uint8_t  chips;                             // Bit per chip read in this frame
+    pcap_data_t data[NUM_PCAP_CHIPS];
+} dual_frame_t;
+
+// Frames the compensation task may fall behind before frames are dropped
+#define DUAL_QUEUE_DEPTH 4
+
+// Acquisition-to-hand-off latency of one stream
+typedef struct {
+    uint64_t sum_us;
+    uint32_t count;
+    uint32_t max_us;
+} stream_latency_t;
+
+static QueueHandle_t dual_queue;
+static dual_frame_t dual_frame;                 // Being filled by the sensor task
+static stream_latency_t fast_latency;
+static stream_latency_t compensated_latency;
+static uint32_t dual_dropped = 0;
+static volatile uint64_t dual_compensate_cycles = 0;   // Compensation task, in prof_now() units
+
+static char comp_line[16 + NUM_SENSORS_PER_CHIP * 16];  // Line buffer of the compensation task
+
+static void stream_latency_add(stream_latency_t* lat, int64_t t0_us)
+{
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0_us);
+    lat->sum_us += us;
+    lat->count++;
+    if (us > lat->max_us) {
+        lat->max_us = us;
+    }
+}
+
+/**
+ * @brief Format one chip line of a dual stream
+ *
+ * Format: "<tag>,<seq>,<chip>,<s0>,<s1>,<s2>,<s3>,<s4>,<s5>\n"
+ */
+static void serial_send_stream(char* line, char tag, uint16_t seq, uint8_t chip_num,
+                               const float values[NUM_SENSORS_PER_CHIP])
+{
+    char* p = line;
+    *p++ = tag;
+    *p++ = ',';
+    p = append_uint(p, seq);
+    *p++ = ',';
+    p = append_uint(p, chip_num);
+    for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+        *p++ = ',';
+        p = append_fixed4(p, values[i]);
+    }
+    *p++ = '\n';
+    serial_stream_write_line(line, p - line);
 }
 
+/**
+ * @brief Send the fast stream of the current frame and queue it for compensation
+ *
+ * Serial: "Q,<seq>,<t0_us>\n", then "S,<seq>,<chip>,<s0>..<s5>\n" per chip
+ * with offset-corrected values. A full queue drops the frame from the
+ * compensated stream only.
+ */
+static void dual_send_fast(void)
+{
+    dual_frame_t* f = &dual_frame;
+
+    if (ble_is_data_subscribed()) {
+        ble_send_frame_marker(f->seq, (uint32_t)f->t0_us);
+        for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+            if (f->chips & (1u << pcap_num)) {
+                ble_send_chip_data(pcap_num, &f->data[pcap_num]);
+            }
+        }
+    } else {
+        serial_stream_printf("Q,%u,%lu\n", f->seq, (uint32_t)f->t0_us);
+        for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+            if (!(f->chips & (1u << pcap_num))) continue;
+            pcap_data_t* d = &f->data[pcap_num];
+            float calibrated[NUM_SENSORS_PER_CHIP];
+            for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+                calibrated[i] = (PCAP_SCALING_NUM * (float)(d->raw[i] - d->offset[i])/PCAP_CONVERSION_NUMBER);
+            }
+            serial_send_stream(serial_line, 'S', f->seq, pcap_num, calibrated);
+        }
+    }
+    stream_latency_add(&fast_latency, f->t0_us);
+
+    if (nn_is_ready() && xQueueSend(dual_queue, f, 0) != pdTRUE) {
+        dual_dropped++;
+    }
+}
+
+/**
+ * @brief Compensate queued frames and send the compensated stream
+ *
+ * Serial: "C,<seq>,<chip>,<s0>..<s5>\n" per chip. Runs below the sensor
+ * task, so compensation never delays acquisition or the fast stream.
+ */
+static void compensation_task(void *pvParameters)
+{
+    static dual_frame_t frame;
+
+    while (1) {
+        if (xQueueReceive(dual_queue, &frame, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        uint32_t t = prof_now();
+        for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+            if (frame.chips & (1u << pcap_num)) {
+                nn_compensate_chip_at(&frame.data[pcap_num], pcap_num, frame.read_us[pcap_num]);
+            }
+        }
+        dual_compensate_cycles += prof_now() - t;
+
+        for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+            if (!(frame.chips & (1u << pcap_num))) continue;
+            if (ble_is_data_subscribed()) {
+                ble_send_compensated(frame.seq, pcap_num, &frame.data[pcap_num]);
+            } else {
+                serial_send_stream(comp_line, 'C', frame.seq, pcap_num, frame.data[pcap_num].final_val);
+            }
+        }
+        stream_latency_add(&compensated_latency, frame.t0_us);
+    }
+}
+
+static void report_stream_latency(const char* name, stream_latency_t* lat)
+{
+    if (lat->count == 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "Stream %s: latency avg %lu us, max %lu us over %lu frames", name,
+             (uint32_t)(lat->sum_us / lat->count), lat->max_us, lat->count);
+    *lat = (stream_latency_t){0};
+}
+#endif
+
+#if LATENCY_PROBE_MODE
+/**
+ * @brief Send a frame's latency record over BLE or serial
+ *
+ * Serial format: "L,<seq>,<t0_us>,<acquire>,<compensate>,<wait>,<encode>,<handoff>\n"
+ * (stage times in us)
+ */
+static void send_latency(const latency_record_t* record)
+{
+    if (ble_is_data_subscribed()) {
+        ble_send_latency(record);
+        return;
+    }
+
+    char* p = serial_line;
+    *p++ = 'L';
+    *p++ = ',';
+    p = append_uint(p, record->seq);
+    *p++ = ',';
+    p = append_uint(p, record->t0_us);
+    for (int s = 0; s < LATENCY_STAGE_COUNT; s++) {
+        *p++ = ',';
+        p = append_uint(p, record->stage_us[s]);
+    }
+    *p++ = '\n';
+    serial_stream_write_line(serial_line, p - serial_line);
+}
+#endif
+
+/**
+ * @brief Print the flight recorder on serial
+ *
+ * Per usable channel: "H,<chip>,<sensor>,<count>,<mean>,<std>\n" with the
+ * samples recorded since the last dump and the running statistics, then
+ * the samples, oldest first, as "h,<v0>..<v7>\n" lines. Values are
+ * offset-corrected and uncompensated, as the NN sees them.
+ */
+static void dump_history(void)
+{
+    static float values[HISTORY_DEPTH];
+    char line[16 + 8 * 16];
+
+    for (int chip = FIRST_PCAP_ID; chip < NUM_PCAP_CHIPS; chip++) {
+        if (!pcap_usable[chip]) continue;
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            history_stats_t stats;
+            history_get_stats(chip, i, &stats);
+            uint16_t n = history_read_new(&recorder_view, chip, i, values, HISTORY_DEPTH);
+
+            char* p = line;
+            *p++ = 'H';
+            *p++ = ',';
+            p = append_uint(p, chip);
+            *p++ = ',';
+            p = append_uint(p, i);
+            *p++ = ',';
+            p = append_uint(p, n);
+            *p++ = ',';
+            p = append_fixed4(p, stats.mean);
+            *p++ = ',';
+            p = append_fixed4(p, sqrtf(stats.var));
+            *p++ = '\n';
+            serial_stream_write_line(line, p - line);
+
+            for (uint16_t k = 0; k < n; k += 8) {
+                p = line;
+                *p++ = 'h';
+                for (uint16_t j = k; j < n && j < k + 8; j++) {
+                    *p++ = ',';
+                    p = append_fixed4(p, values[j]);
+                }
+                *p++ = '\n';
+                serial_stream_write_line(line, p - line);
+            }
+        }
+    }
+}
+
+#if TRIGGERED_MODE
+// Triggered frames since the last report
+static struct {
+    uint32_t frames;
+    uint64_t skew_sum_us;
+    uint32_t skew_max_us;
+    uint32_t read_max_us;
+} trigger_stats;
+
+/**
+ * @brief Start and read this frame's chips together
+ *
+ * Only chips with raw demand are started, like the chips read in
+ * free-running mode.
+ */
+static void trigger_frame(const demand_plan_t* plan)
+{
+    uint8_t chips = 0;
+    for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+        if (pcap_usable[pcap_num] && demand_chip_sensors(plan, DEMAND_RAW, pcap_num) != 0) {
+            chips |= 1u << pcap_num;
+        }
+    }
+
+    pcap_trigger_timing_t timing = {0};
+    pcap_read_triggered(chips, TRIGGER_CONVERSION_US, chip_data, &timing);
+
+    trigger_stats.frames++;
+    trigger_stats.skew_sum_us += timing.skew_us;
+    if (timing.skew_us > trigger_stats.skew_max_us) {
+        trigger_stats.skew_max_us = timing.skew_us;
+    }
+    if (timing.read_us > trigger_stats.read_max_us) {
+        trigger_stats.read_max_us = timing.read_us;
+    }
+}
+
+/**
+ * @brief Log the start skew of triggered frames and the frame rate it allows
+ *
+ * A triggered frame is its start commands, the conversion and the result
+ * reads in sequence; their worst cases bound the frame rate.
+ */
+static void report_trigger(void)
+{
+    if (trigger_stats.frames == 0) {
+        return;
+    }
+    uint32_t frame_us = trigger_stats.skew_max_us + TRIGGER_CONVERSION_US + trigger_stats.read_max_us;
+    ESP_LOGI(TAG, "Triggered: start skew avg %lu us, max %lu us over %lu frames; reads max %lu us; max rate %lu Hz",
+             (uint32_t)(trigger_stats.skew_sum_us / trigger_stats.frames), trigger_stats.skew_max_us,
+             trigger_stats.frames, trigger_stats.read_max_us, 1000000UL / frame_us);
+    memset(&trigger_stats, 0, sizeof(trigger_stats));
+}
+#endif
+
+#if REPLAY_MODE
+static replay_frame_t replay_frame;
+
+/**
+ * @brief Report a finished replay and get ready for the next
+ *
+ * Prints the stage profile of the replayed frames ("P,..."), then
+ * "Y,<frames>,<underruns>,<dropped>,<malformed>\n".
+ */
+static void replay_report(void)
+{
+    replay_stats_t stats;
+    replay_input_get_stats(&stats);
+    prof_report();
+    serial_stream_printf("Y,%lu,%lu,%lu,%lu\n", stats.frames, stats.underruns,
+                         stats.dropped, stats.malformed);
+    // The next replay starts from empty windows, as this one did
+    nn_reset();
+}
+
+/**
+ * @brief Take the replayed frame for this acquisition frame
+ * @return true if there is one to run
+ *
+ * The capture decides which chips exist. New offsets restart the NN
+ * windows, whose inputs they shift. Acknowledges played frames with
+ * "A,<frames>\n" so the host can pace the stream.
+ */
+static bool replay_take_frame(void)
+{
+    replay_status_t status = replay_input_next(&replay_frame);
+    if (status == REPLAY_ENDED) {
+        replay_report();
+    }
+    if (status != REPLAY_FRAME) {
+        return false;
+    }
+
+    bool offsets_changed = false;
+    for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+        pcap_usable[pcap_num] = (replay_frame.chips & (1u << pcap_num)) != 0;
+        if (replay_input_take_offsets(pcap_num, chip_data[pcap_num].offset)) {
+            offsets_changed = true;
+        }
+    }
+    if (offsets_changed) {
+        nn_reset();
+    }
+
+    uint32_t acked = replay_input_ack_due();
+    if (acked != 0) {
+        serial_stream_printf("A,%lu\n", acked);
+    }
+    return true;
+}
+#endif
+
 /**
  * @brief Send battery percentage to serial in place of BLE (Serial mode).
  *
@@ -219,10 +879,47 @@ static void serial_send_chip_data(uint8_t chip_num, pcap_data_t* data)
  */
 static void serial_send_battery(uint8_t battery_pct)
 {
-    printf("B,%d\n", battery_pct);
+    serial_stream_printf("B,%d\n", battery_pct);
 }
 
-static void print_results(void)
+#if GESTURE_MODE
+// Calibrated values of all pads, the classifier's input frame
+static float gesture_frame[GESTURE_NUM_PADS];
+
+// Pads the classifier does not subscribe read as 0
+static void fill_gesture_frame(const demand_plan_t* plan)
+{
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        uint8_t sensors = pcap_usable[chip] ? demand_chip_sensors(plan, DEMAND_RAW, chip) : 0;
+        for (int sensor = 0; sensor < NUM_SENSORS_PER_CHIP; sensor++) {
+            gesture_frame[chip * NUM_SENSORS_PER_CHIP + sensor] =
+                (sensors & (1u << sensor)) ? chip_data[chip].final_val[sensor] : 0.0f;
+        }
+    }
+}
+
+/**
+ * @brief Send a gesture event over BLE or serial
+ *
+ * Serial format: "E,<type>,<x>,<y>,<duration_ms>,<latency_ms>\n"
+ */
+static void send_gesture(const gesture_event_t* event)
+{
+    if (ble_is_data_subscribed()) {
+        ble_send_gesture(event->type, event->x, event->y, event->duration_ms);
+    } else {
+#if DEBUG_MODE
+        printf("Gesture: %s at (%d, %d), %u ms\n", gesture_name(event->type),
+               event->x, event->y, event->duration_ms);
+#else
+        serial_stream_printf("E,%d,%d,%d,%u,%u\n", event->type, event->x, event->y,
+                             event->duration_ms, event->latency_ms);
+#endif
+    }
+}
+#endif
+
+static void print_results(const demand_plan_t* plan)
 {
     static int print_counter = 0;
     float value = 0;
@@ -239,17 +936,12 @@ static void print_results(void)
     printf("Chip | S0       | S1       | S2       | S3       | S4       | S5\n");
     printf("-----|----------|----------|----------|----------|----------|----------\n");
 
-    // Print data for each usable chip
+    // Print data for each subscribed chip (NN-compensated once the model is ready)
     for (int chip = FIRST_PCAP_ID; chip < NUM_PCAP_CHIPS; chip++) {
-        if (!pcap_usable[chip]) continue;
+        if (!pcap_usable[chip] || !demand_chip_sent(plan, DEMAND_CONSUMER_SERIAL, chip)) continue;
         printf("  %d  | ", chip + 1);
 
         for (int sensor = 0; sensor < NUM_SENSORS_PER_CHIP; sensor++) {
-            // Use NN-compensated value if available, otherwise raw-offset
-            if (!nn_is_ready()) {
-                chip_data[chip].final_val[sensor] = (PCAP_SCALING_NUM * (float)(chip_data[chip].raw[sensor] - chip_data[chip].offset[sensor])/PCAP_CONVERSION_NUMBER);            
-            }
-
             value = chip_data[chip].final_val[sensor];
             printf("%.2f | ", value);
         }
@@ -288,13 +980,27 @@ static void battery_task(void *pvParameters)
             // Read battery percentage
             uint8_t battery_pct = battery_get_percentage();
 
-            if (ble_is_connected()) {
+#if POWER_GOVERNOR_MODE
+            governor_update(battery_pct, battery_get_filtered_voltage());
+#endif
+
+            if (ble_is_data_subscribed()) {
                 ble_send_battery(battery_pct);
+#if POWER_GOVERNOR_MODE
+                char status[32];
+                snprintf(status, sizeof(status), "GOV,%d,%lu",
+                         governor_get_tier_index(), governor_get_predicted_runtime_min());
+                ble_send_status(status);
+#endif
             } else {
 #if DEBUG_MODE
                 printf("Battery: %d%%\n", battery_pct);
 #else
                 serial_send_battery(battery_pct);
+#if POWER_GOVERNOR_MODE
+                serial_stream_printf("G,%d,%lu\n", governor_get_tier_index(),
+                                     governor_get_predicted_runtime_min());
+#endif
 #endif
             }
         }
@@ -304,46 +1010,506 @@ static void battery_task(void *pvParameters)
     }
 }
 
+/**
+ * @brief Describe the configuration the pipeline is running
+ */
+static void active_config(capacity_config_t* cfg)
+{
+    uint8_t chips = 0;
+    for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+        if (pcap_usable[pcap_num]) chips++;
+    }
+
+    cfg->chips = chips;
+    cfg->connections = ble_get_link_info(&cfg->conn_itvl);
+#if POWER_GOVERNOR_MODE
+    const governor_tier_t* tier = governor_get_tier();
+    cfg->sample_period_ms = tier->sample_period_ms;
+    cfg->nn_refresh_divider = tier->nn_refresh_divider;
+    cfg->encoding = tier->encoding;
+    cfg->cpu_mhz = tier->cpu_mhz;
+#else
+    cfg->sample_period_ms = sample_period_ms;
+    cfg->nn_refresh_divider = nn_divider;
+    cfg->encoding = data_encoding;
+    cfg->cpu_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+#endif
+    cfg->nn_output_steps = nn_get_output_steps();
+    if (!nn_is_ready() || offload_requested) {
+        cfg->nn_refresh_divider = 0;
+    }
+}
+
+/**
+ * @brief Admit and apply a configuration requested over BLE or serial
+ *
+ * Replies with "CAP,<verdict>,<period_ms>,<nn_divider>,<encoding>,<cpu%>,<bus%>,<link%>"
+ * on the channel the request came in on.
+ */
+static void request_config(const uint8_t* data, uint16_t len, ctrl_origin_t origin)
+{
+#if POWER_GOVERNOR_MODE
+    ESP_LOGW(TAG, "Configuration requests are ignored while the governor runs");
+#else
+    if (len < 6 || data[4] >= BLE_ENCODING_COUNT) {
+        ESP_LOGW(TAG, "Malformed configuration request");
+        return;
+    }
+
+    capacity_config_t request;
+    capacity_config_t granted;
+    capacity_util_t util;
+    active_config(&request);
+    request.sample_period_ms = (uint16_t)(data[1] | (data[2] << 8));
+    request.nn_refresh_divider = nn_is_ready() ? data[3] : 0;
+    request.encoding = (ble_encoding_t)data[4];
+    if (request.sample_period_ms == 0) {
+        ESP_LOGW(TAG, "Malformed configuration request");
+        return;
+    }
+    // sensor_task waits whole ticks: admit the period it will actually run
+    // at, rounded up so the load can only fall
+    uint32_t period_ticks = (request.sample_period_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+    if (period_ticks * portTICK_PERIOD_MS > UINT16_MAX) {
+        period_ticks = UINT16_MAX / portTICK_PERIOD_MS;
+    }
+    request.sample_period_ms = (uint16_t)(period_ticks * portTICK_PERIOD_MS);
+    // Whoever asks is about to receive the data
+    if (request.connections == 0) {
+        request.connections = 1;
+    }
+
+    capacity_verdict_t verdict = capacity_admit(&request, (data[5] & BLE_CTRL_CONFIG_DOWNGRADE) != 0,
+                                                &granted, &util);
+    ESP_LOGI(TAG, "Config %u ms, NN 1/%u, enc %d: %s, cpu %u%% bus %u%% link %u%%",
+             request.sample_period_ms, request.nn_refresh_divider, request.encoding,
+             capacity_verdict_name(verdict), util.cpu_pct, util.bus_pct, util.link_pct);
+
+    if (verdict != CAPACITY_REJECT) {
+        nn_divider = nn_is_ready() ? granted.nn_refresh_divider : data[3];
+        data_encoding = granted.encoding;
+        nn_set_refresh_divider(nn_divider);
+        offload_header_due = offload_requested;     // The host follows the divider
+        ble_set_encoding(data_encoding);
+        sample_period_ms = granted.sample_period_ms;
+    } else {
+        active_config(&granted);
+    }
+
+    char status[48];
+    snprintf(status, sizeof(status), "CAP,%d,%u,%u,%d,%u,%u,%u", verdict,
+             granted.sample_period_ms, granted.nn_refresh_divider, granted.encoding,
+             util.cpu_pct, util.bus_pct, util.link_pct);
+    control_reply(origin, status);
+#endif
+}
+
+/**
+ * @brief Log predicted against measured utilization and refine the model
+ *
+ * Measurements cover the time since the previous call.
+ */
+static void report_capacity(void)
+{
+    static uint64_t prev_stage[PROF_STAGE_COUNT];
+    static uint32_t prev_frames = 0;
+    static uint64_t prev_bus_us = 0;
+    static uint32_t prev_sent = 0;
+    static uint32_t prev_congested = 0;
+    static TickType_t prev_tick = 0;
+
+    static uint64_t prev_deferred = 0;
+    static uint32_t prev_invokes = 0;
+
+    uint64_t stage[PROF_STAGE_COUNT];
+    uint32_t frames = prof_get_totals(stage);
+#if DUAL_STREAM_MODE
+    uint64_t deferred = dual_compensate_cycles;     // Spent in the compensation task
+#else
+    uint64_t deferred = 0;
+#endif
+    uint64_t bus_us = bus_sched_busy_us();
+    uint32_t invokes = nn_get_inference_count();
+    uint32_t sent, congested;
+    ble_get_notify_totals(&sent, &congested);
+    TickType_t now = xTaskGetTickCount();
+
+    capacity_sample_t sample = {
+        .elapsed_ms = pdTICKS_TO_MS(now - prev_tick),
+        .frames = frames - prev_frames,
+        .acquire_cycles = stage[PROF_STAGE_ACQUIRE] - prev_stage[PROF_STAGE_ACQUIRE],
+        .compensate_cycles = stage[PROF_STAGE_COMPENSATE] - prev_stage[PROF_STAGE_COMPENSATE] +
+                             deferred - prev_deferred,
+        .transmit_cycles = stage[PROF_STAGE_TRANSMIT] - prev_stage[PROF_STAGE_TRANSMIT],
+        .other_cycles = stage[PROF_STAGE_CLASSIFY] - prev_stage[PROF_STAGE_CLASSIFY],
+        .bus_busy_us = bus_us - prev_bus_us,
+        .notifications = sent - prev_sent,
+        .congested = congested - prev_congested,
+        .nn_invokes = invokes - prev_invokes,
+    };
+    for (int s = 0; s < PROF_STAGE_COUNT; s++) {
+        prev_stage[s] = stage[s];
+    }
+    prev_frames = frames;
+    prev_deferred = deferred;
+    prev_invokes = invokes;
+    prev_bus_us = bus_us;
+    prev_sent = sent;
+    prev_congested = congested;
+    prev_tick = now;
+
+    capacity_config_t cfg;
+    capacity_util_t predicted;
+    capacity_util_t measured;
+    active_config(&cfg);
+    capacity_predict(&cfg, &predicted);
+    capacity_observe(&cfg, &sample, &measured);
+
+    ESP_LOGI(TAG, "Capacity predicted: cpu %u%% bus %u%% link %u%%; measured: cpu %u%% bus %u%% link %u%%, rate %u%%",
+             predicted.cpu_pct, predicted.bus_pct, predicted.link_pct,
+             measured.cpu_pct, measured.bus_pct, measured.link_pct, measured.rate_pct);
+    ESP_LOGI(TAG, "Compensation on %s: cpu headroom %d%%, fastest period %u ms",
+             offload_requested ? "host" : "device",
+             CAPACITY_LIMIT_CPU_PCT - (int)measured.cpu_pct, capacity_min_period_ms(&cfg));
+}
+
+/**
+ * @brief Read control commands from the serial host
+ *
+ * A line "K,<b0>,<b1>,..." carries, in decimal, the same bytes as a write to
+ * the BLE control characteristic, so a host on serial can switch
+ * compensation or request a configuration. In REPLAY_MODE it also takes the
+ * replayed capture ("I,..." lines, replay_input.h).
+ */
+static void serial_control_task(void *pvParameters)
+{
+    char line[80];
+    size_t n = 0;
+
+    while (1) {
+        int c = getchar();
+        if (c == EOF) {
+            vTaskDelay(pdMS_TO_TICKS(20));
+            continue;
+        }
+        if (c != '\n' && c != '\r') {
+            if (n < sizeof(line) - 1) {
+                line[n++] = (char)c;
+            }
+            continue;
+        }
+        line[n] = '\0';
+        n = 0;
+#if REPLAY_MODE
+        if (replay_input_line(line)) {
+            continue;
+        }
+#endif
+        if (line[0] != 'K' || line[1] != ',') {
+            continue;
+        }
+
+        uint8_t cmd[12];
+        uint16_t len = 0;
+        char* p = &line[1];
+        while (*p == ',' && len < sizeof(cmd)) {
+            cmd[len++] = (uint8_t)strtoul(p + 1, &p, 10);
+        }
+        handle_control(cmd, len, CTRL_ORIGIN_SERIAL);
+    }
+}
+
+// Answer a control command on the channel it came in on
+static void control_reply(ctrl_origin_t origin, const char* reply)
+{
+    if (origin == CTRL_ORIGIN_BLE) {
+        ble_send_status(reply);
+    } else {
+        serial_stream_printf("%s\n", reply);
+    }
+}
+
+/**
+ * @brief Handle a control command, from the BLE control characteristic or a serial "K," line
+ *
+ * Runs in the NimBLE host task or the serial control task, so commands only
+ * update settings.
+ */
+static void handle_control(const uint8_t* data, uint16_t len, ctrl_origin_t origin)
+{
+    // Arrival of the command, for time sync replies
+    uint32_t rx_us = (uint32_t)esp_timer_get_time();
+
+    switch (data[0]) {
+    case BLE_CTRL_SET_SESSION_TARGET:
+        if (len >= 3) {
+#if POWER_GOVERNOR_MODE
+            governor_set_target_minutes((uint32_t)data[1] | ((uint32_t)data[2] << 8));
+#endif
+        }
+        break;
+
+    case BLE_CTRL_SET_CONFIG:
+        request_config(data, len, origin);
+        break;
+
+    case BLE_CTRL_TIME_PING:
+        // Answered to the asker, for host clock mapping
+        if (len >= 2) {
+            char reply[24];
+            snprintf(reply, sizeof(reply), "T,%u,%lu", data[1], (uint32_t)esp_timer_get_time());
+            control_reply(origin, reply);
+        }
+        break;
+
+    case BLE_CTRL_TIME_SYNC:
+        // NTP-style: the host takes out the time between arrival and reply
+        if (len >= 2) {
+            char reply[32];
+            snprintf(reply, sizeof(reply), "U,%u,%lu,%lu", data[1], rx_us, (uint32_t)esp_timer_get_time());
+            control_reply(origin, reply);
+        }
+        break;
+
+    case BLE_CTRL_SET_COMPENSATION:
+#if DUAL_STREAM_MODE
+        ESP_LOGW(TAG, "Compensation stays on the device in dual-stream mode");
+        break;
+#endif
+        // Applied by the sensor task at the next frame
+        if (len >= 2) {
+            offload_requested = (data[1] == BLE_COMPENSATION_HOST);
+            offload_header_due = offload_requested;
+            ESP_LOGI(TAG, "Compensation on %s", offload_requested ? "host" : "device");
+        }
+        break;
+
+    case BLE_CTRL_DUMP_HISTORY:
+        // Printed by the main task, away from NimBLE and acquisition
+        history_dump_due = true;
+        break;
+
+    case BLE_CTRL_SUBSCRIBE:
+        // Takes effect at the next frame's plan
+        if (len >= 9 && data[1] < DEMAND_CONSUMER_COUNT && data[2] < DEMAND_REPR_COUNT) {
+            uint64_t channels = 0;
+            for (int b = 0; b < 6; b++) {
+                channels |= (uint64_t)data[3 + b] << (8 * b);
+            }
+            demand_subscribe((demand_consumer_t)data[1], (demand_repr_t)data[2], channels);
+            ESP_LOGI(TAG, "Consumer %u subscribes repr %u on %012llx", data[1], data[2],
+                     (unsigned long long)(channels & DEMAND_ALL_CHANNELS));
+        } else {
+            ESP_LOGW(TAG, "Malformed subscription");
+        }
+        break;
+
+    case BLE_CTRL_OTA_BEGIN:
+        // The update task takes the patch from here; acquisition carries on
+        if (len >= 5) {
+            ota_delta_begin((uint32_t)data[1] | ((uint32_t)data[2] << 8) |
+                            ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 24));
+        }
+        break;
+
+    case BLE_CTRL_OTA_ABORT:
+        ota_delta_abort();
+        break;
+
+    case BLE_CTRL_PROFILE:
+#if SAMPLE_PROFILE_MODE
+        // Rate and sample count are optional; printed by the main task when full
+        sprof_start(len >= 3 ? (uint32_t)data[1] | ((uint32_t)data[2] << 8) : 0,
+                    len >= 5 ? (uint16_t)(data[3] | (data[4] << 8)) : 0);
+#else
+        ESP_LOGW(TAG, "Sampling profiler not built (SAMPLE_PROFILE_MODE)");
+#endif
+        break;
+
+    default:
+        ESP_LOGW(TAG, "Unknown control opcode 0x%02X", data[0]);
+        break;
+    }
+}
+
+#if !PCAP_QEMU_BUILD
+// ble_control_handler_t for the control characteristic
+static void handle_ble_control(const uint8_t* data, uint16_t len)
+{
+    handle_control(data, len, CTRL_ORIGIN_BLE);
+}
+#endif
+
 static void sensor_task(void *pvParameters)
 {
     TickType_t last_measurement = 0;
-    const TickType_t measurement_period = pdMS_TO_TICKS(10);   // 100Hz
+    TickType_t measurement_period = pdMS_TO_TICKS(sample_period_ms);
+    TickType_t bus_period = 0;
+    uint32_t frame_count = 0;
+    bool offloaded = false;
+    demand_plan_t plan;
+    uint64_t history_channels = 0;
 
     ESP_LOGI(TAG, "Sensor task started");
 
     while (1) {
         TickType_t current_time = xTaskGetTickCount();
 
+#if POWER_GOVERNOR_MODE
+        measurement_period = pdMS_TO_TICKS(governor_get_tier()->sample_period_ms);
+#else
+        measurement_period = pdMS_TO_TICKS(sample_period_ms);
+#endif
+        if (measurement_period != bus_period) {
+            // Background bus work is fitted between acquisition frames
+            bus_period = measurement_period;
+            bus_sched_set_frame_period(pdTICKS_TO_MS(bus_period) * 1000);
+        }
+
         // Take measurement every 10ms (100Hz)
-        if ((current_time - last_measurement) >= measurement_period) {
+        bool frame_due = (current_time - last_measurement) >= measurement_period;
+#if REPLAY_MODE
+        // Without a replayed frame there is nothing to run; wait below and retry
+        frame_due = frame_due && replay_take_frame();
+#endif
+        if (frame_due) {
             last_measurement = current_time;
 
+#if RETAINED_STATE_MODE
+            int64_t frame_us = esp_timer_get_time();
+            uint32_t period_us = pdTICKS_TO_MS(measurement_period) * 1000;
+            if (frame_count == 0) {
+                // Windows kept across a soft reset, before the plan can reset them
+                retained_state_resume(frame_us, period_us, &history_channels);
+            }
+#endif
+
+            if (offloaded != offload_requested) {
+                // The host compensates from raw readings
+                offloaded = offload_requested;
+                demand_subscribe(DEMAND_CONSUMER_SERIAL, offloaded ? DEMAND_RAW : DEMAND_COMPENSATED,
+                                 demand_get_subscription(DEMAND_CONSUMER_SERIAL, NULL));
+            }
+
+            // Output goes to BLE while a central takes sensor data, else serial
+            bool subscribed = ble_is_data_subscribed();
+            demand_enable(DEMAND_CONSUMER_BLE, subscribed);
+            demand_enable(DEMAND_CONSUMER_SERIAL, !subscribed);
+            if (demand_get_plan(&plan)) {
+                if (plan.channels[DEMAND_HISTORY] & ~history_channels) {
+                    // New channels' windows have gaps; refill them
+                    nn_reset();
+                }
+                history_channels = plan.channels[DEMAND_HISTORY];
+            }
+
             // Read results from each usable chip
+#if LATENCY_PROBE_MODE
+            latency_frame_start();
+#endif
+#if DUAL_STREAM_MODE
+            dual_frame.seq++;
+            dual_frame.t0_us = esp_timer_get_time();
+            dual_frame.chips = 0;
+#endif
+            uint8_t usable_chips = 0;
+            uint8_t sendable_chips = 0;
+            uint8_t sent_chips = 0;
+            uint32_t t = prof_now();
+#if TRIGGERED_MODE
+            trigger_frame(&plan);
+            t = prof_lap(PROF_STAGE_ACQUIRE, t);
+#endif
             for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
                 if (!pcap_usable[pcap_num]) continue;
+                usable_chips |= 1u << pcap_num;
+                if (demand_chip_sensors(&plan, DEMAND_RAW, pcap_num) == 0) continue;
+#if REPLAY_MODE
+                memcpy(chip_data[pcap_num].raw, replay_frame.raw[pcap_num], sizeof(chip_data[pcap_num].raw));
+#elif !TRIGGERED_MODE
                 pcap_read_data((pcap_chip_select_t)pcap_num, &chip_data[pcap_num]);
-
-                // Apply NN-based hysteresis compensation
-                if (nn_is_ready()) {
-                    nn_compensate_chip(&chip_data[pcap_num], pcap_num);
-                }
+#endif
+                t = prof_lap(PROF_STAGE_ACQUIRE, t);
+                latency_lap(LATENCY_STAGE_ACQUIRE);
+#if DUAL_STREAM_MODE
+                // Compensation is deferred to compensation_task
+                dual_frame.read_us[pcap_num] = esp_timer_get_time();
+                dual_frame.data[pcap_num] = chip_data[pcap_num];
+                dual_frame.chips |= 1u << pcap_num;
+#else
+                // Record and apply NN-based hysteresis compensation where
+                // demanded (a pass-through until the model is ready)
+                sample_time_us[pcap_num] = esp_timer_get_time();
+                nn_compensate_chip_masked(&chip_data[pcap_num], pcap_num, sample_time_us[pcap_num],
+                                          demand_chip_sensors(&plan, DEMAND_HISTORY, pcap_num),
+                                          demand_chip_sensors(&plan, DEMAND_COMPENSATED, pcap_num));
+#endif
+                t = prof_lap(PROF_STAGE_COMPENSATE, t);
+                latency_lap(LATENCY_STAGE_COMPENSATE);
             }
 
-            if (ble_is_connected()) {
+#if GESTURE_MODE
+            gesture_event_t event;
+            fill_gesture_frame(&plan);
+            bool have_event = gesture_process_frame(gesture_frame, pdTICKS_TO_MS(current_time), &event);
+            t = prof_lap(PROF_STAGE_CLASSIFY, t);
+            if (have_event) {
+                send_gesture(&event);
+            }
+#elif DUAL_STREAM_MODE
+            dual_send_fast();
+            sendable_chips = (uint8_t)__builtin_popcount(usable_chips);
+            sent_chips = (uint8_t)__builtin_popcount(dual_frame.chips);
+#else
+            sendable_chips = (uint8_t)__builtin_popcount(usable_chips);
+            if (subscribed) {
                 for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
-                    if (!pcap_usable[pcap_num]) continue;
+                    if (!pcap_usable[pcap_num] || !demand_chip_sent(&plan, DEMAND_CONSUMER_BLE, pcap_num)) continue;
                     ble_send_chip_data(pcap_num, &chip_data[pcap_num]);
+                    sent_chips++;
                 }
             } else {
 #if DEBUG_MODE
-                print_results();
+                print_results(&plan);
 #else
+                if (offloaded) {
+                    serial_send_offload_header();
+                }
                 for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
-                    if (!pcap_usable[pcap_num]) continue;
-                    serial_send_chip_data(pcap_num, &chip_data[pcap_num]);
+                    if (!pcap_usable[pcap_num] || !demand_chip_sent(&plan, DEMAND_CONSUMER_SERIAL, pcap_num)) continue;
+                    if (offloaded) {
+                        serial_send_chip_raw(pcap_num, &chip_data[pcap_num]);
+                    } else {
+                        serial_send_chip_data(pcap_num, &chip_data[pcap_num]);
+                    }
+                    sent_chips++;
                 }
 #endif
             }
+#endif
+            prof_lap(PROF_STAGE_TRANSMIT, t);
+            prof_frame_done();
+            demand_account(&plan, usable_chips, sent_chips, sendable_chips);
+#if RETAINED_STATE_MODE
+            retained_state_save(frame_us, period_us, history_channels);
+#endif
+
+#if LATENCY_PROBE_MODE
+            latency_record_t record;
+            if (latency_frame_done(&record)) {
+                send_latency(&record);
+            }
+#endif
+
+#if STAGE_PROFILE_MODE
+            if (frame_count % PROFILER_REPORT_FRAMES == PROFILER_REPORT_FRAMES - 1) {
+                prof_report();
+            }
+#endif
+
+            if (++frame_count == STEADY_STATE_FRAMES) {
+                heap_monitor_mark_steady_state();
+            }
         }
 
         // Delay to allow other tasks to run
@@ -351,16 +1517,132 @@ static void sensor_task(void *pvParameters)
     }
 }
 
+#if LOW_RATE_MODE
+/**
+ * @brief Upload the RTC-memory batch over BLE
+ * @return true if a central connected and the batch was sent
+ *
+ * The batch starts with a "BATCH,<count>,<period_s>" status. Each sample
+ * goes out as a "SAMPLE,<seq>,<timestamp_s>" status followed by the usual
+ * per-chip packets, so the host can timestamp them and see samples the
+ * ring overwrote while no central was around.
+ */
+static bool low_rate_upload_batch(void)
+{
+    ble_manager_init();
+
+    TickType_t start = xTaskGetTickCount();
+    while (!ble_is_connected()) {
+        if ((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(LOW_RATE_UPLOAD_WINDOW_MS)) {
+            ESP_LOGW(TAG, "No central within upload window, keeping batch");
+            return false;
+        }
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+
+    // Give the central time to enable notifications
+    vTaskDelay(pdMS_TO_TICKS(500));
+
+    char status[32];
+    snprintf(status, sizeof(status), "BATCH,%u,%d",
+             low_power_batch_count(), LOW_RATE_SAMPLE_PERIOD_S);
+    ble_send_status(status);
+
+    pcap_data_t data;
+    for (uint16_t n = 0; n < low_power_batch_count(); n++) {
+        const low_rate_sample_t* sample = low_power_batch_get(n);
+        snprintf(status, sizeof(status), "SAMPLE,%lu,%lu",
+                 (unsigned long)sample->seq, (unsigned long)sample->timestamp_s);
+        ble_send_status(status);
+        for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+            if (!pcap_usable[pcap_num]) continue;
+            for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+                data.offset[i] = chip_data[pcap_num].offset[i];
+                data.raw[i] = data.offset[i] + (float)sample->delta[pcap_num][i];
+            }
+            ble_send_chip_data(pcap_num, &data);
+        }
+        // Pace the packets so the notification pool can drain
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    return true;
+}
+
+/**
+ * @brief Minimal init path after a deep-sleep wake
+ *
+ * The PCAP chips kept their firmware, configuration and CDC state, so only
+ * SPI and the mux are brought up before taking one sample. Does not return.
+ */
+static void low_rate_wake_cycle(void)
+{
+    pcap_driver_init();
+    low_power_restore_calibration(pcap_usable, chip_data);
+
+    for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+        if (!pcap_usable[pcap_num]) continue;
+        pcap_read_data((pcap_chip_select_t)pcap_num, &chip_data[pcap_num]);
+    }
+
+    bool radio_used = false;
+    if (low_power_append_sample(pcap_usable, chip_data)) {
+        radio_used = true;
+        if (low_rate_upload_batch()) {
+            low_power_batch_clear();
+        } else {
+            low_power_upload_failed();
+        }
+    }
+
+    low_power_enter_sleep(radio_used);
+}
+#endif
+
 void app_main(void)
 {
+    serial_stream_init();
+
+#if LOW_RATE_MODE
+    if (low_power_is_wake()) {
+        low_rate_wake_cycle();
+    }
+#endif
+
     ESP_LOGI(TAG, "========================================");
     ESP_LOGI(TAG, "PCAP04 ESP32C3 Firmware Starting...");
     ESP_LOGI(TAG, "========================================");
 
+    heap_monitor_init();
+
     // Initialize PCAP driver (includes SPI and MUX init)
     pcap_driver_init();
     vTaskDelay(pdMS_TO_TICKS(1000));
 
+#if ASYNC_BRINGUP_MODE
+    // Test, initialize and calibrate all chips at once; only chips that
+    // answered and came up are usable
+    ESP_LOGI(TAG, "--- Bringing Up Chips ---");
+    pcap_async_init();
+    static const pcap_bring_up_t bring_up = {
+        .firmware = standard_firmware,
+        .firmware_size = PCAP_FW_SIZE,
+        .config = standard_config,
+        .config_size = PCAP_CONFIG_SIZE,
+        .calibration_samples = 10,
+        .comm_retries = PCAP_COMM_RETRY_MAX,
+    };
+    uint8_t chips_mask = (uint8_t)(0xFFu << FIRST_PCAP_ID);
+    uint8_t usable_mask = pcap_async_bring_up(&bring_up, chips_mask, chip_data);
+    for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+        pcap_usable[pcap_num] = (usable_mask >> pcap_num) & 1;
+        if (!pcap_usable[pcap_num]) {
+            ESP_LOGW(TAG, "PCAP %d: NOT RESPONDING - skipping", pcap_num);
+        }
+    }
+    // Offsets kept across a soft reset replace the fresh calibration, which
+    // would not match the retained windows
+    restore_calibration();
+#else
     // Test communication with each chip; mark only responding chips as usable
     ESP_LOGI(TAG, "--- Testing Communication ---");
     for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
@@ -393,20 +1675,51 @@ void app_main(void)
     ESP_LOGI(TAG, "--- Waiting for measurements to stabilize ---");
     vTaskDelay(pdMS_TO_TICKS(20));
 
-    // Calibrate all chips
+    // Calibrate all chips, unless offsets were kept across a soft reset
     ESP_LOGI(TAG, "--- Calibrating Sensors ---");
+    bool calibrated = restore_calibration();
     for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
-        if (!pcap_usable[pcap_num]) continue;
+        if (!pcap_usable[pcap_num] || calibrated) continue;
         pcap_calibrate((pcap_chip_select_t)pcap_num, &chip_data[pcap_num], 10);
     }
+#endif
+
+#if TRIGGERED_MODE
+    // Calibrated free-running; from here on each frame starts the conversions
+    ESP_LOGI(TAG, "--- Switching to Triggered Conversion ---");
+    static uint8_t triggered_config[PCAP_CONFIG_SIZE];
+    memcpy(triggered_config, standard_config, PCAP_CONFIG_SIZE);
+    pcap_config_set_trigger(triggered_config, PCAP_TRIG_OPCODE);
+    for (int pcap_num = FIRST_PCAP_ID; pcap_num < NUM_PCAP_CHIPS; pcap_num++) {
+        if (!pcap_usable[pcap_num]) continue;
+        pcap_write_config((pcap_chip_select_t)pcap_num, triggered_config, PCAP_CONFIG_SIZE);
+    }
+#endif
+
+#if LOW_RATE_MODE
+    // Chips are configured and calibrated; sample from now on in deep-sleep cycles
+    low_power_save_calibration(pcap_usable, chip_data);
+    low_power_enter_sleep(false);
+#endif
 
     // Initialize battery ADC
     ESP_LOGI(TAG, "--- Initializing Battery ADC ---");
-    // battery_adc_init();
+#if POWER_GOVERNOR_MODE
+    battery_adc_init();
+#endif
 
-    // Initialize BLE
+    // Initialize BLE (no radio under QEMU; data goes out on serial)
+#if !PCAP_QEMU_BUILD
     ESP_LOGI(TAG, "--- Initializing BLE ---");
     ble_manager_init();
+    ble_set_control_handler(handle_ble_control);
+    ble_set_ota_handler(ota_delta_data);
+#endif
+
+#if POWER_GOVERNOR_MODE
+    ESP_LOGI(TAG, "--- Starting Power Governor ---");
+    governor_init(GOVERNOR_DEFAULT_TARGET_MIN);
+#endif
 
     // Initialize Neural Network (optional - will gracefully fail if no model)
     ESP_LOGI(TAG, "--- Initializing Neural Network ---");
@@ -417,9 +1730,33 @@ void app_main(void)
     //     ESP_LOGW(TAG, "Neural network initialization failed - using raw values");
     // }
 
+#if GESTURE_MODE
+    gesture_init();
+#endif
+
+    // Check the startup configuration against the capacity model
+    capacity_init();
+    {
+        capacity_config_t cfg;
+        capacity_util_t util;
+        active_config(&cfg);
+        capacity_predict(&cfg, &util);
+        if (!capacity_fits(&util)) {
+            ESP_LOGW(TAG, "Startup configuration exceeds capacity: cpu %u%% bus %u%% link %u%%",
+                     util.cpu_pct, util.bus_pct, util.link_pct);
+        }
+    }
+
+    history_add_view(&recorder_view);
+    demand_subscribe_defaults();
+
     // Print diagnostics 
     print_diagnostics();
 
+#if Q_FORMAT_BENCH_MODE
+    signal_fixed_benchmark();
+#endif
+
     ESP_LOGI(TAG, "Setup complete! Starting measurements...");
 
 #if HANDSHAKE_MODE
@@ -428,12 +1765,62 @@ void app_main(void)
 
     // Create sensor task (high priority for time-critical measurements)
     xTaskCreate(sensor_task, "sensor_task", 4096, NULL, 5, NULL);
+
+#if DUAL_STREAM_MODE
+    // Compensated stream, below the sensor task so it never delays acquisition
+    dual_queue = xQueueCreate(DUAL_QUEUE_DEPTH, sizeof(dual_frame_t));
+    xTaskCreate(compensation_task, "comp_task", 4096, NULL, 4, NULL);
+#endif
+
+    // Control commands from a serial host (lowest priority, mostly blocked)
+    xTaskCreate(serial_control_task, "serial_ctrl", 3072, NULL, 2, NULL);
     
     // Create battery monitoring task (lower priority, less time-critical)
-    // xTaskCreate(battery_task, "battery_task", 4096, NULL, 3, NULL);
+#if POWER_GOVERNOR_MODE
+    xTaskCreate(battery_task, "battery_task", 4096, NULL, 3, NULL);
+#endif
 
-    // Main task can now idle
+    // Main task idles and reports heap health periodically
+    uint32_t seconds = 0;
+#if SAMPLE_PROFILE_MODE && PCAP_QEMU_BUILD
+    // One capture of the steady pipeline; later ones on request over serial
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    sprof_start(0, 0);
+#endif
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(1000));
+
+#if SAMPLE_PROFILE_MODE
+        if (sprof_ready()) {
+            sprof_dump();
+        }
+#endif
+
+        if (history_dump_due) {
+            history_dump_due = false;
+            dump_history();
+        }
+
+        if (++seconds >= HEAP_MONITOR_REPORT_INTERVAL_S) {
+            seconds = 0;
+            heap_monitor_report();
+            pcap_bus_report();
+            ESP_LOGI(TAG, "BLE notifications dropped: %lu", ble_get_notify_drops());
+            ble_report_connections();
+            report_capacity();
+            {
+                capacity_config_t cfg;
+                active_config(&cfg);
+                demand_report(capacity_get_costs(), &cfg);
+            }
+#if TRIGGERED_MODE
+            report_trigger();
+#endif
+#if DUAL_STREAM_MODE
+            report_stream_latency("fast", &fast_latency);
+            report_stream_latency("compensated", &compensated_latency);
+            ESP_LOGI(TAG, "Stream compensated: %lu frames dropped", dual_dropped);
+#endif
+        }
     }
 }
\ No newline at end of file
@@ -5,11 +5,40 @@
 
 #include "mux_control.h"
 #include "esp_rom_sys.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+#include "pcap_emulator.h"
+#include "freertos/FreeRTOS.h"
+
+#define MUX_CHANNELS 16
 
 static pcap_chip_select_t current_chip = PCAP_CHIP_NONE;
 
+// Pre-staged output states: select pins set for each channel, and all of them
+static uint32_t staged_set[MUX_CHANNELS];
+static uint32_t staged_pins;
+static portMUX_TYPE out_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+// Drive all four select lines in one write. Changing them one by one, or
+// clearing then setting, passes through other codes (3 -> 4 via 0) and
+// pulses CS on an unrelated chip. Masked so no other GPIO update lands
+// between the read and the write.
+static void mux_write(pcap_chip_select_t chip)
+{
+    portENTER_CRITICAL(&out_spinlock);
+    uint32_t out = REG_READ(GPIO_OUT_REG);
+    REG_WRITE(GPIO_OUT_REG, (out & ~staged_pins) | staged_set[chip & 0x0F]);
+    portEXIT_CRITICAL(&out_spinlock);
+}
+
 void mux_init(void)
 {
+    // Release the deep-sleep hold left by low-rate mode so the pins can be driven
+    gpio_hold_dis(MUX_S0_PIN);
+    gpio_hold_dis(MUX_S1_PIN);
+    gpio_hold_dis(MUX_S2_PIN);
+    gpio_hold_dis(MUX_S3_PIN);
+
     // Configure GPIO pins as outputs
     gpio_config_t io_conf = {
         .pin_bit_mask = (1ULL << MUX_S0_PIN) | (1ULL << MUX_S1_PIN) |
@@ -21,22 +50,45 @@ void mux_init(void)
     };
     gpio_config(&io_conf);
 
+    static const gpio_num_t pins[4] = {MUX_S0_PIN, MUX_S1_PIN, MUX_S2_PIN, MUX_S3_PIN};
+    staged_pins = 0;
+    for (int ch = 0; ch < MUX_CHANNELS; ch++) {
+        staged_set[ch] = 0;
+        for (int b = 0; b < 4; b++) {
+            if (ch & (1 << b)) {
+                staged_set[ch] |= 1u << pins[b];
+            }
+        }
+        staged_pins |= staged_set[ch];
+    }
+
     // Deselect all initially
     mux_deselect_chip();
 }
 
 void mux_select_chip(pcap_chip_select_t chip)
 {
-    // Set the channel select pins according to the chip select value
-    gpio_set_level(MUX_S0_PIN, (chip & 0x01) ? 1 : 0);
-    gpio_set_level(MUX_S1_PIN, (chip & 0x02) ? 1 : 0);
-    gpio_set_level(MUX_S2_PIN, (chip & 0x04) ? 1 : 0);
-    gpio_set_level(MUX_S3_PIN, (chip & 0x08) ? 1 : 0);
+    mux_write(chip);
+    current_chip = chip;
+
+#if PCAP_QEMU_BUILD
+    pcap_emu_select(chip);
+#endif
+
+    // Small delay to allow mux to settle
+    esp_rom_delay_us(MUX_SETTLE_US);
+}
 
+void mux_select_chip_quick(pcap_chip_select_t chip)
+{
+    mux_write(chip);
     current_chip = chip;
 
-    // Small delay to allow mux to settle (10 microseconds)
-    esp_rom_delay_us(10);
+#if PCAP_QEMU_BUILD
+    pcap_emu_select(chip);
+#endif
+
+    esp_rom_delay_us(MUX_QUICK_SETTLE_US);
 }
 
 void mux_deselect_chip() 
@@ -44,6 +44,14 @@ extern "C" {
 
 /** @} */
 
+/**
+ * @defgroup MuxTiming Multiplexer Timing
+ * @{
+ */
+#define MUX_SETTLE_US           10  ///< Settle after mux_select_chip()
+#define MUX_QUICK_SETTLE_US     1   ///< Settle after mux_select_chip_quick(); the CD74HC4067 switches in well under 1 us
+/** @} */
+
 /**
  * @brief PCAP chip selection identifiers
  *
@@ -78,6 +86,17 @@ void mux_init(void);
  */
 void mux_select_chip(pcap_chip_select_t chip);
 
+/**
+ * @brief Select a chip with pre-staged pin states and a short settle
+ * @param chip The PCAP chip to select
+ *
+ * Writes the select pins in one output register write, from masks computed
+ * in mux_init(), so back-to-back frames to different chips (triggered
+ * conversion starts) follow each other closely without passing through
+ * another chip's code.
+ */
+void mux_select_chip_quick(pcap_chip_select_t chip);
+
 /**
  * @brief Select a specific PCAP chip through the multiplexer
  *
@@ -0,0 +1,123 @@
+/**
+ * @file nn_fc_16x8.cpp
+ * @brief Optimized int16-activation / int8-weight FULLY_CONNECTED kernel
+ */
+
+#include "nn_fc_16x8.h"
+
+#include <algorithm>
+#include "tensorflow/lite/kernels/internal/common.h"
+#include "tensorflow/lite/micro/kernels/kernel_util.h"
+
+// Stock registration; its prepare fills the OpDataFullyConnected we read
+static TFLMRegistration stock_fc;
+
+// Dot product of one output row. Blocks of NN_FC_16X8_BLOCK_DEPTH products
+// are summed in int32 (four independent accumulators to keep the multiplier
+// busy) and folded into int64, so the result equals the reference int64 sum.
+static inline int64_t dot_16x8(const int16_t* in, const int8_t* w, int depth)
+{
+    int64_t acc = 0;
+    int d = 0;
+
+    while (d < depth) {
+        int end = std::min(depth, d + NN_FC_16X8_BLOCK_DEPTH);
+        int32_t a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+
+        for (; d + 4 <= end; d += 4) {
+            a0 += (int32_t)in[d]     * w[d];
+            a1 += (int32_t)in[d + 1] * w[d + 1];
+            a2 += (int32_t)in[d + 2] * w[d + 2];
+            a3 += (int32_t)in[d + 3] * w[d + 3];
+        }
+        for (; d < end; d++) {
+            a0 += (int32_t)in[d] * w[d];
+        }
+        acc += (int64_t)a0 + a1 + a2 + a3;
+    }
+    return acc;
+}
+
+// BiasType is int64_t or int32_t, whichever the converter emitted
+template <typename BiasType>
+static void fc_16x8(const tflite::OpDataFullyConnected& data,
+                    const int16_t* input, const int8_t* filter, const BiasType* bias,
+                    int16_t* output, int batches, int output_depth, int accum_depth)
+{
+    for (int b = 0; b < batches; b++) {
+        const int16_t* in_row = input + b * accum_depth;
+
+        for (int c = 0; c < output_depth; c++) {
+            int64_t acc = dot_16x8(in_row, filter + c * accum_depth, accum_depth);
+            if (bias) {
+                acc += bias[c];
+            }
+
+            int32_t multiplier = data.output_multiplier;
+            int shift = data.output_shift;
+            if (data.is_per_channel) {
+                multiplier = data.per_channel_output_multiplier[c];
+                shift = data.per_channel_output_shift[c];
+            }
+
+            int32_t out = tflite::MultiplyByQuantizedMultiplier(acc, multiplier, shift);
+            out += data.output_zero_point;
+            out = std::max(out, data.output_activation_min);
+            out = std::min(out, data.output_activation_max);
+            output[c + output_depth * b] = (int16_t)out;
+        }
+    }
+}
+
+static TfLiteStatus fc_invoke(TfLiteContext* context, TfLiteNode* node)
+{
+    const TfLiteEvalTensor* input =
+        tflite::micro::GetEvalInput(context, node, tflite::kFullyConnectedInputTensor);
+    const TfLiteEvalTensor* filter =
+        tflite::micro::GetEvalInput(context, node, tflite::kFullyConnectedWeightsTensor);
+    const auto& data = *static_cast<const tflite::OpDataFullyConnected*>(node->user_data);
+
+    // Anything that is not a symmetric 16x8 node keeps the stock path
+    if (input->type != kTfLiteInt16 || filter->type != kTfLiteInt8 ||
+        data.input_zero_point != 0 || data.filter_zero_point != 0) {
+        return stock_fc.invoke(context, node);
+    }
+
+    const TfLiteEvalTensor* bias =
+        tflite::micro::GetEvalInput(context, node, tflite::kFullyConnectedBiasTensor);
+    if (bias != nullptr && bias->type != kTfLiteInt64 && bias->type != kTfLiteInt32) {
+        return stock_fc.invoke(context, node);
+    }
+    TfLiteEvalTensor* output =
+        tflite::micro::GetEvalOutput(context, node, tflite::kFullyConnectedOutputTensor);
+
+    const tflite::RuntimeShape filter_shape = tflite::micro::GetTensorShape(filter);
+    const tflite::RuntimeShape output_shape = tflite::micro::GetTensorShape(output);
+    const int output_dims = output_shape.DimensionsCount();
+
+    const int16_t* input_data = tflite::micro::GetTensorData<int16_t>(input);
+    const int8_t* filter_data = tflite::micro::GetTensorData<int8_t>(filter);
+    int16_t* output_data = tflite::micro::GetTensorData<int16_t>(output);
+    const int batches = tflite::FlatSizeSkipDim(output_shape, output_dims - 1);
+    const int output_depth = output_shape.Dims(output_dims - 1);
+    const int accum_depth = filter_shape.Dims(filter_shape.DimensionsCount() - 1);
+
+    if (bias != nullptr && bias->type == kTfLiteInt32) {
+        fc_16x8(data, input_data, filter_data, tflite::micro::GetTensorData<int32_t>(bias),
+                output_data, batches, output_depth, accum_depth);
+    } else {
+        fc_16x8(data, input_data, filter_data, tflite::micro::GetOptionalTensorData<int64_t>(bias),
+                output_data, batches, output_depth, accum_depth);
+    }
+
+    return kTfLiteOk;
+}
+
+TFLMRegistration nn_register_fully_connected_16x8(void)
+{
+    stock_fc = tflite::Register_FULLY_CONNECTED();
+
+    TFLMRegistration registration = stock_fc;
+    registration.invoke = fc_invoke;
+    return registration;
+}
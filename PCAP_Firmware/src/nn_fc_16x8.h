@@ -0,0 +1,33 @@
+/**
+ * @file nn_fc_16x8.h
+ * @brief Optimized int16-activation / int8-weight FULLY_CONNECTED kernel
+ *
+ * The stock ESP-NN FULLY_CONNECTED kernel handles 16x8 quantized models
+ * through the portable reference loop, which accumulates every product in
+ * int64 - slow on the 32-bit C3. This registration keeps the stock init and
+ * prepare, routes int16 x int8 nodes to a kernel that accumulates in int32
+ * blocks, and passes every other type combination to the stock invoke.
+ * Results are bit-exact with the reference kernel.
+ */
+
+#ifndef NN_FC_16X8_H
+#define NN_FC_16X8_H
+
+#include "tensorflow/lite/micro/kernels/fully_connected.h"
+
+/**
+ * @brief Depth of one int32 accumulation block
+ *
+ * 16x8 models are symmetric (zero points 0), so each product is at most
+ * 2^22 in magnitude and 256 of them fit in int32 without overflow.
+ */
+#define NN_FC_16X8_BLOCK_DEPTH  256
+
+/**
+ * @brief FULLY_CONNECTED registration with the optimized 16x8 path
+ *
+ * Pass to MicroMutableOpResolver::AddFullyConnected() in place of the default.
+ */
+TFLMRegistration nn_register_fully_connected_16x8(void);
+
+#endif // NN_FC_16X8_H
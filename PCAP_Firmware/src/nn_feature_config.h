@@ -0,0 +1,23 @@
+/**
+ * @file nn_feature_config.h
+ * @brief NN input feature configuration
+ *
+ * Generated from scalers.json by tools/nn/gen_feature_config.py - regenerate
+ * after retraining instead of editing by hand.
+ */
+
+#ifndef NN_FEATURE_CONFIG_H
+#define NN_FEATURE_CONFIG_H
+
+#define NN_WINDOW_SIZE              400     ///< Samples per inference window
+#define NN_FEATURE_DERIVATIVE       0       ///< Window includes d(cap)/dt
+#define NN_FEATURE_TIME             0       ///< Window includes elapsed time
+#define NN_FEATURE_DERIV_SMOOTH_SHIFT 0     ///< Derivative EMA shift (0 = plain difference)
+#define NN_FEATURE_INPUT_BYTES      1       ///< Input tensor element size (int8 model)
+#define NN_OUTPUT_CORRECTION        0       ///< Outputs are corrections to add to the input, not compensated values
+
+// StandardScaler per feature, in window order: cap[, derivative][, time]
+#define NN_FEATURE_SCALER_MEAN      { 6.191217956661442f }
+#define NN_FEATURE_SCALER_SCALE     { 0.9138432435934595f }
+
+#endif // NN_FEATURE_CONFIG_H
@@ -0,0 +1,122 @@
+/**
+ * @file nn_features.c
+ * @brief NN input feature pipeline implementation
+ */
+
+#include <math.h>
+#include <string.h>
+#include "nn_features.h"
+#include "history_store.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+static const char* TAG = "NN_FEAT";
+
+#define DERIV_Q_ONE       (1 << NN_FEATURE_DERIV_Q_BITS)
+
+static nn_feature_channel_t channels[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+
+// The NN's view of the history: whole windows in the input tensor format
+static history_view_t nn_view = {
+    .name = "nn",
+    .length = NN_WINDOW_SIZE,
+    .format = HISTORY_FORMAT_STORED,
+};
+
+static const float scaler_mean[NN_NUM_FEATURES] = NN_FEATURE_SCALER_MEAN;
+static const float scaler_scale[NN_NUM_FEATURES] = NN_FEATURE_SCALER_SCALE;
+
+bool nn_features_init(nn_feature_type_t type, float q_scale, int32_t q_zero)
+{
+    if (!history_configure(type, q_scale, q_zero) || !history_add_view(&nn_view)) {
+        return false;
+    }
+    memset(channels, 0, sizeof(channels));
+
+    ESP_LOGI(TAG, "%d feature(s) x %d samples, %lu bytes per window",
+             NN_NUM_FEATURES, NN_WINDOW_SIZE, nn_features_window_bytes());
+    return true;
+}
+
+void nn_features_reset(void)
+{
+    memset(channels, 0, sizeof(channels));
+    history_reset();
+}
+
+uint32_t nn_features_fingerprint(uint32_t crc)
+{
+    const uint32_t config[] = {
+        NN_WINDOW_SIZE, NN_NUM_FEATURES, NN_FEATURE_DERIVATIVE, NN_FEATURE_TIME,
+        NN_FEATURE_DERIV_SMOOTH_SHIFT, NN_FEATURE_DERIV_Q_BITS, NN_OUTPUT_CORRECTION,
+    };
+    crc = esp_rom_crc32_le(crc, (const uint8_t*)config, sizeof(config));
+    crc = esp_rom_crc32_le(crc, (const uint8_t*)scaler_mean, sizeof(scaler_mean));
+    return esp_rom_crc32_le(crc, (const uint8_t*)scaler_scale, sizeof(scaler_scale));
+}
+
+void nn_features_save(nn_feature_channel_t dst[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP])
+{
+    memcpy(dst, channels, sizeof(channels));
+}
+
+void nn_features_restore(const nn_feature_channel_t src[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP],
+                         int64_t shift_us)
+{
+    memcpy(channels, src, sizeof(channels));
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            channels[chip][i].start_us += shift_us;
+            channels[chip][i].prev_us += shift_us;
+        }
+    }
+}
+
+uint32_t nn_features_window_bytes(void)
+{
+    return NN_WINDOW_SIZE * history_row_bytes();
+}
+
+void nn_features_push(int chip, int sensor, float input, int64_t now_us)
+{
+    nn_feature_channel_t* ch = &channels[chip][sensor];
+    float features[NN_NUM_FEATURES];
+    int idx = 0;
+
+    features[idx++] = input;
+
+#if NN_FEATURE_DERIVATIVE
+    // Difference in fixed point so the small step between two samples is
+    // not lost to float cancellation; optionally EMA-smoothed
+    int32_t q = (int32_t)lroundf(input * DERIV_Q_ONE);
+    float deriv = 0.0f;
+    if (ch->started && now_us > ch->prev_us) {
+        int32_t diff = q - ch->prev_q;
+        ch->deriv_q += (diff - ch->deriv_q) >> NN_FEATURE_DERIV_SMOOTH_SHIFT;
+        deriv = (float)ch->deriv_q / DERIV_Q_ONE * 1e6f / (float)(now_us - ch->prev_us);
+    }
+    ch->prev_q = q;
+    features[idx++] = deriv;    // units per second
+#endif
+
+#if NN_FEATURE_TIME
+    if (!ch->started) {
+        ch->start_us = now_us;
+    }
+    features[idx++] = (float)(now_us - ch->start_us) * 1e-6f;  // seconds
+#endif
+
+    history_write(chip, sensor, features);
+    ch->prev_us = now_us;
+    ch->started = true;
+}
+
+bool nn_features_window_ready(int chip, int sensor)
+{
+    return history_view_ready(&nn_view, chip, sensor);
+}
+
+void nn_features_write_window(int chip, int sensor, void* dst)
+{
+    history_read_window(&nn_view, chip, sensor, dst);
+}
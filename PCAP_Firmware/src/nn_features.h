@@ -0,0 +1,138 @@
+/**
+ * @file nn_features.h
+ * @brief NN input feature pipeline
+ *
+ * Prepares each sample for the model when it arrives instead of when the
+ * model runs. The sample is expanded into its features, as selected in
+ * nn_feature_config.h (generated from scalers.json and the model). The cap
+ * value and the elapsed time come from the sample alone; only the time
+ * derivative carries state from one sample to the next. The features are
+ * normalized with the per-feature scalers, quantized for the input tensor
+ * and stored as one row in the shared history (history_store.h), so a
+ * sample costs the same whatever the window length.
+ *
+ * Filling the tensor for an inference is not incremental. It copies the NN
+ * view's whole window, [window][features] oldest row first, in at most two
+ * memcpy() calls because the ring wraps.
+ */
+
+#ifndef NN_FEATURES_H
+#define NN_FEATURES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcap04_defs.h"
+#include "nn_feature_config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup FeatureConfig Feature Pipeline Configuration
+ * @{
+ */
+#define NN_NUM_FEATURES (1 + NN_FEATURE_DERIVATIVE + NN_FEATURE_TIME)  ///< Features per sample
+#define NN_FEATURE_DERIV_Q_BITS     16      ///< Fraction bits of the fixed-point difference
+
+/**
+ * @brief Bytes reserved per stored feature value
+ *
+ * The element size of the model's input tensor, as generated into
+ * nn_feature_config.h, so an int8 model's history takes a quarter of a
+ * float model's. nn_features_init() refuses a model whose inputs are wider.
+ */
+#define NN_FEATURE_STORAGE_BYTES    NN_FEATURE_INPUT_BYTES
+/** @} */
+
+/**
+ * @brief Element type of the input tensor the windows are prepared for
+ */
+typedef enum {
+    NN_FEATURE_FLOAT32 = 0,
+    NN_FEATURE_INT8,
+    NN_FEATURE_INT16,
+} nn_feature_type_t;
+
+/**
+ * @brief Per-channel incremental state; the samples live in the history store
+ */
+typedef struct {
+    bool     started;       ///< A sample has been pushed since the last reset
+    int32_t  prev_q;        ///< Previous input in fixed point
+    int32_t  deriv_q;       ///< Smoothed per-sample difference in fixed point
+    int64_t  start_us;      ///< Timestamp of the first sample
+    int64_t  prev_us;       ///< Timestamp of the previous sample
+} nn_feature_channel_t;
+
+/**
+ * @brief Configure quantization of the stored windows and reset all channels
+ * @param type       Input tensor element type
+ * @param q_scale    Input tensor quantization scale (ignored for float)
+ * @param q_zero     Input tensor zero point (ignored for float)
+ * @return false if the type does not fit NN_FEATURE_STORAGE_BYTES
+ */
+bool nn_features_init(nn_feature_type_t type, float q_scale, int32_t q_zero);
+
+/**
+ * @brief Empty every channel's window, keeping the quantization
+ */
+void nn_features_reset(void);
+
+/**
+ * @brief Fold the feature configuration and scaler into a CRC-32
+ * @param crc CRC-32 so far (e.g. of the model)
+ * @return CRC-32 continued over window size, feature switches and scaler
+ *
+ * Used to check that a host compensator runs the same pipeline.
+ */
+uint32_t nn_features_fingerprint(uint32_t crc);
+
+/**
+ * @brief Copy every channel's incremental state
+ */
+void nn_features_save(nn_feature_channel_t dst[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP]);
+
+/**
+ * @brief Restore saved incremental state
+ * @param src      State from nn_features_save()
+ * @param shift_us Added to the saved timestamps, to carry them into a new
+ *                 timebase (esp_timer restarts at 0 after a reset)
+ *
+ * The windows themselves are restored through history_restore_state().
+ */
+void nn_features_restore(const nn_feature_channel_t src[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP],
+                         int64_t shift_us);
+
+/**
+ * @brief Size of one full window in bytes, as written by nn_features_write_window()
+ */
+uint32_t nn_features_window_bytes(void);
+
+/**
+ * @brief Append one sample to a channel's window
+ * @param chip   Chip index
+ * @param sensor Sensor index on the chip
+ * @param input  Offset-corrected capacitance value
+ * @param now_us Sample timestamp in microseconds
+ */
+void nn_features_push(int chip, int sensor, float input, int64_t now_us);
+
+/**
+ * @brief Check whether a channel has a full window
+ */
+bool nn_features_window_ready(int chip, int sensor);
+
+/**
+ * @brief Copy a channel's window, oldest sample first, to the input tensor
+ * @param chip   Chip index
+ * @param sensor Sensor index on the chip
+ * @param dst    Input tensor data, nn_features_window_bytes() long
+ */
+void nn_features_write_window(int chip, int sensor, void* dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NN_FEATURES_H
@@ -6,16 +6,21 @@
  * which includes ESP-NN acceleration for better performance on ESP32 chips.
  */
 
+#include <string.h>
 #include "nn_inference.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "esp_rom_crc.h"
 
 // TensorFlow Lite Micro headers
 #include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
 #include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_utils.h"
 #include "tensorflow/lite/schema/schema_generated.h"
 
 #include "model_data.h"
+#include "nn_fc_16x8.h"
+#include "nn_features.h"
 
 static const char* TAG = "NN";
 
@@ -37,30 +42,20 @@ static bool nn_ready = false;
 static uint32_t last_inference_time_us = 0;
 static uint32_t total_inference_time_us = 0;
 static uint32_t inference_count = 0;
+static uint32_t fingerprint = 0;
 
-// Sliding window size (from scalers.json "window": 400)
-#define NN_WINDOW_SIZE 400
-
-// Circular buffer: one ring per sensor per chip
-static float sensor_buffers[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP][NN_WINDOW_SIZE];
-static int   buffer_head[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];   // next write index
-static int   buffer_count[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];  // samples stored (0..NN_WINDOW_SIZE)
-
-// Input scaler parameters (from scalers.json)
-// StandardScaler: normalized = (value - mean) / scale
-const float INPUT_SCALER_MEAN = 6.191217956661442f;
-const float INPUT_SCALER_SCALE = 0.9138432435934595f;
+// Inference decimation (see nn_set_refresh_divider)
+static uint8_t  refresh_divider = 1;
+static uint8_t  output_steps = 1;
+static uint16_t refresh_period = 1;    // Samples between invokes: divider * output steps
+static uint16_t refresh_phase[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+// Output - input per step of the last Invoke
+static float    corrections[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP][NN_MAX_OUTPUT_STEPS];
 
 // Op resolver - add only the operations your model needs to save memory
 // Common ops for hysteresis models: FULLY_CONNECTED, RELU, TANH, etc.
 static tflite::MicroMutableOpResolver<10> op_resolver;
 
-// Normalize input using StandardScaler parameters
-static inline float normalize_input(float raw_value)
-{
-    return (raw_value - INPUT_SCALER_MEAN) / INPUT_SCALER_SCALE;
-}
-
 bool nn_init(void)
 {
     ESP_LOGI(TAG, "Initializing neural network inference engine");
@@ -75,7 +70,7 @@ bool nn_init(void)
 
     ESP_LOGI(TAG, "Model schema version OK");
 
-    op_resolver.AddFullyConnected();
+    op_resolver.AddFullyConnected(nn_register_fully_connected_16x8());
     op_resolver.AddRelu();
     op_resolver.AddTanh();
     op_resolver.AddSoftmax();
@@ -112,12 +107,42 @@ bool nn_init(void)
         return false;
     }
 
+    // Prepare the feature windows in the input tensor's own representation
+    nn_feature_type_t feature_type;
+    switch (input_tensor->type) {
+    case kTfLiteFloat32: feature_type = NN_FEATURE_FLOAT32; break;
+    case kTfLiteInt8:    feature_type = NN_FEATURE_INT8; break;
+    case kTfLiteInt16:   feature_type = NN_FEATURE_INT16; break;
+    default:
+        ESP_LOGE(TAG, "Unsupported input tensor type %d", input_tensor->type);
+        return false;
+    }
+    if (!nn_features_init(feature_type, input_tensor->params.scale, input_tensor->params.zero_point)) {
+        return false;
+    }
+    if (input_tensor->bytes != nn_features_window_bytes()) {
+        ESP_LOGE(TAG, "Input tensor is %zu bytes, feature config gives %lu (window %d x %d features)",
+                 input_tensor->bytes, nn_features_window_bytes(), NN_WINDOW_SIZE, NN_NUM_FEATURES);
+        return false;
+    }
+
+    int outputs = tflite::ElementCount(*output_tensor->dims);
+    if (outputs < 1 || outputs > NN_MAX_OUTPUT_STEPS) {
+        ESP_LOGE(TAG, "Model has %d outputs, at most %d supported", outputs, NN_MAX_OUTPUT_STEPS);
+        return false;
+    }
+    output_steps = (uint8_t)outputs;
+    nn_set_refresh_divider(refresh_divider);
+
+    fingerprint = nn_features_fingerprint(esp_rom_crc32_le(0, model_int8_tflite, model_int8_tflite_len));
+
     // Log tensor information
-    ESP_LOGI(TAG, "Model loaded successfully");
+    ESP_LOGI(TAG, "Model loaded successfully, fingerprint %08lx", fingerprint);
     ESP_LOGI(TAG, "Input tensor: dims=%d, type=%d",
              input_tensor->dims->size, input_tensor->type);
-    ESP_LOGI(TAG, "Output tensor: dims=%d, type=%d",
-             output_tensor->dims->size, output_tensor->type);
+    ESP_LOGI(TAG, "Output tensor: dims=%d, type=%d, %u step(s) per invoke of %s",
+             output_tensor->dims->size, output_tensor->type, output_steps,
+             NN_OUTPUT_CORRECTION ? "corrections" : "compensated values");
     ESP_LOGI(TAG, "Arena used: %zu bytes of %d bytes", 
              interpreter->arena_used_bytes(), kTensorArenaSize);
 
@@ -125,44 +150,62 @@ bool nn_init(void)
     return true;
 }
 
+// Dequantized model output k
+static float read_output(int k)
+{
+    if (output_tensor->type == kTfLiteInt8) {
+        return (output_tensor->data.int8[k] - output_tensor->params.zero_point) * output_tensor->params.scale;
+    }
+    if (output_tensor->type == kTfLiteInt16) {
+        return (output_tensor->data.i16[k] - output_tensor->params.zero_point) * output_tensor->params.scale;
+    }
+    return output_tensor->data.f[k];
+}
+
 void nn_compensate_chip(pcap_data_t* data, int chip_idx)
+{
+    nn_compensate_chip_at(data, chip_idx, esp_timer_get_time());
+}
+
+void nn_compensate_chip_at(pcap_data_t* data, int chip_idx, int64_t now_us)
+{
+    nn_compensate_chip_masked(data, chip_idx, now_us, NN_ALL_SENSORS, NN_ALL_SENSORS);
+}
+
+void nn_compensate_chip_masked(pcap_data_t* data, int chip_idx, int64_t now_us,
+                               uint8_t history_mask, uint8_t compensate_mask)
 {
     for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
         float input = (PCAP_SCALING_NUM * (float)(data->raw[i] - data->offset[i])) / PCAP_CONVERSION_NUMBER;
 
-        // Push sample into circular buffer
-        sensor_buffers[chip_idx][i][buffer_head[chip_idx][i]] = input;
-        buffer_head[chip_idx][i] = (buffer_head[chip_idx][i] + 1) % NN_WINDOW_SIZE;
-        if (buffer_count[chip_idx][i] < NN_WINDOW_SIZE) {
-            buffer_count[chip_idx][i]++;
+        // Features are computed once per sample as it arrives. Every sample
+        // with history demand enters the store, model or not, for its other
+        // consumers.
+        if (!(history_mask & (1u << i))) {
+            data->final_val[i] = input;
+            continue;
         }
+        nn_features_push(chip_idx, i, input, now_us);
 
         // Pass through until the window is fully populated (~4 seconds at 100Hz)
-        if (!nn_ready || buffer_count[chip_idx][i] < NN_WINDOW_SIZE) {
+        if (!(compensate_mask & (1u << i)) ||
+            !nn_ready || !nn_features_window_ready(chip_idx, i) || refresh_divider == 0) {
             data->final_val[i] = input;
             continue;
         }
 
+        // Between refreshes apply the correction for this step, or the last
+        // one once the steps run out
+        uint16_t phase = refresh_phase[chip_idx][i];
+        refresh_phase[chip_idx][i] = (phase + 1 >= refresh_period) ? 0 : phase + 1;
+        if (phase != 0) {
+            data->final_val[i] = input + corrections[chip_idx][i][phase < output_steps ? phase : output_steps - 1];
+            continue;
+        }
+
         int64_t start_time = esp_timer_get_time();
 
-        // Fill input tensor with the window oldest→newest
-        int oldest = buffer_head[chip_idx][i];  // head points to oldest when buffer is full
-        if (input_tensor->type == kTfLiteFloat32) {
-            float* input_data = input_tensor->data.f;
-            for (int j = 0; j < NN_WINDOW_SIZE; j++) {
-                int buf_idx = (oldest + j) % NN_WINDOW_SIZE;
-                input_data[j] = normalize_input(sensor_buffers[chip_idx][i][buf_idx]);
-            }
-        } else if (input_tensor->type == kTfLiteInt8) {
-            int8_t* input_data = input_tensor->data.int8;
-            float q_scale = input_tensor->params.scale;
-            int q_zero = input_tensor->params.zero_point;
-            for (int j = 0; j < NN_WINDOW_SIZE; j++) {
-                int buf_idx = (oldest + j) % NN_WINDOW_SIZE;
-                float norm = normalize_input(sensor_buffers[chip_idx][i][buf_idx]);
-                input_data[j] = (int8_t)((int32_t)(norm / q_scale) + q_zero);
-            }
-        }
+        nn_features_write_window(chip_idx, i, input_tensor->data.raw);
 
         // Run inference
         TfLiteStatus invoke_status = interpreter->Invoke();
@@ -172,14 +215,14 @@ void nn_compensate_chip(pcap_data_t* data, int chip_idx)
             continue;
         }
 
-        // Read output
-        if (output_tensor->type == kTfLiteFloat32) {
-            data->final_val[i] = output_tensor->data.f[0];
-        } else if (output_tensor->type == kTfLiteInt8) {
-            float q_scale = output_tensor->params.scale;
-            int q_zero = output_tensor->params.zero_point;
-            data->final_val[i] = (output_tensor->data.int8[0] - q_zero) * q_scale;
+        // One output per step: compensated values or corrections, as the
+        // generated config says, for any number of steps. Values are kept as
+        // their correction to this input, for the steps between invokes.
+        float* correction = corrections[chip_idx][i];
+        for (int k = 0; k < output_steps; k++) {
+            correction[k] = NN_OUTPUT_CORRECTION ? read_output(k) : read_output(k) - input;
         }
+        data->final_val[i] = NN_OUTPUT_CORRECTION ? input + correction[0] : read_output(0);
 
         // Track timing
         int64_t end_time = esp_timer_get_time();
@@ -189,6 +232,56 @@ void nn_compensate_chip(pcap_data_t* data, int chip_idx)
     }
 }
 
+void nn_set_refresh_divider(uint8_t divider)
+{
+    refresh_divider = divider;
+    if (divider == 0) {
+        return;
+    }
+    refresh_period = (uint16_t)divider * output_steps;
+
+    // Stagger the refresh phase so each frame carries ~1/period of the invokes
+    int channel = 0;
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            refresh_phase[chip][i] = channel++ % refresh_period;
+        }
+    }
+}
+
+uint8_t nn_get_output_steps(void)
+{
+    return output_steps;
+}
+
+void nn_reset(void)
+{
+    nn_features_reset();
+    nn_set_refresh_divider(refresh_divider);
+}
+
+void nn_save_state(nn_state_t* state)
+{
+    nn_features_save(state->features);
+    state->refresh_period = refresh_period;
+    memcpy(state->refresh_phase, refresh_phase, sizeof(refresh_phase));
+    memcpy(state->corrections, corrections, sizeof(corrections));
+}
+
+void nn_restore_state(const nn_state_t* state, int64_t shift_us)
+{
+    nn_features_restore(state->features, shift_us);
+    if (state->refresh_period == refresh_period) {
+        memcpy(refresh_phase, state->refresh_phase, sizeof(refresh_phase));
+    }
+    memcpy(corrections, state->corrections, sizeof(corrections));
+}
+
+uint32_t nn_get_fingerprint(void)
+{
+    return fingerprint;
+}
+
 bool nn_is_ready(void)
 {
     return nn_ready;
@@ -201,3 +294,8 @@ uint32_t nn_get_inference_time_us(void)
     }
     return total_inference_time_us / inference_count;
 }
+
+uint32_t nn_get_inference_count(void)
+{
+    return inference_count;
+}
@@ -4,6 +4,12 @@
  *
  * This module provides neural network inference capabilities for compensating
  * hysteresis in PCAP capacitive sensor readings using TensorFlow Lite Micro.
+ *
+ * A model with one output produces the compensated value of the newest
+ * sample. A model with K outputs (K-step) produces corrections, compensated
+ * minus input, for the newest sample and the K-1 samples that follow it.
+ * Each channel then invokes once every K samples, so inference cost per
+ * sample drops by about K.
  */
 
 #ifndef NN_INFERENCE_H
@@ -12,11 +18,30 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "pcap04_defs.h"
+#include "nn_features.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @defgroup NNConfig Neural Network Configuration
+ * @{
+ */
+#define NN_MAX_OUTPUT_STEPS     8   ///< Most outputs (samples per invoke) a model may have
+#define NN_ALL_SENSORS          ((uint8_t)((1u << NUM_SENSORS_PER_CHIP) - 1))   ///< Sensor mask of a whole chip
+/** @} */
+
+/**
+ * @brief Compensation state beyond the windows, for retaining it across resets
+ */
+typedef struct {
+    nn_feature_channel_t features[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+    uint16_t refresh_period;
+    uint16_t refresh_phase[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+    float corrections[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP][NN_MAX_OUTPUT_STEPS];
+} nn_state_t;
+
 /**
  * @brief Initialize the neural network inference engine
  *
@@ -30,8 +55,9 @@ bool nn_init(void);
 /**
  * @brief Run windowed inference on a full chip's data
  *
- * Maintains a 400-sample circular buffer per sensor and runs inference
- * once the window is full. Passes through raw values until then.
+ * Appends each sample to the sensor's feature window (see nn_features.h)
+ * and runs inference once the window is full. Passes through raw values
+ * until then.
  *
  * @param data     Pointer to PCAP data structure (raw/offset used as input,
  *                 final_val updated with compensated output)
@@ -39,6 +65,79 @@ bool nn_init(void);
  */
 void nn_compensate_chip(pcap_data_t* data, int chip_idx);
 
+/**
+ * @brief nn_compensate_chip() for a sample read earlier
+ *
+ * @param data     As for nn_compensate_chip()
+ * @param chip_idx As for nn_compensate_chip()
+ * @param now_us   esp_timer time the chip was read, for the time features
+ */
+void nn_compensate_chip_at(pcap_data_t* data, int chip_idx, int64_t now_us);
+
+/**
+ * @brief nn_compensate_chip_at() for a subset of the chip's sensors
+ *
+ * Sensors outside history_mask skip the feature window and history store;
+ * sensors outside compensate_mask skip inference. Either way final_val gets
+ * the calibrated value. A sensor whose history lapses has a gap in its
+ * window, so call nn_reset() when the history mask grows.
+ *
+ * @param history_mask    Sensors whose sample enters the history (bit per sensor)
+ * @param compensate_mask Sensors to compensate (subset of history_mask)
+ */
+void nn_compensate_chip_masked(pcap_data_t* data, int chip_idx, int64_t now_us,
+                               uint8_t history_mask, uint8_t compensate_mask);
+
+/**
+ * @brief Set how often each channel runs inference
+ *
+ * With a divider of N every channel invokes the model on every Nth sample
+ * (every N*K-th for a K-step model), staggered across channels. In between
+ * it applies the correction for that step, or the last one once the steps
+ * run out.
+ * The windows keep filling either way, so raising the rate again takes
+ * effect immediately.
+ *
+ * @param divider Invoke every Nth sample (1 = every sample, 0 = pass through)
+ */
+void nn_set_refresh_divider(uint8_t divider);
+
+/**
+ * @brief Samples each invoke covers
+ * @return Number of model outputs (1 for a single-step model)
+ */
+uint8_t nn_get_output_steps(void);
+
+/**
+ * @brief Drop the feature windows
+ *
+ * Compensation passes values through until the windows refill. Call when
+ * the device takes compensation back from the host, whose samples never
+ * reached the windows.
+ */
+void nn_reset(void);
+
+/**
+ * @brief Copy the feature state, refresh phases and held corrections
+ */
+void nn_save_state(nn_state_t* state);
+
+/**
+ * @brief Restore state saved by nn_save_state() under the same model
+ * @param state    Saved state
+ * @param shift_us Added to the saved feature timestamps (see nn_features_restore())
+ *
+ * Refresh phases saved under a different refresh period keep the current
+ * stagger. Restore the windows (history_restore_state()) as well.
+ */
+void nn_restore_state(const nn_state_t* state, int64_t shift_us);
+
+/**
+ * @brief Fingerprint of the model, feature configuration and scaler
+ * @return CRC-32 a host compensator must reproduce (0 before nn_init())
+ */
+uint32_t nn_get_fingerprint(void);
+
 /**
  * @brief Check if the neural network is ready for inference
  *
@@ -53,6 +152,11 @@ bool nn_is_ready(void);
  */
 uint32_t nn_get_inference_time_us(void);
 
+/**
+ * @brief Get the number of invokes run since boot
+ */
+uint32_t nn_get_inference_count(void);
+
 #ifdef __cplusplus
 }
 #endif
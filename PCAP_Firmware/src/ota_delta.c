@@ -0,0 +1,255 @@
+/**
+ * @file ota_delta.c
+ * @brief Delta patch firmware updates over BLE (ESP-IDF)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ota_delta.h"
+#include "delta_patch.h"
+#include "ble_manager.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/stream_buffer.h"
+
+static const char* TAG = "OTA";
+
+#define OTA_DELTA_POLL_MS   100     // Abort and timeout checks while waiting for data
+
+static StreamBufferHandle_t stream = NULL;
+static volatile bool active = false;
+static volatile bool abort_requested = false;
+static volatile bool overflowed = false;
+static uint32_t patch_size = 0;
+
+// Update in progress, owned by the task
+static const esp_partition_t* running = NULL;
+static const esp_partition_t* update = NULL;
+static esp_ota_handle_t ota_handle = 0;
+static bool ota_open = false;
+static uint8_t target_sha256[32];
+static const char* io_error = NULL;
+
+static void send_status(const char* text)
+{
+    ESP_LOGI(TAG, "%s", text);
+    ble_send_status(text);
+}
+
+static bool io_begin(void* ctx, const delta_header_t* header)
+{
+    // A patch that copies nothing (a full image) has no source to check
+    if (header->source_size > 0) {
+        uint8_t sha[32];
+        if (header->source_size > running->size ||
+            esp_partition_get_sha256(running, sha) != ESP_OK ||
+            memcmp(sha, header->source_sha256, sizeof(sha)) != 0) {
+            io_error = "source";
+            return false;
+        }
+    }
+    if (header->target_size > update->size) {
+        io_error = "target size";
+        return false;
+    }
+    // Sequential writes erase each sector as the decoder reaches it, instead
+    // of the whole image's span before the first byte is taken
+    esp_err_t err = esp_ota_begin(update, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        io_error = "begin";
+        return false;
+    }
+    ota_open = true;
+    memcpy(target_sha256, header->target_sha256, sizeof(target_sha256));
+    ESP_LOGI(TAG, "Patch %lu bytes: %lu-byte image into %s",
+             (unsigned long)patch_size, (unsigned long)header->target_size, update->label);
+    return true;
+}
+
+static bool io_read_source(void* ctx, uint32_t offset, uint8_t* dst, uint32_t len)
+{
+    if (esp_partition_read(running, offset, dst, len) != ESP_OK) {
+        io_error = "read";
+        return false;
+    }
+    return true;
+}
+
+static bool io_write_target(void* ctx, const uint8_t* data, uint32_t len)
+{
+    esp_err_t err = esp_ota_write(ota_handle, data, len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_write failed: %s", esp_err_to_name(err));
+        io_error = "write";
+        return false;
+    }
+    return true;
+}
+
+static const delta_io_t patch_io = {
+    .begin = io_begin,
+    .read_source = io_read_source,
+    .write_target = io_write_target,
+    .ctx = NULL,
+};
+
+// Validate the written image and make it the boot partition; NULL on success
+static const char* finish(void)
+{
+    ota_open = false;
+    esp_err_t err = esp_ota_end(ota_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
+        return "image";
+    }
+
+    // What is in flash, not what was meant to be written
+    uint8_t sha[32];
+    if (esp_partition_get_sha256(update, sha) != ESP_OK ||
+        memcmp(sha, target_sha256, sizeof(sha)) != 0) {
+        return "hash";
+    }
+    if (esp_ota_set_boot_partition(update) != ESP_OK) {
+        return "boot";
+    }
+    return NULL;
+}
+
+// Decode the patch as it arrives
+static const char* run_update(void)
+{
+    static uint8_t piece[OTA_DELTA_PIECE];
+    static const char* const status_names[] = {"more", "done", "format", "range", "io"};
+    uint32_t consumed = 0;
+    uint32_t acked = 0;
+    uint32_t idle_ms = 0;
+    delta_status_t status = DELTA_MORE;
+    char line[24];
+
+    delta_patch_begin(&patch_io);
+    while (status == DELTA_MORE) {
+        if (abort_requested) {
+            return "aborted";
+        }
+        if (overflowed) {
+            return "overflow";
+        }
+        size_t n = xStreamBufferReceive(stream, piece, sizeof(piece), pdMS_TO_TICKS(OTA_DELTA_POLL_MS));
+        if (n == 0) {
+            idle_ms += OTA_DELTA_POLL_MS;
+            if (idle_ms >= OTA_DELTA_TIMEOUT_MS) {
+                return "timeout";
+            }
+            continue;
+        }
+        idle_ms = 0;
+        if (consumed + n > patch_size) {
+            return "size";
+        }
+
+        status = delta_patch_feed(piece, n);
+        consumed += n;
+        if (consumed - acked >= OTA_DELTA_ACK_BYTES || consumed == patch_size) {
+            acked = consumed;
+            snprintf(line, sizeof(line), "W,%lu", (unsigned long)consumed);
+            ble_send_status(line);
+        }
+    }
+
+    if (status == DELTA_ERR_IO && io_error) {
+        return io_error;
+    }
+    if (status != DELTA_DONE) {
+        return status_names[status];
+    }
+    if (consumed != patch_size) {
+        return "size";
+    }
+    return finish();
+}
+
+static void ota_task(void* pvParameters)
+{
+    int64_t start = esp_timer_get_time();
+    const char* error = run_update();
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+    char line[BLE_NOTIFY_PAYLOAD_MAX];
+
+    if (ota_open) {
+        esp_ota_abort(ota_handle);
+        ota_open = false;
+    }
+    if (error) {
+        snprintf(line, sizeof(line), "OTA,ERR,%s", error);
+        send_status(line);
+        active = false;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    snprintf(line, sizeof(line), "OTA,OK,%lu,%lu", (unsigned long)patch_size, (unsigned long)elapsed_ms);
+    send_status(line);
+    ESP_LOGI(TAG, "%lu B/s; restarting into %s", (unsigned long)(elapsed_ms ? patch_size * 1000ULL / elapsed_ms : 0),
+             update->label);
+    vTaskDelay(pdMS_TO_TICKS(OTA_DELTA_RESTART_MS));
+    esp_restart();
+}
+
+bool ota_delta_begin(uint32_t size)
+{
+    if (active) {
+        ESP_LOGW(TAG, "Update already in progress");
+        return false;
+    }
+    if (stream == NULL) {
+        stream = xStreamBufferCreate(OTA_DELTA_WINDOW, 1);
+        if (stream == NULL) {
+            send_status("OTA,ERR,memory");
+            return false;
+        }
+    }
+    xStreamBufferReset(stream);
+
+    running = esp_ota_get_running_partition();
+    update = esp_ota_get_next_update_partition(NULL);
+    if (update == NULL) {
+        send_status("OTA,ERR,partition");
+        return false;
+    }
+
+    patch_size = size;
+    abort_requested = false;
+    overflowed = false;
+    io_error = NULL;
+    active = true;
+    if (xTaskCreate(ota_task, "ota_delta", OTA_DELTA_TASK_STACK, NULL, OTA_DELTA_TASK_PRIORITY, NULL) != pdPASS) {
+        active = false;
+        send_status("OTA,ERR,memory");
+        return false;
+    }
+    return true;
+}
+
+void ota_delta_data(const uint8_t* data, uint16_t len)
+{
+    if (!active) {
+        return;
+    }
+    // The host's window fits the buffer; anything more is lost data
+    if (xStreamBufferSend(stream, data, len, 0) != len) {
+        overflowed = true;
+    }
+}
+
+void ota_delta_abort(void)
+{
+    if (active) {
+        abort_requested = true;
+    }
+}
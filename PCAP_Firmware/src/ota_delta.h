@@ -0,0 +1,70 @@
+/**
+ * @file ota_delta.h
+ * @brief Firmware updates over BLE from delta patches (ESP-IDF)
+ *
+ * The host pairs with BLE_OTA_PASSKEY, sends BLE_CTRL_OTA_BEGIN with the
+ * patch size, then the patch (delta_patch.h) as writes to the OTA
+ * characteristic; ble_manager.c refuses both on a link that is not
+ * encrypted with keys from passkey pairing. The writes go
+ * through a stream buffer to an update task, which checks the installed
+ * image's SHA-256 against the patch header, applies the patch into the
+ * inactive OTA slot and acknowledges consumed bytes on the status
+ * characteristic ("W,<bytes>"). The host keeps at most OTA_DELTA_WINDOW
+ * bytes unacknowledged, so the buffer never overflows. Once the patch is
+ * through, the written image is validated and its SHA-256 read back from
+ * flash and compared with the header before the slot becomes the boot
+ * partition. The result is one status line, "OTA,OK,<bytes>,<ms>" followed
+ * by a restart, or "OTA,ERR,<reason>".
+ *
+ * A full image travels the same way as a patch of one literal block with
+ * an empty source, so both kinds of update share the path and compare
+ * directly (tools/ota/delta_ota.py).
+ */
+
+#ifndef OTA_DELTA_H
+#define OTA_DELTA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup OtaConfig Delta OTA Configuration
+ * @{
+ */
+#define OTA_DELTA_WINDOW            4096    ///< Patch bytes the host may have unacknowledged
+#define OTA_DELTA_ACK_BYTES         1024    ///< Consumed bytes per "W," acknowledgement
+#define OTA_DELTA_PIECE             256     ///< Patch bytes fed to the decoder at a time
+#define OTA_DELTA_TIMEOUT_MS        10000   ///< Silence that abandons an update
+#define OTA_DELTA_RESTART_MS        500     ///< Delay before restarting into the new image
+#define OTA_DELTA_TASK_PRIORITY     1       ///< Below acquisition; flash writes take their time
+#define OTA_DELTA_TASK_STACK        4096
+/** @} */
+
+/**
+ * @brief Start an update
+ * @param patch_size Bytes of patch that will follow
+ * @return false if an update is already running or the task could not start
+ *
+ * Called from the control handler; does not block.
+ */
+bool ota_delta_begin(uint32_t patch_size);
+
+/**
+ * @brief Take the next piece of patch (ble_ota_handler_t)
+ */
+void ota_delta_data(const uint8_t* data, uint16_t len);
+
+/**
+ * @brief Abandon the update in progress, leaving the boot partition as it is
+ */
+void ota_delta_abort(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // OTA_DELTA_H
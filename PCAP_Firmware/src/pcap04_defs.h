@@ -78,6 +78,18 @@ extern "C" {
 #define PCAP_SCALING_NUM 1000
 /** @} */
 
+/**
+ * @defgroup ConfigFields Configuration Register Fields
+ * @brief Fields changed at run time, as byte offsets into the configuration
+ * @{
+ */
+#define PCAP_CFG_TRIG_REG       13          ///< Register holding C_TRIG_SEL
+#define PCAP_CFG_TRIG_SHIFT     2           ///< C_TRIG_SEL[2:0] position
+#define PCAP_CFG_TRIG_MASK      (0x07 << PCAP_CFG_TRIG_SHIFT)
+#define PCAP_TRIG_CONTINUOUS    0           ///< Free-running, a conversion every CONV_TIME
+#define PCAP_TRIG_OPCODE        5           ///< One conversion per PCAP_CDC_START
+/** @} */
+
 /**
  * @struct pcap_data_t
  * @brief Data structure for storing PCAP04 measurement results
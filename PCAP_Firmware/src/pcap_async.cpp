@@ -0,0 +1,252 @@
+/**
+ * @file pcap_async.cpp
+ * @brief Asynchronous PCAP04 driver operations and their FreeRTOS executor
+ */
+
+#include "pcap_async.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+static const char* TAG = "PCAP_ASYNC";
+
+static portMUX_TYPE async_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t async_task_handle = NULL;
+
+static int64_t async_now_us(void)
+{
+    return esp_timer_get_time();
+}
+
+static void async_lock(void)
+{
+    portENTER_CRITICAL(&async_spinlock);
+}
+
+static void async_unlock(void)
+{
+    portEXIT_CRITICAL(&async_spinlock);
+}
+
+static void async_wake(void)
+{
+    if (async_task_handle) {
+        xTaskNotifyGive(async_task_handle);
+    }
+}
+
+static const async::async_ops_t async_ops = {
+    .now_us = async_now_us,
+    .lock = async_lock,
+    .unlock = async_unlock,
+    .wake = async_wake,
+};
+
+static async::Executor exec(&async_ops);
+
+static void async_task(void* pvParameters)
+{
+    while (1) {
+        uint32_t wait_us = exec.run();
+        TickType_t ticks = (wait_us == async::IDLE_WAIT_US) ? portMAX_DELAY
+                                                            : pdMS_TO_TICKS(wait_us / 1000) + 1;
+        ulTaskNotifyTake(pdTRUE, ticks);
+    }
+}
+
+void pcap_async_init(void)
+{
+    xTaskCreate(async_task, "pcap_async", PCAP_ASYNC_TASK_STACK, NULL, PCAP_ASYNC_TASK_PRIORITY, &async_task_handle);
+    ESP_LOGI(TAG, "Async executor started");
+}
+
+namespace pcap {
+
+async::Executor& executor()
+{
+    return exec;
+}
+
+async::Task<bool> test_communication(pcap_chip_select_t chip)
+{
+    const uint8_t tx[2] = {PCAP_TEST_READ, 0x00};
+    uint8_t rx[2] = {0};
+    bus_op_t op = {};
+    op.chip = chip;
+    op.cmd_len = 1;
+    op.len = 2;
+    op.tx = tx;
+    op.rx = rx;
+
+    co_await async::bus(exec, BUS_PRIO_CONTROL, &op, 1);
+    co_return rx[1] == PCAP_TEST_RESPONSE;
+}
+
+async::Task<void> init_chip(pcap_chip_select_t chip)
+{
+    // Power-on reset, then initialize
+    static const uint8_t por = PCAP_POR;
+    static const uint8_t init = PCAP_INIT;
+    bus_op_t ops[2] = {};
+    ops[0].chip = ops[1].chip = chip;
+    ops[0].len = ops[1].len = 1;
+    ops[0].tx = &por;
+    ops[1].tx = &init;
+
+    co_await async::bus(exec, BUS_PRIO_CONTROL, ops, 2);
+}
+
+async::Task<void> write_firmware(pcap_chip_select_t chip, const uint8_t* firmware, uint16_t size)
+{
+    ESP_LOGI(TAG, "Uploading firmware to PCAP chip %d (%d bytes)", chip, size);
+
+    uint8_t frame[2 + PCAP_FW_CHUNK_SIZE];
+    for (uint16_t addr = 0; addr < size; addr += PCAP_FW_CHUNK_SIZE) {
+        bus_op_t op;
+        pcap_firmware_chunk_op(chip, firmware, size, addr, frame, &op);
+        co_await async::bus(exec, BUS_PRIO_CONTROL, &op, 1);
+    }
+}
+
+async::Task<bool> write_config(pcap_chip_select_t chip, const uint8_t* config, uint16_t size)
+{
+    uint8_t frame[2 + PCAP_CONFIG_SIZE];
+    bus_op_t op;
+    if (!pcap_config_op(chip, config, size, frame, &op)) {
+        co_return false;
+    }
+    co_await async::bus(exec, BUS_PRIO_CONTROL, &op, 1);
+
+    // Allow config to settle, without holding a task
+    co_await async::sleep_ms(exec, PCAP_CONFIG_SETTLE_MS);
+    co_return true;
+}
+
+async::Task<void> start_cdc(pcap_chip_select_t chip)
+{
+    static const uint8_t opcode = PCAP_CDC_START;
+    bus_op_t op = {};
+    op.chip = chip;
+    op.len = 1;
+    op.tx = &opcode;
+
+    co_await async::bus(exec, BUS_PRIO_CONTROL, &op, 1);
+}
+
+async::Task<void> read_data(pcap_chip_select_t chip, pcap_data_t* data)
+{
+    uint8_t tx[NUM_SENSORS_PER_CHIP][PCAP_RESULT_FRAME_LEN];
+    uint8_t rx[NUM_SENSORS_PER_CHIP][PCAP_RESULT_FRAME_LEN];
+    bus_op_t ops[NUM_SENSORS_PER_CHIP];
+
+    pcap_read_ops(chip, tx, rx, ops);
+    co_await async::bus(exec, BUS_PRIO_REALTIME, ops, NUM_SENSORS_PER_CHIP);
+    pcap_read_decode(rx, data);
+}
+
+async::Task<void> calibrate(pcap_chip_select_t chip, pcap_data_t* data, uint16_t num_samples)
+{
+    if (num_samples == 0) {
+        ESP_LOGE(TAG, "calibrate called with 0 samples");
+        co_return;
+    }
+
+    uint64_t accumulator[NUM_SENSORS_PER_CHIP] = {0};
+    for (int s = 0; s < num_samples; s++) {
+        co_await read_data(chip, data);
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            accumulator[i] += data->raw[i];
+        }
+    }
+
+    for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+        data->offset[i] = (accumulator[i] / num_samples);
+    }
+}
+
+async::Task<bool> bring_up(pcap_chip_select_t chip, const pcap_bring_up_t* params, pcap_data_t* data)
+{
+    bool answered = false;
+    for (int attempt = 0; attempt < params->comm_retries && !answered; attempt++) {
+        answered = co_await test_communication(chip);
+    }
+    if (!answered) {
+        ESP_LOGW(TAG, "Chip %d failed communication test after %d attempts", chip, params->comm_retries);
+        co_return false;
+    }
+
+    co_await init_chip(chip);
+    co_await write_firmware(chip, params->firmware, params->firmware_size);
+    // co_await kept out of if conditions: GCC 12 miscompiles the whole
+    // coroutine around one (tools/bus/check_async_bringup.py)
+    bool configured = co_await write_config(chip, params->config, params->config_size);
+    if (!configured) {
+        ESP_LOGE(TAG, "Chip %d: config of %d bytes exceeds %d", chip, params->config_size, PCAP_CONFIG_SIZE);
+        co_return false;
+    }
+    co_await start_cdc(chip);
+    co_await async::sleep_ms(exec, PCAP_CDC_SETTLE_MS);
+    co_await calibrate(chip, data, params->calibration_samples);
+
+    ESP_LOGI(TAG, "Chip %d up", chip);
+    co_return true;
+}
+
+} // namespace pcap
+
+namespace {
+
+struct BringUpJob {
+    const pcap_bring_up_t* params;
+    uint8_t chips_mask;
+    pcap_data_t* data;
+    uint8_t usable;
+    SemaphoreHandle_t done;
+};
+
+async::Task<void> bring_up_one(BringUpJob* job, int chip)
+{
+    bool up = co_await pcap::bring_up((pcap_chip_select_t)chip, job->params, &job->data[chip]);
+    if (up) {
+        job->usable |= 1u << chip;
+    }
+}
+
+async::Task<void> bring_up_all(BringUpJob* job)
+{
+    async::WaitGroup group;
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        if (job->chips_mask & (1u << chip)) {
+            async::spawn(exec, bring_up_one(job, chip), &group);
+        }
+    }
+    co_await group.wait();
+
+    // Its own semaphore rather than the caller's task notification, which
+    // other code gives too. The job is on the caller's stack and gone once
+    // the caller takes it.
+    xSemaphoreGive(job->done);
+}
+
+} // namespace
+
+uint8_t pcap_async_bring_up(const pcap_bring_up_t* params, uint8_t chips_mask,
+                            pcap_data_t data[NUM_PCAP_CHIPS])
+{
+    if (async_task_handle == NULL) {
+        ESP_LOGE(TAG, "pcap_async_bring_up called before pcap_async_init");
+        return 0;
+    }
+
+    int64_t start = esp_timer_get_time();
+    StaticSemaphore_t done_buffer;
+    BringUpJob job = {params, chips_mask, data, 0, xSemaphoreCreateBinaryStatic(&done_buffer)};
+    async::spawn(exec, bring_up_all(&job));
+    xSemaphoreTake(job.done, portMAX_DELAY);
+
+    ESP_LOGI(TAG, "Brought up chips 0x%02X of 0x%02X in %lld ms", job.usable, chips_mask,
+             (long long)((esp_timer_get_time() - start) / 1000));
+    return job.usable;
+}
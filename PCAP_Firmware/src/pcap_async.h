@@ -0,0 +1,93 @@
+/**
+ * @file pcap_async.h
+ * @brief Asynchronous PCAP04 driver operations (C++20 coroutines)
+ *
+ * The same chip operations as pcap_driver.h, as coroutines that suspend on
+ * bus completion and on timers instead of blocking a task. They run on one
+ * executor task, so bringing up eight chips concurrently takes one stack:
+ * while one chip settles after a configuration write, the bus serves the
+ * firmware upload of another.
+ *
+ * C callers get whole sequences through a blocking wrapper
+ * (pcap_async_bring_up()); C++ callers can co_await single operations.
+ * Every bus transfer still goes through the bus scheduler, so async work is
+ * arbitrated against acquisition like any other client.
+ */
+
+#ifndef PCAP_ASYNC_H
+#define PCAP_ASYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcap_driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup AsyncConfig Async Driver Configuration
+ * @{
+ */
+#define PCAP_ASYNC_TASK_PRIORITY    4       ///< Below the bus task, above the sensor task
+#define PCAP_ASYNC_TASK_STACK       4096    ///< Executor stack; coroutine frames live on the heap
+#define PCAP_CDC_SETTLE_MS          20      ///< Wait between CDC start and calibration
+/** @} */
+
+/**
+ * @brief Everything a chip needs to come up
+ */
+typedef struct {
+    const uint8_t* firmware;
+    uint16_t firmware_size;
+    const uint8_t* config;
+    uint16_t config_size;
+    uint16_t calibration_samples;   ///< Reads averaged into the offsets
+    uint8_t comm_retries;           ///< Communication test attempts per chip
+} pcap_bring_up_t;
+
+/**
+ * @brief Start the executor task
+ *
+ * Call after pcap_driver_init().
+ */
+void pcap_async_init(void);
+
+/**
+ * @brief Bring up chips concurrently: test, reset, firmware, config, CDC, calibrate
+ * @param params     Firmware, configuration and calibration settings
+ * @param chips_mask Bit per chip to bring up
+ * @param data       Receives each chip's calibration offsets
+ * @return Bit per chip that answered the communication test and came up
+ *
+ * Blocks the calling task until every chip is done.
+ */
+uint8_t pcap_async_bring_up(const pcap_bring_up_t* params, uint8_t chips_mask,
+                            pcap_data_t data[NUM_PCAP_CHIPS]);
+
+#ifdef __cplusplus
+}
+
+#include "async_exec.h"
+
+namespace pcap {
+
+/// The executor the operations run on
+async::Executor& executor();
+
+async::Task<bool> test_communication(pcap_chip_select_t chip);
+async::Task<void> init_chip(pcap_chip_select_t chip);
+async::Task<void> write_firmware(pcap_chip_select_t chip, const uint8_t* firmware, uint16_t size);
+async::Task<bool> write_config(pcap_chip_select_t chip, const uint8_t* config, uint16_t size);
+async::Task<void> start_cdc(pcap_chip_select_t chip);
+async::Task<void> read_data(pcap_chip_select_t chip, pcap_data_t* data);
+async::Task<void> calibrate(pcap_chip_select_t chip, pcap_data_t* data, uint16_t num_samples);
+
+/// The pcap_async_bring_up() sequence for one chip
+async::Task<bool> bring_up(pcap_chip_select_t chip, const pcap_bring_up_t* params, pcap_data_t* data);
+
+} // namespace pcap
+
+#endif // __cplusplus
+
+#endif // PCAP_ASYNC_H
@@ -4,8 +4,12 @@
  */
 
 #include "pcap_driver.h"
+#include "pcap_emulator.h"
 #include "esp_log.h"
 #include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "string.h"
 
 static const char* TAG = "PCAP";
@@ -13,9 +17,116 @@ static const char* TAG = "PCAP";
 static spi_device_handle_t spi_handle;
 static const uint8_t sensor_addr[NUM_SENSORS_PER_CHIP] = {0x00, 0x04, 0x08, 0x0C, 0x10, 0x14};
 
-// Internal SPI transfer functions
-static uint8_t spi_transfer_byte(uint8_t data);
-static void spi_transfer_bytes(const uint8_t* tx_data, uint8_t* rx_data, size_t len);
+static portMUX_TYPE bus_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t bus_task_handle = NULL;
+
+// Triggered conversion: the timer wakes the task waiting for the results
+static esp_timer_handle_t conversion_timer = NULL;
+static TaskHandle_t conversion_waiter = NULL;
+static volatile bool conversion_done = false;
+
+static void spi_transfer_bytes(const uint8_t* tx_data, uint8_t* rx_data, size_t len)
+{
+#if PCAP_QEMU_BUILD
+    pcap_emu_transfer(tx_data, rx_data, len);
+    return;
+#endif
+    // Command and result frames fit the transaction's inline buffers, which
+    // avoids a DMA bounce buffer for unaligned stack data on every read
+    if (len <= 4) {
+        spi_transaction_t trans = {
+            .length = len * 8,
+            .flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA,
+        };
+        if (tx_data) {
+            memcpy(trans.tx_data, tx_data, len);
+        }
+        spi_device_polling_transmit(spi_handle, &trans);
+        if (rx_data) {
+            memcpy(rx_data, trans.rx_data, len);
+        }
+        return;
+    }
+
+    spi_transaction_t trans = {
+        .length = len * 8,
+        .tx_buffer = tx_data,
+        .rx_buffer = rx_data,
+    };
+    spi_device_polling_transmit(spi_handle, &trans);
+}
+
+// Bus scheduler binding: the scheduler runs in bus_task and is the only
+// code that touches the SPI device and the mux after pcap_driver_init()
+static void bus_select(uint8_t chip)
+{
+    mux_select_chip((pcap_chip_select_t)chip);
+}
+
+static void bus_select_quick(uint8_t chip)
+{
+    mux_select_chip_quick((pcap_chip_select_t)chip);
+}
+
+static void bus_deselect(void)
+{
+    mux_deselect_chip();
+}
+
+static void bus_delay_us(uint32_t us)
+{
+    esp_rom_delay_us(us);
+}
+
+static int64_t bus_now_us(void)
+{
+    return esp_timer_get_time();
+}
+
+static void bus_lock(void)
+{
+    portENTER_CRITICAL(&bus_spinlock);
+}
+
+static void bus_unlock(void)
+{
+    portEXIT_CRITICAL(&bus_spinlock);
+}
+
+static void bus_kick(void)
+{
+    if (bus_task_handle) {
+        xTaskNotifyGive(bus_task_handle);
+    }
+}
+
+static const bus_ops_t bus_ops = {
+    .select = bus_select,
+    .deselect = bus_deselect,
+    .transfer = spi_transfer_bytes,
+    .delay_us = bus_delay_us,
+    .now_us = bus_now_us,
+    .lock = bus_lock,
+    .unlock = bus_unlock,
+    .kick = bus_kick,
+    .select_quick = bus_select_quick,
+};
+
+static void conversion_timer_cb(void* arg)
+{
+    conversion_done = true;
+    xTaskNotifyGive(conversion_waiter);
+}
+
+static void bus_task(void* pvParameters)
+{
+    while (1) {
+        uint32_t wait_us = bus_sched_run();
+        TickType_t ticks = (wait_us == BUS_SCHED_IDLE_WAIT_US) ? portMAX_DELAY
+                                                               : pdMS_TO_TICKS(wait_us / 1000) + 1;
+        ulTaskNotifyTake(pdTRUE, ticks);
+    }
+}
 
 void pcap_driver_init(void)
 {
@@ -24,6 +135,10 @@ void pcap_driver_init(void)
     // Initialize multiplexer
     mux_init();
 
+#if PCAP_QEMU_BUILD
+    // QEMU has no GPSPI model; transfers go to pcap_emulator.c instead
+    ESP_LOGI(TAG, "Using emulated bus");
+#else
     // Configure SPI bus
     spi_bus_config_t bus_cfg = {
         .mosi_io_num = PCAP_SPI_MOSI_PIN,
@@ -54,97 +169,143 @@ void pcap_driver_init(void)
         ESP_LOGE(TAG, "Failed to add SPI device: %s", esp_err_to_name(ret));
         return;
     }
+#endif
+
+    // From here on the bus task owns the SPI device and the mux
+    bus_sched_init(&bus_ops, (uint32_t)(8ULL * 1000000000ULL / PCAP_SPI_CLOCK_HZ));
+    xTaskCreate(bus_task, "pcap_bus", PCAP_BUS_TASK_STACK, NULL, PCAP_BUS_TASK_PRIORITY, &bus_task_handle);
+
+    const esp_timer_create_args_t timer_args = { .callback = conversion_timer_cb, .name = "pcap_conv" };
+    esp_timer_create(&timer_args, &conversion_timer);
 
     ESP_LOGI(TAG, "PCAP driver initialized");
 }
 
-static uint8_t spi_transfer_byte(uint8_t data)
+static void bus_wake_waiter(bus_batch_t* batch)
 {
-    spi_transaction_t trans = {
-        .length = 8,
-        .tx_buffer = &data,
-        .rx_buffer = NULL,
-        .flags = SPI_TRANS_USE_RXDATA,
-    };
-    spi_device_polling_transmit(spi_handle, &trans);
-    return trans.rx_data[0];
+    xTaskNotifyGive((TaskHandle_t)batch->ctx);
 }
 
-static void spi_transfer_bytes(const uint8_t* tx_data, uint8_t* rx_data, size_t len)
+// Run a batch and wait for it; the batch's timing fields are valid after
+static bool execute_batch(bus_batch_t* batch)
 {
-    spi_transaction_t trans = {
-        .length = len * 8,
-        .tx_buffer = tx_data,
-        .rx_buffer = rx_data,
+    batch->on_done = bus_wake_waiter;
+    batch->ctx = xTaskGetCurrentTaskHandle();
+
+    if (bus_task_handle == NULL || !bus_sched_submit(batch)) {
+        ESP_LOGE(TAG, "Rejected bus batch (class %d, %d ops)", batch->prio, batch->count);
+        return false;
+    }
+    while (!batch->done) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    return true;
+}
+
+void pcap_bus_execute(bus_prio_t prio, bus_op_t* ops, uint16_t count)
+{
+    bus_batch_t batch = {
+        .ops = ops,
+        .count = count,
+        .prio = prio,
     };
-    spi_device_polling_transmit(spi_handle, &trans);
+    execute_batch(&batch);
 }
 
-static uint8_t spi_transmit_u8(pcap_chip_select_t chip, uint8_t data)
+void pcap_bus_report(void)
 {
-    uint8_t rx;
-    mux_select_chip(chip);
-    rx = spi_transfer_byte(data);
-    esp_rom_delay_us(1);
-    mux_deselect_chip();
-    esp_rom_delay_us(1);
-    return rx;
+    static const char* class_names[BUS_PRIO_COUNT] = {"realtime", "control", "background"};
+
+    for (int p = 0; p < BUS_PRIO_COUNT; p++) {
+        bus_class_stats_t stats;
+        bus_sched_get_stats((bus_prio_t)p, &stats);
+        ESP_LOGI(TAG, "Bus %s: %lu batches, latency avg %lu max %lu us, depth %u (max %u), deferred %lu",
+                 class_names[p], stats.batches, stats.latency_avg_us, stats.latency_max_us,
+                 stats.depth, stats.depth_max, stats.deferrals);
+    }
+}
+
+// Single-byte opcode frame
+static void send_opcode(pcap_chip_select_t chip, uint8_t opcode, bus_prio_t prio)
+{
+    bus_op_t op = { .chip = chip, .len = 1, .tx = &opcode };
+    pcap_bus_execute(prio, &op, 1);
 }
 
 bool pcap_init_chip(pcap_chip_select_t chip)
 {
     ESP_LOGI(TAG, "Initializing PCAP chip %d", chip);
 
-    // Power-on reset
-    spi_transmit_u8(chip, PCAP_POR);
-
-    // Initialize
-    spi_transmit_u8(chip, PCAP_INIT);
+    // Power-on reset, then initialize
+    static const uint8_t por = PCAP_POR;
+    static const uint8_t init = PCAP_INIT;
+    bus_op_t ops[] = {
+        { .chip = chip, .len = 1, .tx = &por },
+        { .chip = chip, .len = 1, .tx = &init },
+    };
+    pcap_bus_execute(BUS_PRIO_CONTROL, ops, 2);
 
     ESP_LOGI(TAG, "POR and INIT sent to chip %d", chip);
     return true;
 }
 
+uint16_t pcap_firmware_chunk_op(pcap_chip_select_t chip, const uint8_t* firmware, uint16_t size,
+                                uint16_t addr, uint8_t frame[2 + PCAP_FW_CHUNK_SIZE], bus_op_t* op)
+{
+    uint16_t n = (size - addr < PCAP_FW_CHUNK_SIZE) ? size - addr : PCAP_FW_CHUNK_SIZE;
+    frame[0] = PCAP_WR_MEM | ((addr >> 8) & 0x03);
+    frame[1] = addr & 0xFF;
+    memcpy(&frame[2], &firmware[addr], n);
+    *op = (bus_op_t){ .chip = chip, .len = 2 + n, .tx = frame };
+    return n;
+}
+
 bool pcap_write_firmware(pcap_chip_select_t chip, const uint8_t* firmware, uint16_t size)
 {
     ESP_LOGI(TAG, "Uploading firmware to PCAP chip %d (%d bytes)", chip, size);
 
-    mux_select_chip(chip);
-
-    // Send write memory command and start address
-    spi_transfer_byte(PCAP_WR_MEM);
-    spi_transfer_byte(0x00);
-
-    // Transfer firmware bytes
-    for (int i = 0; i < size; i++) {
-        spi_transfer_byte(firmware[i]);
+    // One write frame per chunk, each carrying its own start address, so
+    // acquisition of other chips can run between chunks
+    uint8_t frame[2 + PCAP_FW_CHUNK_SIZE];
+    for (uint16_t addr = 0; addr < size; addr += PCAP_FW_CHUNK_SIZE) {
+        bus_op_t op;
+        pcap_firmware_chunk_op(chip, firmware, size, addr, frame, &op);
+        pcap_bus_execute(BUS_PRIO_CONTROL, &op, 1);
     }
 
-    mux_deselect_chip();
-
     ESP_LOGI(TAG, "Firmware upload complete for chip %d", chip);
     return true;
 }
  
-bool pcap_write_config(pcap_chip_select_t chip, const uint8_t* config, uint16_t size)
+bool pcap_config_op(pcap_chip_select_t chip, const uint8_t* config, uint16_t size,
+                    uint8_t frame[2 + PCAP_CONFIG_SIZE], bus_op_t* op)
 {
-    ESP_LOGI(TAG, "Writing config to PCAP chip %d (%d bytes)", chip, size);
+    if (size > PCAP_CONFIG_SIZE) {
+        ESP_LOGE(TAG, "Config of %d bytes exceeds %d", size, PCAP_CONFIG_SIZE);
+        return false;
+    }
 
-    mux_select_chip(chip);
+    // Write config command (16-bit) followed by the config bytes
+    frame[0] = (PCAP_WR_CONFIG >> 8) & 0xFF;
+    frame[1] = PCAP_WR_CONFIG & 0xFF;
+    memcpy(&frame[2], config, size);
+    *op = (bus_op_t){ .chip = chip, .len = 2 + size, .tx = frame };
+    return true;
+}
 
-    // Send write config command (16-bit)
-    spi_transfer_byte((PCAP_WR_CONFIG >> 8) & 0xFF);
-    spi_transfer_byte(PCAP_WR_CONFIG & 0xFF);
+bool pcap_write_config(pcap_chip_select_t chip, const uint8_t* config, uint16_t size)
+{
+    ESP_LOGI(TAG, "Writing config to PCAP chip %d (%d bytes)", chip, size);
 
-    // Transfer config bytes
-    for (int i = 0; i < size; i++) {
-        spi_transfer_byte(config[i]);
+    uint8_t frame[2 + PCAP_CONFIG_SIZE];
+    bus_op_t op;
+    if (!pcap_config_op(chip, config, size, frame, &op)) {
+        return false;
     }
-
-    mux_deselect_chip();
+    pcap_bus_execute(BUS_PRIO_CONTROL, &op, 1);
 
     // Allow config to settle
-    vTaskDelay(pdMS_TO_TICKS(10));
+    vTaskDelay(pdMS_TO_TICKS(PCAP_CONFIG_SETTLE_MS));
 
     ESP_LOGI(TAG, "Successfully wrote config to chip %d", chip);
     return true;
@@ -160,58 +321,82 @@ void pcap_read_config(pcap_chip_select_t chip, uint8_t* buffer, uint16_t size)
 
 void pcap_start_cdc(pcap_chip_select_t chip)
 {
-    spi_transmit_u8(chip, PCAP_CDC_START);
+    send_opcode(chip, PCAP_CDC_START, BUS_PRIO_CONTROL);
 }
 
 void pcap_start_rdc(pcap_chip_select_t chip)
 {
-    spi_transmit_u8(chip, PCAP_RDC_START);
+    send_opcode(chip, PCAP_RDC_START, BUS_PRIO_CONTROL);
 }
 
-void pcap_read_data(pcap_chip_select_t chip, pcap_data_t* data)
+// Result read frame: opcode, command gap, 4 little-endian result bytes
+static void read_result_op(bus_op_t* op, pcap_chip_select_t chip, uint8_t sensor_num,
+                           uint8_t tx[PCAP_RESULT_FRAME_LEN], uint8_t rx[PCAP_RESULT_FRAME_LEN])
+{
+    memset(tx, 0, PCAP_RESULT_FRAME_LEN);
+    tx[0] = PCAP_RD_RESULT | sensor_addr[sensor_num];
+    *op = (bus_op_t){ .chip = chip, .cmd_len = 1, .len = PCAP_RESULT_FRAME_LEN, .tx = tx, .rx = rx };
+}
+
+static float result_value(const uint8_t rx[PCAP_RESULT_FRAME_LEN])
+{
+    uint32_t raw = ((uint32_t)rx[4] << 24) | ((uint32_t)rx[3] << 16) | ((uint32_t)rx[2] <<  8) | ((uint32_t)rx[1] <<  0);
+    return (float)raw;
+}
+
+void pcap_read_ops(pcap_chip_select_t chip, uint8_t tx[][PCAP_RESULT_FRAME_LEN],
+                   uint8_t rx[][PCAP_RESULT_FRAME_LEN], bus_op_t ops[NUM_SENSORS_PER_CHIP])
 {
-    float result;
     for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
-        mux_select_chip(chip);
-        result = pcap_read_sensor(chip, i);
-        mux_deselect_chip();
+        read_result_op(&ops[i], chip, i, tx[i], rx[i]);
+    }
+}
 
-        if (data != NULL) {
-            data->raw[i] = result;
-        }
+void pcap_read_decode(const uint8_t rx[][PCAP_RESULT_FRAME_LEN], pcap_data_t* data)
+{
+    for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+        data->raw[i] = result_value(rx[i]);
     }
 }
 
-float pcap_read_sensor(pcap_chip_select_t chip, uint8_t sensor_num)
+void pcap_read_data(pcap_chip_select_t chip, pcap_data_t* data)
 {
-    uint8_t buffer[4] = {0};
+    uint8_t tx[NUM_SENSORS_PER_CHIP][PCAP_RESULT_FRAME_LEN];
+    uint8_t rx[NUM_SENSORS_PER_CHIP][PCAP_RESULT_FRAME_LEN];
+    bus_op_t ops[NUM_SENSORS_PER_CHIP];
 
-    // Note: chip should already be selected by pcap_read_data
-    spi_transfer_byte(PCAP_RD_RESULT | sensor_addr[sensor_num]);
+    pcap_read_ops(chip, tx, rx, ops);
+    pcap_bus_execute(BUS_PRIO_REALTIME, ops, NUM_SENSORS_PER_CHIP);
 
-    esp_rom_delay_us(1);
+    if (data != NULL) {
+        pcap_read_decode((const uint8_t (*)[PCAP_RESULT_FRAME_LEN])rx, data);
+    }
+}
 
-    // Receive 4 bytes
-    spi_transfer_bytes(NULL, buffer, 4);
+float pcap_read_sensor(pcap_chip_select_t chip, uint8_t sensor_num)
+{
+    uint8_t tx[PCAP_RESULT_FRAME_LEN];
+    uint8_t rx[PCAP_RESULT_FRAME_LEN];
+    bus_op_t op;
 
-    uint32_t raw = ((uint32_t)buffer[3] << 24) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[1] <<  8) | ((uint32_t)buffer[0] <<  0);
-    return (float)raw;
+    read_result_op(&op, chip, sensor_num, tx, rx);
+    pcap_bus_execute(BUS_PRIO_REALTIME, &op, 1);
+    return result_value(rx);
 }
 
 bool pcap_test_communication(pcap_chip_select_t chip)
 {
-    uint8_t result;
+    static const uint8_t tx[2] = {PCAP_TEST_READ, 0x00};
+    uint8_t rx[2] = {0};
     bool test_passed;
 
     ESP_LOGI(TAG, "Testing communication with chip %d", chip);
 
-    mux_select_chip(chip);
+    bus_op_t op = { .chip = chip, .cmd_len = 1, .len = 2, .tx = tx, .rx = rx };
+    pcap_bus_execute(BUS_PRIO_CONTROL, &op, 1);
+    uint8_t result = rx[1];
 
-    spi_transfer_byte(PCAP_TEST_READ);
-    esp_rom_delay_us(1);
-    result = spi_transfer_byte(0x00);
-
-    if (result == 0x11) {
+    if (result == PCAP_TEST_RESPONSE) {
         ESP_LOGI(TAG, "Communication test PASSED for chip %d", chip);
         test_passed = true;
     } else {
@@ -219,7 +404,6 @@ bool pcap_test_communication(pcap_chip_select_t chip)
         test_passed = false;
     }
 
-    mux_deselect_chip();
     return test_passed;
 }
 
@@ -251,3 +435,54 @@ void pcap_calibrate(pcap_chip_select_t chip, pcap_data_t* data, uint16_t num_sam
 
     ESP_LOGI(TAG, "Calibration complete for chip %d", chip);
 }
+
+void pcap_config_set_trigger(uint8_t config[PCAP_CONFIG_SIZE], uint8_t trig_sel)
+{
+    config[PCAP_CFG_TRIG_REG] = (config[PCAP_CFG_TRIG_REG] & ~PCAP_CFG_TRIG_MASK) |
+                                ((trig_sel << PCAP_CFG_TRIG_SHIFT) & PCAP_CFG_TRIG_MASK);
+}
+
+void pcap_read_triggered(uint8_t chips_mask, uint32_t conversion_us,
+                         pcap_data_t data[NUM_PCAP_CHIPS], pcap_trigger_timing_t* timing)
+{
+    static const uint8_t start = PCAP_CDC_START;
+    bus_op_t ops[NUM_PCAP_CHIPS];
+    uint16_t count = 0;
+
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        if (chips_mask & (1u << chip)) {
+            ops[count++] = (bus_op_t){ .chip = chip, .len = 1, .tx = &start, .flags = BUS_OP_QUICK_SELECT };
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+
+    bus_batch_t batch = { .ops = ops, .count = count, .prio = BUS_PRIO_REALTIME };
+    if (!execute_batch(&batch)) {
+        return;
+    }
+
+    // Every chip has converted conversion_us after the last start
+    int64_t remaining = batch.end_us + conversion_us - esp_timer_get_time();
+    if (remaining > 0) {
+        conversion_waiter = xTaskGetCurrentTaskHandle();
+        conversion_done = false;
+        esp_timer_start_once(conversion_timer, (uint64_t)remaining);
+        while (!conversion_done) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+
+    int64_t read_start = esp_timer_get_time();
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        if (chips_mask & (1u << chip)) {
+            pcap_read_data((pcap_chip_select_t)chip, &data[chip]);
+        }
+    }
+
+    if (timing != NULL) {
+        timing->skew_us = (uint32_t)(batch.end_us - batch.run_us);
+        timing->read_us = (uint32_t)(esp_timer_get_time() - read_start);
+    }
+}
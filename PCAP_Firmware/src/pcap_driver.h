@@ -16,6 +16,7 @@
 #include "driver/spi_master.h"
 #include "pcap04_defs.h"
 #include "mux_control.h"
+#include "bus_scheduler.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -36,14 +37,103 @@ extern "C" {
 #define PCAP_SPI_CS_PIN     -1       ///< CS handled by multiplexer, not SPI driver
 /** @} */
 
+/**
+ * @defgroup BusConfig Bus Task Configuration
+ * @{
+ */
+#define PCAP_BUS_TASK_PRIORITY  6       ///< Above sensor_task so batches start at once
+#define PCAP_BUS_TASK_STACK     3072
+#define PCAP_FW_CHUNK_SIZE      128     ///< Firmware bytes per write frame
+#define PCAP_CONFIG_SETTLE_MS   10      ///< Wait after a configuration write
+#define PCAP_RESULT_FRAME_LEN   5       ///< Result read frame: opcode, 4 result bytes
+#define PCAP_TEST_RESPONSE      0x11    ///< Byte a chip returns to PCAP_TEST_READ
+/** @} */
+
 /**
  * @brief Initialize the PCAP driver system
  *
- * Initializes both the multiplexer control and SPI interface.
- * Must be called before any other driver functions.
+ * Initializes the multiplexer control and SPI interface and starts the bus
+ * task, which runs the bus scheduler (bus_scheduler.h) and from then on is
+ * the only code touching the bus. Must be called before any other driver
+ * functions.
  */
 void pcap_driver_init(void);
 
+/**
+ * @brief Run a batch of bus ops and wait for it to complete
+ *
+ * All driver functions go through this. Acquisition reads use
+ * BUS_PRIO_REALTIME, configuration BUS_PRIO_CONTROL. Clients that must not
+ * block can call bus_sched_submit() with their own completion callback.
+ *
+ * @param prio  Priority class
+ * @param ops   Ops to run in order
+ * @param count Number of ops
+ */
+void pcap_bus_execute(bus_prio_t prio, bus_op_t* ops, uint16_t count);
+
+/**
+ * @brief Log per-class bus latency and queue depth, then reset them
+ */
+void pcap_bus_report(void);
+
+/**
+ * @brief Timing of one triggered frame
+ */
+typedef struct {
+    uint32_t skew_us;       ///< First chip's start command to the last one's end
+    uint32_t read_us;       ///< Reading the triggered chips after the conversion
+} pcap_trigger_timing_t;
+
+/**
+ * @brief Set the conversion trigger of a configuration image
+ * @param config   Configuration bytes, as passed to pcap_write_config()
+ * @param trig_sel PCAP_TRIG_CONTINUOUS or PCAP_TRIG_OPCODE
+ */
+void pcap_config_set_trigger(uint8_t config[PCAP_CONFIG_SIZE], uint8_t trig_sel);
+
+/**
+ * @brief Sample several chips at the same instant
+ * @param chips_mask    Bit per chip, configured with PCAP_TRIG_OPCODE
+ * @param conversion_us CDC start to results ready
+ * @param data          Receives raw readings of the chips in chips_mask
+ * @param timing        Receives the frame's start skew and read time (may be NULL)
+ *
+ * Sends the start commands back to back in one realtime batch, with
+ * quick mux selects and no deselect between chips, then sleeps the
+ * calling task until the last chip's conversion is done and reads them.
+ */
+void pcap_read_triggered(uint8_t chips_mask, uint32_t conversion_us,
+                         pcap_data_t data[NUM_PCAP_CHIPS], pcap_trigger_timing_t* timing);
+
+/**
+ * @brief Build the ops that read every sensor of a chip
+ *
+ * The frame builders are shared with clients that run their own batches
+ * (pcap_async.cpp). Buffers must outlive the batch.
+ */
+void pcap_read_ops(pcap_chip_select_t chip, uint8_t tx[][PCAP_RESULT_FRAME_LEN],
+                   uint8_t rx[][PCAP_RESULT_FRAME_LEN], bus_op_t ops[NUM_SENSORS_PER_CHIP]);
+
+/**
+ * @brief Store the results of pcap_read_ops() in data->raw
+ */
+void pcap_read_decode(const uint8_t rx[][PCAP_RESULT_FRAME_LEN], pcap_data_t* data);
+
+/**
+ * @brief Build the write frame of the firmware chunk starting at addr
+ * @return Firmware bytes in the chunk
+ */
+uint16_t pcap_firmware_chunk_op(pcap_chip_select_t chip, const uint8_t* firmware, uint16_t size,
+                                uint16_t addr, uint8_t frame[2 + PCAP_FW_CHUNK_SIZE], bus_op_t* op);
+
+/**
+ * @brief Build the configuration write frame
+ * @return false if size exceeds PCAP_CONFIG_SIZE
+ */
+bool pcap_config_op(pcap_chip_select_t chip, const uint8_t* config, uint16_t size,
+                    uint8_t frame[2 + PCAP_CONFIG_SIZE], bus_op_t* op);
+
 /**
  * @brief Initialize a specific PCAP chip
  * @param chip The chip to initialize
@@ -101,6 +191,9 @@ void pcap_read_data(pcap_chip_select_t chip, pcap_data_t* data);
 
 /**
  * @brief Read measurement result from a single sensor
+ *
+ * Runs as its own realtime batch; prefer pcap_read_data() for a whole chip.
+ *
  * @param chip The chip to read from
  * @param sensor_num Sensor number (0-5)
  * @return 24-bit measurement value
@@ -0,0 +1,185 @@
+/**
+ * @file pcap_emulator.c
+ * @brief Software model of the PCAP04 chips behind the mux (QEMU builds)
+ *
+ * Models the byte-level SPI protocol used by pcap_driver.c. Memory writes
+ * cover the 1 KB program/config space (the configuration registers are
+ * mapped at 0x3C0, which is how PCAP_WR_CONFIG addresses them), and result
+ * reads return a synthetic press cycle with a little noise per sensor. With
+ * C_TRIG_SEL set to PCAP_TRIG_OPCODE, each PCAP_CDC_START latches one set of
+ * results, which reads return until the next start.
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include "pcap_emulator.h"
+#include "pcap04_defs.h"
+
+#define EMU_MEM_SIZE        PCAP_FW_SIZE
+#define EMU_TEST_RESPONSE   0x11
+#define EMU_CONFIG_BASE     (PCAP_WR_CONFIG & 0x3FF)
+
+// Protocol state within one chip-select frame
+typedef enum {
+    EMU_IDLE,           // Expecting an opcode
+    EMU_TEST_READ,      // Next byte returns the test pattern
+    EMU_WR_ADDR,        // Expecting low address byte of a memory write
+    EMU_WR_DATA,        // Writing memory bytes
+    EMU_RD_ADDR,        // Expecting low address byte of a memory read
+    EMU_RD_DATA,        // Returning memory bytes
+    EMU_RD_RESULT,      // Returning a latched result
+    EMU_IGNORE,         // Command complete; remaining bytes are don't-care
+} emu_state_t;
+
+typedef struct {
+    uint8_t  mem[EMU_MEM_SIZE];
+    bool     cdc_running;
+    uint32_t reads[NUM_SENSORS_PER_CHIP];
+    uint32_t noise;
+    uint32_t latched[NUM_SENSORS_PER_CHIP];   // Triggered mode results
+} emu_chip_t;
+
+static emu_chip_t chips[NUM_PCAP_CHIPS];
+static pcap_chip_select_t selected = PCAP_CHIP_NONE;
+static emu_state_t state = EMU_IDLE;
+static uint16_t addr = 0;
+static uint8_t result_bytes[4];
+static uint8_t result_idx = 0;
+
+// Synthetic result: triangle-wave press cycle on top of the baseline,
+// phase-shifted per channel, plus a few LSBs of pseudo-random noise
+static uint32_t emu_result(int chip, int sensor)
+{
+    emu_chip_t* c = &chips[chip];
+
+    if (!c->cdc_running || sensor >= NUM_SENSORS_PER_CHIP) {
+        return 0;
+    }
+
+    uint32_t phase = (c->reads[sensor]++ + chip * 37 + sensor * 53) % PCAP_EMU_PERIOD_READS;
+    uint32_t half = PCAP_EMU_PERIOD_READS / 2;
+    uint32_t tri = (phase < half) ? phase : PCAP_EMU_PERIOD_READS - phase;
+    uint32_t deflection = (uint32_t)((uint64_t)PCAP_EMU_AMPLITUDE * tri / half);
+
+    c->noise = c->noise * 1664525u + 1013904223u;
+    int32_t jitter = (int32_t)(c->noise >> 20) - 2048;
+
+    return (uint32_t)((int32_t)(PCAP_EMU_BASELINE + deflection) + jitter);
+}
+
+static bool emu_triggered(const emu_chip_t* c)
+{
+    uint8_t reg = c->mem[EMU_CONFIG_BASE + PCAP_CFG_TRIG_REG];
+    return ((reg & PCAP_CFG_TRIG_MASK) >> PCAP_CFG_TRIG_SHIFT) == PCAP_TRIG_OPCODE;
+}
+
+static uint8_t emu_opcode(int chip, uint8_t op)
+{
+    emu_chip_t* c = &chips[chip];
+
+    // Fixed opcodes first: PCAP_TEST_READ lies inside the result-read range
+    switch (op) {
+    case PCAP_TEST_READ:
+        state = EMU_TEST_READ;
+        return 0;
+    case PCAP_POR:
+        memset(c->mem, 0, sizeof(c->mem));
+        c->cdc_running = false;
+        state = EMU_IGNORE;
+        return 0;
+    case PCAP_CDC_START:
+        c->cdc_running = true;
+        if (emu_triggered(c)) {
+            for (int s = 0; s < NUM_SENSORS_PER_CHIP; s++) {
+                c->latched[s] = emu_result(chip, s);
+            }
+        }
+        state = EMU_IGNORE;
+        return 0;
+    case PCAP_INIT:
+    case PCAP_RDC_START:
+    case PCAP_DSP_TRIG:
+    case PCAP_NV_STORE:
+    case PCAP_NV_RECALL:
+    case PCAP_NV_ERASE:
+        state = EMU_IGNORE;
+        return 0;
+    default:
+        break;
+    }
+
+    if ((op & 0xFC) == PCAP_WR_MEM) {
+        addr = (uint16_t)(op & 0x03) << 8;
+        state = EMU_WR_ADDR;
+    } else if ((op & 0xFC) == PCAP_RD_MEM) {
+        addr = (uint16_t)(op & 0x03) << 8;
+        state = EMU_RD_ADDR;
+    } else if ((op & 0xC0) == PCAP_RD_RESULT) {
+        int sensor = (op & 0x3F) / 4;
+        uint32_t value = (emu_triggered(c) && sensor < NUM_SENSORS_PER_CHIP) ? c->latched[sensor]
+                                                                             : emu_result(chip, sensor);
+        memcpy(result_bytes, &value, sizeof(result_bytes));   // little-endian
+        result_idx = 0;
+        state = EMU_RD_RESULT;
+    } else {
+        state = EMU_IGNORE;
+    }
+    return 0;
+}
+
+static uint8_t emu_byte(int chip, uint8_t tx)
+{
+    emu_chip_t* c = &chips[chip];
+    uint8_t rx = 0;
+
+    switch (state) {
+    case EMU_IDLE:
+        rx = emu_opcode(chip, tx);
+        break;
+    case EMU_TEST_READ:
+        rx = EMU_TEST_RESPONSE;
+        state = EMU_IGNORE;
+        break;
+    case EMU_WR_ADDR:
+        addr |= tx;
+        state = EMU_WR_DATA;
+        break;
+    case EMU_WR_DATA:
+        c->mem[addr++ % EMU_MEM_SIZE] = tx;
+        break;
+    case EMU_RD_ADDR:
+        addr |= tx;
+        state = EMU_RD_DATA;
+        break;
+    case EMU_RD_DATA:
+        rx = c->mem[addr++ % EMU_MEM_SIZE];
+        break;
+    case EMU_RD_RESULT:
+        rx = result_bytes[result_idx++ % sizeof(result_bytes)];
+        break;
+    case EMU_IGNORE:
+        break;
+    }
+    return rx;
+}
+
+void pcap_emu_select(pcap_chip_select_t chip)
+{
+    // Every select models a fresh CS assertion
+    selected = chip;
+    state = EMU_IDLE;
+}
+
+void pcap_emu_transfer(const uint8_t* tx, uint8_t* rx, size_t len)
+{
+    bool present = selected < NUM_PCAP_CHIPS && (PCAP_EMU_CHIP_MASK & (1u << selected));
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t out = tx ? tx[i] : 0x00;
+        // Nothing drives MISO for an absent chip
+        uint8_t in = present ? emu_byte(selected, out) : 0x00;
+        if (rx) {
+            rx[i] = in;
+        }
+    }
+}
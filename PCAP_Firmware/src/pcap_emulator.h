@@ -0,0 +1,55 @@
+/**
+ * @file pcap_emulator.h
+ * @brief Software model of the PCAP04 chips behind the mux (QEMU builds)
+ *
+ * The QEMU esp32c3 machine does not emulate the GPSPI peripheral, so builds
+ * with PCAP_QEMU_BUILD=1 route the driver's SPI transfers into this model
+ * instead. It tracks the mux chip select, answers PCAP_TEST_READ, accepts
+ * firmware and configuration uploads, and produces result data once CDC is
+ * started, so app_main() runs end to end without hardware.
+ */
+
+#ifndef PCAP_EMULATOR_H
+#define PCAP_EMULATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mux_control.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef PCAP_QEMU_BUILD
+#define PCAP_QEMU_BUILD 0
+#endif
+
+/**
+ * @defgroup EmulatorConfig Emulator Configuration
+ * @{
+ */
+#define PCAP_EMU_CHIP_MASK      0xFF        ///< Chips that answer on the emulated bus
+#define PCAP_EMU_BASELINE       0x08000000  ///< Result at rest (1.0 in the 27-bit fraction)
+#define PCAP_EMU_AMPLITUDE      0x00200000  ///< Peak deflection of the synthetic press cycle
+#define PCAP_EMU_PERIOD_READS   400         ///< Reads per press cycle on each sensor
+/** @} */
+
+/**
+ * @brief Notify the model of a mux chip-select change
+ * @param chip Newly selected chip, PCAP_CHIP_NONE ends the current frame
+ */
+void pcap_emu_select(pcap_chip_select_t chip);
+
+/**
+ * @brief Clock bytes through the currently selected emulated chip
+ * @param tx  Bytes sent by the master (NULL sends zeros)
+ * @param rx  Buffer for bytes returned by the chip (may be NULL)
+ * @param len Number of bytes
+ */
+void pcap_emu_transfer(const uint8_t* tx, uint8_t* rx, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PCAP_EMULATOR_H
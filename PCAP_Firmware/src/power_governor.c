@@ -0,0 +1,153 @@
+/**
+ * @file power_governor.c
+ * @brief Battery-aware performance governor implementation (ESP-IDF)
+ */
+
+#include "power_governor.h"
+#include "battery_manager.h"
+#include "nn_inference.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_pm.h"
+
+static const char* TAG = "GOV";
+
+// Ordered from full performance to maximum endurance
+static const governor_tier_t tiers[] = {
+    { "FULL",     10,  1, BLE_ENCODING_FLOAT32,  6, 160, 95 },
+    { "BALANCED", 20,  2, BLE_ENCODING_INT16,   12, 160, 70 },
+    { "ECO",      50,  4, BLE_ENCODING_INT16,   24,  80, 45 },
+    { "SURVIVAL", 100, 0, BLE_ENCODING_INT16,   48,  80, 30 },
+};
+#define NUM_TIERS (sizeof(tiers) / sizeof(tiers[0]))
+
+static uint8_t  tier_idx = 0;
+static uint32_t target_min = 0;
+static int64_t  target_start_us = 0;
+
+// Discharge-rate tracking
+static float    remaining_mah = BATTERY_CAPACITY_MAH;
+static float    rate_ref_mah = -1.0f;       // Capacity at the start of the rate window
+static int64_t  rate_ref_us = 0;
+static float    measured_ma = 0.0f;         // Filtered discharge rate, 0 until measured
+static float    load_factor = 1.0f;         // measured / modelled draw of the active tier
+
+static void apply_tier(uint8_t idx)
+{
+    const governor_tier_t* t = &tiers[idx];
+
+    nn_set_refresh_divider(t->nn_refresh_divider);
+    ble_set_encoding(t->encoding);
+    ble_request_conn_interval(t->conn_itvl);
+
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = t->cpu_mhz,
+        .min_freq_mhz = t->cpu_mhz,
+        .light_sleep_enable = false,
+    };
+    esp_err_t ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "CPU frequency change failed: %s", esp_err_to_name(ret));
+    }
+#endif
+
+    tier_idx = idx;
+    ESP_LOGI(TAG, "Tier %d (%s): %d ms, NN 1/%d, %s, itvl %d, %d MHz",
+             idx, t->name, t->sample_period_ms, t->nn_refresh_divider,
+             t->encoding == BLE_ENCODING_INT16 ? "int16" : "float32",
+             t->conn_itvl, t->cpu_mhz);
+}
+
+// Predicted runtime of a tier, correcting its model by the measured load
+static uint32_t tier_runtime_min(uint8_t idx)
+{
+    float draw_ma = tiers[idx].model_current_ma * load_factor;
+    return (uint32_t)(remaining_mah / draw_ma * 60.0f);
+}
+
+static uint32_t remaining_target_min(void)
+{
+    if (target_min == 0) {
+        return 0;
+    }
+    uint32_t elapsed_min = (uint32_t)((esp_timer_get_time() - target_start_us) / 60000000LL);
+    return elapsed_min >= target_min ? 0 : target_min - elapsed_min;
+}
+
+void governor_init(uint32_t target_minutes)
+{
+    governor_set_target_minutes(target_minutes);
+    apply_tier(0);
+}
+
+void governor_set_target_minutes(uint32_t target_minutes)
+{
+    target_min = target_minutes;
+    target_start_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Session target: %lu min", target_min);
+}
+
+void governor_update(uint8_t battery_pct, float voltage)
+{
+    int64_t now = esp_timer_get_time();
+    // From the filtered voltage, not the whole-percent reading: one percent
+    // is BATTERY_CAPACITY_MAH / 100 and would quantize every window's rate
+    remaining_mah = battery_voltage_to_percent(voltage) * BATTERY_CAPACITY_MAH / 100.0f;
+
+    // Discharge rate over a window long enough to see through ADC noise. The
+    // window stays open until the charge has visibly dropped, so a slow
+    // discharge is measured over a longer span instead of reading as zero.
+    if (rate_ref_mah < 0.0f) {
+        rate_ref_mah = remaining_mah;
+        rate_ref_us = now;
+    } else if ((now - rate_ref_us) >= (int64_t)GOVERNOR_RATE_WINDOW_S * 1000000LL &&
+               rate_ref_mah - remaining_mah >= GOVERNOR_RATE_MIN_DROP_MAH) {
+        float hours = (float)(now - rate_ref_us) / 3.6e9f;
+        float rate = (rate_ref_mah - remaining_mah) / hours;
+        measured_ma = (measured_ma == 0.0f) ? rate : 0.7f * measured_ma + 0.3f * rate;
+        load_factor = measured_ma / tiers[tier_idx].model_current_ma;
+        rate_ref_mah = remaining_mah;
+        rate_ref_us = now;
+    }
+
+    // Fastest tier whose predicted runtime covers the rest of the session;
+    // moving to a faster tier than the current one needs extra margin
+    uint32_t needed = remaining_target_min();
+    uint8_t next = NUM_TIERS - 1;
+    for (uint8_t i = 0; i < NUM_TIERS; i++) {
+        uint32_t required = (i < tier_idx)
+            ? needed * GOVERNOR_STEP_UP_MARGIN_PCT / 100 : needed;
+        if (tier_runtime_min(i) >= required) {
+            next = i;
+            break;
+        }
+    }
+
+    ESP_LOGD(TAG, "%.3f V (%u%%), %.1f mAh, %.1f mA, runtime %lu min, need %lu min",
+             voltage, battery_pct, remaining_mah, measured_ma, tier_runtime_min(tier_idx), needed);
+
+    if (next != tier_idx) {
+        apply_tier(next);
+        // Restart the rate window so the new tier's draw is measured cleanly;
+        // the load factor carries over as the best correction so far
+        measured_ma = 0.0f;
+        rate_ref_mah = remaining_mah;
+        rate_ref_us = now;
+    }
+}
+
+const governor_tier_t* governor_get_tier(void)
+{
+    return &tiers[tier_idx];
+}
+
+uint8_t governor_get_tier_index(void)
+{
+    return tier_idx;
+}
+
+uint32_t governor_get_predicted_runtime_min(void)
+{
+    return tier_runtime_min(tier_idx);
+}
@@ -0,0 +1,88 @@
+/**
+ * @file power_governor.h
+ * @brief Battery-aware performance governor (ESP-IDF)
+ *
+ * Maps battery state (filtered voltage and measured discharge rate) to a
+ * performance tier covering sample rate, NN refresh, BLE payload encoding,
+ * BLE connection interval and CPU frequency. The tier is chosen so the
+ * predicted runtime covers the remainder of a user-specified session.
+ */
+
+#ifndef POWER_GOVERNOR_H
+#define POWER_GOVERNOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble_manager.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup GovernorConfig Governor Configuration
+ * @{
+ */
+#define GOVERNOR_DEFAULT_TARGET_MIN  120    ///< Session length assumed until the host sets one
+#define GOVERNOR_RATE_WINDOW_S       60     ///< Minimum span for one discharge-rate estimate
+#define GOVERNOR_RATE_MIN_DROP_MAH   5.0f   ///< Charge drop that closes a rate window (above filtered ADC noise)
+#define GOVERNOR_STEP_UP_MARGIN_PCT  110    ///< Runtime margin required to move to a faster tier
+/** @} */
+
+/**
+ * @brief One performance tier
+ */
+typedef struct {
+    const char* name;
+    uint16_t sample_period_ms;      ///< Acquisition period of sensor_task
+    uint8_t  nn_refresh_divider;    ///< Invoke every Nth sample per channel (0 = NN off)
+    ble_encoding_t encoding;        ///< Chip data payload encoding
+    uint16_t conn_itvl;             ///< Requested BLE connection interval (1.25 ms units)
+    uint16_t cpu_mhz;               ///< CPU frequency
+    uint16_t model_current_ma;      ///< Modelled average draw, corrected by measurement
+} governor_tier_t;
+
+/**
+ * @brief Initialize the governor and apply the full-performance tier
+ * @param target_minutes Session length to plan for (0 = always full performance)
+ *
+ * Call after ble_manager_init() since tier changes reconfigure the link.
+ */
+void governor_init(uint32_t target_minutes);
+
+/**
+ * @brief Set the target session duration
+ * @param target_minutes Minutes from now the battery should last (0 = no target)
+ */
+void governor_set_target_minutes(uint32_t target_minutes);
+
+/**
+ * @brief Feed a battery measurement and re-evaluate the tier
+ * @param battery_pct Battery percentage from battery_get_percentage(), for the log
+ * @param voltage     Filtered battery voltage in volts; remaining charge is
+ *                    estimated from it on the discharge curve
+ */
+void governor_update(uint8_t battery_pct, float voltage);
+
+/**
+ * @brief Get the active tier
+ * @return Pointer to the active tier (never NULL)
+ */
+const governor_tier_t* governor_get_tier(void);
+
+/**
+ * @brief Get the active tier index (0 = full performance)
+ */
+uint8_t governor_get_tier_index(void);
+
+/**
+ * @brief Get the predicted remaining runtime in the active tier
+ * @return Minutes until the battery is empty at the current draw
+ */
+uint32_t governor_get_predicted_runtime_min(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POWER_GOVERNOR_H
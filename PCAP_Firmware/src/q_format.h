@@ -0,0 +1,250 @@
+/**
+ * @file q_format.h
+ * @brief Header-only Q-format fixed-point arithmetic for signal stages
+ *
+ * The C3 has no FPU, so every float add, multiply and conversion is a
+ * libgcc call. q::Q<F, T> holds a value as an integer T with F fraction
+ * bits, and all arithmetic compiles to integer instructions:
+ *
+ *   - Conversions from floating constants are constexpr, so calibration
+ *     constants (scalers, unit factors) cost nothing at run time.
+ *   - Add, subtract, multiply and format conversions saturate at the
+ *     limits of the destination instead of wrapping.
+ *   - Right shifts round to nearest, ties away from zero, like lroundf().
+ *   - Q::from_float() converts a runtime float by decoding its bits, with
+ *     no soft-float call, for stages fed by the float pipeline.
+ *
+ * Storage is int8_t, int16_t or int32_t, and products are formed in the
+ * next wider type. tools/fixed/validate_q_format.py checks the operations
+ * against double precision on the host. Q_FORMAT_BENCH_MODE in main.c
+ * compares their cost with soft-float on the device.
+ */
+
+#ifndef Q_FORMAT_H
+#define Q_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+namespace q {
+
+/// Type products and intermediate results are formed in
+template <typename T> struct wider;
+template <> struct wider<int8_t>  { using type = int16_t; };
+template <> struct wider<int16_t> { using type = int32_t; };
+template <> struct wider<int32_t> { using type = int64_t; };
+template <typename T> using wider_t = typename wider<T>::type;
+
+/// Clamp v to the range of T
+template <typename T, typename W>
+constexpr T saturate(W v)
+{
+    return v > static_cast<W>(std::numeric_limits<T>::max()) ? std::numeric_limits<T>::max()
+         : v < static_cast<W>(std::numeric_limits<T>::min()) ? std::numeric_limits<T>::min()
+         : static_cast<T>(v);
+}
+
+/// v / 2^shift rounded to nearest, ties away from zero (shift >= 0)
+template <typename W>
+constexpr W rshift_round(W v, int shift)
+{
+    if (shift <= 0) {
+        return v;
+    }
+    const W half = static_cast<W>(W(1) << (shift - 1));
+    return v >= 0 ? static_cast<W>((v + half) >> shift) : static_cast<W>(-((-v + half) >> shift));
+}
+
+/// v * 2^shift (shift >= 0) saturated to T, computed without overflow
+template <typename T, typename W>
+constexpr T lshift_sat(W v, int shift)
+{
+    constexpr int bits = std::numeric_limits<T>::digits;
+    if (shift > bits) {
+        return v > 0 ? std::numeric_limits<T>::max() : v < 0 ? std::numeric_limits<T>::min() : T(0);
+    }
+    const W limit = static_cast<W>(W(1) << (bits - shift));
+    if (v >= limit) {
+        return std::numeric_limits<T>::max();
+    }
+    if (v < -limit) {
+        return std::numeric_limits<T>::min();
+    }
+    return saturate<T>(static_cast<W>(v * (W(1) << shift)));
+}
+
+/**
+ * @brief Signed fixed-point value with F fraction bits stored in T
+ */
+template <int F, typename T = int32_t>
+class Q {
+    static_assert(std::is_same<T, int8_t>::value || std::is_same<T, int16_t>::value ||
+                  std::is_same<T, int32_t>::value, "storage must be int8_t, int16_t or int32_t");
+    static_assert(F >= 0 && F < std::numeric_limits<T>::digits + 1, "fraction bits out of range");
+
+public:
+    using storage_type = T;
+    using wide_type = wider_t<T>;
+    static constexpr int frac_bits = F;
+
+    constexpr Q() : v_(0) {}
+
+    /// Value from its raw integer representation
+    static constexpr Q from_raw(T raw) { return Q(raw); }
+
+    /// Nearest value to x, saturated; use for constants
+    static constexpr Q from_double(double x)
+    {
+        double s = x * static_cast<double>(int64_t(1) << F);
+        if (s >= static_cast<double>(std::numeric_limits<T>::max())) {
+            return max();
+        }
+        if (s <= static_cast<double>(std::numeric_limits<T>::min())) {
+            return min();
+        }
+        return Q(static_cast<T>(s >= 0 ? static_cast<int64_t>(s + 0.5) : -static_cast<int64_t>(-s + 0.5)));
+    }
+
+    /// Integer value, saturated
+    static constexpr Q from_int(int32_t x) { return Q(lshift_sat<T, int64_t>(x, F)); }
+
+    /// Nearest value to a runtime float, saturated, using integer ops only.
+    /// NaN converts to 0.
+    static Q from_float(float x)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        const bool negative = (bits >> 31) != 0;
+        const int exponent = static_cast<int>((bits >> 23) & 0xFF);
+        if (exponent == 0xFF && (bits & 0x7FFFFF) != 0) {
+            return Q();
+        }
+        if (exponent == 0) {
+            return Q();     // Zero or denormal, far below any Q resolution
+        }
+
+        // |x| = mantissa * 2^(exponent - 150); raw = |x| * 2^F
+        const int32_t mantissa = static_cast<int32_t>((bits & 0x7FFFFF) | 0x800000);
+        const int shift = exponent - 150 + F;
+        int64_t magnitude;
+        if (shift >= 0) {
+            if (shift >= std::numeric_limits<T>::digits - 23) {
+                return negative ? min() : max();
+            }
+            magnitude = static_cast<int64_t>(mantissa) << shift;
+        } else if (shift < -24) {
+            magnitude = 0;
+        } else {
+            magnitude = rshift_round<int64_t>(mantissa, -shift);
+        }
+        return Q(saturate<T>(negative ? -magnitude : magnitude));
+    }
+
+    static constexpr Q max() { return Q(std::numeric_limits<T>::max()); }
+    static constexpr Q min() { return Q(std::numeric_limits<T>::min()); }
+
+    constexpr T raw() const { return v_; }
+
+    constexpr double to_double() const
+    {
+        return static_cast<double>(v_) / static_cast<double>(int64_t(1) << F);
+    }
+
+    /// Float value, for handing results to float consumers
+    float to_float() const { return static_cast<float>(v_) * (1.0f / static_cast<float>(int64_t(1) << F)); }
+
+    /// Nearest integer
+    constexpr int32_t to_int() const
+    {
+        return static_cast<int32_t>(rshift_round<wide_type>(v_, F));
+    }
+
+    /// Same value in another format, rounded and saturated
+    template <int F2, typename T2 = T>
+    constexpr Q<F2, T2> convert() const
+    {
+        if constexpr (F2 >= F) {
+            return Q<F2, T2>::from_raw(lshift_sat<T2, int64_t>(v_, F2 - F));
+        } else {
+            return Q<F2, T2>::from_raw(saturate<T2>(rshift_round<int64_t>(v_, F - F2)));
+        }
+    }
+
+    friend constexpr Q operator+(Q a, Q b)
+    {
+        return Q(saturate<T>(static_cast<wide_type>(a.v_) + b.v_));
+    }
+
+    friend constexpr Q operator-(Q a, Q b)
+    {
+        return Q(saturate<T>(static_cast<wide_type>(a.v_) - b.v_));
+    }
+
+    friend constexpr Q operator-(Q a)
+    {
+        return Q(saturate<T>(-static_cast<wide_type>(a.v_)));
+    }
+
+    /// Product in this format, rounded and saturated
+    friend constexpr Q operator*(Q a, Q b)
+    {
+        return Q(saturate<T>(rshift_round<wide_type>(static_cast<wide_type>(a.v_) * b.v_, F)));
+    }
+
+    Q& operator+=(Q b) { return *this = *this + b; }
+    Q& operator-=(Q b) { return *this = *this - b; }
+    Q& operator*=(Q b) { return *this = *this * b; }
+
+    friend constexpr bool operator==(Q a, Q b) { return a.v_ == b.v_; }
+    friend constexpr bool operator!=(Q a, Q b) { return a.v_ != b.v_; }
+    friend constexpr bool operator<(Q a, Q b)  { return a.v_ < b.v_; }
+    friend constexpr bool operator>(Q a, Q b)  { return a.v_ > b.v_; }
+    friend constexpr bool operator<=(Q a, Q b) { return a.v_ <= b.v_; }
+    friend constexpr bool operator>=(Q a, Q b) { return a.v_ >= b.v_; }
+
+private:
+    constexpr explicit Q(T raw) : v_(raw) {}
+    T v_;
+};
+
+/**
+ * @brief Product of two formats in a third, rounded and saturated
+ *
+ * Formed in int64_t, so any pair of int32_t operands is exact before the
+ * final rounding shift.
+ */
+template <int FR, typename TR = int32_t, int FA, typename TA, int FB, typename TB>
+constexpr Q<FR, TR> mul(Q<FA, TA> a, Q<FB, TB> b)
+{
+    const int64_t p = static_cast<int64_t>(a.raw()) * b.raw();
+    constexpr int shift = FA + FB - FR;
+    if constexpr (shift >= 0) {
+        return Q<FR, TR>::from_raw(saturate<TR>(rshift_round<int64_t>(p, shift)));
+    } else {
+        return Q<FR, TR>::from_raw(lshift_sat<TR, int64_t>(p, -shift));
+    }
+}
+
+/**
+ * @brief First-order low-pass step: y + (x - y) * alpha, in y's format
+ */
+template <int F, typename T, int FA, typename TA>
+constexpr Q<F, T> ema(Q<F, T> y, Q<F, T> x, Q<FA, TA> alpha)
+{
+    return y + mul<F, T>(x - y, alpha);
+}
+
+// Compile-time checks of the constant paths
+static_assert(Q<16>::from_double(1.5).raw() == 98304, "from_double");
+static_assert(Q<15, int16_t>::from_double(1.0).raw() == INT16_MAX, "from_double saturates");
+static_assert(Q<8>::from_double(-2.5 / 256).raw() == -3, "from_double rounds ties away from zero");
+static_assert((Q<8, int16_t>::from_int(100) + Q<8, int16_t>::from_int(100)).raw() == INT16_MAX, "add saturates");
+static_assert((Q<16>::from_double(-1.5) * Q<16>::from_double(2.0)).to_int() == -3, "mul");
+static_assert(mul<0, int16_t>(Q<8>::from_int(1000), Q<31>::from_double(0.25)).raw() == 250, "mixed mul");
+static_assert(Q<16>::from_double(2.75).convert<1, int8_t>().raw() == 6, "convert rounds");
+
+} // namespace q
+
+#endif // Q_FORMAT_H
@@ -0,0 +1,204 @@
+/**
+ * @file replay_input.c
+ * @brief Hardware-in-the-loop replay implementation
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "replay_input.h"
+
+// Queue: the producer advances head, the consumer tail (free-running)
+static replay_frame_t queue[REPLAY_QUEUE_FRAMES];
+static volatile uint16_t head = 0;
+static volatile uint16_t tail = 0;
+
+// Producer side
+static replay_frame_t pending;
+static int pending_last_chip = -1;
+static float offsets[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+static volatile uint8_t offsets_new = 0;
+static volatile bool stream_active = false;
+static volatile bool end_pending = false;
+
+// Consumer side
+static bool started = false;
+static bool playing = false;
+static uint32_t acked = 0;
+
+static replay_stats_t stats;
+
+void replay_input_reset(void)
+{
+    head = 0;
+    tail = 0;
+    memset(&pending, 0, sizeof(pending));
+    pending_last_chip = -1;
+    offsets_new = 0;
+    stream_active = false;
+    end_pending = false;
+    started = false;
+    playing = false;
+    acked = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+static void commit_pending(void)
+{
+    if (pending.chips == 0) {
+        return;
+    }
+    if ((uint16_t)(head - tail) >= REPLAY_QUEUE_FRAMES) {
+        stats.dropped++;
+    } else {
+        queue[head % REPLAY_QUEUE_FRAMES] = pending;
+        __sync_synchronize();   // Frame contents before the index
+        head = head + 1;
+    }
+    memset(&pending, 0, sizeof(pending));
+    pending_last_chip = -1;
+}
+
+// Parse ",<hex>" n times into float bit patterns
+static bool parse_floats(const char** p, float* out, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (**p != ',') {
+            return false;
+        }
+        char* end;
+        uint32_t bits = (uint32_t)strtoul(*p + 1, &end, 16);
+        if (end == *p + 1) {
+            return false;
+        }
+        memcpy(&out[i], &bits, sizeof(bits));
+        *p = end;
+    }
+    return **p == '\0';
+}
+
+static bool parse_chip(const char** p, int* chip)
+{
+    char* end;
+    long value = strtol(*p, &end, 10);
+    if (end == *p || value < 0 || value >= NUM_PCAP_CHIPS) {
+        return false;
+    }
+    *chip = (int)value;
+    *p = end;
+    return true;
+}
+
+bool replay_input_line(const char* line)
+{
+    if (line[0] != 'I' || line[1] != ',') {
+        return false;
+    }
+    if (!stream_active) {
+        // First line of a new stream
+        stats.dropped = 0;
+        stats.malformed = 0;
+        stream_active = true;
+    }
+
+    const char* p = line + 2;
+    int chip;
+    float values[NUM_SENSORS_PER_CHIP];
+
+    if (p[0] == 'E' && p[1] == '\0') {
+        commit_pending();
+        end_pending = true;
+    } else if (p[0] == 'O' && p[1] == ',') {
+        p += 2;
+        if (parse_chip(&p, &chip) && parse_floats(&p, values, NUM_SENSORS_PER_CHIP)) {
+            memcpy(offsets[chip], values, sizeof(values));
+            offsets_new |= 1u << chip;
+        } else {
+            stats.malformed++;
+        }
+    } else if (parse_chip(&p, &chip) && parse_floats(&p, values, NUM_SENSORS_PER_CHIP)) {
+        if (chip <= pending_last_chip) {
+            commit_pending();
+        }
+        memcpy(pending.raw[chip], values, sizeof(values));
+        pending.chips |= 1u << chip;
+        pending_last_chip = chip;
+    } else {
+        stats.malformed++;
+    }
+    return true;
+}
+
+static replay_status_t end_stream(void)
+{
+    playing = false;
+    started = false;
+    end_pending = false;
+    stream_active = false;
+    return REPLAY_ENDED;
+}
+
+replay_status_t replay_input_next(replay_frame_t* frame)
+{
+    // The end flag is read first: frames committed before it are counted
+    bool ending = end_pending;
+    __sync_synchronize();
+    uint16_t queued = (uint16_t)(head - tail);
+
+    if (!stream_active) {
+        return REPLAY_IDLE;
+    }
+    if (!started) {
+        started = true;
+        acked = 0;
+        stats.frames = 0;
+        stats.underruns = 0;
+    }
+
+    if (queued == 0 && ending) {
+        return end_stream();
+    }
+    if (!playing) {
+        // The tail of a stream plays without filling the prebuffer
+        if (queued < REPLAY_PREBUFFER_FRAMES && !ending) {
+            return REPLAY_BUFFERING;
+        }
+        playing = true;
+    }
+    if (queued == 0) {
+        playing = false;
+        stats.underruns++;
+        return REPLAY_UNDERRUN;
+    }
+
+    __sync_synchronize();   // Index before the frame contents
+    *frame = queue[tail % REPLAY_QUEUE_FRAMES];
+    tail = tail + 1;
+    stats.frames++;
+    return REPLAY_FRAME;
+}
+
+bool replay_input_take_offsets(int chip, float* offset)
+{
+    // Offsets repeat unchanged in capture headers, so a copy racing a
+    // rewrite still reads consistent values
+    if (!(offsets_new & (1u << chip))) {
+        return false;
+    }
+    offsets_new &= (uint8_t)~(1u << chip);
+    memcpy(offset, offsets[chip], sizeof(offsets[chip]));
+    return true;
+}
+
+uint32_t replay_input_ack_due(void)
+{
+    if (stats.frames - acked < REPLAY_ACK_FRAMES) {
+        return 0;
+    }
+    acked = stats.frames;
+    return acked;
+}
+
+void replay_input_get_stats(replay_stats_t* out)
+{
+    *out = stats;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file replay_input.h
+ * @brief Hardware-in-the-loop replay of recorded raw readings
+ *
+ * In REPLAY_MODE the host streams a recorded capture over serial and the
+ * sensor task takes each frame from here instead of pcap_read_data(), at
+ * its configured rate, then runs the unchanged pipeline. Host lines:
+ *
+ *   "I,<chip>,<raw0>..<raw5>"      one chip of a frame, float bits in hex
+ *   "I,O,<chip>,<off0>..<off5>"    calibration offsets, float bits in hex
+ *   "I,E"                          end of the stream
+ *
+ * These are the "R," and "O," lines of host compensation mode, so an
+ * offload capture replays as recorded. A frame ends when the chip number
+ * stops increasing. The device acknowledges every REPLAY_ACK_FRAMES frames
+ * it consumes ("A,<frames>"), and the host keeps fewer than
+ * REPLAY_QUEUE_FRAMES frames unacknowledged, so the queue never overflows.
+ *
+ * Playback starts once REPLAY_PREBUFFER_FRAMES frames are queued, and
+ * starts again that way after an underrun, so host jitter does not leave
+ * holes in the replayed sequence. A frame that finds the queue empty is
+ * skipped, not run on stale data.
+ *
+ * No ESP-IDF or FreeRTOS dependency: one producer (the serial reader) and
+ * one consumer (the sensor task) share the queue through head and tail
+ * indices, and tools/replay/hil_replay.py --simulate runs the parser and
+ * the timing on the host.
+ */
+
+#ifndef REPLAY_INPUT_H
+#define REPLAY_INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcap04_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup ReplayConfig Replay Configuration
+ * @{
+ */
+#define REPLAY_QUEUE_FRAMES     16  ///< Frames buffered between serial and the sensor task
+#define REPLAY_PREBUFFER_FRAMES 8   ///< Frames queued before playback (re)starts
+#define REPLAY_ACK_FRAMES       4   ///< Frames consumed per "A," acknowledgement
+/** @} */
+
+/**
+ * @brief One replayed acquisition frame
+ */
+typedef struct {
+    uint8_t chips;                                          ///< Bit per chip present
+    float raw[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+} replay_frame_t;
+
+/**
+ * @brief What replay_input_next() produced for an acquisition frame
+ */
+typedef enum {
+    REPLAY_IDLE = 0,        ///< No stream
+    REPLAY_BUFFERING,       ///< Waiting for the prebuffer to fill
+    REPLAY_FRAME,           ///< A frame to run
+    REPLAY_UNDERRUN,        ///< Playing, but the queue ran dry; frame skipped
+    REPLAY_ENDED,           ///< Stream finished (returned once)
+} replay_status_t;
+
+/**
+ * @brief Replay counters
+ */
+typedef struct {
+    uint32_t frames;        ///< Frames played
+    uint32_t underruns;     ///< Acquisition frames skipped for want of data
+    uint32_t dropped;       ///< Frames lost to a full queue (host ignored the acks)
+    uint32_t malformed;     ///< Replay lines that did not parse
+} replay_stats_t;
+
+/**
+ * @brief Clear the queue, offsets and counters
+ */
+void replay_input_reset(void);
+
+/**
+ * @brief Parse one host line (without the newline)
+ * @return true if it was a replay line, well-formed or not
+ */
+bool replay_input_line(const char* line);
+
+/**
+ * @brief Take the frame for the current acquisition frame
+ * @param frame Receives the frame when REPLAY_FRAME is returned
+ */
+replay_status_t replay_input_next(replay_frame_t* frame);
+
+/**
+ * @brief Take offsets received since the last call for a chip
+ * @param chip   Chip index
+ * @param offset Receives NUM_SENSORS_PER_CHIP offsets
+ * @return true if new offsets arrived
+ */
+bool replay_input_take_offsets(int chip, float* offset);
+
+/**
+ * @brief Check whether an acknowledgement is due after a played frame
+ * @return Frames played so far when due, 0 otherwise
+ */
+uint32_t replay_input_ack_due(void);
+
+/**
+ * @brief Get the counters
+ */
+void replay_input_get_stats(replay_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REPLAY_INPUT_H
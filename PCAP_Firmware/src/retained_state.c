@@ -0,0 +1,243 @@
+/**
+ * @file retained_state.c
+ * @brief Pipeline state retained across soft resets (ESP-IDF)
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "retained_state.h"
+#include "demand.h"
+#include "history_store.h"
+#include "nn_inference.h"
+#include "esp_app_desc.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+
+static const char* TAG = "RETAIN";
+
+#define RETAINED_MAGIC 0x52544e44  // "RTND"
+#define RETAINED_BLOCK_BYTES 128    // CRC granularity of the saved state
+
+// Saved after every frame, in blocks with a CRC-32 each; crc covers the
+// block CRCs. Counters that change every frame come first, in block 0.
+typedef struct {
+    uint32_t magic;
+    uint32_t size;                  // sizeof(retained_t), catches layout changes
+    uint8_t  image[32];             // SHA-256 of the firmware that saved it
+    uint8_t  usable_mask;
+    uint8_t  attempts;              // Boots on this state without a frame
+    uint32_t fingerprint;           // nn_get_fingerprint() of the saving model
+    uint32_t period_us;
+    int64_t  frame_us;              // esp_timer time of the last saved frame
+    uint32_t frames;                // Frames since the cold start
+    uint32_t resumes;               // Soft resets resumed from since the cold start
+    uint64_t history_channels;
+    float    offset[NUM_PCAP_CHIPS][NUM_SENSORS_PER_CHIP];
+    history_state_t history;
+    nn_state_t nn;
+} retained_data_t;
+
+#define RETAINED_BLOCKS ((sizeof(retained_data_t) + RETAINED_BLOCK_BYTES - 1) / RETAINED_BLOCK_BYTES)
+
+typedef struct {
+    retained_data_t data;
+    uint32_t block_crc[RETAINED_BLOCKS];
+    uint32_t crc;
+} retained_t;
+
+static __NOINIT_ATTR retained_t retained;
+
+// Built here each frame; only the blocks that differ from the retained copy
+// are copied over and checksummed again. Most of the ~4.4 KB (corrections,
+// refresh phases, channels without demand) is unchanged between frames.
+static retained_data_t staged;
+
+static const pcap_data_t* chips = NULL;    // Offsets saved with every frame
+static uint8_t chips_mask = 0;
+static bool offsets_restored = false;       // retained_state_check() passed this boot
+static bool resumed = false;                // retained_state_resume() restored the windows
+static bool saved = false;                  // retained_state_save() ran this boot
+static bool valid_reported = false;
+static uint32_t boot_frames = 0;
+
+static size_t block_len(size_t block)
+{
+    size_t left = sizeof(retained_data_t) - block * RETAINED_BLOCK_BYTES;
+    return left < RETAINED_BLOCK_BYTES ? left : RETAINED_BLOCK_BYTES;
+}
+
+static uint32_t block_crc(size_t block)
+{
+    return esp_rom_crc32_le(0, (const uint8_t*)&retained.data + block * RETAINED_BLOCK_BYTES,
+                            block_len(block));
+}
+
+static uint32_t retained_crc(void)
+{
+    return esp_rom_crc32_le(0, (const uint8_t*)retained.block_crc, sizeof(retained.block_crc));
+}
+
+static bool retained_valid(void)
+{
+    if (retained.crc != retained_crc()) {
+        return false;
+    }
+    for (size_t block = 0; block < RETAINED_BLOCKS; block++) {
+        if (retained.block_crc[block] != block_crc(block)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Copy the staged blocks that changed, or all of them, and update their CRCs
+static void retained_commit(bool all)
+{
+    const uint8_t* src = (const uint8_t*)&staged;
+    uint8_t* dst = (uint8_t*)&retained.data;
+    bool changed = false;
+
+    for (size_t block = 0; block < RETAINED_BLOCKS; block++) {
+        size_t start = block * RETAINED_BLOCK_BYTES;
+        if (all || memcmp(dst + start, src + start, block_len(block)) != 0) {
+            memcpy(dst + start, src + start, block_len(block));
+            retained.block_crc[block] = block_crc(block);
+            changed = true;
+        }
+    }
+    if (changed) {
+        retained.crc = retained_crc();
+    }
+}
+
+static bool soft_reset(esp_reset_reason_t reason)
+{
+    return reason == ESP_RST_SW || reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT ||
+           reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT;
+}
+
+bool retained_state_check(uint8_t usable_mask, pcap_data_t data[NUM_PCAP_CHIPS])
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    const uint8_t* image = esp_app_get_description()->app_elf_sha256;
+
+    chips = data;
+    chips_mask = usable_mask;
+    if (!soft_reset(reason)) {
+        ESP_LOGI(TAG, "Reset reason %d, starting cold", reason);
+        return false;
+    }
+    if (retained.data.magic != RETAINED_MAGIC || retained.data.size != sizeof(retained) ||
+        !retained_valid()) {
+        ESP_LOGW(TAG, "No valid retained state, starting cold");
+        return false;
+    }
+    if (memcmp(retained.data.image, image, sizeof(retained.data.image)) != 0) {
+        ESP_LOGI(TAG, "Retained state is from another firmware, starting cold");
+        return false;
+    }
+    if (retained.data.usable_mask != usable_mask) {
+        ESP_LOGW(TAG, "Usable chips 0x%02X, retained state has 0x%02X, starting cold",
+                 usable_mask, retained.data.usable_mask);
+        return false;
+    }
+    if (retained.data.attempts >= RETAINED_MAX_ATTEMPTS) {
+        ESP_LOGW(TAG, "Retained state reset the device %d times before a frame, starting cold",
+                 retained.data.attempts);
+        return false;
+    }
+
+    // Count this boot, in case the state itself brings the device down
+    staged = retained.data;
+    staged.attempts++;
+    retained_commit(false);
+
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        memcpy(data[chip].offset, staged.offset[chip], sizeof(data[chip].offset));
+    }
+    offsets_restored = true;
+    ESP_LOGI(TAG, "Reset reason %d: restored offsets of chips 0x%02X, %lu frames since cold start",
+             reason, usable_mask, (unsigned long)staged.frames);
+    return true;
+}
+
+bool retained_state_resume(int64_t frame_us, uint32_t period_us, uint64_t* history_channels)
+{
+    if (!offsets_restored) {
+        return false;
+    }
+    if (staged.fingerprint != nn_get_fingerprint() || staged.period_us != period_us) {
+        ESP_LOGW(TAG, "Model %08lx or period %lu us changed since the reset, windows start empty",
+                 (unsigned long)nn_get_fingerprint(), (unsigned long)period_us);
+        return false;
+    }
+    if (!history_restore_state(&staged.history)) {
+        ESP_LOGW(TAG, "History not restored, windows start empty");
+        return false;
+    }
+
+    nn_restore_state(&staged.nn, frame_us - (int64_t)period_us - staged.frame_us);
+    *history_channels = staged.history_channels;
+    staged.resumes++;
+    retained_commit(false);
+    resumed = true;
+    ESP_LOGI(TAG, "Resumed windows of channels 0x%012llX (resume %lu)",
+             (unsigned long long)staged.history_channels, (unsigned long)staged.resumes);
+    return true;
+}
+
+// Every channel with history demand has a full window
+static bool windows_full(uint64_t history_channels)
+{
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+            if (((history_channels >> (DEMAND_CHIP_SHIFT(chip) + i)) & 1) &&
+                !nn_features_window_ready(chip, i)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void retained_state_save(int64_t frame_us, uint32_t period_us, uint64_t history_channels)
+{
+    boot_frames++;
+    if (!valid_reported && windows_full(history_channels)) {
+        valid_reported = true;
+        ESP_LOGI(TAG, "Valid output %lu ms after boot, on frame %lu of sampling (%s)",
+                 (unsigned long)(frame_us / 1000), (unsigned long)boot_frames,
+                 resumed ? "resumed" : "cold");
+    }
+
+    if (chips == NULL) {
+        return;
+    }
+    bool cold = !saved && !offsets_restored;
+    if (cold) {
+        // First save of a cold start: the counters begin here
+        memset(&staged, 0, sizeof(staged));
+        memcpy(staged.image, esp_app_get_description()->app_elf_sha256, sizeof(staged.image));
+        staged.magic = RETAINED_MAGIC;
+        staged.size = sizeof(retained);
+        staged.usable_mask = chips_mask;
+    }
+    saved = true;
+
+    staged.attempts = 0;
+    staged.fingerprint = nn_get_fingerprint();
+    staged.period_us = period_us;
+    staged.frame_us = frame_us;
+    staged.frames++;
+    staged.history_channels = history_channels;
+    for (int chip = 0; chip < NUM_PCAP_CHIPS; chip++) {
+        memcpy(staged.offset[chip], chips[chip].offset, sizeof(staged.offset[chip]));
+    }
+    history_save_state(&staged.history);
+    nn_save_state(&staged.nn);
+    // After a cold start the retained copy is garbage and may match a staged
+    // block by chance, so the first save writes every block
+    retained_commit(cold);
+}
@@ -0,0 +1,79 @@
+/**
+ * @file retained_state.h
+ * @brief Pipeline state retained across soft resets in no-init RAM (ESP-IDF)
+ *
+ * A panic or watchdog reset keeps RAM powered. The calibration offsets, the
+ * feature and compensation state, the history positions and the frame
+ * counters are saved to no-init RAM after every frame, behind a magic
+ * number and a CRC-32 per block, recomputed only for the blocks that
+ * changed; the history rows themselves stay in place in the store's no-init
+ * rings (history_store.h). After a soft reset of the same firmware with the
+ * same chips responding, the offsets replace the calibration and the pipeline
+ * resumes on the first frame with full windows, instead of warming up for
+ * NN_WINDOW_SIZE frames.
+ *
+ * Power-on, brownout and deep-sleep resets, a different firmware image and
+ * failed checks all start cold. So does a restored state that resets the
+ * device again before its first frame, RETAINED_MAX_ATTEMPTS times over.
+ */
+
+#ifndef RETAINED_STATE_H
+#define RETAINED_STATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pcap04_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup RetainedConfig Retained State Configuration
+ * @{
+ */
+#define RETAINED_MAX_ATTEMPTS   3   ///< Boots on one saved state without a frame before starting cold
+/** @} */
+
+/**
+ * @brief Check for state retained from before a soft reset
+ * @param usable_mask Chips that answered the communication test
+ * @param data        Receives each chip's retained offsets; saved from
+ *                    here after every frame, so it must stay valid
+ * @return true if the state is valid and the offsets were restored; skip
+ *         calibration then
+ *
+ * Call once at boot, after the communication test. Nothing is saved
+ * without this call.
+ */
+bool retained_state_check(uint8_t usable_mask, pcap_data_t data[NUM_PCAP_CHIPS]);
+
+/**
+ * @brief Restore the pipeline state at the start of the first frame
+ * @param frame_us         esp_timer time of the frame
+ * @param period_us        Sample period
+ * @param history_channels Receives the channels whose history was kept
+ * @return true if the windows and compensation state were restored
+ *
+ * Call after nn_init() and before anything reads or resets the windows.
+ * The saved timestamps are moved so the last saved frame lies one period
+ * before this one. Needs the same model and sample period as before.
+ */
+bool retained_state_resume(int64_t frame_us, uint32_t period_us, uint64_t* history_channels);
+
+/**
+ * @brief Save the state after a frame has gone through the pipeline
+ * @param frame_us         esp_timer time of the frame
+ * @param period_us        Sample period
+ * @param history_channels Channels whose samples entered the history
+ *
+ * Also logs, once per boot, when the first frame with full windows on
+ * every history channel completed: the time to valid output.
+ */
+void retained_state_save(int64_t frame_us, uint32_t period_us, uint64_t history_channels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RETAINED_STATE_H
@@ -0,0 +1,202 @@
+/**
+ * @file sample_profiler.c
+ * @brief Statistical sampling profiler implementation
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "sample_profiler.h"
+#include "stage_profiler.h"
+#include "serial_stream.h"
+#include "driver/gptimer.h"
+#include "riscv/rvruntime-frames.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char* TAG = "SPROF";
+
+#define SPROF_TIMER_HZ  1000000     // Timer resolution, alarm periods in microseconds
+
+// prof_now() units per microsecond, for the overhead share
+#if PCAP_QEMU_BUILD
+#define UNITS_PER_US    1000        // -icount shift=0: one instruction per nanosecond
+#else
+#define UNITS_PER_US    CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#endif
+
+typedef enum {
+    SPROF_IDLE = 0,
+    SPROF_RUNNING,
+    SPROF_READY,
+} sprof_state_t;
+
+static gptimer_handle_t timer = NULL;
+static volatile sprof_state_t state = SPROF_IDLE;
+static uint32_t rate;
+static uint16_t target;
+static volatile uint16_t count;
+
+// Samples, as two arrays so they pack to 5 bytes each
+static uint32_t sample_pc[SPROF_MAX_SAMPLES];
+static uint8_t sample_task[SPROF_MAX_SAMPLES];
+
+// Tasks in order of first sample; later ones share the last index
+static TaskHandle_t task_handles[SPROF_MAX_TASKS];
+static char task_names[SPROF_MAX_TASKS][configMAX_TASK_NAME_LEN];
+static uint8_t task_count;
+
+static int64_t start_us;
+static int64_t end_us;
+static uint64_t handler_total;
+static uint32_t handler_max;
+
+static uint8_t task_index(TaskHandle_t task)
+{
+    for (uint8_t i = 0; i < task_count; i++) {
+        if (task_handles[i] == task) {
+            return i;
+        }
+    }
+    if (task_count == SPROF_MAX_TASKS) {
+        return SPROF_MAX_TASKS - 1;
+    }
+    // Copied now: the task may be gone by the dump
+    task_handles[task_count] = task;
+    strncpy(task_names[task_count], task ? pcTaskGetName(task) : "ISR", configMAX_TASK_NAME_LEN - 1);
+    return task_count++;
+}
+
+// Timer alarm, in the timer's interrupt handler. Not IRAM-safe, so no
+// samples are taken while flash is being written (NVS commits, OTA).
+static bool on_sample(gptimer_handle_t t, const gptimer_alarm_event_data_t* edata, void* user_ctx)
+{
+    uint32_t begin = prof_now();
+    if (state != SPROF_RUNNING) {
+        return false;
+    }
+
+    // Not the mepc CSR: an interrupt of a higher level taken since this one
+    // returns with mepc pointing into this handler. Interrupt entry saved the
+    // interrupted task's frame, mepc first, at its pxTopOfStack, which is
+    // the first field of the TCB. An interrupted handler's frame is out of
+    // reach on the ISR stack, so those samples count as task "ISR" with no PC.
+    // The port returns the nesting count, which includes this interrupt: 1
+    // means it interrupted a task.
+    uint16_t n = count;
+    if (xPortInterruptedFromISRContext() == 1) {
+        TaskHandle_t task = xTaskGetCurrentTaskHandle();
+        const RvExcFrame* frame = *(const RvExcFrame* const*)task;
+        sample_pc[n] = frame->mepc;
+        sample_task[n] = task_index(task);
+    } else {
+        sample_pc[n] = 0;
+        sample_task[n] = task_index(NULL);
+    }
+    count = ++n;
+    if (n == target) {
+        end_us = esp_timer_get_time();
+        state = SPROF_READY;
+    }
+
+    uint32_t cost = prof_now() - begin;
+    handler_total += cost;
+    if (cost > handler_max) {
+        handler_max = cost;
+    }
+    return false;
+}
+
+bool sprof_start(uint32_t rate_hz, uint16_t samples)
+{
+    if (rate_hz == 0) {
+        rate_hz = SPROF_DEFAULT_RATE_HZ;
+    }
+    if (samples == 0 || samples > SPROF_MAX_SAMPLES) {
+        samples = SPROF_MAX_SAMPLES;
+    }
+    if (state != SPROF_IDLE) {
+        ESP_LOGW(TAG, "Capture already in progress");
+        return false;
+    }
+    if (rate_hz < SPROF_MIN_RATE_HZ || rate_hz > SPROF_MAX_RATE_HZ) {
+        ESP_LOGW(TAG, "Rate %lu Hz outside %d..%d", rate_hz, SPROF_MIN_RATE_HZ, SPROF_MAX_RATE_HZ);
+        return false;
+    }
+
+    if (timer == NULL) {
+        gptimer_config_t config = {
+            .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+            .direction = GPTIMER_COUNT_UP,
+            .resolution_hz = SPROF_TIMER_HZ,
+            .intr_priority = SPROF_INTR_PRIORITY,
+        };
+        gptimer_event_callbacks_t callbacks = { .on_alarm = on_sample };
+        if (gptimer_new_timer(&config, &timer) != ESP_OK) {
+            ESP_LOGE(TAG, "No general-purpose timer available");
+            timer = NULL;
+            return false;
+        }
+        gptimer_register_event_callbacks(timer, &callbacks, NULL);
+    }
+
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = SPROF_TIMER_HZ / rate_hz,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    gptimer_set_alarm_action(timer, &alarm);
+    gptimer_set_raw_count(timer, 0);
+
+    rate = rate_hz;
+    target = samples;
+    count = 0;
+    task_count = 0;
+    handler_total = 0;
+    handler_max = 0;
+    start_us = esp_timer_get_time();
+    state = SPROF_RUNNING;
+
+    gptimer_enable(timer);
+    gptimer_start(timer);
+    ESP_LOGI(TAG, "Sampling %u PCs at %lu Hz", samples, rate_hz);
+    return true;
+}
+
+bool sprof_ready(void)
+{
+    return state == SPROF_READY;
+}
+
+void sprof_dump(void)
+{
+    if (state != SPROF_READY) {
+        return;
+    }
+    gptimer_stop(timer);
+    gptimer_disable(timer);
+
+    uint32_t elapsed_us = (uint32_t)(end_us - start_us);
+    uint32_t overhead_ppm = elapsed_us ? (uint32_t)(handler_total * 1000000ULL / ((uint64_t)elapsed_us * UNITS_PER_US)) : 0;
+    serial_stream_printf("X,%u,%lu,%lu,%s,%lu,%lu,%lu\n", count, rate, elapsed_us, PROF_UNIT,
+                         (uint32_t)(handler_total / count), handler_max, overhead_ppm);
+    for (uint8_t i = 0; i < task_count; i++) {
+        serial_stream_printf("N,%u,%s\n", i, task_names[i]);
+    }
+
+    char line[4 + SPROF_DUMP_PER_LINE * 13];
+    for (uint16_t k = 0; k < count; k += SPROF_DUMP_PER_LINE) {
+        int n = snprintf(line, sizeof(line), "x");
+        for (uint16_t j = k; j < count && j < k + SPROF_DUMP_PER_LINE; j++) {
+            n += snprintf(line + n, sizeof(line) - n, ",%u:%lx", sample_task[j], sample_pc[j]);
+        }
+        n += snprintf(line + n, sizeof(line) - n, "\n");
+        serial_stream_write_line(line, n);
+    }
+
+    ESP_LOGI(TAG, "%u samples over %lu ms, handler %lu %s average, %lu.%02lu%% of the CPU",
+             count, elapsed_us / 1000, (uint32_t)(handler_total / count), PROF_UNIT,
+             overhead_ppm / 10000, overhead_ppm / 100 % 100);
+    state = SPROF_IDLE;
+}
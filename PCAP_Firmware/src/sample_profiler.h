@@ -0,0 +1,82 @@
+/**
+ * @file sample_profiler.h
+ * @brief Statistical sampling profiler (ESP-IDF)
+ *
+ * stage_profiler.h only sees the sections someone laps. This profiler sees
+ * everything the CPU runs: a general-purpose timer interrupts at a fixed
+ * rate, and its handler records the interrupted program counter and the
+ * running task into a RAM buffer. NimBLE, the SPI driver, TFLM kernels and
+ * the idle task all show up in proportion to their CPU time. When the
+ * buffer is full the capture stops and the main task prints it on serial
+ * for tools/profiler/sample_profile.py, which symbolizes the addresses
+ * against the firmware ELF into a flat profile and folded stacks for flame
+ * graphs.
+ *
+ * The interrupt runs at SPROF_INTR_PRIORITY, above the FreeRTOS tick and
+ * the peripheral drivers, so samples land inside their handlers too. Those
+ * count toward a task named "ISR" with PC 0 ("[unknown]" on the host): the
+ * handler's PC is saved on the ISR stack, out of reach, and the mepc CSR
+ * no longer holds it once a higher-level interrupt has come and gone. Code
+ * that masks interrupts is charged at the instruction after it unmasks.
+ * Only the PC is sampled, not the call stack; the host tool expands
+ * inlined frames from the debug info.
+ *
+ * The handler's own cost is measured per sample, in prof_now() units
+ * (cycles, or instructions in QEMU), and reported as a share of the CPU
+ * with the dump. Interrupt entry and exit are not part of it.
+ *
+ * Dump format:
+ *   "X,<samples>,<rate_hz>,<elapsed_us>,<unit>,<handler_avg>,<handler_max>,<overhead_ppm>"
+ *   "N,<task>,<name>" once per task seen
+ *   "x,<task>:<pc hex>,..." up to SPROF_DUMP_PER_LINE samples per line
+ */
+
+#ifndef SAMPLE_PROFILER_H
+#define SAMPLE_PROFILER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup SprofConfig Sampling Profiler Configuration
+ * @{
+ */
+#define SPROF_MAX_SAMPLES       2048    ///< Buffer size, 5 bytes RAM per sample
+#define SPROF_DEFAULT_RATE_HZ   1000    ///< Rate when none is given
+#define SPROF_MIN_RATE_HZ       10
+#define SPROF_MAX_RATE_HZ       20000   ///< Handler overhead grows with the rate
+#define SPROF_MAX_TASKS         16      ///< Distinct tasks named in a capture
+#define SPROF_INTR_PRIORITY     3       ///< Highest level for C handlers
+#define SPROF_DUMP_PER_LINE     8
+/** @} */
+
+/**
+ * @brief Start a capture
+ * @param rate_hz Samples per second, 0 for SPROF_DEFAULT_RATE_HZ
+ * @param samples Samples to take, 0 or above SPROF_MAX_SAMPLES for a full buffer
+ * @return false if a capture is in progress, the rate is out of range or
+ *         the timer could not be set up
+ *
+ * Does not block; safe from the BLE control handler.
+ */
+bool sprof_start(uint32_t rate_hz, uint16_t samples);
+
+/**
+ * @brief Whether a started capture has filled its samples
+ */
+bool sprof_ready(void);
+
+/**
+ * @brief Print a finished capture on serial and free the profiler for the next one
+ */
+void sprof_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SAMPLE_PROFILER_H
@@ -0,0 +1,134 @@
+/**
+ * @file serial_stream.c
+ * @brief Serial output with optional framed, multi-channel encoding
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "serial_stream.h"
+#include "esp_log.h"
+#if TOKEN_LOG_MODE
+#include "driver/uart_vfs.h"
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG || CONFIG_ESP_CONSOLE_SECONDARY_USB_SERIAL_JTAG
+#include "driver/usb_serial_jtag_vfs.h"
+#endif
+#endif
+
+// Channel byte + payload + CRC, plus COBS overhead and both delimiters
+#define FRAME_RAW_MAX   (1 + SERIAL_STREAM_MAX_PAYLOAD + 1)
+#define FRAME_BUF_SIZE  (FRAME_RAW_MAX + FRAME_RAW_MAX / 254 + 3)
+
+static uint8_t crc8(const uint8_t* data, size_t len)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// COBS-encode src into dst, returns encoded length (no delimiter)
+static size_t cobs_encode(const uint8_t* src, size_t len, uint8_t* dst)
+{
+    size_t code_idx = 0;
+    size_t out = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[code_idx] = code;
+            code_idx = out++;
+            code = 1;
+            continue;
+        }
+        dst[out++] = src[i];
+        if (++code == 0xFF) {
+            dst[code_idx] = code;
+            code_idx = out++;
+            code = 1;
+        }
+    }
+    dst[code_idx] = code;
+    return out;
+}
+
+void serial_stream_write(serial_channel_t channel, const void* payload, size_t len)
+{
+    uint8_t raw[FRAME_RAW_MAX];
+    uint8_t frame[FRAME_BUF_SIZE];
+
+    if (len > SERIAL_STREAM_MAX_PAYLOAD) {
+        len = SERIAL_STREAM_MAX_PAYLOAD;
+    }
+    raw[0] = (uint8_t)channel;
+    memcpy(&raw[1], payload, len);
+    raw[1 + len] = crc8(raw, 1 + len);
+
+    frame[0] = 0x00;
+    size_t n = 1 + cobs_encode(raw, len + 2, &frame[1]);
+    frame[n++] = 0x00;
+
+    // One fwrite per frame: stdout's lock keeps frames from interleaving.
+    // stdout is line-buffered and frames end in 0x00, not '\n', so push
+    // each one out now instead of when a later frame happens to hold 0x0A.
+    fwrite(frame, 1, n, stdout);
+    fflush(stdout);
+}
+
+void serial_stream_write_line(const char* line, size_t len)
+{
+#if TOKEN_LOG_MODE
+    serial_stream_write(SERIAL_CH_DATA, line, len);
+#else
+    fwrite(line, 1, len, stdout);
+#endif
+}
+
+void serial_stream_printf(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+#if TOKEN_LOG_MODE
+    char line[SERIAL_STREAM_MAX_PAYLOAD];
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    if (n > 0) {
+        serial_stream_write(SERIAL_CH_DATA, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    }
+#else
+    vprintf(fmt, args);
+#endif
+    va_end(args);
+}
+
+#if TOKEN_LOG_MODE
+// ESP_LOG backend for code built outside this component
+static int text_vprintf(const char* fmt, va_list args)
+{
+    char text[SERIAL_STREAM_MAX_PAYLOAD];
+    int n = vsnprintf(text, sizeof(text), fmt, args);
+    if (n > 0) {
+        serial_stream_write(SERIAL_CH_TEXT, text, (size_t)n < sizeof(text) ? (size_t)n : sizeof(text) - 1);
+    }
+    return n;
+}
+#endif
+
+void serial_stream_init(void)
+{
+#if TOKEN_LOG_MODE
+    // Frames are binary: the console's default CRLF translation would put a
+    // 0x0D before every 0x0A byte and break the frame CRC on the host
+    fflush(stdout);
+#if CONFIG_ESP_CONSOLE_UART
+    uart_vfs_dev_port_set_tx_line_endings(CONFIG_ESP_CONSOLE_UART_NUM, ESP_LINE_ENDINGS_LF);
+#endif
+#if CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG || CONFIG_ESP_CONSOLE_SECONDARY_USB_SERIAL_JTAG
+    usb_serial_jtag_vfs_set_tx_line_endings(ESP_LINE_ENDINGS_LF);
+#endif
+    esp_log_set_vprintf(text_vprintf);
+#endif
+}
@@ -0,0 +1,74 @@
+/**
+ * @file serial_stream.h
+ * @brief Serial output with optional framed, multi-channel encoding
+ *
+ * By default lines are written to stdout as before, so the CSV protocol is
+ * unchanged. With TOKEN_LOG_MODE each write becomes a frame on one channel:
+ * data lines, tokenized log records (see tlog.h) and formatted text from
+ * components that log through ESP_LOG outside this firmware. A log line can
+ * then no longer corrupt the data the host is parsing.
+ *
+ * Frame: 0x00, COBS(channel, payload, CRC-8), 0x00. The leading delimiter
+ * isolates any unframed bytes (ROM boot messages, panics) that precede it.
+ */
+
+#ifndef SERIAL_STREAM_H
+#define SERIAL_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef TOKEN_LOG_MODE
+#define TOKEN_LOG_MODE 0
+#endif
+
+#define SERIAL_STREAM_MAX_PAYLOAD   128     ///< Largest payload of one frame
+#define SERIAL_STREAM_FRAME_OVERHEAD 5      ///< Delimiters, COBS code, channel and CRC bytes
+
+/**
+ * @brief Frame channels
+ */
+typedef enum {
+    SERIAL_CH_DATA = 0,     ///< CSV data lines ("D,...", "B,...", ...)
+    SERIAL_CH_LOG,          ///< Tokenized log records
+    SERIAL_CH_TEXT,         ///< Formatted ESP_LOG text from other components
+} serial_channel_t;
+
+/**
+ * @brief Prepare the console for frames
+ *
+ * Turns off the console's CRLF translation, so frames reach the host byte
+ * for byte, and routes ESP_LOG output of other components into the text
+ * channel. No-op unless TOKEN_LOG_MODE. Call before the first log.
+ */
+void serial_stream_init(void);
+
+/**
+ * @brief Write one frame
+ * @param channel Channel of the payload
+ * @param payload Payload bytes
+ * @param len     Payload length, truncated to SERIAL_STREAM_MAX_PAYLOAD
+ */
+void serial_stream_write(serial_channel_t channel, const void* payload, size_t len);
+
+/**
+ * @brief Write one data line, framed or as plain text depending on the mode
+ * @param line Line including its trailing newline
+ * @param len  Line length
+ */
+void serial_stream_write_line(const char* line, size_t len);
+
+/**
+ * @brief printf() variant of serial_stream_write_line()
+ */
+void serial_stream_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SERIAL_STREAM_H
@@ -0,0 +1,124 @@
+/**
+ * @file signal_fixed.cpp
+ * @brief Fixed-point signal stages implementation
+ */
+
+#include "signal_fixed.h"
+
+#include <math.h>
+#include "q_format.h"
+#include "ble_manager.h"
+#include "nn_feature_config.h"
+#include "stage_profiler.h"
+#include "esp_log.h"
+
+static const char* TAG = "SIGNAL_FX";
+
+// Offset-corrected PCAP counts: +/-2^27 (1000 pF) with 1/16 count resolution
+using Counts = q::Q<4>;
+
+// BLE int16 units per count, 100000 / 2^27, exact in Q31
+static constexpr auto kInt16PerCount =
+    q::Q<31>::from_double((double)PCAP_SCALING_NUM * BLE_INT16_SCALE / PCAP_CONVERSION_NUMBER);
+
+int16_t signal_encode_int16(float raw, float offset)
+{
+    return q::mul<0, int16_t>(Counts::from_float(raw - offset), kInt16PerCount).raw();
+}
+
+// Benchmark stages beyond the encoder: the NN input normalization with its
+// scaler folded into constants, and a battery-style low-pass step
+using Cap = q::Q<20>;           // pF, +/-2048
+static constexpr float kScalerMean[] = NN_FEATURE_SCALER_MEAN;
+static constexpr float kScalerScale[] = NN_FEATURE_SCALER_SCALE;
+static constexpr Cap kMean = Cap::from_double(kScalerMean[0]);
+static constexpr auto kInvScale = q::Q<28>::from_double(1.0 / kScalerScale[0]);
+static constexpr auto kAlpha = q::Q<15, int16_t>::from_double(0.2);
+
+// Keeps the timed results alive
+static volatile int32_t sink;
+
+static int16_t encode_float(float raw, float offset)
+{
+    float calibrated = (PCAP_SCALING_NUM * (float)(raw - offset)/PCAP_CONVERSION_NUMBER);
+    float scaled = calibrated * BLE_INT16_SCALE;
+    if (scaled > INT16_MAX) scaled = INT16_MAX;
+    if (scaled < INT16_MIN) scaled = INT16_MIN;
+    return (int16_t)scaled;
+}
+
+void signal_fixed_benchmark(void)
+{
+    static float raw[SIGNAL_BENCH_OPS];
+    static float offset[SIGNAL_BENCH_OPS];
+    static float cap[SIGNAL_BENCH_OPS];
+
+    // Readings around a 6 pF baseline, deltas up to +/-2 pF
+    uint32_t seed = 12345;
+    for (int n = 0; n < SIGNAL_BENCH_OPS; n++) {
+        seed = seed * 1664525u + 1013904223u;
+        offset[n] = 800000.0f + (float)(seed >> 20);
+        raw[n] = offset[n] + (float)((int32_t)(seed >> 8) % 536870 - 268435);
+        cap[n] = (PCAP_SCALING_NUM * (raw[n] - offset[n])) / PCAP_CONVERSION_NUMBER + kScalerMean[0];
+    }
+
+    uint32_t t = prof_now();
+    for (int n = 0; n < SIGNAL_BENCH_OPS; n++) {
+        sink = encode_float(raw[n], offset[n]);
+    }
+    uint32_t encode_float_cost = prof_now() - t;
+
+    t = prof_now();
+    for (int n = 0; n < SIGNAL_BENCH_OPS; n++) {
+        sink = signal_encode_int16(raw[n], offset[n]);
+    }
+    uint32_t encode_fixed_cost = prof_now() - t;
+
+    t = prof_now();
+    for (int n = 0; n < SIGNAL_BENCH_OPS; n++) {
+        float norm = (cap[n] - kScalerMean[0]) / kScalerScale[0];
+        sink = (int32_t)lroundf(norm * 4096.0f);
+    }
+    uint32_t norm_float_cost = prof_now() - t;
+
+    t = prof_now();
+    for (int n = 0; n < SIGNAL_BENCH_OPS; n++) {
+        sink = q::mul<12>(Cap::from_float(cap[n]) - kMean, kInvScale).raw();
+    }
+    uint32_t norm_fixed_cost = prof_now() - t;
+
+    float yf = cap[0];
+    t = prof_now();
+    for (int n = 0; n < SIGNAL_BENCH_OPS; n++) {
+        yf = 0.8f * yf + 0.2f * cap[n];
+    }
+    sink = (int32_t)yf;
+    uint32_t ema_float_cost = prof_now() - t;
+
+    Cap yq = Cap::from_float(cap[0]);
+    t = prof_now();
+    for (int n = 0; n < SIGNAL_BENCH_OPS; n++) {
+        yq = q::ema(yq, Cap::from_float(cap[n]), kAlpha);
+    }
+    sink = yq.raw();
+    uint32_t ema_fixed_cost = prof_now() - t;
+
+    // Agreement, outside the timed loops
+    int encode_diff = 0;
+    float norm_diff = 0.0f;
+    for (int n = 0; n < SIGNAL_BENCH_OPS; n++) {
+        int d = abs(signal_encode_int16(raw[n], offset[n]) - encode_float(raw[n], offset[n]));
+        encode_diff = d > encode_diff ? d : encode_diff;
+        float norm = (cap[n] - kScalerMean[0]) / kScalerScale[0];
+        float e = fabsf(q::mul<12>(Cap::from_float(cap[n]) - kMean, kInvScale).to_float() - norm);
+        norm_diff = e > norm_diff ? e : norm_diff;
+    }
+
+    ESP_LOGI(TAG, "Fixed point vs soft-float, %s per op over %d ops:", PROF_UNIT, SIGNAL_BENCH_OPS);
+    ESP_LOGI(TAG, "  encode int16  float %lu  fixed %lu  (max diff %d LSB: truncation vs rounding)",
+             encode_float_cost / SIGNAL_BENCH_OPS, encode_fixed_cost / SIGNAL_BENCH_OPS, encode_diff);
+    ESP_LOGI(TAG, "  normalize     float %lu  fixed %lu  (max diff %.6f)",
+             norm_float_cost / SIGNAL_BENCH_OPS, norm_fixed_cost / SIGNAL_BENCH_OPS, norm_diff);
+    ESP_LOGI(TAG, "  low-pass      float %lu  fixed %lu  (final %.6f vs %.6f pF)",
+             ema_float_cost / SIGNAL_BENCH_OPS, ema_fixed_cost / SIGNAL_BENCH_OPS, yf, yq.to_float());
+}
@@ -0,0 +1,45 @@
+/**
+ * @file signal_fixed.h
+ * @brief Fixed-point signal stages (C interface to q_format.h)
+ *
+ * Stages of the sample path that run in Q-format integer arithmetic
+ * instead of soft-float, callable from the C modules.
+ */
+
+#ifndef SIGNAL_FIXED_H
+#define SIGNAL_FIXED_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup SignalFixedConfig Fixed-Point Stage Configuration
+ * @{
+ */
+#define SIGNAL_BENCH_OPS    1000    ///< Operations per stage timed by signal_fixed_benchmark()
+/** @} */
+
+/**
+ * @brief Calibrated value in BLE int16 units (BLE_INT16_SCALE per pF)
+ * @param raw    Raw PCAP result
+ * @param offset Calibration offset
+ * @return Value rounded to nearest and saturated to int16
+ */
+int16_t signal_encode_int16(float raw, float offset);
+
+/**
+ * @brief Time the fixed-point stages against their soft-float versions
+ *
+ * Logs cost per operation (cycles, or instructions in QEMU builds) and the
+ * largest difference between the two versions of each stage.
+ */
+void signal_fixed_benchmark(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SIGNAL_FIXED_H
@@ -0,0 +1,71 @@
+/**
+ * @file stage_profiler.c
+ * @brief Per-stage cost accounting implementation
+ */
+
+#include <stdio.h>
+#include "stage_profiler.h"
+#include "serial_stream.h"
+
+static uint32_t frame_cost[PROF_STAGE_COUNT];
+static prof_stage_stats_t stage_stats[PROF_STAGE_COUNT];
+static uint32_t frames = 0;
+
+// Since boot, for long-interval consumers (capacity_planner.h)
+static uint64_t lifetime_total[PROF_STAGE_COUNT];
+static uint32_t lifetime_frames = 0;
+
+uint32_t prof_lap(prof_stage_t stage, uint32_t start)
+{
+    uint32_t now = prof_now();
+    frame_cost[stage] += now - start;
+    return now;
+}
+
+void prof_frame_done(void)
+{
+    for (int s = 0; s < PROF_STAGE_COUNT; s++) {
+        stage_stats[s].total += frame_cost[s];
+        lifetime_total[s] += frame_cost[s];
+        if (frame_cost[s] > stage_stats[s].max) {
+            stage_stats[s].max = frame_cost[s];
+        }
+        frame_cost[s] = 0;
+    }
+    frames++;
+    lifetime_frames++;
+}
+
+uint32_t prof_get(prof_stage_t stage, prof_stage_stats_t* stats)
+{
+    *stats = stage_stats[stage];
+    return frames;
+}
+
+uint32_t prof_get_totals(uint64_t totals[PROF_STAGE_COUNT])
+{
+    for (int s = 0; s < PROF_STAGE_COUNT; s++) {
+        totals[s] = lifetime_total[s];
+    }
+    return lifetime_frames;
+}
+
+void prof_report(void)
+{
+    if (frames == 0) {
+        return;
+    }
+
+    // Built as one line so it goes out as a single serial frame
+    char line[24 + PROF_STAGE_COUNT * 22];
+    int n = snprintf(line, sizeof(line), "P,%lu,%s", frames, PROF_UNIT);
+    for (int s = 0; s < PROF_STAGE_COUNT; s++) {
+        n += snprintf(line + n, sizeof(line) - n, ",%lu,%lu",
+                      (uint32_t)(stage_stats[s].total / frames), stage_stats[s].max);
+        stage_stats[s].total = 0;
+        stage_stats[s].max = 0;
+    }
+    n += snprintf(line + n, sizeof(line) - n, "\n");
+    serial_stream_write_line(line, n);
+    frames = 0;
+}
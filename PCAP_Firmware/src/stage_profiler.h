@@ -0,0 +1,105 @@
+/**
+ * @file stage_profiler.h
+ * @brief Per-stage cost accounting for the sensor pipeline
+ *
+ * Accumulates the cost of each pipeline stage per frame. On hardware the
+ * unit is CPU cycles from the C3's performance counter. In QEMU builds the
+ * unit is retired instructions, read from the RISC-V minstret counter that
+ * QEMU implements (the C3 itself has none). Under -icount shift=0 the count
+ * is exact, so profiles are deterministic and comparable between
+ * optimization branches, down to single-instruction laps.
+ */
+
+#ifndef STAGE_PROFILER_H
+#define STAGE_PROFILER_H
+
+#include <stdint.h>
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "riscv/csr.h"
+#include "pcap_emulator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PROFILER_REPORT_FRAMES  500     ///< Frames per serial profile report
+
+/**
+ * @brief Pipeline stages
+ */
+typedef enum {
+    PROF_STAGE_ACQUIRE = 0,     ///< SPI reads of all usable chips
+    PROF_STAGE_COMPENSATE,      ///< NN compensation
+    PROF_STAGE_TRANSMIT,        ///< Encoding and hand-off to BLE or serial
+    PROF_STAGE_CLASSIFY,        ///< Gesture classification (GESTURE_MODE)
+    PROF_STAGE_COUNT
+} prof_stage_t;
+
+/**
+ * @brief Accumulated cost of one stage
+ */
+typedef struct {
+    uint64_t total;     ///< Sum over all recorded frames
+    uint32_t max;       ///< Worst single frame
+} prof_stage_stats_t;
+
+#if PCAP_QEMU_BUILD
+#define PROF_UNIT "instr"
+#else
+#define PROF_UNIT "cycles"
+#endif
+
+/**
+ * @brief Read the profiling clock
+ */
+static inline uint32_t prof_now(void)
+{
+#if PCAP_QEMU_BUILD
+    return RV_READ_CSR(minstret);
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+/**
+ * @brief Charge the time since start to a stage for the current frame
+ * @param stage Stage to charge
+ * @param start Value of prof_now() when the stage section began
+ * @return prof_now() at the end of the section, for chaining laps
+ */
+uint32_t prof_lap(prof_stage_t stage, uint32_t start);
+
+/**
+ * @brief Close the current frame and fold its per-stage costs into the totals
+ */
+void prof_frame_done(void);
+
+/**
+ * @brief Get accumulated statistics for a stage
+ * @param stage Stage to query
+ * @param stats Receives the statistics
+ * @return Number of frames accumulated
+ */
+uint32_t prof_get(prof_stage_t stage, prof_stage_stats_t* stats);
+
+/**
+ * @brief Get the totals of every stage since boot
+ * @param totals Receives the accumulated cost per stage (never reset)
+ * @return Frames accumulated since boot
+ */
+uint32_t prof_get_totals(uint64_t totals[PROF_STAGE_COUNT]);
+
+/**
+ * @brief Print the per-frame averages and maxima and reset the totals
+ *
+ * Format: "P,<frames>,<unit>,<acq_avg>,<acq_max>,<comp_avg>,<comp_max>,<tx_avg>,<tx_max>,
+ *          <cls_avg>,<cls_max>\n"
+ */
+void prof_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // STAGE_PROFILER_H
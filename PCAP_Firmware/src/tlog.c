@@ -0,0 +1,163 @@
+/**
+ * @file tlog.c
+ * @brief Tokenized logging implementation
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "tlog.h"
+#include "esp_cpu.h"
+
+static const char* TAG = "TLOG";
+
+#define TLOG_RECORD_MAX     SERIAL_STREAM_MAX_PAYLOAD
+
+static inline uint8_t* put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+// Copy the arguments as raw bytes, walking the conversions in the format.
+// Stops early rather than overflow the record; the host flags the remainder.
+static size_t tlog_encode(uint8_t* record, esp_log_level_t level, const char* tag,
+                          const char* fmt, va_list args)
+{
+    uint8_t* p = record;
+    uint8_t* end = record + TLOG_RECORD_MAX;
+
+    *p++ = (uint8_t)level;
+    p = put_u32(p, (uint32_t)(uintptr_t)fmt);
+    p = put_u32(p, (uint32_t)(uintptr_t)tag);
+    p = put_u32(p, esp_log_timestamp());
+
+    for (const char* f = fmt; *f; f++) {
+        if (*f != '%') {
+            continue;
+        }
+        if (*++f == '%') {
+            continue;
+        }
+
+        // Flags, then width and precision ('*' consumes an int argument)
+        while (*f == '-' || *f == '+' || *f == ' ' || *f == '#' || *f == '0') {
+            f++;
+        }
+        for (int field = 0; field < 2; field++) {
+            if (*f == '*') {
+                if (p + 4 > end) return p - record;
+                p = put_u32(p, (uint32_t)va_arg(args, int));
+                f++;
+            }
+            while (*f >= '0' && *f <= '9') {
+                f++;
+            }
+            if (field == 1 || *f != '.') {
+                break;
+            }
+            f++;
+        }
+
+        // Length modifiers; only ll and j widen past 32 bits on RV32
+        int wide = 0;
+        while (*f == 'l' || *f == 'h' || *f == 'z' || *f == 'j' || *f == 't' || *f == 'L') {
+            wide += (*f == 'l') ? 1 : (*f == 'j') ? 2 : 0;
+            f++;
+        }
+
+        switch (*f) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': case 'p':
+            if (wide >= 2) {
+                if (p + 8 > end) return p - record;
+                uint64_t v = va_arg(args, unsigned long long);
+                p = put_u32(p, (uint32_t)v);
+                p = put_u32(p, (uint32_t)(v >> 32));
+            } else {
+                if (p + 4 > end) return p - record;
+                p = put_u32(p, (uint32_t)va_arg(args, unsigned long));
+            }
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+            if (p + 4 > end) return p - record;
+            float v = (float)va_arg(args, double);
+            uint32_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            p = put_u32(p, bits);
+            break;
+        }
+        case 's': {
+            const char* s = va_arg(args, const char*);
+            size_t n = s ? strnlen(s, TLOG_STRING_MAX) : 0;
+            if (p >= end) return p - record;
+            if (n > (size_t)(end - p - 1)) {
+                n = end - p - 1;
+            }
+            *p++ = (uint8_t)n;
+            if (n > 0) {
+                memcpy(p, s, n);
+                p += n;
+            }
+            break;
+        }
+        default:
+            // Unsupported or truncated conversion: nothing more can be decoded
+            return p - record;
+        }
+    }
+    return p - record;
+}
+
+void tlog_write(esp_log_level_t level, const char* tag, const char* fmt, ...)
+{
+    uint8_t record[TLOG_RECORD_MAX];
+    va_list args;
+
+    va_start(args, fmt);
+    size_t len = tlog_encode(record, level, tag, fmt, args);
+    va_end(args);
+
+    serial_stream_write(SERIAL_CH_LOG, record, len);
+}
+
+// Encode into a record without sending it, for the cost comparison
+static size_t tlog_encode_only(uint8_t* record, const char* tag, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    size_t len = tlog_encode(record, ESP_LOG_INFO, tag, fmt, args);
+    va_end(args);
+    return len;
+}
+
+void tlog_report_cost(void)
+{
+    // A typical status line, once as a tokenized record and once formatted
+    // the way ESP_LOG builds its line (level, timestamp, tag, message)
+    static const char sample_tag[] = "BATT";
+    uint8_t record[TLOG_RECORD_MAX];
+    char line[TLOG_RECORD_MAX];
+    size_t record_len = 0;
+    int line_len = 0;
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < TLOG_COST_ITERATIONS; i++) {
+        record_len = tlog_encode_only(record, sample_tag, "Battery %d%% (%lu mV), runtime %.1f h",
+                                      87, 3912UL, 12.5);
+    }
+    uint32_t token_cycles = (esp_cpu_get_cycle_count() - start) / TLOG_COST_ITERATIONS;
+
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < TLOG_COST_ITERATIONS; i++) {
+        line_len = snprintf(line, sizeof(line), "I (%lu) %s: Battery %d%% (%lu mV), runtime %.1f h\n",
+                            esp_log_timestamp(), sample_tag, 87, 3912UL, 12.5);
+    }
+    uint32_t text_cycles = (esp_cpu_get_cycle_count() - start) / TLOG_COST_ITERATIONS;
+
+    ESP_LOGI(TAG, "Tokenized: %lu cycles, %u bytes; ESP_LOG text: %lu cycles, %d bytes",
+             token_cycles, (unsigned)(record_len + SERIAL_STREAM_FRAME_OVERHEAD),
+             text_cycles, line_len);
+}
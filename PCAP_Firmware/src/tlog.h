@@ -0,0 +1,72 @@
+/**
+ * @file tlog.h
+ * @brief Tokenized logging for the framed serial stream
+ *
+ * With TOKEN_LOG_MODE (CMake -DPCAP_TOKEN_LOG=1, which also force-includes
+ * this header into every source of the component) the ESP_LOGx macros stop
+ * formatting on the device. Each call site keeps its format string in the
+ * .rodata.tlog section and sends a record on SERIAL_CH_LOG holding only the
+ * string's address as its token, the tag address, a timestamp and the raw
+ * argument bytes. tools/tlog/tlog_decode.py builds the token dictionary from
+ * the firmware ELF and formats the records on the host.
+ *
+ * Record: level(1) fmt(4) tag(4) timestamp_ms(4) args, little-endian.
+ * Arguments follow the conversions in the format: integers as 4 bytes (8 for
+ * ll/j), floating point as float32, %s as a length byte plus the bytes.
+ * Only the compile-time LOG_LOCAL_LEVEL filter applies.
+ */
+
+#ifndef TLOG_H
+#define TLOG_H
+
+#include <stdint.h>
+#include "esp_log.h"
+#include "serial_stream.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TLOG_STRING_MAX     32      ///< %s arguments are truncated to this many bytes
+#define TLOG_COST_ITERATIONS 16     ///< Calls averaged by tlog_report_cost()
+
+/**
+ * @brief Encode and send one tokenized record (use through ESP_LOGx)
+ * @param level Log level
+ * @param tag   Tag string, sent by address
+ * @param fmt   Format string in .rodata.tlog, sent by address
+ */
+void tlog_write(esp_log_level_t level, const char* tag, const char* fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * @brief Log the per-call cycles and bytes of a tokenized record against
+ *        the same line formatted the ESP_LOG way
+ */
+void tlog_report_cost(void);
+
+#define TLOG_RECORD(level, tag, format, ...) do {                                      \
+        if ((level) <= LOG_LOCAL_LEVEL) {                                               \
+            static const char tlog_fmt_[] __attribute__((section(".rodata.tlog"))) = format; \
+            tlog_write((level), (tag), tlog_fmt_, ##__VA_ARGS__);                       \
+        }                                                                               \
+    } while (0)
+
+#if TOKEN_LOG_MODE
+#undef ESP_LOGE
+#undef ESP_LOGW
+#undef ESP_LOGI
+#undef ESP_LOGD
+#undef ESP_LOGV
+#define ESP_LOGE(tag, format, ...) TLOG_RECORD(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) TLOG_RECORD(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) TLOG_RECORD(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) TLOG_RECORD(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) TLOG_RECORD(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TLOG_H
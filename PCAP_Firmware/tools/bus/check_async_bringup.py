@@ -0,0 +1,379 @@
+#!/usr/bin/env python3
+"""Check concurrent chip bring-up (pcap_async) on the host against emulated chips.
+
+Builds pcap_async.cpp and async_exec.h with the host C++ compiler, together
+with the real bus scheduler, pcap_driver.c in its QEMU configuration and
+pcap_emulator.c as the chips behind the mux. Small stand-ins for the ESP-IDF
+and FreeRTOS headers replace the clock, the critical sections and the task
+notifications with a simulated clock and a single-threaded event loop: while
+pcap_async_bring_up() waits for its result, the loop does what the bus task
+and the executor task do on the device, and jumps the clock over their
+waits. SPI bytes take as long as at PCAP_SPI_CLOCK_HZ and the mux settles
+as on the board.
+
+The scenarios check:
+
+  one chip:     a chip comes up and its offsets are calibrated
+  eight chips:  all come up, their bus frames interleave (while one chip
+                settles, the bus serves the others), and the whole bring-up
+                takes far less than eight single ones
+  absent chip:  a chip that never answers the communication test is left
+                out without holding up the rest
+  repeat:       a second bring-up right after the first returns the same
+                result (no state left over from the previous call)
+
+The exit status is 1 if any check fails.
+
+Usage:
+    check_async_bringup.py [--cc cc] [--cxx c++] [-v]
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src")
+
+# Host stand-ins for the ESP-IDF and FreeRTOS headers the sources include.
+# Functions that need the simulated clock or the event loop are defined by
+# the harness.
+SHIMS = {
+    "esp_err.h": """#pragma once
+typedef int esp_err_t;
+#define ESP_OK 0
+static inline const char* esp_err_to_name(esp_err_t err) { (void)err; return "error"; }
+""",
+    "esp_log.h": """#pragma once
+#include "esp_err.h"
+#define ESP_LOGE(tag, ...) ((void)(tag))
+#define ESP_LOGW(tag, ...) ((void)(tag))
+#define ESP_LOGI(tag, ...) ((void)(tag))
+""",
+    "esp_timer.h": """#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+typedef struct esp_timer* esp_timer_handle_t;
+typedef struct {
+    void (*callback)(void* arg);
+    void* arg;
+    const char* name;
+} esp_timer_create_args_t;
+int64_t esp_timer_get_time(void);
+static inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out)
+{
+    (void)args;
+    *out = 0;
+    return ESP_OK;
+}
+static inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    (void)timer;
+    (void)timeout_us;
+    return ESP_OK;
+}
+#ifdef __cplusplus
+}
+#endif
+""",
+    "esp_rom_sys.h": """#pragma once
+#include <stdint.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+void esp_rom_delay_us(uint32_t us);
+#ifdef __cplusplus
+}
+#endif
+""",
+    "freertos/FreeRTOS.h": """#pragma once
+#include <stdint.h>
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef int portMUX_TYPE;
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define pdPASS                          1
+#define portMAX_DELAY                   UINT32_MAX
+#define portTICK_PERIOD_MS              10
+#define pdMS_TO_TICKS(ms)               ((TickType_t)(ms) / portTICK_PERIOD_MS)
+#define portMUX_INITIALIZER_UNLOCKED    0
+#define portENTER_CRITICAL(mux)         ((void)(mux))
+#define portEXIT_CRITICAL(mux)          ((void)(mux))
+""",
+    "freertos/task.h": """#pragma once
+#include "FreeRTOS.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+void host_notify(void);
+/* Tasks are never started; the harness runs their loops itself */
+static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stack, void* arg,
+                                     UBaseType_t prio, TaskHandle_t* handle)
+{
+    (void)name; (void)stack; (void)arg; (void)prio;
+    if (handle) *handle = (TaskHandle_t)fn;
+    return pdPASS;
+}
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t task) { (void)task; host_notify(); return pdPASS; }
+static inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) { (void)clear; (void)wait; return 1; }
+static inline TaskHandle_t xTaskGetCurrentTaskHandle(void) { return 0; }
+static inline void vTaskDelay(TickType_t ticks) { (void)ticks; }
+#ifdef __cplusplus
+}
+#endif
+""",
+    "freertos/semphr.h": """#pragma once
+#include "FreeRTOS.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+typedef struct { volatile int count; } StaticSemaphore_t;
+typedef StaticSemaphore_t* SemaphoreHandle_t;
+static inline SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer)
+{
+    buffer->count = 0;
+    return buffer;
+}
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) { sem->count = 1; return pdTRUE; }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+#ifdef __cplusplus
+}
+#endif
+""",
+    "driver/gpio.h": """#pragma once
+typedef int gpio_num_t;
+""",
+    "driver/spi_master.h": """#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+typedef struct spi_device* spi_device_handle_t;
+#define SPI_TRANS_USE_RXDATA (1 << 2)
+#define SPI_TRANS_USE_TXDATA (1 << 3)
+typedef struct {
+    uint32_t flags;
+    size_t length;
+    const void* tx_buffer;
+    void* rx_buffer;
+    uint8_t tx_data[4];
+    uint8_t rx_data[4];
+} spi_transaction_t;
+static inline esp_err_t spi_device_polling_transmit(spi_device_handle_t dev, spi_transaction_t* trans)
+{
+    (void)dev;
+    (void)trans;
+    return ESP_OK;
+}
+""",
+}
+
+HARNESS = r"""#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "pcap_async.h"
+#include "pcap_emulator.h"
+#include "freertos/semphr.h"
+
+static int verbose;
+static int failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { failures++; printf("  FAIL: " __VA_ARGS__); printf("\n"); } \
+    else if (verbose) { printf("  ok: " __VA_ARGS__); printf("\n"); } \
+} while (0)
+
+// Simulated board
+static int64_t now;
+static bool notified;
+static uint8_t absent;
+static pcap_chip_select_t selected = PCAP_CHIP_NONE;
+static std::vector<uint8_t> trace;      // Chip of every chip-select frame
+
+extern "C" {
+
+int64_t esp_timer_get_time(void) { return now; }
+void esp_rom_delay_us(uint32_t us) { now += us; }
+void host_notify(void) { notified = true; }
+
+void mux_init(void) {}
+
+static void select_chip(pcap_chip_select_t chip)
+{
+    selected = chip;
+    if (chip != PCAP_CHIP_NONE) {
+        trace.push_back((uint8_t)chip);
+    }
+    pcap_emu_select(chip);
+}
+
+void mux_select_chip(pcap_chip_select_t chip) { select_chip(chip); now += MUX_SETTLE_US; }
+void mux_select_chip_quick(pcap_chip_select_t chip) { select_chip(chip); now += MUX_QUICK_SETTLE_US; }
+void mux_deselect_chip(void) { mux_select_chip(PCAP_CHIP_NONE); }
+pcap_chip_select_t mux_get_current_chip(void) { return selected; }
+
+// pcap_emulator.c's own transfer, renamed at build time
+void pcap_emu_model_transfer(const uint8_t* tx, uint8_t* rx, size_t len);
+
+void pcap_emu_transfer(const uint8_t* tx, uint8_t* rx, size_t len)
+{
+    now += ((int64_t)len * 8 * 1000000 + PCAP_SPI_CLOCK_HZ - 1) / PCAP_SPI_CLOCK_HZ;
+    if (selected != PCAP_CHIP_NONE && (absent & (1u << selected))) {
+        if (rx) memset(rx, 0, len);     // Nobody drives MISO
+        return;
+    }
+    pcap_emu_model_transfer(tx, rx, len);
+}
+
+// The caller's wait is the event loop: the bus task and the executor task
+// of the device, run in turn until the semaphore is given
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    (void)wait;
+    while (!sem->count) {
+        notified = false;
+        uint32_t exec_wait = pcap::executor().run();
+        uint32_t bus_wait = bus_sched_run();
+        if (sem->count || notified) {
+            continue;
+        }
+        uint32_t next = exec_wait < bus_wait ? exec_wait : bus_wait;
+        if (next == UINT32_MAX) {
+            printf("  FAIL: nothing left to run and the bring-up never finished\n");
+            failures++;
+            return pdFALSE;
+        }
+        now += next ? next : 1;
+    }
+    sem->count = 0;
+    return pdTRUE;
+}
+
+} // extern "C"
+
+static uint8_t firmware[PCAP_FW_SIZE - PCAP_CONFIG_SIZE - 64];
+static uint8_t config[PCAP_CONFIG_SIZE];
+static const pcap_bring_up_t params = {
+    firmware, sizeof(firmware), config, sizeof(config),
+    8,      // calibration_samples
+    3,      // comm_retries
+};
+
+struct Result {
+    uint8_t usable;
+    int64_t elapsed_us;
+    pcap_data_t data[NUM_PCAP_CHIPS];
+};
+
+static Result bring_up(uint8_t mask, uint8_t missing)
+{
+    Result r = {};
+    absent = missing;
+    trace.clear();
+    int64_t start = now;
+    r.usable = pcap_async_bring_up(&params, mask, r.data);
+    r.elapsed_us = now - start;
+    return r;
+}
+
+static bool calibrated(const pcap_data_t* d)
+{
+    for (int i = 0; i < NUM_SENSORS_PER_CHIP; i++) {
+        if (!(d->offset[i] > 0.0f)) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    for (size_t i = 0; i < sizeof(firmware); i++) firmware[i] = (uint8_t)(i * 7 + 3);
+    pcap_driver_init();
+    pcap_async_init();
+
+    printf("one chip\n");
+    Result one = bring_up(0x01, 0);
+    CHECK(one.usable == 0x01, "chip 0 up (0x%02X)", one.usable);
+    CHECK(calibrated(&one.data[0]), "offsets calibrated");
+    int64_t single_us = one.elapsed_us;
+    if (verbose) printf("  %lld us\n", (long long)single_us);
+
+    printf("eight chips\n");
+    Result all = bring_up(0xFF, 0);
+    CHECK(all.usable == 0xFF, "all chips up (0x%02X)", all.usable);
+    bool all_calibrated = true;
+    for (int c = 0; c < NUM_PCAP_CHIPS; c++) all_calibrated = all_calibrated && calibrated(&all.data[c]);
+    CHECK(all_calibrated, "every chip calibrated");
+    CHECK(all.elapsed_us < 2 * single_us, "%lld us, against %lld us for one chip",
+          (long long)all.elapsed_us, (long long)single_us);
+
+    // Chip 0's frames are spread through the others', not run as one block
+    size_t first = trace.size(), last = 0;
+    for (size_t i = 0; i < trace.size(); i++) {
+        if (trace[i] == 0) { if (first == trace.size()) first = i; last = i; }
+    }
+    uint8_t between = 0;
+    int switches = 0;
+    for (size_t i = first; i <= last && i < trace.size(); i++) between |= 1u << trace[i];
+    for (size_t i = 1; i < trace.size(); i++) switches += trace[i] != trace[i - 1];
+    CHECK(between == 0xFF, "every other chip used the bus during chip 0's bring-up (0x%02X)", between);
+    CHECK(switches > 8 * 8, "frames interleave (%d chip changes over %zu frames)", switches, trace.size());
+
+    printf("absent chip\n");
+    Result partial = bring_up(0xFF, 1u << 3);
+    CHECK(partial.usable == 0xF7, "chip 3 left out (0x%02X)", partial.usable);
+    CHECK(partial.elapsed_us < 2 * single_us, "the rest not held up (%lld us)", (long long)partial.elapsed_us);
+
+    printf("repeat\n");
+    Result again = bring_up(0xFF, 0);
+    CHECK(again.usable == 0xFF, "second bring-up (0x%02X)", again.usable);
+
+    printf("%s: %d failure(s)\n", failures ? "FAIL" : "PASS", failures);
+    return failures ? 1 : 0;
+}
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="host C compiler")
+    parser.add_argument("--cxx", default=os.environ.get("CXX", "c++"), help="host C++20 compiler")
+    parser.add_argument("-v", "--verbose", action="store_true", help="print passing checks")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        shim_dir = os.path.join(tmp, "shim")
+        for name, text in SHIMS.items():
+            path = os.path.join(shim_dir, name)
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            with open(path, "w") as f:
+                f.write(text)
+        harness = os.path.join(tmp, "harness.cpp")
+        with open(harness, "w") as f:
+            f.write(HARNESS)
+
+        flags = ["-O1", "-DPCAP_QEMU_BUILD=1", "-I", shim_dir, "-I", SRC_DIR]
+        objects = []
+        for src, extra in (("bus_scheduler.c", []), ("pcap_driver.c", []),
+                           ("pcap_emulator.c", ["-Dpcap_emu_transfer=pcap_emu_model_transfer"])):
+            obj = os.path.join(tmp, src + ".o")
+            subprocess.run([args.cc, "-std=gnu11", "-c"] + flags + extra +
+                           [os.path.join(SRC_DIR, src), "-o", obj], check=True)
+            objects.append(obj)
+        exe = os.path.join(tmp, "check_async_bringup")
+        subprocess.run([args.cxx, "-std=c++20"] + flags +
+                       [harness, os.path.join(SRC_DIR, "pcap_async.cpp")] + objects + ["-o", exe],
+                       check=True)
+        result = subprocess.run([exe] + (["-v"] if args.verbose else []))
+    sys.exit(result.returncode)
+
+
+if __name__ == "__main__":
+    main()
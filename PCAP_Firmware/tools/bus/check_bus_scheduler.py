@@ -0,0 +1,308 @@
+#!/usr/bin/env python3
+"""Check the bus scheduler's priorities and frame budget against a mock bus.
+
+Builds src/bus_scheduler.c on the host with a mock bus: a simulated clock
+that select, transfer and delay advance by what the real bus would take,
+and a trace of every chip-select frame. Batches are submitted at set
+simulated times, including while an op is on the bus, the way sensor_task
+and the control paths submit on the device. The scenarios check:
+
+  order:       realtime, then control, then background, each class FIFO
+  preemption:  realtime and control work submitted during a background
+               batch runs after the op in progress, before the batch's next op
+  chaining:    quick-select ops of a realtime batch share one deselect
+  budget:      with 1 kHz frames, background ops never delay a frame and
+               still all complete; deferrals are counted
+  oversized:   an op too long for the guarded gap runs right after a frame
+               instead of starving
+  stats:       batch counts and queue depth per class
+
+The exit status is 1 if any check fails.
+
+Usage:
+    check_bus_scheduler.py [--cc cc] [-v]
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src")
+
+HARNESS = r"""#include <stdio.h>
+#include <string.h>
+#include "bus_scheduler.h"
+
+#define BYTE_NS         1000    // 8 MHz SPI
+#define SELECT_US       20      // Mux settling, within BUS_SCHED_OP_OVERHEAD_US
+#define QUICK_SELECT_US 2
+#define CHIP_CONTROL    10      // Mock chips tag the class in the trace
+#define CHIP_BACKGROUND 11
+#define MAX_TRACE       8192
+#define MAX_PENDING     4096
+
+static int verbose;
+static int failures;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { failures++; printf("  FAIL: " __VA_ARGS__); printf("\n"); } \
+    else if (verbose) { printf("  ok: " __VA_ARGS__); printf("\n"); } \
+} while (0)
+
+// Mock bus
+static int64_t now;
+static uint8_t trace_chip[MAX_TRACE];
+static int64_t trace_start[MAX_TRACE];
+static int trace_len;
+static int deselects, quick_selects;
+
+// Submissions due at a simulated time
+static bus_batch_t* pending[MAX_PENDING];
+static int64_t pending_at[MAX_PENDING];
+static int pending_len, pending_next;
+
+static void submit_due(void)
+{
+    while (pending_next < pending_len && pending_at[pending_next] <= now) {
+        bus_sched_submit(pending[pending_next++]);
+    }
+}
+
+static void at(int64_t t, bus_batch_t* batch)
+{
+    int i = pending_len++;
+    for (; i > pending_next && pending_at[i - 1] > t; i--) {
+        pending_at[i] = pending_at[i - 1];
+        pending[i] = pending[i - 1];
+    }
+    pending_at[i] = t;
+    pending[i] = batch;
+}
+
+static void record(uint8_t chip)
+{
+    if (trace_len < MAX_TRACE) {
+        trace_chip[trace_len] = chip;
+        trace_start[trace_len++] = now;
+    }
+}
+
+static void mock_select(uint8_t chip) { now += SELECT_US; record(chip); }
+static void mock_select_quick(uint8_t chip) { now += QUICK_SELECT_US; quick_selects++; record(chip); }
+static void mock_deselect(void) { deselects++; }
+static void mock_transfer(const uint8_t* tx, uint8_t* rx, size_t len)
+{
+    (void)tx;
+    now += (int64_t)len * BYTE_NS / 1000;
+    if (rx) memset(rx, 0xA5, len);
+    submit_due();       // Other tasks keep submitting while the bus is busy
+}
+static void mock_delay(uint32_t us) { now += us; }
+static int64_t mock_now(void) { return now; }
+static void mock_nop(void) {}
+
+static const bus_ops_t mock_ops = {
+    .select = mock_select,
+    .deselect = mock_deselect,
+    .transfer = mock_transfer,
+    .delay_us = mock_delay,
+    .now_us = mock_now,
+    .lock = mock_nop,
+    .unlock = mock_nop,
+    .kick = mock_nop,
+    .select_quick = mock_select_quick,
+};
+
+static void reset(void)
+{
+    now = 0;
+    trace_len = deselects = quick_selects = 0;
+    pending_len = pending_next = 0;
+    bus_sched_init(&mock_ops, BYTE_NS);
+}
+
+// Run until the queues are empty, jumping the clock over waits
+static void drain(void)
+{
+    while (1) {
+        submit_due();
+        uint32_t wait = bus_sched_run();
+        if (pending_next < pending_len) {
+            int64_t t = pending_at[pending_next];
+            if (wait != BUS_SCHED_IDLE_WAIT_US && now + wait < t) t = now + wait;
+            if (t > now) now = t;
+            continue;
+        }
+        if (wait == BUS_SCHED_IDLE_WAIT_US) return;
+        now += wait;
+    }
+}
+
+static bus_op_t ops[MAX_PENDING][8];
+static bus_batch_t batches[MAX_PENDING];
+static int batch_count;
+
+static bus_batch_t* make(bus_prio_t prio, uint8_t chip, uint16_t count, uint16_t len, uint8_t flags)
+{
+    bus_batch_t* b = &batches[batch_count];
+    bus_op_t* o = ops[batch_count++];
+    for (uint16_t i = 0; i < count; i++) {
+        o[i] = (bus_op_t){ .chip = (uint8_t)(chip + ((flags & BUS_OP_QUICK_SELECT) ? i : 0)),
+                           .cmd_len = 2, .len = len, .flags = flags };
+    }
+    memset(b, 0, sizeof(*b));
+    b->ops = o;
+    b->count = count;
+    b->prio = prio;
+    return b;
+}
+
+static void expect_trace(const char* name, const uint8_t* want, int n)
+{
+    int same = trace_len == n;
+    for (int i = 0; same && i < n; i++) same = trace_chip[i] == want[i];
+    if (!same || verbose) {
+        printf("  %s trace:", name);
+        for (int i = 0; i < trace_len; i++) printf(" %u", trace_chip[i]);
+        printf("\n");
+    }
+    CHECK(same, "%s: frames in the expected order", name);
+}
+
+static void test_order(void)
+{
+    printf("order\n");
+    reset();
+    batch_count = 0;
+    bus_sched_submit(make(BUS_PRIO_BACKGROUND, CHIP_BACKGROUND, 2, 10, 0));
+    bus_sched_submit(make(BUS_PRIO_CONTROL, CHIP_CONTROL, 2, 10, 0));
+    bus_sched_submit(make(BUS_PRIO_REALTIME, 0, 1, 10, 0));
+    bus_sched_submit(make(BUS_PRIO_CONTROL, CHIP_CONTROL + 2, 1, 10, 0));
+    drain();
+    const uint8_t want[] = {0, CHIP_CONTROL, CHIP_CONTROL, CHIP_CONTROL + 2, CHIP_BACKGROUND, CHIP_BACKGROUND};
+    expect_trace("order", want, sizeof(want));
+    CHECK(batches[0].done && batches[1].done && batches[2].done && batches[3].done, "every batch completes");
+}
+
+static void test_preemption(void)
+{
+    printf("preemption\n");
+    reset();
+    batch_count = 0;
+    // Background ops of 100 bytes take 120 us: [0,120) [120,240) ...
+    bus_batch_t* bg = make(BUS_PRIO_BACKGROUND, CHIP_BACKGROUND, 5, 100, 0);
+    bus_batch_t* ctl = make(BUS_PRIO_CONTROL, CHIP_CONTROL, 2, 100, 0);
+    bus_batch_t* rt = make(BUS_PRIO_REALTIME, 0, 1, 10, 0);
+    bus_sched_submit(bg);
+    at(130, ctl);   // During background op 2
+    at(250, rt);    // During control op 1
+    drain();
+    const uint8_t want[] = {CHIP_BACKGROUND, CHIP_BACKGROUND, CHIP_CONTROL, 0, CHIP_CONTROL,
+                            CHIP_BACKGROUND, CHIP_BACKGROUND, CHIP_BACKGROUND};
+    expect_trace("preemption", want, sizeof(want));
+    CHECK(rt->run_us - rt->submit_us <= 120, "realtime waits at most one op (%lld us)",
+          (long long)(rt->run_us - rt->submit_us));
+}
+
+static void test_chaining(void)
+{
+    printf("chaining\n");
+    reset();
+    batch_count = 0;
+    bus_sched_submit(make(BUS_PRIO_REALTIME, 0, 4, 10, BUS_OP_QUICK_SELECT));
+    drain();
+    CHECK(quick_selects == 4, "4 quick selects (%d)", quick_selects);
+    CHECK(deselects == 1, "one deselect for the chained batch (%d)", deselects);
+}
+
+static void frames(uint32_t period_us, int count, uint16_t bg_ops, uint16_t bg_len,
+                   int64_t* max_delay, int64_t* bg_end)
+{
+    reset();
+    batch_count = 0;
+    bus_sched_set_frame_period(period_us);
+    // Realtime: 8 chips read back to back each frame, as sensor_task does
+    for (int f = 0; f < count; f++) {
+        bus_batch_t* b = make(BUS_PRIO_REALTIME, 0, 8, 10, BUS_OP_QUICK_SELECT);
+        b->ctx = (void*)(intptr_t)f;
+        at((int64_t)f * period_us, b);
+    }
+    bus_batch_t* bg = make(BUS_PRIO_BACKGROUND, CHIP_BACKGROUND, bg_ops, bg_len, 0);
+    at(period_us / 10, bg);
+    drain();
+
+    *max_delay = 0;
+    for (int i = 0; i < batch_count; i++) {
+        if (batches[i].prio != BUS_PRIO_REALTIME) continue;
+        int64_t delay = batches[i].run_us - (int64_t)(intptr_t)batches[i].ctx * period_us;
+        if (delay > *max_delay) *max_delay = delay;
+    }
+    *bg_end = bg->done ? bg->end_us : -1;
+}
+
+static void test_budget(void)
+{
+    printf("budget\n");
+    int64_t delay, end;
+    // 8 background ops of 200 bytes (230 us estimated) around 1 kHz frames
+    frames(1000, 20, 8, 200, &delay, &end);
+    CHECK(delay == 0, "no frame delayed by background work (worst %lld us)", (long long)delay);
+    CHECK(end > 0, "background batch completes (at %lld us)", (long long)end);
+
+    bus_class_stats_t stats;
+    bus_sched_get_stats(BUS_PRIO_BACKGROUND, &stats);
+    CHECK(stats.deferrals > 0, "ops deferred near frames (%lu)", (unsigned long)stats.deferrals);
+    CHECK(stats.batches == 1 && stats.depth == 0, "one background batch done, queue empty");
+    bus_sched_get_stats(BUS_PRIO_REALTIME, &stats);
+    CHECK(stats.batches == 20 && stats.depth == 0, "20 realtime batches done (%lu)", (unsigned long)stats.batches);
+    CHECK(stats.depth_max >= 1, "realtime depth recorded");
+    bus_sched_get_stats(BUS_PRIO_REALTIME, &stats);
+    CHECK(stats.batches == 0 && stats.deferrals == 0, "statistics reset after reading");
+}
+
+static void test_oversized(void)
+{
+    printf("oversized\n");
+    int64_t delay, end;
+    // 520 us ops: estimate plus guard exceeds half the period, so they may
+    // only start right after a frame, and still end before the next one
+    frames(1000, 10, 3, 500, &delay, &end);
+    CHECK(end > 0, "oversized ops complete (at %lld us)", (long long)end);
+    CHECK(delay == 0, "frames not delayed (worst %lld us)", (long long)delay);
+}
+
+int main(int argc, char** argv)
+{
+    verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    test_order();
+    test_preemption();
+    test_chaining();
+    test_budget();
+    test_oversized();
+    printf("%s: %d failure(s)\n", failures ? "FAIL" : "PASS", failures);
+    return failures ? 1 : 0;
+}
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="host C compiler")
+    parser.add_argument("-v", "--verbose", action="store_true", help="print passing checks and traces")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        src = os.path.join(tmp, "harness.c")
+        exe = os.path.join(tmp, "check_bus_scheduler")
+        with open(src, "w") as f:
+            f.write(HARNESS)
+        subprocess.run([args.cc, "-std=c11", "-O1", "-Wall", "-Wextra", "-I", SRC_DIR, src,
+                        os.path.join(SRC_DIR, "bus_scheduler.c"), "-o", exe], check=True)
+        result = subprocess.run([exe] + (["-v"] if args.verbose else []))
+    sys.exit(result.returncode)
+
+
+if __name__ == "__main__":
+    main()
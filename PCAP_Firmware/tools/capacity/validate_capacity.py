@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+"""Validate the capacity model against simulated runs.
+
+Builds src/capacity_planner.c on the host and compares its admission
+verdicts with a simulation of the pipeline on a board whose true costs
+differ from the model's defaults (scaled by --cpu-scale and --bus-scale,
+with a link that carries fewer notifications than modelled). The
+simulation runs the sensor task at the requested period on a CPU that
+also serves the BLE host, and drains notifications per connection with a
+bounded mbuf pool, the way the firmware does.
+
+First one simulated run of the default configuration, with demand for a
+quarter of the channels, is fed to capacity_observe() with the invokes
+that ran, as the firmware does every 60 s, then every
+configuration of a grid is checked:
+  - sustained:    the simulated run keeps the requested rate without congestion
+  - false accept: the model admits a configuration that collapses
+  - conservative: the model rejects a configuration that would have run
+False accepts are the failures that matter; the exit status is 1 if any
+occur.
+
+Usage:
+    validate_capacity.py [--cpu-scale 1.25] [--bus-scale 1.1] [--cc cc] [-v]
+"""
+
+import argparse
+import ctypes
+import itertools
+import os
+import subprocess
+import sys
+import tempfile
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src")
+
+SENSORS_PER_CHIP = 6
+ENC_FLOAT32, ENC_INT16 = 0, 1
+NOTIFY_POOL_PER_CONN = 24           # BLE_NOTIFY_MBUF_COUNT
+BACKGROUND_CPU = 0.10               # BLE host, logging, idle hooks
+SIM_SECONDS = 10
+
+
+class Config(ctypes.Structure):
+    _fields_ = [("sample_period_ms", ctypes.c_uint16), ("chips", ctypes.c_uint8),
+                ("nn_refresh_divider", ctypes.c_uint8), ("encoding", ctypes.c_int),
+                ("connections", ctypes.c_uint8), ("conn_itvl", ctypes.c_uint16),
+                ("cpu_mhz", ctypes.c_uint16), ("nn_output_steps", ctypes.c_uint8)]
+
+
+class Util(ctypes.Structure):
+    _fields_ = [("cpu_pct", ctypes.c_uint16), ("bus_pct", ctypes.c_uint16),
+                ("link_pct", ctypes.c_uint16), ("rate_pct", ctypes.c_uint16)]
+
+
+class Sample(ctypes.Structure):
+    _fields_ = [("elapsed_ms", ctypes.c_uint32), ("frames", ctypes.c_uint32),
+                ("acquire_cycles", ctypes.c_uint64), ("compensate_cycles", ctypes.c_uint64),
+                ("transmit_cycles", ctypes.c_uint64), ("other_cycles", ctypes.c_uint64),
+                ("bus_busy_us", ctypes.c_uint64), ("notifications", ctypes.c_uint32),
+                ("congested", ctypes.c_uint32), ("nn_invokes", ctypes.c_uint32)]
+
+
+class Costs(ctypes.Structure):
+    _fields_ = [("acquire_cycles_per_chip", ctypes.c_float), ("bus_us_per_chip", ctypes.c_float),
+                ("nn_cycles_per_invoke", ctypes.c_float), ("encode_cycles_per_chip", ctypes.c_float * 2),
+                ("notify_cycles", ctypes.c_float), ("serial_cycles_per_chip", ctypes.c_float),
+                ("link_scale", ctypes.c_float)]
+
+
+def build_model(cc, out_dir):
+    lib_path = os.path.join(out_dir, "libcapacity.so")
+    subprocess.run([cc, "-O2", "-shared", "-fPIC", "-I", SRC_DIR,
+                    os.path.join(SRC_DIR, "capacity_planner.c"), "-o", lib_path], check=True)
+    lib = ctypes.CDLL(lib_path)
+    lib.capacity_get_costs.restype = ctypes.POINTER(Costs)
+    lib.capacity_fits.restype = ctypes.c_bool
+    return lib
+
+
+class Board:
+    """True costs of the simulated board."""
+
+    def __init__(self, defaults, cpu_scale, bus_scale):
+        self.acquire = defaults.acquire_cycles_per_chip * cpu_scale
+        self.bus_us = defaults.bus_us_per_chip * bus_scale
+        self.nn = defaults.nn_cycles_per_invoke * cpu_scale
+        self.encode = [defaults.encode_cycles_per_chip[e] * cpu_scale for e in (0, 1)]
+        self.notify = defaults.notify_cycles * cpu_scale
+        self.serial = defaults.serial_cycles_per_chip * cpu_scale
+        self.link_efficiency = 0.8      # Share of airtime the controller schedules
+        self.max_per_event = 6
+
+    def run(self, cfg, compensated=1.0):
+        """Simulate SIM_SECONDS of cfg with a share of the channels
+        compensated (demand); return (Sample, sustained)."""
+        period = cfg.nn_refresh_divider * max(cfg.nn_output_steps, 1)
+        invokes = compensated * cfg.chips * SENSORS_PER_CHIP / period if period else 0.0
+        if cfg.connections:
+            tx = self.encode[cfg.encoding] + cfg.connections * self.notify
+        else:
+            tx = self.serial
+        acquire = cfg.chips * self.acquire
+        compensate = invokes * self.nn
+        transmit = cfg.chips * tx
+        frame_us = (acquire + compensate + transmit) / cfg.cpu_mhz / (1.0 - BACKGROUND_CPU)
+
+        # The task starts a frame every period, or as soon as the last one ends
+        interval_us = max(cfg.sample_period_ms * 1000.0, frame_us, cfg.chips * self.bus_us)
+        frames = int(SIM_SECONDS * 1e6 / interval_us)
+
+        # Link: each connection drains its queue at the slower of the airtime
+        # and the per-event limit; bursts beyond the pool are refused
+        sent = congested = 0
+        if cfg.connections:
+            payload = 13 if cfg.encoding == ENC_INT16 else 25
+            airtime_us = (payload + 17) * 8 + 380
+            per_conn_airtime = self.link_efficiency * 1e6 / (cfg.connections * airtime_us)
+            per_event = self.max_per_event * 1e6 / (cfg.conn_itvl * 1250.0)
+            drain_per_us = min(per_conn_airtime, per_event) / 1e6
+            queue = 0.0
+            for _ in range(frames):
+                queue = max(0.0, queue - drain_per_us * interval_us)
+                room = NOTIFY_POOL_PER_CONN - queue
+                accepted = min(cfg.chips, max(0, int(room)))
+                queue += accepted
+                sent += accepted * cfg.connections
+                congested += (cfg.chips - accepted) * cfg.connections
+
+        sample = Sample(SIM_SECONDS * 1000, frames,
+                        int(frames * acquire), int(frames * compensate), int(frames * transmit), 0,
+                        int(frames * cfg.chips * self.bus_us), sent, congested, int(frames * invokes))
+        requested = SIM_SECONDS * 1000.0 / cfg.sample_period_ms
+        sustained = frames >= 0.99 * requested and congested == 0
+        return sample, sustained
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cpu-scale", type=float, default=1.25, help="true/default CPU costs")
+    parser.add_argument("--bus-scale", type=float, default=1.1, help="true/default bus time")
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="host C compiler")
+    parser.add_argument("-v", "--verbose", action="store_true", help="print every configuration")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        lib = build_model(args.cc, tmp)
+        lib.capacity_init()
+        board = Board(lib.capacity_get_costs().contents, args.cpu_scale, args.bus_scale)
+
+        # Calibrate on the startup configuration, as the 60 s report does,
+        # while a consumer subscribes to a quarter of the channels; the grid
+        # assumes every channel compensated
+        base = Config(10, 8, 1, ENC_FLOAT32, 1, 6, 160)
+        measured = Util()
+        for _ in range(8):
+            sample, _ = board.run(base, compensated=0.25)
+            lib.capacity_observe(ctypes.byref(base), ctypes.byref(sample), ctypes.byref(measured))
+
+        counts = {"agree": 0, "false accept": 0, "conservative": 0}
+        grid = itertools.product((5, 10, 20, 50), (4, 8), (0, 1, 4), (ENC_FLOAT32, ENC_INT16),
+                                 (0, 1, 3), (6, 24), (80, 160))
+        for period, chips, div, enc, conns, itvl, mhz in grid:
+            cfg = Config(period, chips, div, enc, conns, itvl, mhz)
+            util = Util()
+            lib.capacity_predict(ctypes.byref(cfg), ctypes.byref(util))
+            fits = lib.capacity_fits(ctypes.byref(util))
+            _, sustained = board.run(cfg)
+            if fits and not sustained:
+                outcome = "false accept"
+            elif sustained and not fits:
+                outcome = "conservative"
+            else:
+                outcome = "agree"
+            counts[outcome] += 1
+            if args.verbose or outcome == "false accept":
+                print(f"{period:>3} ms {chips} chips NN 1/{div} {'i16' if enc else 'f32'} "
+                      f"{conns} conn itvl {itvl:>2} {mhz} MHz: cpu {util.cpu_pct:>3}% "
+                      f"bus {util.bus_pct:>3}% link {util.link_pct:>3}% -> "
+                      f"{'fits' if fits else 'over'}, sim {'ok' if sustained else 'collapses'} "
+                      f"[{outcome}]")
+
+    total = sum(counts.values())
+    print(f"{total} configurations: {counts['agree']} agree, "
+          f"{counts['conservative']} conservative rejects, {counts['false accept']} false accepts")
+    sys.exit(1 if counts["false accept"] else 0)
+
+
+if __name__ == "__main__":
+    main()
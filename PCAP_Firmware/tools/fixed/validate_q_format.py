@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+"""Check the Q-format library against double precision on the host.
+
+Builds a small harness around src/q_format.h with the host C++ compiler
+and runs each operation on random and edge-case operands: conversions
+from double and float, add, subtract, multiply in one format, mixed-format
+multiply, format conversion, the low-pass step, and the BLE int16 encoder
+of signal_fixed.cpp. Every result must equal the double-precision value
+rounded to the nearest step (ties away from zero) and saturated to the
+format's range. For products too wide for a double, the reference is
+computed exactly with rationals. The exit status is 1 on any mismatch.
+
+The device-side counterpart, the cost against soft-float on the C3, is
+Q_FORMAT_BENCH_MODE in src/main.c.
+
+Usage:
+    validate_q_format.py [--cases 50000] [--seed 1] [--cxx c++] [-v]
+"""
+
+import argparse
+import ctypes
+import math
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+from fractions import Fraction
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src")
+
+# C-callable wrappers for the operations under test
+HARNESS = """#include <stdint.h>
+#include "q_format.h"
+
+using Q16 = q::Q<16>;
+using Q15s = q::Q<15, int16_t>;
+using Q7b = q::Q<7, int8_t>;
+using Q4 = q::Q<4>;
+using Q31 = q::Q<31>;
+
+extern "C" {
+int32_t q16_from_double(double x) { return Q16::from_double(x).raw(); }
+int32_t q16_from_float(float x) { return Q16::from_float(x).raw(); }
+int16_t q15s_from_float(float x) { return Q15s::from_float(x).raw(); }
+int8_t q7b_from_float(float x) { return Q7b::from_float(x).raw(); }
+int32_t q16_add(int32_t a, int32_t b) { return (Q16::from_raw(a) + Q16::from_raw(b)).raw(); }
+int32_t q16_sub(int32_t a, int32_t b) { return (Q16::from_raw(a) - Q16::from_raw(b)).raw(); }
+int32_t q16_mul(int32_t a, int32_t b) { return (Q16::from_raw(a) * Q16::from_raw(b)).raw(); }
+int16_t q15s_mul(int16_t a, int16_t b) { return (Q15s::from_raw(a) * Q15s::from_raw(b)).raw(); }
+int16_t q15s_add(int16_t a, int16_t b) { return (Q15s::from_raw(a) + Q15s::from_raw(b)).raw(); }
+int16_t mul_4_31_to_0s(int32_t a, int32_t b) { return q::mul<0, int16_t>(Q4::from_raw(a), Q31::from_raw(b)).raw(); }
+int32_t mul_16_15s_to_20(int32_t a, int16_t b) { return q::mul<20>(Q16::from_raw(a), Q15s::from_raw(b)).raw(); }
+int16_t q16_to_q12s(int32_t a) { return Q16::from_raw(a).convert<12, int16_t>().raw(); }
+int32_t q15s_to_q20(int16_t a) { return Q15s::from_raw(a).convert<20, int32_t>().raw(); }
+int32_t q16_ema(int32_t y, int32_t x, int16_t alpha)
+{
+    return q::ema(Q16::from_raw(y), Q16::from_raw(x), Q15s::from_raw(alpha)).raw();
+}
+int16_t encode_int16(float raw, float offset)
+{
+    // signal_encode_int16(), without the ESP-IDF includes of signal_fixed.cpp
+    constexpr auto k = Q31::from_double(1000.0 * 100.0 / 134217728.0);
+    return q::mul<0, int16_t>(Q4::from_float(raw - offset), k).raw();
+}
+}
+"""
+
+INT = {8: (-(1 << 7), (1 << 7) - 1), 16: (-(1 << 15), (1 << 15) - 1), 32: (-(1 << 31), (1 << 31) - 1)}
+
+
+def build(cxx, out_dir):
+    src = os.path.join(out_dir, "harness.cpp")
+    with open(src, "w") as f:
+        f.write(HARNESS)
+    lib_path = os.path.join(out_dir, "libqformat.so")
+    subprocess.run([cxx, "-std=c++17", "-O2", "-shared", "-fPIC", "-Wall", "-Wextra", "-I", SRC_DIR,
+                    src, "-o", lib_path], check=True)
+    lib = ctypes.CDLL(lib_path)
+    types = {"q16_from_double": (ctypes.c_int32, [ctypes.c_double]),
+             "q16_from_float": (ctypes.c_int32, [ctypes.c_float]),
+             "q15s_from_float": (ctypes.c_int16, [ctypes.c_float]),
+             "q7b_from_float": (ctypes.c_int8, [ctypes.c_float]),
+             "q16_add": (ctypes.c_int32, [ctypes.c_int32] * 2),
+             "q16_sub": (ctypes.c_int32, [ctypes.c_int32] * 2),
+             "q16_mul": (ctypes.c_int32, [ctypes.c_int32] * 2),
+             "q15s_mul": (ctypes.c_int16, [ctypes.c_int16] * 2),
+             "q15s_add": (ctypes.c_int16, [ctypes.c_int16] * 2),
+             "mul_4_31_to_0s": (ctypes.c_int16, [ctypes.c_int32] * 2),
+             "mul_16_15s_to_20": (ctypes.c_int32, [ctypes.c_int32, ctypes.c_int16]),
+             "q16_to_q12s": (ctypes.c_int16, [ctypes.c_int32]),
+             "q15s_to_q20": (ctypes.c_int32, [ctypes.c_int16]),
+             "q16_ema": (ctypes.c_int32, [ctypes.c_int32, ctypes.c_int32, ctypes.c_int16]),
+             "encode_int16": (ctypes.c_int16, [ctypes.c_float, ctypes.c_float])}
+    for name, (restype, argtypes) in types.items():
+        fn = getattr(lib, name)
+        fn.restype, fn.argtypes = restype, argtypes
+    return lib
+
+
+def round_sat(value, frac_bits, bits):
+    """Reference: value * 2^frac_bits rounded, ties away from zero, saturated."""
+    scaled = Fraction(value) * (1 << frac_bits)
+    mag = abs(scaled)
+    r = math.floor(mag + Fraction(1, 2))
+    r = r if scaled >= 0 else -r
+    lo, hi = INT[bits]
+    return min(max(r, lo), hi)
+
+
+def f32(x):
+    return struct.unpack("<f", struct.pack("<f", x))[0]
+
+
+def rand_raw(rng, bits):
+    lo, hi = INT[bits]
+    pick = rng.random()
+    if pick < 0.05:
+        return rng.choice((lo, hi, 0, 1, -1, lo + 1, hi - 1))
+    if pick < 0.5:
+        return rng.randint(-(1 << (bits // 2)), 1 << (bits // 2))
+    return rng.randint(lo, hi)
+
+
+def rand_float(rng):
+    pick = rng.random()
+    if pick < 0.05:
+        return f32(rng.choice((0.0, -0.0, 0.5, -0.5, 1.5 / 65536, -2.5 / 65536, 32767.99999,
+                           -32768.0, 1e30, -1e30, float("inf"), float("-inf"), 1e-30)))
+    return f32(rng.uniform(-1, 1) * 2.0 ** rng.uniform(-20, 18))
+
+
+class Checker:
+    def __init__(self, verbose):
+        self.verbose = verbose
+        self.counts = {}
+        self.failures = {}
+
+    def check(self, name, got, expected, args):
+        self.counts[name] = self.counts.get(name, 0) + 1
+        if got != expected:
+            self.failures[name] = self.failures.get(name, 0) + 1
+            if self.verbose or self.failures[name] <= 3:
+                print(f"{name}{args}: got {got}, expected {expected}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cases", type=int, default=50000, help="random cases per operation")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--cxx", default=os.environ.get("CXX", "c++"), help="host C++ compiler")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    chk = Checker(args.verbose)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        lib = build(args.cxx, tmp)
+        for _ in range(args.cases):
+            d = rng.uniform(-1, 1) * 2.0 ** rng.uniform(-20, 17)
+            chk.check("from_double", lib.q16_from_double(d), round_sat(d, 16, 32), (d,))
+
+            x = rand_float(rng)
+            if math.isinf(x):
+                exp32 = INT[32][1] if x > 0 else INT[32][0]
+                exp16 = INT[16][1] if x > 0 else INT[16][0]
+                exp8 = INT[8][1] if x > 0 else INT[8][0]
+            else:
+                exp32, exp16, exp8 = round_sat(x, 16, 32), round_sat(x, 15, 16), round_sat(x, 7, 8)
+            chk.check("from_float Q16", lib.q16_from_float(x), exp32, (x,))
+            chk.check("from_float Q15 int16", lib.q15s_from_float(x), exp16, (x,))
+            chk.check("from_float Q7 int8", lib.q7b_from_float(x), exp8, (x,))
+
+            a, b = rand_raw(rng, 32), rand_raw(rng, 32)
+            fa, fb = Fraction(a, 1 << 16), Fraction(b, 1 << 16)
+            chk.check("add Q16", lib.q16_add(a, b), round_sat(fa + fb, 16, 32), (a, b))
+            chk.check("sub Q16", lib.q16_sub(a, b), round_sat(fa - fb, 16, 32), (a, b))
+            chk.check("mul Q16", lib.q16_mul(a, b), round_sat(fa * fb, 16, 32), (a, b))
+            chk.check("convert Q16->Q12 int16", lib.q16_to_q12s(a), round_sat(fa, 12, 16), (a,))
+
+            s, t = rand_raw(rng, 16), rand_raw(rng, 16)
+            fs, ft = Fraction(s, 1 << 15), Fraction(t, 1 << 15)
+            chk.check("mul Q15 int16", lib.q15s_mul(s, t), round_sat(fs * ft, 15, 16), (s, t))
+            chk.check("add Q15 int16", lib.q15s_add(s, t), round_sat(fs + ft, 15, 16), (s, t))
+            chk.check("convert Q15 int16->Q20", lib.q15s_to_q20(s), round_sat(fs, 20, 32), (s,))
+            chk.check("mul Q16 x Q15 -> Q20", lib.mul_16_15s_to_20(a, s), round_sat(fa * fs, 20, 32),
+                      (a, s))
+
+            c = rand_raw(rng, 32)
+            chk.check("mul Q4 x Q31 -> Q0 int16", lib.mul_4_31_to_0s(a, c),
+                      round_sat(Fraction(a, 1 << 4) * Fraction(c, 1 << 31), 0, 16), (a, c))
+
+            # EMA: the difference saturates first, then the product and sum
+            alpha = rng.randint(0, INT[16][1])
+            diff = round_sat(fb - fa, 16, 32)
+            step = round_sat(Fraction(diff, 1 << 16) * Fraction(alpha, 1 << 15), 16, 32)
+            chk.check("ema Q16", lib.q16_ema(a, b, alpha), round_sat(fa + Fraction(step, 1 << 16), 16, 32),
+                      (a, b, alpha))
+
+            # BLE encoder: float subtraction as on the device, then exact scaling
+            offset = f32(rng.uniform(5e5, 2e6))
+            raw = f32(offset + rng.uniform(-3e7, 3e7))
+            delta = round_sat(f32(raw - offset), 4, 32)
+            chk.check("encode int16", lib.encode_int16(raw, offset),
+                      round_sat(Fraction(delta, 1 << 4) * Fraction(100000, 1 << 27), 0, 16), (raw, offset))
+
+    print(f"{'operation':<28}{'cases':>10}{'mismatches':>12}")
+    for name, n in chk.counts.items():
+        print(f"{name:<28}{n:>10}{chk.failures.get(name, 0):>12}")
+    sys.exit(1 if chk.failures else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""Replay a capture through the on-device gesture classifier.
+
+Builds src/gesture.c into a shared library with the host C compiler and
+feeds it the frames of a recorded serial log (the "D,<chip>,<s0>..<s5>"
+lines of a normal build), so thresholds in gesture.h can be tuned and
+decision latency measured without flashing. A frame ends when the chip
+number stops increasing; chips missing from a frame read as 0, as on the
+device.
+
+For every event it prints the frame time, the gesture, the touch-down
+position and duration, and the latency from the moment the gesture was
+decidable (touch-up, or the hold time for a long-press) to its emission.
+Reported latency excludes acquisition and the link; single taps wait out
+the double-tap window by design.
+
+Usage:
+    replay_gesture.py [--period-ms 10] [--cc cc] capture.log
+"""
+
+import argparse
+import ctypes
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src")
+
+NUM_CHIPS = 8
+SENSORS_PER_CHIP = 6
+NUM_PADS = NUM_CHIPS * SENSORS_PER_CHIP
+
+NAMES = ("none", "tap", "double-tap", "long-press",
+         "swipe-left", "swipe-right", "swipe-up", "swipe-down")
+
+
+class GestureEvent(ctypes.Structure):
+    _fields_ = [
+        ("type", ctypes.c_int),
+        ("x", ctypes.c_uint8),
+        ("y", ctypes.c_uint8),
+        ("duration_ms", ctypes.c_uint16),
+        ("latency_ms", ctypes.c_uint16),
+    ]
+
+
+def build_classifier(cc, out_dir):
+    """Compile gesture.c and return the loaded library."""
+    lib_path = os.path.join(out_dir, "libgesture.so")
+    subprocess.run([cc, "-O2", "-shared", "-fPIC", "-I", SRC_DIR,
+                    os.path.join(SRC_DIR, "gesture.c"), "-o", lib_path], check=True)
+    lib = ctypes.CDLL(lib_path)
+    lib.gesture_init.restype = None
+    lib.gesture_process_frame.argtypes = [ctypes.POINTER(ctypes.c_float), ctypes.c_uint32,
+                                          ctypes.POINTER(GestureEvent)]
+    lib.gesture_process_frame.restype = ctypes.c_bool
+    return lib
+
+
+def load_frames(path):
+    """Yield lists of NUM_PADS values, one per frame."""
+    frame = [0.0] * NUM_PADS
+    last_chip = -1
+    with open(path, errors="replace") as f:
+        for line in f:
+            fields = line.strip().split(",")
+            if len(fields) != 2 + SENSORS_PER_CHIP or fields[0] != "D":
+                continue
+            try:
+                chip = int(fields[1])
+                values = [float(v) for v in fields[2:]]
+            except ValueError:
+                continue
+            if not 0 <= chip < NUM_CHIPS:
+                continue
+            if chip <= last_chip:
+                yield frame
+                frame = [0.0] * NUM_PADS
+            frame[chip * SENSORS_PER_CHIP:(chip + 1) * SENSORS_PER_CHIP] = values
+            last_chip = chip
+    if last_chip >= 0:
+        yield frame
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture")
+    parser.add_argument("--period-ms", type=int, default=10, help="frame period of the capture")
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="host C compiler")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        lib = build_classifier(args.cc, tmp)
+        lib.gesture_init()
+
+        values = (ctypes.c_float * NUM_PADS)()
+        event = GestureEvent()
+        latencies = {}
+        frames = 0
+        host_s = 0.0
+
+        for frame in load_frames(args.capture):
+            values[:] = frame
+            now_ms = frames * args.period_ms
+            start = time.perf_counter()
+            found = lib.gesture_process_frame(values, now_ms, ctypes.byref(event))
+            host_s += time.perf_counter() - start
+            frames += 1
+            if not found:
+                continue
+            name = NAMES[event.type] if event.type < len(NAMES) else "?"
+            print(f"{now_ms:>9} ms  {name:<12} at ({event.x:3}, {event.y:3})  "
+                  f"{event.duration_ms:5} ms  latency {event.latency_ms} ms")
+            latencies.setdefault(name, []).append(event.latency_ms)
+
+    if frames == 0:
+        sys.exit(f"{args.capture}: no D, lines found")
+
+    print(f"\n{frames} frames, {host_s / frames * 1e6:.1f} us/frame on the host")
+    print(f"{'gesture':<12}{'count':>7}{'latency avg':>14}{'max':>7}")
+    for name, values_ms in sorted(latencies.items()):
+        print(f"{name:<12}{len(values_ms):>7}{sum(values_ms) / len(values_ms):>11.0f} ms"
+              f"{max(values_ms):>7}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,303 @@
+#!/usr/bin/env python3
+"""End-to-end latency distributions from a device in LATENCY_PROBE_MODE.
+
+Each data frame is followed by a latency record: the acquisition timestamp
+(device clock, start of the first SPI read) and the time spent in each
+stage up to the transport hand-off. The host maps the device clock onto its
+own with BLE_CTRL_TIME_PING round trips. It keeps, over a sliding window,
+the ping with the shortest round trip and takes its midpoint. Delivery is
+then the time from hand-off to the record's arrival, and end-to-end latency
+runs from acquisition to arrival.
+
+Transports:
+    serial  "L," records and "T," ping replies on the serial port, pings
+            sent as "K,5,<token>" lines (needs pyserial)
+    ble     LATENCY_OP_CODE packets on the sensor data characteristic, ping
+            replies on the status characteristic (needs bleak)
+
+With DUAL_STREAM_MODE the device sends no latency records. Instead, frame
+markers ("Q," / FRAME_OP_CODE) carry each frame's acquisition time. The
+fast ("S," / chip packets) and compensated ("C," / COMPENSATED_OP_CODE)
+streams are then timed separately, from acquisition to the arrival of the
+frame's last chip.
+
+The classes work as a library too. Feed LatencyStats from any transport
+that yields (record, host arrival time) and call its percentiles().
+
+Usage:
+    latency_report.py serial /dev/ttyACM0 [--baud 115200] [--seconds 60] [--csv out.csv]
+    latency_report.py ble [PCAP-Sensor] [--seconds 60] [--csv out.csv]
+"""
+
+import argparse
+import asyncio
+import csv
+import struct
+import sys
+import time
+from collections import deque
+
+STAGES = ("acquire", "compensate", "wait", "encode", "handoff")
+COLUMNS = STAGES + ("delivery", "end_to_end")
+PERCENTILES = (50, 90, 99, 99.9)
+
+LATENCY_OP_CODE = 0xFD
+FRAME_OP_CODE = 0xFC
+COMPENSATED_OP_CODE = 0xFB
+BLE_CTRL_TIME_PING = 0x05
+PING_INTERVAL_S = 0.5
+PING_WINDOW = 16            # Pings the clock mapping picks its best from
+
+DATA_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+STATUS_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26a9"
+CONTROL_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26aa"
+
+
+def host_us():
+    return time.monotonic_ns() // 1000
+
+
+class Unwrap:
+    """Extend the device's wrapping counters (32-bit microseconds, 16-bit
+    frame numbers) to unbounded integers.
+
+    Values arrive nearly in order (records trail their frame, pings
+    interleave), so each one is taken as the nearest value to the last.
+    """
+
+    def __init__(self, bits=32):
+        self.bits = bits
+        self.last = None
+
+    def __call__(self, value):
+        if self.last is None:
+            self.last = value
+            return value
+        delta = (value - self.last) & ((1 << self.bits) - 1)
+        if delta >= 1 << (self.bits - 1):
+            delta -= 1 << self.bits
+        self.last += delta
+        return self.last
+
+
+class ClockMap:
+    """Device-to-host clock offset from ping round trips."""
+
+    def __init__(self):
+        self.pings = deque(maxlen=PING_WINDOW)
+        self.pending = {}
+        self.token = 0
+
+    def next_ping(self):
+        """Start a ping; returns the token to send."""
+        self.token = (self.token + 1) & 0xFF
+        self.pending[self.token] = host_us()
+        return self.token
+
+    def reply(self, token, device_us):
+        sent = self.pending.pop(token, None)
+        if sent is None:
+            return
+        received = host_us()
+        self.pings.append((received - sent, device_us - (sent + received) // 2))
+
+    def ready(self):
+        return bool(self.pings)
+
+    def offset(self):
+        """device - host, from the ping with the shortest round trip."""
+        return min(self.pings)[1]
+
+    def uncertainty_us(self):
+        return min(self.pings)[0] // 2
+
+
+class LatencyStats:
+    """Per-frame latency rows and their percentiles."""
+
+    def __init__(self):
+        self.rows = []
+
+    def add(self, seq, t0_device_us, stage_us, arrival_host_us, offset_us):
+        end_to_end = arrival_host_us - (t0_device_us - offset_us)
+        delivery = end_to_end - sum(stage_us)
+        self.rows.append((seq, t0_device_us) + tuple(stage_us) + (delivery, end_to_end))
+
+    def column(self, name):
+        i = 2 + COLUMNS.index(name)
+        return sorted(row[i] for row in self.rows)
+
+    @staticmethod
+    def percentile(values, p):
+        """Nearest-rank percentile of sorted values."""
+        if not values:
+            return None
+        rank = max(1, -(-len(values) * p // 100))
+        return values[min(int(rank), len(values)) - 1]
+
+    def percentiles(self, name, ps=PERCENTILES):
+        values = self.column(name)
+        return {p: self.percentile(values, p) for p in ps} | {"max": values[-1] if values else None}
+
+    def report(self, transport, clock, out=sys.stdout):
+        print(f"{transport}: {len(self.rows)} frames, clock mapping +/- {clock.uncertainty_us()} us",
+              file=out)
+        print(f"{'stage (us)':<12}" + "".join(f"{'p' + str(p):>9}" for p in PERCENTILES)
+              + f"{'max':>9}", file=out)
+        for name in COLUMNS:
+            row = self.percentiles(name)
+            print(f"{name:<12}" + "".join(f"{row[k]:>9}" for k in row), file=out)
+
+    def write_csv(self, path):
+        with open(path, "w", newline="") as f:
+            writer = csv.writer(f)
+            writer.writerow(("seq", "t0_device_us") + COLUMNS)
+            writer.writerows(self.rows)
+
+
+class StreamStats:
+    """End-to-end latency of the dual-stream outputs, per stream."""
+
+    STREAMS = ("fast", "compensated")
+
+    def __init__(self):
+        self.seq = Unwrap(16)
+        self.t0 = {}                                    # frame -> device acquisition time
+        self.arrival = {s: {} for s in self.STREAMS}    # frame -> host arrival of the last chip
+
+    def frame(self, seq, t0_device_us):
+        self.t0[self.seq(seq)] = t0_device_us
+
+    def chip(self, stream, seq, arrival_host_us):
+        self.arrival[stream][self.seq(seq)] = arrival_host_us
+
+    def latencies(self, stream, offset_us):
+        return sorted(arrival - (self.t0[seq] - offset_us)
+                      for seq, arrival in self.arrival[stream].items() if seq in self.t0)
+
+    def report(self, clock, out=sys.stdout):
+        print(f"{'stream (us)':<12}" + "".join(f"{'p' + str(p):>9}" for p in PERCENTILES)
+              + f"{'max':>9}{'frames':>9}", file=out)
+        for stream in self.STREAMS:
+            values = self.latencies(stream, clock.offset())
+            if values:
+                print(f"{stream:<12}" + "".join(f"{LatencyStats.percentile(values, p):>9}"
+                                                for p in PERCENTILES)
+                      + f"{values[-1]:>9}{len(values):>9}", file=out)
+
+    def __bool__(self):
+        return any(self.arrival[s] for s in self.STREAMS)
+
+
+def run_serial(args, stats, clock, streams):
+    import serial
+
+    unwrap = Unwrap()
+    deadline = time.monotonic() + args.seconds
+    next_ping = 0.0
+    with serial.Serial(args.port, args.baud, timeout=0.01) as port:
+        while time.monotonic() < deadline:
+            if time.monotonic() >= next_ping:
+                port.write(f"K,{BLE_CTRL_TIME_PING},{clock.next_ping()}\n".encode())
+                next_ping = time.monotonic() + PING_INTERVAL_S
+            line = port.readline()
+            arrival = host_us()
+            fields = line.decode(errors="replace").strip().split(",")
+            try:
+                if fields[0] == "T" and len(fields) == 3:
+                    clock.reply(int(fields[1]), unwrap(int(fields[2])))
+                elif fields[0] == "L" and len(fields) == 3 + len(STAGES):
+                    t0 = unwrap(int(fields[2]))
+                    if clock.ready():
+                        stats.add(int(fields[1]), t0, [int(v) for v in fields[3:]],
+                                  arrival, clock.offset())
+                elif fields[0] == "Q" and len(fields) == 3:
+                    streams.frame(int(fields[1]), unwrap(int(fields[2])))
+                elif fields[0] in ("S", "C") and len(fields) > 3:
+                    streams.chip("fast" if fields[0] == "S" else "compensated",
+                                 int(fields[1]), arrival)
+            except ValueError:
+                continue
+
+
+async def run_ble(args, stats, clock, streams):
+    from bleak import BleakClient, BleakScanner
+
+    unwrap = Unwrap()
+    device = await BleakScanner.find_device_by_name(args.name, timeout=10.0)
+    if device is None:
+        sys.exit(f"{args.name} not found")
+
+    frame_seq = None
+
+    def on_data(_, data):
+        nonlocal frame_seq
+        arrival = host_us()
+        if data[0] == FRAME_OP_CODE and len(data) == 7:
+            frame_seq, t0 = struct.unpack_from("<HI", data, 1)
+            streams.frame(frame_seq, unwrap(t0))
+            return
+        if data[0] == COMPENSATED_OP_CODE and len(data) >= 3:
+            streams.chip("compensated", struct.unpack_from("<H", data, 1)[0], arrival)
+            return
+        if data[0] < 0x80 and frame_seq is not None:     # Chip packet of the open frame
+            streams.chip("fast", frame_seq, arrival)
+            return
+        if len(data) != 7 + 2 * len(STAGES) or data[0] != LATENCY_OP_CODE:
+            return
+        seq, t0 = struct.unpack_from("<HI", data, 1)
+        stage_us = struct.unpack_from(f"<{len(STAGES)}H", data, 7)
+        t0 = unwrap(t0)
+        if clock.ready():
+            stats.add(seq, t0, stage_us, arrival, clock.offset())
+
+    def on_status(_, data):
+        fields = data.decode(errors="replace").split(",")
+        if fields[0] == "T" and len(fields) == 3:
+            clock.reply(int(fields[1]), unwrap(int(fields[2])))
+
+    async with BleakClient(device) as client:
+        await client.start_notify(STATUS_UUID, on_status)
+        await client.start_notify(DATA_UUID, on_data)
+        deadline = time.monotonic() + args.seconds
+        while time.monotonic() < deadline:
+            await client.write_gatt_char(CONTROL_UUID,
+                                         bytes((BLE_CTRL_TIME_PING, clock.next_ping())),
+                                         response=False)
+            await asyncio.sleep(PING_INTERVAL_S)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="transport", required=True)
+    ser = sub.add_parser("serial")
+    ser.add_argument("port")
+    ser.add_argument("--baud", type=int, default=115200)
+    ble = sub.add_parser("ble")
+    ble.add_argument("name", nargs="?", default="PCAP-Sensor")
+    for p in (ser, ble):
+        p.add_argument("--seconds", type=float, default=60.0)
+        p.add_argument("--csv", help="also write every frame's latencies here")
+    args = parser.parse_args()
+
+    stats = LatencyStats()
+    streams = StreamStats()
+    clock = ClockMap()
+    if args.transport == "serial":
+        run_serial(args, stats, clock, streams)
+    else:
+        asyncio.run(run_ble(args, stats, clock, streams))
+
+    if not clock.ready() or not (stats.rows or streams):
+        sys.exit("no latency data; is LATENCY_PROBE_MODE or DUAL_STREAM_MODE on "
+                 "and does the device answer time pings?")
+    if stats.rows:
+        stats.report(args.transport, clock)
+        if args.csv:
+            stats.write_csv(args.csv)
+    if streams:
+        streams.report(clock)
+
+
+if __name__ == "__main__":
+    main()
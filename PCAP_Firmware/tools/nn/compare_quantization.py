@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Replay a capture through float, int8 and 16x8 models and compare them.
+
+Feeds every sliding window of a recorded channel through each model the way
+the device does (StandardScaler from scalers.json, then the tensor's own
+quantization, both as in history_store.c: float32 arithmetic, multiplication
+by the reciprocal scale, lroundf() rounding half away from zero, saturation)
+and reports, per model, the error against the float model and the mean host
+latency per invoke. An integer model therefore sees the same input codes as
+on the device. The float model is the reference for
+accuracy; latency is relative, not an estimate of C3 timing (use the stage
+profiler for that).
+
+The capture is the serial log of a run with NN compensation off (the "D,"
+lines then carry the NN input), or a plain file with one value per line.
+
+A 16x8 model is produced from the float model by the converter with
+    converter.optimizations = [tf.lite.Optimize.DEFAULT]
+    converter.representative_dataset = ...
+    converter.target_spec.supported_ops = [
+        tf.lite.OpsSet.EXPERIMENTAL_TFLITE_BUILTINS_ACTIVATIONS_INT16_WEIGHTS_INT8]
+    converter.inference_input_type = tf.int16
+    converter.inference_output_type = tf.int16
+
+Usage:
+    compare_quantization.py [--chip N] [--sensor N] [--scalers scalers.json]
+                            capture.log float.tflite int8.tflite [int16x8.tflite]
+"""
+
+import argparse
+import json
+import time
+
+import numpy as np
+
+try:
+    from tflite_runtime.interpreter import Interpreter
+except ImportError:
+    from tensorflow.lite.python.interpreter import Interpreter
+
+
+def load_capture(path, chip, sensor):
+    """Return the recorded NN input values of one channel."""
+    values = []
+    with open(path, errors="replace") as f:
+        for line in f:
+            fields = line.strip().split(",")
+            if fields[0] == "D":
+                if len(fields) == 8 and int(fields[1]) == chip:
+                    values.append(float(fields[2 + sensor]))
+            elif len(fields) == 1 and fields[0]:
+                try:
+                    values.append(float(fields[0]))
+                except ValueError:
+                    pass
+    return np.array(values, dtype=np.float32)
+
+
+def normalize(samples, mean, scale):
+    """(value - mean) / scale in float32, as store_feature() computes it."""
+    return (samples.astype(np.float32) - np.float32(mean)) / np.float32(scale)
+
+
+def quantize(x, dtype, scale, zero):
+    """Input codes as store_feature() writes them to the history rows."""
+    inv_scale = np.float32(1.0) / np.float32(scale)
+    y = x.astype(np.float32) * inv_scale
+    # lroundf(): halfway cases away from zero, where np.round goes to even
+    q = np.sign(y) * np.floor(np.abs(y).astype(np.float64) + 0.5) + zero
+    info = np.iinfo(dtype)
+    return np.clip(q, info.min, info.max)
+
+
+class Model:
+    def __init__(self, path):
+        self.path = path
+        self.interp = Interpreter(model_path=path)
+        self.interp.allocate_tensors()
+        self.inp = self.interp.get_input_details()[0]
+        self.out = self.interp.get_output_details()[0]
+        self.invoke_s = 0.0
+        self.invokes = 0
+
+    def run(self, window):
+        return float(self.run_all(window)[0])
+
+    def run_all(self, window):
+        """Invoke on one window and return every output, dequantized."""
+        x = window.reshape(self.inp["shape"])
+        dtype = self.inp["dtype"]
+        if dtype != np.float32:
+            x = quantize(x, dtype, *self.inp["quantization"])
+        self.interp.set_tensor(self.inp["index"], x.astype(dtype))
+
+        start = time.perf_counter()
+        self.interp.invoke()
+        self.invoke_s += time.perf_counter() - start
+        self.invokes += 1
+
+        y = self.interp.get_tensor(self.out["index"]).reshape(-1).astype(np.float64)
+        if self.out["dtype"] != np.float32:
+            scale, zero = self.out["quantization"]
+            y = (y - zero) * scale
+        return y
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--chip", type=int, default=0)
+    parser.add_argument("--sensor", type=int, default=0)
+    parser.add_argument("--scalers", default="scalers.json")
+    parser.add_argument("capture")
+    parser.add_argument("models", nargs="+", help="float model first")
+    args = parser.parse_args()
+
+    with open(args.scalers) as f:
+        scalers = json.load(f)
+    window = scalers["window"]
+    if scalers.get("include_derivative") or scalers.get("include_time"):
+        raise SystemExit("only single-feature (cap) models are supported")
+    mean = scalers["cap"]["mean"][0]
+    scale = scalers["cap"]["scale"][0]
+
+    samples = load_capture(args.capture, args.chip, args.sensor)
+    if len(samples) < window:
+        raise SystemExit(f"{args.capture}: {len(samples)} samples, need at least {window}")
+    norm = normalize(samples, mean, scale)
+
+    models = [Model(p) for p in args.models]
+    outputs = [[] for _ in models]
+    for end in range(window, len(norm) + 1):
+        w = norm[end - window:end]
+        for m, out in zip(models, outputs):
+            out.append(m.run(w))
+
+    ref = np.array(outputs[0])
+    ref_range = float(np.ptp(ref)) or 1.0
+    print(f"{len(ref)} windows from chip {args.chip} sensor {args.sensor}")
+    print(f"{'model':<32}{'input':>8}{'rmse':>12}{'max err':>12}{'% range':>9}{'us/invoke':>11}")
+    for m, out in zip(models, outputs):
+        err = np.array(out) - ref
+        rmse = float(np.sqrt(np.mean(err ** 2)))
+        worst = float(np.max(np.abs(err)))
+        us = m.invoke_s / m.invokes * 1e6
+        print(f"{m.path[-32:]:<32}{np.dtype(m.inp['dtype']).name:>8}"
+              f"{rmse:>12.5f}{worst:>12.5f}{rmse / ref_range * 100:>8.2f}%{us:>11.1f}")
+
+
+if __name__ == "__main__":
+    main()
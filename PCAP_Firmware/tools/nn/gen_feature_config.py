@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Generate src/nn_feature_config.h from the training scalers.json.
+
+Reads "window", "include_derivative" and "include_time" and one
+StandardScaler per enabled feature, in window order cap, derivative, time.
+Scalers are taken from the "cap" entry when its mean/scale lists have one
+value per feature, otherwise from separate "cap", "derivative" and "time"
+entries. An optional "derivative_smoothing_shift" selects the EMA used for
+the derivative (0 = plain difference between consecutive samples); the
+derivative is in cap units per second and time in seconds since the
+channel started streaming, which is what training must use.
+
+"output" says what the model's outputs are, for any number of them:
+"value" (the default) for compensated values, "correction" for amounts to
+add to the input. The device and tools/nn/host_compensator.py apply them
+accordingly.
+
+The element type of the model's input tensor is read from the model (a
+.tflite file, or the C array of src/model_data.h) and sizes the history
+rings: 1 byte per feature for int8 inputs, 2 for int16, 4 for float.
+
+Usage:
+    gen_feature_config.py [scalers.json] [src/nn_feature_config.h] [src/model_data.h]
+"""
+
+import json
+import re
+import struct
+import sys
+
+# TFLite TensorType -> bytes per element of the input window
+INPUT_TYPES = {0: ("float32", 4), 7: ("int16", 2), 9: ("int8", 1)}
+
+HEADER = """/**
+ * @file nn_feature_config.h
+ * @brief NN input feature configuration
+ *
+ * Generated from scalers.json by tools/nn/gen_feature_config.py - regenerate
+ * after retraining instead of editing by hand.
+ */
+
+#ifndef NN_FEATURE_CONFIG_H
+#define NN_FEATURE_CONFIG_H
+
+#define NN_WINDOW_SIZE              {window:<8}///< Samples per inference window
+#define NN_FEATURE_DERIVATIVE       {deriv:<8}///< Window includes d(cap)/dt
+#define NN_FEATURE_TIME             {time:<8}///< Window includes elapsed time
+#define NN_FEATURE_DERIV_SMOOTH_SHIFT {shift:<6}///< Derivative EMA shift (0 = plain difference)
+#define NN_FEATURE_INPUT_BYTES      {input_bytes:<8}///< Input tensor element size ({input_type} model)
+#define NN_OUTPUT_CORRECTION        {correction:<8}///< Outputs are corrections to add to the input, not compensated values
+
+// StandardScaler per feature, in window order: cap[, derivative][, time]
+#define NN_FEATURE_SCALER_MEAN      {{ {mean} }}
+#define NN_FEATURE_SCALER_SCALE     {{ {scale} }}
+
+#endif // NN_FEATURE_CONFIG_H
+"""
+
+
+def scaler(cfg, key, index):
+    entry = cfg.get(key)
+    if entry is None:
+        sys.exit(f"scalers.json: no scaler for feature '{key}'")
+    return entry["mean"][index], entry["scale"][index]
+
+
+def model_input_type(path):
+    """TensorType of the first input of the first subgraph of a TFLite model."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if not path.endswith(".tflite"):
+        text = data.decode(errors="replace")
+        body = text[text.index("{") + 1:text.index("}")]
+        data = bytes(int(b, 16) for b in re.findall(r"0x([0-9a-fA-F]{2})", body))
+
+    def u32(pos):
+        return struct.unpack_from("<I", data, pos)[0]
+
+    def field(table, index):
+        vtable = table - struct.unpack_from("<i", data, table)[0]
+        if 4 + 2 * index >= struct.unpack_from("<H", data, vtable)[0]:
+            return None
+        offset = struct.unpack_from("<H", data, vtable + 4 + 2 * index)[0]
+        return table + offset if offset else None
+
+    def element(vector_field, index):
+        vector = vector_field + u32(vector_field)
+        pos = vector + 4 + 4 * index
+        return pos + u32(pos)
+
+    model = u32(0)
+    subgraph = element(field(model, 2), 0)
+    inputs = field(subgraph, 1)
+    tensor_index = u32(inputs + u32(inputs) + 4)
+    tensor = element(field(subgraph, 0), tensor_index)
+    type_field = field(tensor, 1)
+    return data[type_field] if type_field else 0
+
+
+def main(argv):
+    src = argv[1] if len(argv) > 1 else "scalers.json"
+    dst = argv[2] if len(argv) > 2 else "src/nn_feature_config.h"
+    model = argv[3] if len(argv) > 3 else "src/model_data.h"
+
+    with open(src) as f:
+        cfg = json.load(f)
+
+    features = ["cap"]
+    if cfg.get("include_derivative", False):
+        features.append("derivative")
+    if cfg.get("include_time", False):
+        features.append("time")
+
+    if len(cfg["cap"]["mean"]) == len(features):
+        scalers = [scaler(cfg, "cap", i) for i in range(len(features))]
+    else:
+        scalers = [scaler(cfg, name, 0) for name in features]
+
+    output = cfg.get("output", "value")
+    if output not in ("value", "correction"):
+        sys.exit(f"scalers.json: output '{output}' is neither 'value' nor 'correction'")
+
+    tensor_type = model_input_type(model)
+    if tensor_type not in INPUT_TYPES:
+        sys.exit(f"{model}: input tensor type {tensor_type} is not float32, int16 or int8")
+    input_type, input_bytes = INPUT_TYPES[tensor_type]
+
+    text = HEADER.format(
+        window=cfg["window"],
+        deriv=int("derivative" in features),
+        time=int("time" in features),
+        shift=int(cfg.get("derivative_smoothing_shift", 0)),
+        input_bytes=input_bytes,
+        input_type=input_type,
+        correction=int(output == "correction"),
+        mean=", ".join(f"{repr(float(m))}f" for m, _ in scalers),
+        scale=", ".join(f"{repr(float(s))}f" for _, s in scalers))
+
+    with open(dst, "w") as f:
+        f.write(text)
+    print(f"{dst}: window {cfg['window']}, features {', '.join(features)}, {input_type} input, "
+          f"{output} outputs")
+
+
+if __name__ == "__main__":
+    main(sys.argv)
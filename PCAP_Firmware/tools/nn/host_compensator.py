@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""Compensate a raw sensor stream on the host, as the device would.
+
+Consumes the serial stream of a device in host compensation mode
+(BLE_CTRL_SET_COMPENSATION, or a "K,4,1" line on serial): "F," headers with
+the device's model fingerprint and NN divider, "O," lines with the
+calibration offsets and "R," lines with each chip's raw readings and read
+time. Prints "D,<chip>,<s0>..<s5>" lines, the same as the device prints
+with compensation on.
+
+The results are bit-identical to on-device compensation from the same
+samples. The NN input and the feature windows come from the firmware's own
+code (src/nn_features.c and src/history_store.c built with the host C
+compiler, no FP contraction), the model runs on the TFLite reference
+kernels, which the device kernels match bit for bit, and refresh decimation
+and output dequantization follow nn_inference.cpp in float32. The tool refuses to run when its model, feature
+configuration or scaler differ from the device's (fingerprint mismatch).
+
+Usage:
+    host_compensator.py [--model model.tflite] [--cc cc] capture.log
+    host_compensator.py [--model model.tflite] --port /dev/ttyACM0 [--baud 115200]
+"""
+
+import argparse
+import ctypes
+import math
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+import numpy as np
+
+try:
+    from tflite_runtime.interpreter import Interpreter, OpResolverType
+except ImportError:
+    from tensorflow.lite.python.interpreter import Interpreter, OpResolverType
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src")
+
+NUM_CHIPS = 8
+SENSORS_PER_CHIP = 6
+
+# Serial output clamp and format of main.c (append_fixed4)
+SERIAL_VALUE_LIMIT = np.float32(200000.0)
+
+# Host stand-ins for the ESP-IDF headers nn_features.c and history_store.c include
+SHIM_LOG = """#pragma once
+#define ESP_LOGE(tag, ...) ((void)(tag))
+#define ESP_LOGW(tag, ...) ((void)(tag))
+#define ESP_LOGI(tag, ...) ((void)(tag))
+"""
+
+SHIM_ATTR = """#pragma once
+#define __NOINIT_ATTR
+"""
+
+SHIM_CRC = """#pragma once
+#include <stdint.h>
+/* Same convention as the ROM function: chainable, zlib crc32 compatible */
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+"""
+
+# The NN input exactly as nn_compensate_chip() computes it, and the kind of
+# output the generated feature configuration declares
+HOST_INPUT = """#include "pcap04_defs.h"
+#include "nn_feature_config.h"
+float host_input(float raw, float offset)
+{
+    return (PCAP_SCALING_NUM * (float)(raw - offset)) / PCAP_CONVERSION_NUMBER;
+}
+int host_output_correction(void)
+{
+    return NN_OUTPUT_CORRECTION;
+}
+"""
+
+FEATURE_TYPES = {np.float32: 0, np.int8: 1, np.int16: 2}
+
+
+def build_features(cc, out_dir):
+    """Compile nn_features.c and its history store with the host shims and
+    return the loaded library."""
+    with open(os.path.join(out_dir, "esp_log.h"), "w") as f:
+        f.write(SHIM_LOG)
+    with open(os.path.join(out_dir, "esp_attr.h"), "w") as f:
+        f.write(SHIM_ATTR)
+    with open(os.path.join(out_dir, "esp_rom_crc.h"), "w") as f:
+        f.write(SHIM_CRC)
+    host_src = os.path.join(out_dir, "host_input.c")
+    with open(host_src, "w") as f:
+        f.write(HOST_INPUT)
+
+    lib_path = os.path.join(out_dir, "libnnfeatures.so")
+    subprocess.run([cc, "-O2", "-shared", "-fPIC", "-ffp-contract=off", "-I", out_dir, "-I", SRC_DIR,
+                    os.path.join(SRC_DIR, "nn_features.c"), os.path.join(SRC_DIR, "history_store.c"),
+                    host_src, "-lm", "-o", lib_path],
+                   check=True)
+    lib = ctypes.CDLL(lib_path)
+    lib.nn_features_init.argtypes = [ctypes.c_int, ctypes.c_float, ctypes.c_int32]
+    lib.nn_features_init.restype = ctypes.c_bool
+    lib.nn_features_fingerprint.argtypes = [ctypes.c_uint32]
+    lib.nn_features_fingerprint.restype = ctypes.c_uint32
+    lib.nn_features_window_bytes.restype = ctypes.c_uint32
+    lib.nn_features_push.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_float, ctypes.c_int64]
+    lib.nn_features_push.restype = None
+    lib.nn_features_window_ready.argtypes = [ctypes.c_int, ctypes.c_int]
+    lib.nn_features_window_ready.restype = ctypes.c_bool
+    lib.nn_features_write_window.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_void_p]
+    lib.nn_features_write_window.restype = None
+    lib.host_input.argtypes = [ctypes.c_float, ctypes.c_float]
+    lib.host_input.restype = ctypes.c_float
+    lib.host_output_correction.restype = ctypes.c_int
+    return lib
+
+
+def load_model_bytes(path):
+    """Read a .tflite file, or the model array of src/model_data.h by default."""
+    if path:
+        with open(path, "rb") as f:
+            return f.read()
+    with open(os.path.join(SRC_DIR, "model_data.h")) as f:
+        text = f.read()
+    body = text[text.index("{", text.index("model_int8_tflite[]")) + 1:]
+    body = body[:body.index("}")]
+    return bytes(int(v, 16) for v in re.findall(r"0x[0-9a-fA-F]{2}", body))
+
+
+def bits_to_float(hex_bits):
+    return struct.unpack("<f", struct.pack("<I", int(hex_bits, 16)))[0]
+
+
+def format_fixed4(value):
+    """Equivalent of append_fixed4() in main.c."""
+    value = min(max(np.float32(value), -SERIAL_VALUE_LIMIT), SERIAL_VALUE_LIMIT)
+    scaled = float(np.float32(value) * np.float32(10000.0))
+    scaled = int(math.copysign(math.floor(abs(scaled) + 0.5), scaled))  # lroundf
+    sign = "-" if scaled < 0 else ""
+    scaled = abs(scaled)
+    return f"{sign}{scaled // 10000}.{scaled % 10000:04d}"
+
+
+class Compensator:
+    """Host copy of nn_compensate_chip() and its decimation state."""
+
+    def __init__(self, lib, model):
+        self.lib = lib
+        self.interp = Interpreter(model_content=model,
+                                  experimental_op_resolver_type=OpResolverType.BUILTIN_REF)
+        self.interp.allocate_tensors()
+        self.inp = self.interp.get_input_details()[0]
+        self.out = self.interp.get_output_details()[0]
+
+        dtype = self.inp["dtype"]
+        if dtype not in FEATURE_TYPES:
+            raise SystemExit(f"unsupported input tensor type {np.dtype(dtype).name}")
+        scale, zero = self.inp["quantization"]
+        if not lib.nn_features_init(FEATURE_TYPES[dtype], scale, zero):
+            raise SystemExit("feature pipeline rejected the input tensor quantization")
+        self.window = ctypes.create_string_buffer(lib.nn_features_window_bytes())
+
+        self.fingerprint = lib.nn_features_fingerprint(zlib.crc32(model))
+        self.steps = int(np.prod(self.out["shape"]))
+        self.output_correction = bool(lib.host_output_correction())
+        self.divider = 1
+        self.period = self.steps
+        self.phase = [[0] * SENSORS_PER_CHIP for _ in range(NUM_CHIPS)]
+        self.correction = [[[np.float32(0.0)] * self.steps for _ in range(SENSORS_PER_CHIP)]
+                           for _ in range(NUM_CHIPS)]
+        self.invokes = 0
+
+    def set_divider(self, divider):
+        """nn_set_refresh_divider()"""
+        self.divider = divider
+        if divider == 0:
+            return
+        self.period = divider * self.steps
+        channel = 0
+        for chip in range(NUM_CHIPS):
+            for i in range(SENSORS_PER_CHIP):
+                self.phase[chip][i] = channel % self.period
+                channel += 1
+
+    def invoke(self):
+        x = np.frombuffer(self.window.raw, dtype=self.inp["dtype"]).reshape(self.inp["shape"])
+        self.interp.set_tensor(self.inp["index"], x)
+        self.interp.invoke()
+        self.invokes += 1
+        y = self.interp.get_tensor(self.out["index"]).reshape(-1)
+        if self.out["dtype"] == np.float32:
+            return [np.float32(v) for v in y]
+        scale, zero = self.out["quantization"]
+        return [np.float32(int(v) - zero) * np.float32(scale) for v in y]
+
+    def compensate(self, chip, t_us, raw, offset):
+        values = []
+        for i in range(SENSORS_PER_CHIP):
+            value = np.float32(self.lib.host_input(raw[i], offset[i]))
+            self.lib.nn_features_push(chip, i, value, t_us)
+
+            if not self.lib.nn_features_window_ready(chip, i) or self.divider == 0:
+                values.append(value)
+                continue
+
+            phase = self.phase[chip][i]
+            self.phase[chip][i] = 0 if phase + 1 >= self.period else phase + 1
+            if phase != 0:
+                values.append(value + self.correction[chip][i][min(phase, self.steps - 1)])
+                continue
+
+            self.lib.nn_features_write_window(chip, i, self.window)
+            outputs = self.invoke()
+            if self.output_correction:
+                self.correction[chip][i] = outputs
+                values.append(value + outputs[0])
+            else:
+                self.correction[chip][i] = [y - value for y in outputs]
+                values.append(outputs[0])
+        return values
+
+
+def read_lines(args):
+    """Yield stream lines from a capture file or a live serial port."""
+    if not args.port:
+        with open(args.capture, errors="replace") as f:
+            yield from f
+        return
+
+    import serial
+    with serial.Serial(args.port, args.baud, timeout=1) as port:
+        port.write(b"K,4,1\n")      # BLE_CTRL_SET_COMPENSATION, host
+        try:
+            while True:
+                line = port.readline()
+                if line:
+                    yield line.decode(errors="replace")
+        finally:
+            port.write(b"K,4,0\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", nargs="?", help="recorded serial log")
+    parser.add_argument("--port", help="compensate a live device on this serial port")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--model", help=".tflite model (default: the array in src/model_data.h)")
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="host C compiler")
+    args = parser.parse_args()
+    if bool(args.capture) == bool(args.port):
+        parser.error("give either a capture or --port")
+
+    with tempfile.TemporaryDirectory() as tmp:
+        lib = build_features(args.cc, tmp)
+        comp = Compensator(lib, load_model_bytes(args.model))
+
+        offsets = [None] * NUM_CHIPS
+        last_t = [None] * NUM_CHIPS
+        t_wrap = [0] * NUM_CHIPS
+        verified = False
+        samples = 0
+
+        for line in read_lines(args):
+            fields = line.strip().split(",")
+            try:
+                if fields[0] == "F" and len(fields) == 3:
+                    device_fp, divider = int(fields[1], 16), int(fields[2])
+                    if device_fp != comp.fingerprint:
+                        sys.exit(f"fingerprint mismatch: device {device_fp:08x}, host "
+                                 f"{comp.fingerprint:08x}; model, nn_feature_config.h or "
+                                 f"scaler differ")
+                    if not verified or divider != comp.divider:
+                        comp.set_divider(divider)
+                    verified = True
+                elif fields[0] == "O" and len(fields) == 2 + SENSORS_PER_CHIP:
+                    offsets[int(fields[1])] = [bits_to_float(v) for v in fields[2:]]
+                elif fields[0] == "R" and len(fields) == 3 + SENSORS_PER_CHIP:
+                    chip, t32 = int(fields[1]), int(fields[2])
+                    if not verified or offsets[chip] is None:
+                        continue
+                    # Unwrap the 32-bit microsecond timestamp
+                    if last_t[chip] is not None and t32 < last_t[chip]:
+                        t_wrap[chip] += 1 << 32
+                    last_t[chip] = t32
+                    raw = [bits_to_float(v) for v in fields[3:]]
+                    values = comp.compensate(chip, t_wrap[chip] + t32, raw, offsets[chip])
+                    print(f"D,{chip}," + ",".join(format_fixed4(v) for v in values), flush=bool(args.port))
+                    samples += 1
+            except (ValueError, IndexError):
+                continue
+
+    if not verified:
+        sys.exit("no F, header found; is the device in host compensation mode?")
+    print(f"{samples} chip samples, {comp.invokes} invokes, fingerprint {comp.fingerprint:08x}",
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
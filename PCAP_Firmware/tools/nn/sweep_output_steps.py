@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Accuracy versus samples per invoke (K) for multi-step models.
+
+Replays one recorded channel the way nn_inference.cpp schedules it and
+compares the result with the reference model invoked on every sample. A
+K-step model (K outputs) is invoked every K samples. Its outputs are, per
+--output, corrections for the newest sample and the K-1 that follow,
+added to each new input as it arrives, or compensated values, kept as
+their correction to the newest sample (the "output" of scalers.json). For comparison, the reference model is also run
+every K samples with its last correction reused in between, which is what
+nn_set_refresh_divider(K) does with a single-step model. Accuracy is
+measured against the reference model, as in compare_quantization.py.
+
+Usage:
+    sweep_output_steps.py [--chip N] [--sensor N] [--scalers scalers.json]
+                          [--output correction|value]
+                          capture.log reference.tflite kstep.tflite [kstep.tflite ...]
+"""
+
+import argparse
+import json
+
+import numpy as np
+
+from compare_quantization import Model, load_capture
+
+
+def replay(model, norm, samples, window, period, output="value"):
+    """Compensated values of samples[window-1:] with one invoke every period samples.
+
+    Every output is a compensated value, kept as its correction to the
+    newest sample, or a correction, as nn_inference.cpp applies them.
+    """
+    out = []
+    correction = np.zeros(1)
+    for n in range(window - 1, len(samples)):
+        phase = (n - window + 1) % period
+        if phase == 0:
+            y = model.run_all(norm[n - window + 1:n + 1])
+            correction = y if output == "correction" else y - samples[n]
+        out.append(samples[n] + correction[min(phase, len(correction) - 1)])
+    return np.array(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--chip", type=int, default=0)
+    parser.add_argument("--sensor", type=int, default=0)
+    parser.add_argument("--scalers", default="scalers.json")
+    parser.add_argument("--output", choices=("correction", "value"), default="correction",
+                        help="what the K-step models output")
+    parser.add_argument("capture")
+    parser.add_argument("reference", help="single-step model, invoked every sample")
+    parser.add_argument("models", nargs="+", help="K-step models")
+    args = parser.parse_args()
+
+    with open(args.scalers) as f:
+        scalers = json.load(f)
+    window = scalers["window"]
+    if scalers.get("include_derivative") or scalers.get("include_time"):
+        raise SystemExit("only single-feature (cap) models are supported")
+    mean = scalers["cap"]["mean"][0]
+    scale = scalers["cap"]["scale"][0]
+
+    samples = load_capture(args.capture, args.chip, args.sensor).astype(np.float64)
+    if len(samples) < window:
+        raise SystemExit(f"{args.capture}: {len(samples)} samples, need at least {window}")
+    norm = ((samples - mean) / scale).astype(np.float32)
+
+    ref_model = Model(args.reference)
+    ref = replay(ref_model, norm, samples, window, 1)
+    ref_range = float(np.ptp(ref)) or 1.0
+
+    rows = []
+    for path in args.models:
+        model = Model(path)
+        k = int(np.prod(model.out["shape"]))
+        rows.append((f"{k}-step {path[-24:]}", k, model, replay(model, norm, samples, window, k, args.output)))
+        stale = Model(args.reference)
+        rows.append((f"reference 1/{k}", k, stale,
+                     replay(stale, norm, samples, window, k)))
+
+    print(f"{len(ref)} samples from chip {args.chip} sensor {args.sensor}")
+    print(f"{'schedule':<36}{'K':>3}{'rmse':>12}{'max err':>12}{'% range':>9}"
+          f"{'us/invoke':>11}{'us/sample':>11}")
+    for name, k, model, out in sorted(rows, key=lambda r: (r[1], r[0])):
+        err = out - ref
+        rmse = float(np.sqrt(np.mean(err ** 2)))
+        us = model.invoke_s / model.invokes * 1e6
+        print(f"{name:<36}{k:>3}{rmse:>12.5f}{float(np.max(np.abs(err))):>12.5f}"
+              f"{rmse / ref_range * 100:>8.2f}%{us:>11.1f}{us * model.invokes / len(out):>11.1f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,459 @@
+#!/usr/bin/env python3
+"""Binary delta firmware updates over BLE.
+
+diff writes a patch that rebuilds new.bin from the installed old.bin (the
+format is described in src/delta_patch.h). Matches are found through an
+index of the installed image and then extended for as long as the bytes
+mostly agree, so code that moved keeps matching across its relocated
+addresses: the differences are stored as runs, with zero runs costing a
+byte. Whatever does not match goes in literally.
+
+send uploads a patch to the device's OTA characteristic after
+BLE_CTRL_OTA_BEGIN. The device applies it in pieces into the inactive OTA
+slot, acknowledges consumed bytes ("W,<bytes>") so that at most --window
+bytes are in flight, and checks the SHA-256 of the installed and of the
+written image against the patch header before it switches slots and
+restarts ("OTA,OK,..." or "OTA,ERR,..."). The OTA characteristic and the
+OTA control writes need an encrypted link from passkey pairing, so send
+pairs first; enter BLE_OTA_PASSKEY (src/ble_manager.h) when the system's
+Bluetooth agent asks for it. --full sends the whole image as
+a patch of one literal block, the same path as a full-image update, so the
+two transfers compare directly.
+
+check applies a patch with src/delta_patch.c, built with the host C
+compiler, in pieces of random size, and checks the result against new.bin.
+--simulate does the same for synthetic images with the changes a release
+typically makes (an edited function that moves the code after it, a new
+model_data.h) and prints patch and full sizes with the transfer time at
+--rate bytes per second.
+
+Usage:
+    delta_ota.py diff old.bin new.bin -o update.patch [--rate 8000]
+    delta_ota.py check old.bin new.bin update.patch [--cc cc]
+    delta_ota.py send update.patch [--name PCAP-Sensor] [--window 4096]
+    delta_ota.py send --full new.bin [--name PCAP-Sensor]
+    delta_ota.py --simulate [--size 900000] [--seed 1] [--rate 8000]
+"""
+
+import argparse
+import asyncio
+import ctypes
+import hashlib
+import os
+import random
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src")
+
+GRAM = 16                   # Exact bytes that start a match
+STEP = 4                    # Installed image positions indexed
+MIN_MATCH = 24              # Shorter exact matches go in literally
+CHUNK = 32                  # Bytes compared at once while extending
+MAX_MISS_RUN = 24           # Mismatched bytes that end an approximate match
+MIN_DENSITY = 0.5           # Matching share of the bytes since the last check
+ZERO_RUN_MIN = 3            # Shorter zero runs stay inside literal difference runs
+
+BLE_CTRL_OTA_BEGIN = 0x09
+BLE_CTRL_OTA_ABORT = 0x0A
+STATUS_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26a9"
+CONTROL_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26aa"
+OTA_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26ab"
+
+
+def read_config():
+    """DELTA_* constants of delta_patch.h."""
+    config = {}
+    with open(os.path.join(SRC_DIR, "delta_patch.h")) as f:
+        for m in re.finditer(r"#define (DELTA_\w+)\s+(0x[0-9A-Fa-f]+|\d+)", f.read()):
+            config[m.group(1)] = int(m.group(2), 0)
+    return config
+
+
+def varint(n):
+    out = bytearray()
+    while True:
+        byte = n & 0x7F
+        n >>= 7
+        if n:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def zigzag(n):
+    return (n << 1) if n >= 0 else ((-n << 1) - 1)
+
+
+def encode_differences(old, s, new, t, length):
+    """Difference runs of new[t:t+length] against old[s:s+length]."""
+    diff = bytes((new[t + k] - old[s + k]) & 0xFF for k in range(length))
+    out = bytearray()
+    k = 0
+    while k < length:
+        if diff[k] == 0:
+            z = k
+            while z < length and diff[z] == 0:
+                z += 1
+            if z - k >= ZERO_RUN_MIN or z == length:
+                out += varint((z - k - 1) << 1)
+                k = z
+                continue
+        # Literal differences up to the next zero run worth its own token
+        e = k
+        while e < length:
+            if diff[e] == 0:
+                z = e
+                while z < length and diff[z] == 0 and z - e < ZERO_RUN_MIN:
+                    z += 1
+                if z - e >= ZERO_RUN_MIN or z == length:
+                    break
+                e = z
+            else:
+                e += 1
+        out += varint(((e - k - 1) << 1) | 1) + diff[k:e]
+        k = e
+    return bytes(out)
+
+
+def build_index(old):
+    index = {}
+    for s in range(0, len(old) - GRAM + 1, STEP):
+        index.setdefault(old[s:s + GRAM], s)
+    return index
+
+
+def extend(old, new, s, t):
+    """End of the approximate match of new[t:] against old[s:]."""
+    off = s - t
+    end = t                 # After the last matching byte
+    i = t
+    limit = min(len(new), len(old) - off)
+    checked = t
+    matches = 0
+    while i < limit:
+        if new[i:i + CHUNK] == old[i + off:i + off + CHUNK] and i + CHUNK <= limit:
+            i += CHUNK
+            matches += CHUNK
+            end = i
+            continue
+        if new[i] == old[i + off]:
+            matches += 1
+            end = i + 1
+        elif i - end >= MAX_MISS_RUN:
+            break
+        i += 1
+        if i - checked >= 4 * CHUNK:
+            if matches < MIN_DENSITY * (i - checked):
+                break
+            checked = i
+            matches = 0
+    return end
+
+
+def make_patch(old, new):
+    """Patch bytes and (matched, literal) byte counts."""
+    index = build_index(old)
+    body = bytearray()
+    matched = 0
+
+    # The open block: diff part new[block_t:block_end] from old[block_s:]
+    block_t = block_end = 0
+    block_s = 0
+    t = 0
+    while t <= len(new) - GRAM:
+        s = index.get(new[t:t + GRAM])
+        if s is None:
+            t += 1
+            continue
+        # Extend backwards into the literal bytes, then forwards
+        ts = t
+        while ts > block_end and s > 0 and new[ts - 1] == old[s - 1]:
+            ts -= 1
+            s -= 1
+        end = extend(old, new, s, ts)
+        if end - ts < MIN_MATCH:
+            t += 1
+            continue
+
+        # Close the open block with the literals up to the match
+        seek = s - (block_s + (block_end - block_t))
+        body += encode_block(old, new, block_s, block_t, block_end, ts, seek)
+        matched += block_end - block_t
+        block_s, block_t, block_end = s, ts, end
+        t = end
+    body += encode_block(old, new, block_s, block_t, block_end, len(new), 0)
+    matched += block_end - block_t
+
+    header = struct.pack("<I", read_config()["DELTA_MAGIC"])
+    header += struct.pack("<I", len(old)) + image_sha256(old)
+    header += struct.pack("<I", len(new)) + image_sha256(new)
+    return header + bytes(body), matched, len(new) - matched
+
+
+def encode_block(old, new, s, t, diff_end, extra_end, seek):
+    out = varint(diff_end - t) + varint(extra_end - diff_end) + varint(zigzag(seek))
+    out += encode_differences(old, s, new, t, diff_end - t)
+    return out + new[diff_end:extra_end]
+
+
+def image_sha256(image):
+    """The SHA-256 esp_partition_get_sha256() reports for an app image.
+
+    ESP-IDF appends to each app image the SHA-256 of everything before it,
+    and the device reports that digest rather than hashing the whole image.
+    Images without one (the synthetic ones of --simulate) hash whole.
+    """
+    digest = hashlib.sha256(image[:-32]).digest()
+    if len(image) > 32 and image[-32:] == digest:
+        return digest
+    return hashlib.sha256(image).digest()
+
+
+def full_patch(old_size, old_sha, new):
+    """The whole image as one literal block, for a full-image update."""
+    header = struct.pack("<I", read_config()["DELTA_MAGIC"])
+    header += struct.pack("<I", old_size) + old_sha
+    header += struct.pack("<I", len(new)) + image_sha256(new)
+    return header + varint(0) + varint(len(new)) + varint(0) + new
+
+
+# Decoder on the host
+
+IO_BEGIN = ctypes.CFUNCTYPE(ctypes.c_bool, ctypes.c_void_p, ctypes.c_void_p)
+IO_READ = ctypes.CFUNCTYPE(ctypes.c_bool, ctypes.c_void_p, ctypes.c_uint32,
+                           ctypes.POINTER(ctypes.c_uint8), ctypes.c_uint32)
+IO_WRITE = ctypes.CFUNCTYPE(ctypes.c_bool, ctypes.c_void_p,
+                            ctypes.POINTER(ctypes.c_uint8), ctypes.c_uint32)
+
+
+class DeltaIo(ctypes.Structure):
+    _fields_ = [("begin", IO_BEGIN), ("read_source", IO_READ),
+                ("write_target", IO_WRITE), ("ctx", ctypes.c_void_p)]
+
+
+STATUS = ("more", "done", "format error", "range error", "io error")
+
+
+def build(cc, out_dir):
+    lib_path = os.path.join(out_dir, "libdelta.so")
+    subprocess.run([cc, "-O2", "-shared", "-fPIC", "-Wall", "-Wextra", "-I", SRC_DIR,
+                    os.path.join(SRC_DIR, "delta_patch.c"), "-o", lib_path], check=True)
+    lib = ctypes.CDLL(lib_path)
+    lib.delta_patch_begin.argtypes = [ctypes.POINTER(DeltaIo)]
+    lib.delta_patch_begin.restype = None
+    lib.delta_patch_feed.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+    lib.delta_patch_feed.restype = ctypes.c_int
+    return lib
+
+
+def apply_patch(lib, old, patch, rng, max_piece=512):
+    """Target bytes and status, feeding the patch in random pieces."""
+    out = bytearray()
+    reads = [0]
+
+    def read_source(_, offset, dst, n):
+        if offset + n > len(old):
+            return False
+        ctypes.memmove(dst, old[offset:offset + n], n)
+        reads[0] += n
+        return True
+
+    def write_target(_, data, n):
+        out.extend(ctypes.string_at(data, n))
+        return True
+
+    callbacks = (IO_BEGIN(lambda ctx, header: True), IO_READ(read_source), IO_WRITE(write_target))
+    io = DeltaIo(*callbacks, None)
+    lib.delta_patch_begin(ctypes.byref(io))
+    status = 0
+    pos = 0
+    while pos < len(patch) and STATUS[status] == "more":
+        n = rng.randint(1, max_piece)
+        status = lib.delta_patch_feed(patch[pos:pos + n], len(patch[pos:pos + n]))
+        pos += n
+    return bytes(out), STATUS[status], reads[0]
+
+
+def describe(name, old, new, patch, rate):
+    full = len(full_patch(len(old), image_sha256(old), new))
+    print(f"{name}: patch {len(patch)} bytes ({len(patch) / full:.1%} of the {full}-byte full "
+          f"transfer), {len(patch) / rate:.1f} s against {full / rate:.1f} s at {rate} B/s")
+
+
+def check(args, old, new, patch):
+    config = read_config()
+    with tempfile.TemporaryDirectory() as tmp:
+        lib = build(args.cc, tmp)
+        out, status, reads = apply_patch(lib, old, patch, random.Random(args.seed))
+    ok = status == "done" and out == new
+    ram = config["DELTA_SOURCE_CHUNK"] + config["DELTA_TARGET_CHUNK"] + config["DELTA_HEADER_LEN"]
+    print(f"decoder: {status}, {len(out)} of {len(new)} bytes, {'matches' if ok else 'DIFFERS from'} "
+          f"new image, {reads} source bytes read, {ram} bytes of buffers")
+    return ok
+
+
+# Synthetic images
+
+def synthetic_image(rng, size):
+    """Code-like bytes: instructions with absolute addresses into the image."""
+    base = 0x42000000
+    out = bytearray()
+    while len(out) < size:
+        if rng.random() < 0.15:
+            out += struct.pack("<I", base + rng.randrange(0, size, 4))
+        else:
+            out += struct.pack("<I", rng.getrandbits(32) & 0xFFFF00FF | rng.choice((0x13, 0x33, 0x03)) << 8)
+    return bytes(out[:size])
+
+
+def relocate(image, at, shift):
+    """image with shift bytes inserted at `at` and the addresses past it moved."""
+    base = 0x42000000
+    out = bytearray(image)
+    for k in range(0, len(out) - 3, 4):
+        word = struct.unpack_from("<I", out, k)[0]
+        if base + at <= word < base + len(image):
+            struct.pack_into("<I", out, k, word + shift)
+    return bytes(out)
+
+
+def simulate(args):
+    rng = random.Random(args.seed)
+    old = synthetic_image(rng, args.size)
+
+    # An edited function: 96 changed bytes, 160 more, the rest moves
+    at = args.size // 3
+    moved = relocate(old, at, 160)
+    edited = moved[:at] + synthetic_image(rng, 256) + moved[at + 96:]
+
+    # A retrained model: model_data.h's array swapped in place
+    model_at, model_len = args.size // 2, 9736
+    model = old[:model_at] + bytes(rng.getrandbits(8) for _ in range(model_len)) + old[model_at + model_len:]
+
+    cases = (("function edit", edited), ("model swap", model), ("both", None))
+    failed = False
+    for name, new in cases:
+        if new is None:
+            new = edited[:model_at] + model[model_at:model_at + model_len] + edited[model_at + model_len:]
+        patch, _, _ = make_patch(old, new)
+        describe(name, old, new, patch, args.rate)
+        failed |= not check(args, old, new, patch)
+    return 1 if failed else 0
+
+
+# Upload
+
+async def send(args, patch):
+    from bleak import BleakClient, BleakScanner
+
+    device = await BleakScanner.find_device_by_name(args.name, timeout=10.0)
+    if device is None:
+        sys.exit(f"{args.name} not found")
+
+    acked = 0
+    result = None
+    done = asyncio.Event()
+    progress = asyncio.Event()
+
+    def on_status(_, data):
+        nonlocal acked, result
+        text = data.decode(errors="replace").strip()
+        if text.startswith("W,"):
+            acked = int(text[2:])
+            progress.set()
+        elif text.startswith("OTA,"):
+            result = text
+            done.set()
+            progress.set()
+
+    async with BleakClient(device) as client:
+        # Writes to the OTA path are refused on an unauthenticated link
+        await client.pair()
+        await client.start_notify(STATUS_UUID, on_status)
+        await client.write_gatt_char(CONTROL_UUID, struct.pack("<BI", BLE_CTRL_OTA_BEGIN, len(patch)),
+                                     response=True)
+        piece = client.mtu_size - 3
+        start = time.monotonic()
+        sent = 0
+        while sent < len(patch) and not done.is_set():
+            while sent - acked >= args.window and not done.is_set():
+                progress.clear()
+                try:
+                    await asyncio.wait_for(progress.wait(), args.timeout)
+                except asyncio.TimeoutError:
+                    await client.write_gatt_char(CONTROL_UUID, bytes((BLE_CTRL_OTA_ABORT,)), response=True)
+                    sys.exit(f"no acknowledgement for {args.timeout} s at {acked} of {len(patch)} bytes")
+            n = min(piece, len(patch) - sent, args.window - (sent - acked))
+            await client.write_gatt_char(OTA_UUID, patch[sent:sent + n], response=False)
+            sent += n
+        try:
+            await asyncio.wait_for(done.wait(), args.timeout + 10.0)
+        except asyncio.TimeoutError:
+            sys.exit("no result from the device")
+        elapsed = time.monotonic() - start
+
+    print(f"{len(patch)} bytes in {elapsed:.1f} s ({len(patch) / elapsed:.0f} B/s): {result}")
+    return 0 if result.startswith("OTA,OK") else 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--simulate", action="store_true", help="patch synthetic images and check them")
+    parser.add_argument("--size", type=int, default=900_000, help="synthetic image size")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--rate", type=int, default=8000, help="BLE transfer rate for estimates, B/s")
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="host C compiler")
+    sub = parser.add_subparsers(dest="command")
+    p_diff = sub.add_parser("diff")
+    p_diff.add_argument("old")
+    p_diff.add_argument("new")
+    p_diff.add_argument("-o", "--out", required=True)
+    p_check = sub.add_parser("check")
+    p_check.add_argument("old")
+    p_check.add_argument("new")
+    p_check.add_argument("patch")
+    p_send = sub.add_parser("send")
+    p_send.add_argument("patch", nargs="?")
+    p_send.add_argument("--full", help="send this whole image instead of a patch")
+    p_send.add_argument("--name", default="PCAP-Sensor")
+    p_send.add_argument("--window", type=int, default=4096, help="unacknowledged bytes in flight")
+    p_send.add_argument("--timeout", type=float, default=10.0, help="seconds without an acknowledgement")
+    args = parser.parse_args()
+
+    if args.simulate:
+        sys.exit(simulate(args))
+
+    if args.command == "diff":
+        old = open(args.old, "rb").read()
+        new = open(args.new, "rb").read()
+        patch, matched, literal = make_patch(old, new)
+        with open(args.out, "wb") as f:
+            f.write(patch)
+        print(f"{matched} bytes matched, {literal} literal")
+        describe(args.out, old, new, patch, args.rate)
+    elif args.command == "check":
+        old = open(args.old, "rb").read()
+        new = open(args.new, "rb").read()
+        sys.exit(0 if check(args, old, new, open(args.patch, "rb").read()) else 1)
+    elif args.command == "send":
+        if args.full:
+            # The device checks the installed image's hash only when something is copied from it
+            patch = full_patch(0, bytes(32), open(args.full, "rb").read())
+        elif args.patch:
+            patch = open(args.patch, "rb").read()
+        else:
+            sys.exit("give a patch, or --full image.bin")
+        sys.exit(asyncio.run(send(args, patch)))
+    else:
+        parser.print_usage()
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
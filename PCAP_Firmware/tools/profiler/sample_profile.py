@@ -0,0 +1,426 @@
+#!/usr/bin/env python3
+"""Symbolize a sampling profile of the firmware.
+
+A SAMPLE_PROFILE_MODE build (src/sample_profiler.h) samples the interrupted
+program counter and task at a fixed rate and prints the capture on serial
+("X,", "N," and "x," lines). This tool maps every PC to its function
+against the firmware ELF and prints a flat profile, per task and per
+function, with the profiler's own overhead. --folded writes the samples as
+folded stacks ("task;function;inlined count" lines) for flamegraph.pl or
+speedscope.
+
+Functions come from the ELF symbol table. With addr2line (riscv32-esp-elf-
+addr2line from the ESP-IDF toolchain, or --addr2line), inlined functions
+and source lines are expanded from the debug info as well. The device
+samples only the PC, so a stack is the task and the inlining chain. Samples
+that landed in another interrupt handler carry no PC and show as
+[unknown] under the "ISR" task.
+
+Start a capture with BLE_CTRL_PROFILE, or on serial with
+"K,11,<rate lo>,<rate hi>,<samples lo>,<samples hi>" ("K,11" for the
+defaults); the main task prints it within a second of the buffer filling.
+QEMU builds (tools/qemu/run_qemu.sh) take one capture at startup.
+
+--simulate samples a host program instead: a timer signal records the
+interrupted PC of a workload with known shares of CPU time, in the
+device's dump format, and the program is profiled with the host addr2line.
+The exit status is 1 if the measured shares are off by more than
+--tolerance percentage points or the inlined frame is missing.
+
+Usage:
+    sample_profile.py firmware.elf [capture.log] [--folded out.folded] [--top 30]
+                                   [--addr2line riscv32-esp-elf-addr2line]
+    sample_profile.py --simulate [--rate 1000] [--tolerance 5] [--cc cc]
+"""
+
+import argparse
+import bisect
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+from collections import Counter
+
+ADDR2LINE = "riscv32-esp-elf-addr2line"
+UNKNOWN = "[unknown]"
+
+
+class Capture:
+    """The last complete capture of a serial log."""
+
+    def __init__(self):
+        self.samples = 0
+        self.rate = 0
+        self.elapsed_us = 0
+        self.unit = ""
+        self.handler_avg = 0
+        self.handler_max = 0
+        self.overhead_ppm = 0
+        self.tasks = {}
+        self.pcs = []       # (task index, pc)
+
+
+def parse(lines):
+    capture = None
+    current = None
+    for line in lines:
+        fields = line.strip().split(",")
+        if fields[0] == "X" and len(fields) == 8:
+            current = Capture()
+            current.samples, current.rate, current.elapsed_us = (int(f) for f in fields[1:4])
+            current.unit = fields[4]
+            current.handler_avg, current.handler_max, current.overhead_ppm = (int(f) for f in fields[5:8])
+        elif current is None:
+            continue
+        elif fields[0] == "N" and len(fields) >= 3:
+            current.tasks[int(fields[1])] = ",".join(fields[2:])
+        elif fields[0] == "x":
+            for sample in fields[1:]:
+                task, pc = sample.split(":")
+                current.pcs.append((int(task), int(pc, 16)))
+            if len(current.pcs) >= current.samples:
+                capture, current = current, None
+    return capture
+
+
+class Symbols:
+    """Function symbols of an ELF32 or ELF64 little-endian file."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF" or data[5] != 1:
+            sys.exit(f"{path}: not a little-endian ELF file")
+        wide = data[4] == 2
+        if wide:
+            shoff, = struct.unpack_from("<Q", data, 0x28)
+            shentsize, shnum = struct.unpack_from("<HH", data, 0x3A)
+            section, symbol = struct.Struct("<IIQQQQIIQQ"), struct.Struct("<IBBHQQ")
+        else:
+            shoff, = struct.unpack_from("<I", data, 0x20)
+            shentsize, shnum = struct.unpack_from("<HH", data, 0x2E)
+            section, symbol = struct.Struct("<IIIIIIIIII"), struct.Struct("<IIIBBH")
+
+        sections = [section.unpack_from(data, shoff + i * shentsize) for i in range(shnum)]
+        functions = {}
+        for _, sh_type, _, _, offset, size, link, _, _, entsize in sections:
+            if sh_type != 2:        # SHT_SYMTAB
+                continue
+            strtab = sections[link][4]
+            for j in range(size // entsize):
+                fields = symbol.unpack_from(data, offset + j * entsize)
+                if wide:
+                    st_name, info, _, _, value, st_size = fields
+                else:
+                    st_name, value, st_size, info, _, _ = fields
+                if info & 0xF != 2 or value == 0:     # STT_FUNC
+                    continue
+                end = data.index(b"\0", strtab + st_name)
+                name = data[strtab + st_name:end].decode(errors="replace")
+                if value not in functions or functions[value][0] == 0:
+                    functions[value] = (st_size, name)
+        self.starts = sorted(functions)
+        self.entries = [functions[s] for s in self.starts]
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.starts, pc) - 1
+        if i < 0:
+            return UNKNOWN
+        size, name = self.entries[i]
+        return name if pc < self.starts[i] + max(size, 1) else UNKNOWN
+
+
+def addr2line_frames(tool, elf, pcs):
+    """PC -> [(function, file:line)], outermost first, or None without addr2line."""
+    if shutil.which(tool) is None:
+        return None
+    pcs = sorted(pcs)
+    result = subprocess.run([tool, "-e", elf, "-a", "-f", "-i", "-C"],
+                            input="\n".join(f"{pc:x}" for pc in pcs) + "\n",
+                            capture_output=True, text=True, check=True)
+    out = result.stdout.splitlines()
+    frames = {}
+    k = 0
+    for pc in pcs:
+        while k < len(out) and not out[k].startswith("0x"):
+            k += 1
+        k += 1
+        chain = []
+        while k + 1 < len(out) and not out[k].startswith("0x"):
+            chain.append((out[k], os.path.basename(out[k + 1].split(" ")[0])))
+            k += 2
+        frames[pc] = list(reversed(chain))
+    return frames
+
+
+def symbolize(capture, elf, tool):
+    """Stack per sample: (task, [function, ..., innermost]), and source line per PC."""
+    symbols = Symbols(elf)
+    pcs = {pc for _, pc in capture.pcs}
+    frames = addr2line_frames(tool, elf, pcs)
+    if frames is None:
+        print(f"{tool} not found; functions only, no inlining or lines", file=sys.stderr)
+
+    stacks = []
+    where = {}
+    for task, pc in capture.pcs:
+        function = symbols.lookup(pc)
+        chain = [function]
+        if frames and frames.get(pc):
+            # Debug info names the function and what was inlined into it,
+            # demangled; the symbol table covers code without debug info
+            inlined = [f for f, _ in frames[pc] if f != "??"]
+            if inlined and function != UNKNOWN:
+                chain = inlined
+            if not frames[pc][-1][1].startswith("??"):
+                where[pc] = frames[pc][-1][1]
+        stacks.append((capture.tasks.get(task, f"task{task}"), chain))
+    return stacks, where
+
+
+def report(capture, stacks, where, top):
+    n = len(stacks)
+    print(f"{n} samples at {capture.rate} Hz over {capture.elapsed_us / 1e6:.2f} s")
+    print(f"profiler handler: {capture.handler_avg} {capture.unit} average, {capture.handler_max} max, "
+          f"{capture.overhead_ppm / 1e4:.3f}% of the CPU (interrupt entry and exit not included)")
+
+    print("\nTask             samples      %")
+    for task, count in Counter(task for task, _ in stacks).most_common():
+        print(f"{task:16} {count:7} {100.0 * count / n:6.1f}")
+
+    # Self samples per innermost function, and total samples per function
+    # anywhere in the chain, counting a function inlined into itself once
+    self_counts = Counter(chain[-1] for _, chain in stacks)
+    total_counts = Counter(function for _, chain in stacks for function in set(chain))
+    lines = {}
+    for (task, chain), (_, pc) in zip(stacks, capture.pcs):
+        if pc in where:
+            lines.setdefault(chain[-1], Counter())[where[pc]] += 1
+
+    print(f"\n   self%  total%  samples  function")
+    for function, count in self_counts.most_common(top):
+        hot = lines.get(function)
+        location = f"  ({hot.most_common(1)[0][0]})" if hot else ""
+        print(f"  {100.0 * count / n:6.1f}  {100.0 * total_counts.get(function, 0) / n:6.1f}  {count:7}  "
+              f"{function}{location}")
+
+
+def write_folded(path, stacks):
+    folded = Counter(";".join([task] + chain) for task, chain in stacks)
+    with open(path, "w") as f:
+        for stack, count in sorted(folded.items()):
+            f.write(f"{stack} {count}\n")
+
+
+# Host simulation
+
+# A workload with known shares of CPU time, sampled the way the device is:
+# a periodic timer interrupts it and the handler records the interrupted PC
+# and the "task" running. Prints the capture in the device's dump format.
+HARNESS = r"""#define _GNU_SOURCE
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+
+#define MAX_SAMPLES 100000
+
+static const char* task_names[] = {"sensor_task", "IDLE"};
+static volatile int current_task;
+static uintptr_t sample_pc[MAX_SAMPLES];
+static unsigned char sample_task[MAX_SAMPLES];
+static volatile int count;
+static uint64_t handler_total, handler_max;
+static volatile float sink;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void on_sample(int sig, siginfo_t* info, void* context)
+{
+    uint64_t begin = now_ns();
+    ucontext_t* uc = context;
+    if (count < MAX_SAMPLES) {
+#if defined(__x86_64__)
+        sample_pc[count] = uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+        sample_pc[count] = uc->uc_mcontext.pc;
+#else
+#error "no PC in ucontext for this host"
+#endif
+        sample_task[count++] = current_task;
+    }
+    uint64_t cost = now_ns() - begin;
+    handler_total += cost;
+    if (cost > handler_max) handler_max = cost;
+}
+
+static inline __attribute__((always_inline)) float dot(const float* a, const float* b, int n)
+{
+    float s = 0;
+    for (int i = 0; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+
+// Run for ns nanoseconds, checking the clock every few hundred iterations
+__attribute__((noinline)) void compensate(uint64_t ns)
+{
+    static float w[64], x[64];
+    uint64_t end = now_ns() + ns;
+    do {
+        for (int k = 0; k < 50; k++) {
+            x[k & 63] = dot(w, x, 64) * 0.5f + 1.0f;
+        }
+    } while (now_ns() < end);
+    sink = x[0];
+}
+
+__attribute__((noinline)) void encode(uint64_t ns)
+{
+    static char buf[32];
+    uint64_t end = now_ns() + ns;
+    unsigned v = 12345;
+    do {
+        for (int k = 0; k < 200; k++) {
+            unsigned u = v++;
+            int i = 31;
+            do { buf[--i] = '0' + u % 10; u /= 10; } while (u && i);
+        }
+    } while (now_ns() < end);
+    sink = buf[30];
+}
+
+__attribute__((noinline)) void idle_wait(uint64_t ns)
+{
+    uint64_t end = now_ns() + ns;
+    do {
+        for (volatile int k = 0; k < 500; k++) {
+        }
+    } while (now_ns() < end);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned rate = argc > 1 ? (unsigned)atoi(argv[1]) : 1000;
+    unsigned samples = argc > 2 ? (unsigned)atoi(argv[2]) : 2048;
+    if (samples > MAX_SAMPLES) samples = MAX_SAMPLES;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = on_sample;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigaction(SIGPROF, &sa, NULL);
+
+    timer_t timer;
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo = SIGPROF;
+    timer_create(CLOCK_MONOTONIC, &sev, &timer);
+    struct itimerspec period = {{0, 1000000000L / rate}, {0, 1000000000L / rate}};
+
+    uint64_t start = now_ns();
+    timer_settime(timer, 0, &period, NULL);
+    // 60% compensate, 30% encode, 10% idle, in 10 ms rounds
+    while ((unsigned)count < samples) {
+        current_task = 0;
+        compensate(6000000);
+        encode(3000000);
+        current_task = 1;
+        idle_wait(1000000);
+    }
+    struct itimerspec stop = {{0, 0}, {0, 0}};
+    timer_settime(timer, 0, &stop, NULL);
+    uint64_t elapsed = now_ns() - start;
+
+    int n = count < (int)samples ? count : (int)samples;
+    printf("X,%d,%u,%llu,ns,%llu,%llu,%llu\n", n, rate, (unsigned long long)(elapsed / 1000),
+           (unsigned long long)(handler_total / count), (unsigned long long)handler_max,
+           (unsigned long long)(handler_total * 1000000 / elapsed));
+    for (int i = 0; i < 2; i++) printf("N,%d,%s\n", i, task_names[i]);
+    for (int k = 0; k < n; k += 8) {
+        printf("x");
+        for (int j = k; j < n && j < k + 8; j++) printf(",%u:%lx", sample_task[j], (unsigned long)sample_pc[j]);
+        printf("\n");
+    }
+    return 0;
+}
+"""
+
+EXPECTED = {"compensate": 60.0, "encode": 30.0, "idle_wait": 10.0}
+
+
+def simulate(args):
+    with tempfile.TemporaryDirectory() as tmp:
+        src = os.path.join(tmp, "workload.c")
+        exe = os.path.join(tmp, "workload")
+        with open(src, "w") as f:
+            f.write(HARNESS)
+        subprocess.run([args.cc, "-O2", "-g", "-no-pie", "-Wall", src, "-o", exe, "-lrt"], check=True)
+        out = subprocess.run([exe, str(args.rate), str(args.samples)], capture_output=True, text=True,
+                             check=True).stdout
+
+        capture = parse(out.splitlines())
+        stacks, where = symbolize(capture, exe, args.addr2line or "addr2line")
+        report(capture, stacks, where, args.top)
+        if args.folded:
+            write_folded(args.folded, stacks)
+
+    n = len(stacks)
+    totals = Counter(chain[0] for _, chain in stacks)
+    failed = False
+    print("\nfunction      expected  measured")
+    for function, share in EXPECTED.items():
+        measured = 100.0 * totals.get(function, 0) / n
+        ok = abs(measured - share) <= args.tolerance
+        failed |= not ok
+        print(f"{function:12} {share:8.1f}  {measured:8.1f}  {'ok' if ok else 'FAIL'}")
+    inlined = any(chain[-1] == "dot" and chain[0] == "compensate" for _, chain in stacks)
+    print(f"inlined frame compensate;dot: {'found' if inlined else 'MISSING'}")
+    return 1 if failed or not inlined else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf", nargs="?", help="firmware ELF of the profiled build")
+    parser.add_argument("capture", nargs="?", help="serial log with the capture (default stdin)")
+    parser.add_argument("--folded", help="write folded stacks here")
+    parser.add_argument("--top", type=int, default=30, help="functions in the flat profile")
+    parser.add_argument("--addr2line", help=f"addr2line of the ELF's toolchain (default {ADDR2LINE})")
+    parser.add_argument("--simulate", action="store_true", help="profile a host workload")
+    parser.add_argument("--rate", type=int, default=1000, help="simulated sampling rate")
+    parser.add_argument("--samples", type=int, default=2048, help="simulated samples")
+    parser.add_argument("--tolerance", type=float, default=5.0, help="allowed error in percentage points")
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="host C compiler")
+    args = parser.parse_args()
+
+    if args.simulate:
+        sys.exit(simulate(args))
+    if not args.elf:
+        parser.error("the firmware ELF is required")
+
+    if args.capture:
+        with open(args.capture, errors="replace") as f:
+            capture = parse(f)
+    else:
+        capture = parse(sys.stdin)
+    if capture is None:
+        sys.exit("no complete capture (\"X,\" line and its samples) in the log")
+
+    stacks, where = symbolize(capture, args.elf, args.addr2line or ADDR2LINE)
+    report(capture, stacks, where, args.top)
+    if args.folded:
+        write_folded(args.folded, stacks)
+
+
+if __name__ == "__main__":
+    main()
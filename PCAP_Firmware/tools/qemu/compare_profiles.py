@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Compare per-stage profiles captured from QEMU (or hardware) serial logs.
+
+Reads the "P,<frames>,<unit>,<acq_avg>,<acq_max>,<comp_avg>,<comp_max>,
+<tx_avg>,<tx_max>,<cls_avg>,<cls_max>" lines printed by stage_profiler.c,
+drops the first report (boot/warm-up), and prints the per-frame cost of
+each stage. Logs from builds before the classify stage existed load with
+that stage at zero.
+Given two logs it prints the change from the baseline to the candidate.
+
+Usage:
+    compare_profiles.py serial.log
+    compare_profiles.py baseline.log candidate.log
+"""
+
+import sys
+
+STAGES = ("acquire", "compensate", "transmit", "classify")
+MIN_STAGES = 3
+
+
+def load_profile(path):
+    """Return (unit, {stage: (avg, max)}) averaged over all reports."""
+    reports = []
+    unit = None
+    with open(path, errors="replace") as f:
+        for line in f:
+            fields = line.strip().split(",")
+            stages = (len(fields) - 3) // 2
+            if (fields[0] != "P" or len(fields) != 3 + 2 * stages
+                    or not MIN_STAGES <= stages <= len(STAGES)):
+                continue
+            unit = fields[2]
+            values = [int(v) for v in fields[3:]]
+            values += [0] * (2 * len(STAGES) - len(values))
+            reports.append((int(fields[1]), values))
+
+    if len(reports) > 1:
+        reports = reports[1:]
+    if not reports:
+        sys.exit(f"{path}: no profile reports found")
+
+    total_frames = sum(frames for frames, _ in reports)
+    profile = {}
+    for i, stage in enumerate(STAGES):
+        avg = sum(frames * v[2 * i] for frames, v in reports) / total_frames
+        worst = max(v[2 * i + 1] for _, v in reports)
+        profile[stage] = (avg, worst)
+    return unit, profile
+
+
+def main(argv):
+    if len(argv) not in (2, 3):
+        sys.exit(__doc__)
+
+    unit, base = load_profile(argv[1])
+    if len(argv) == 2:
+        print(f"{'stage':<12}{'avg ' + unit:>16}{'max ' + unit:>16}")
+        for stage in STAGES:
+            avg, worst = base[stage]
+            print(f"{stage:<12}{avg:>16.0f}{worst:>16}")
+        return
+
+    cand_unit, cand = load_profile(argv[2])
+    if cand_unit != unit:
+        sys.exit(f"unit mismatch: {unit} vs {cand_unit}")
+
+    print(f"{'stage':<12}{'baseline':>14}{'candidate':>14}{'change':>10}   ({unit}/frame)")
+    for stage in STAGES:
+        b = base[stage][0]
+        c = cand[stage][0]
+        change = (c - b) / b * 100.0 if b else 0.0
+        print(f"{stage:<12}{b:>14.0f}{c:>14.0f}{change:>9.1f}%")
+
+
+if __name__ == "__main__":
+    main(sys.argv)
@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+#
+# Build the firmware for the QEMU esp32c3 machine and run it.
+#
+# The image is the real firmware built with PCAP_QEMU_BUILD=1: the PCAP04
+# chips and the mux are served by src/pcap_emulator.c, BLE is not started,
+# and sensor_task prints per-stage profiles ("P,..." lines) counted in
+# instructions (QEMU runs with -icount shift=0, 1 ns per instruction).
+# A sampling profile of the first seconds follows ("X,"/"N,"/"x," lines):
+#   tools/profiler/sample_profile.py build_qemu/pcap_firmware.elf build_qemu/serial.log
+#
+# Usage: tools/qemu/run_qemu.sh [seconds] [log_file]
+#   seconds   Run time before QEMU is stopped (default 30)
+#   log_file  Serial output capture (default build_qemu/serial.log)
+#
+# Requires an ESP-IDF environment (idf.py, esptool.py) and Espressif's
+# qemu-system-riscv32 on PATH (idf_tools.py install qemu-riscv32).
+
+set -euo pipefail
+
+PROJECT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BUILD_DIR="${PROJECT_DIR}/build_qemu"
+RUN_SECONDS="${1:-30}"
+LOG_FILE="${2:-${BUILD_DIR}/serial.log}"
+
+cd "${PROJECT_DIR}"
+
+idf.py -B "${BUILD_DIR}" \
+    -DPCAP_QEMU=1 \
+    -DSDKCONFIG="${BUILD_DIR}/sdkconfig" \
+    -DSDKCONFIG_DEFAULTS="sdkconfig.defaults;sdkconfig.qemu" \
+    build
+
+# QEMU boots from a single full-size flash image
+(cd "${BUILD_DIR}" && esptool.py --chip esp32c3 merge_bin \
+    --fill-flash-size 4MB -o flash_image.bin @flash_args)
+
+# Blank eFuse block (revision v0.0, matching sdkconfig.qemu)
+if [ ! -f "${BUILD_DIR}/qemu_efuse.bin" ]; then
+    dd if=/dev/zero of="${BUILD_DIR}/qemu_efuse.bin" bs=1 count=1024 status=none
+fi
+
+timeout --foreground "${RUN_SECONDS}" qemu-system-riscv32 \
+    -nographic \
+    -machine esp32c3 \
+    -icount shift=0 \
+    -drive file="${BUILD_DIR}/flash_image.bin",if=mtd,format=raw \
+    -drive file="${BUILD_DIR}/qemu_efuse.bin",if=none,format=raw,id=efuse \
+    -global driver=nvram.esp32c3.efuse,property=drive,value=efuse \
+    -serial mon:stdio | tee "${LOG_FILE}" || true
+
+echo "Serial log: ${LOG_FILE}"
@@ -0,0 +1,272 @@
+#!/usr/bin/env python3
+"""Replay a recorded raw capture through the device pipeline.
+
+The capture is the serial log of a device in host compensation mode
+("K,4,1"): its "O," offset lines and "R," raw lines are sent back to a
+REPLAY_MODE build as "I,O," and "I," lines (src/replay_input.h). The
+device runs them through the unchanged pipeline, one frame per sample
+period, so NN and encoding costs can be measured on the board with the
+same input every run.
+
+The device acknowledges played frames ("A,<frames>"), and the tool keeps
+at most REPLAY_QUEUE_FRAMES frames unacknowledged. Everything else the
+device prints (data lines, "L," latency records with LATENCY_PROBE_MODE)
+goes to --out. At the end the tool prints the device's stage profile of
+the replayed frames and its replay counters.
+
+--simulate runs src/replay_input.c, built with the host C compiler,
+against a simulated device clock and a host link with random stalls
+instead. Each played frame must equal the captured frame, in order and bit
+for bit. The exit status is 1 on any mismatch or lost frame.
+
+Usage:
+    hil_replay.py capture.log --port /dev/ttyACM0 [--baud 115200] [--out outputs.log]
+    hil_replay.py capture.log --simulate [--period-ms 10] [--stall-ms 30] [--seed 1] [--cc cc]
+"""
+
+import argparse
+import ctypes
+import heapq
+import os
+import random
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+SRC_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src")
+
+NUM_CHIPS = 8
+SENSORS_PER_CHIP = 6
+
+STAGES = ("acquire", "compensate", "transmit", "classify")
+STATUS = ("idle", "buffering", "frame", "underrun", "ended")
+
+
+def read_config():
+    """REPLAY_* constants of replay_input.h."""
+    config = {}
+    with open(os.path.join(SRC_DIR, "replay_input.h")) as f:
+        for m in re.finditer(r"#define (REPLAY_\w+)\s+(\d+)", f.read()):
+            config[m.group(1)] = int(m.group(2))
+    return config
+
+
+def load_capture(path):
+    """Replay lines of a capture grouped per frame, and the frames' raw bits.
+
+    Offset lines travel with the frame after them; the end line with the last.
+    """
+    groups = []
+    frames = []
+    offsets = []
+    last_chip = None
+    with open(path, errors="replace") as f:
+        for raw in f:
+            fields = raw.strip().split(",")
+            if fields[0] == "O" and len(fields) == 2 + SENSORS_PER_CHIP:
+                offsets.append("I,O," + ",".join(fields[1:]))
+            elif fields[0] == "R" and len(fields) == 3 + SENSORS_PER_CHIP:
+                chip = int(fields[1])
+                if last_chip is None or chip <= last_chip:
+                    groups.append([])
+                    frames.append({})
+                groups[-1] += offsets + ["I," + ",".join([fields[1]] + fields[3:])]
+                offsets = []
+                frames[-1][chip] = tuple(int(v, 16) for v in fields[3:])
+                last_chip = chip
+    if groups:
+        groups[-1].append("I,E")
+    return groups, frames
+
+
+class ReplayFrame(ctypes.Structure):
+    _fields_ = [("chips", ctypes.c_uint8),
+                ("raw", (ctypes.c_float * SENSORS_PER_CHIP) * NUM_CHIPS)]
+
+
+class ReplayStats(ctypes.Structure):
+    _fields_ = [("frames", ctypes.c_uint32), ("underruns", ctypes.c_uint32),
+                ("dropped", ctypes.c_uint32), ("malformed", ctypes.c_uint32)]
+
+
+def build(cc, out_dir):
+    lib_path = os.path.join(out_dir, "libreplay.so")
+    subprocess.run([cc, "-O2", "-shared", "-fPIC", "-Wall", "-Wextra", "-I", SRC_DIR,
+                    os.path.join(SRC_DIR, "replay_input.c"), "-o", lib_path], check=True)
+    lib = ctypes.CDLL(lib_path)
+    lib.replay_input_reset.restype = None
+    lib.replay_input_line.argtypes = [ctypes.c_char_p]
+    lib.replay_input_line.restype = ctypes.c_bool
+    lib.replay_input_next.argtypes = [ctypes.POINTER(ReplayFrame)]
+    lib.replay_input_next.restype = ctypes.c_int
+    lib.replay_input_ack_due.restype = ctypes.c_uint32
+    lib.replay_input_get_stats.argtypes = [ctypes.POINTER(ReplayStats)]
+    lib.replay_input_get_stats.restype = None
+    return lib
+
+
+def frame_bits(frame):
+    """{chip: raw values as float bits} of a played frame."""
+    out = {}
+    for chip in range(NUM_CHIPS):
+        if frame.chips & (1 << chip):
+            out[chip] = tuple(ctypes.c_uint32.from_buffer_copy(ctypes.c_float(v)).value
+                              for v in frame.raw[chip])
+    return out
+
+
+def simulate(args, groups, frames, config):
+    """Play the capture through replay_input.c with a simulated link and clock."""
+    rng = random.Random(args.seed)
+    period_us = args.period_ms * 1000
+    link_us = args.link_ms * 1000
+    window = config["REPLAY_QUEUE_FRAMES"]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        lib = build(args.cc, tmp)
+        lib.replay_input_reset()
+
+        # Events: (time, order, kind, payload). The host sends frames as the
+        # acknowledgements allow, with random stalls, over a fixed-delay link.
+        events = []
+        order = 0
+
+        def push(t, kind, payload=None):
+            nonlocal order
+            heapq.heappush(events, (t, order, kind, payload))
+            order += 1
+
+        sent = 0
+        acked = 0
+        stalled_until = 0
+
+        def host_send(now):
+            nonlocal sent, stalled_until
+            while sent < len(groups) and sent - acked < window and stalled_until <= now:
+                if rng.random() < args.stall_prob:
+                    stalled_until = now + int(rng.expovariate(1.0 / (args.stall_ms * 1000)))
+                    push(stalled_until, "host")
+                    return
+                push(now + link_us, "lines", groups[sent])
+                sent += 1
+
+        push(0, "host")
+        push(period_us, "tick")
+        frame = ReplayFrame()
+        played = []
+        status_counts = [0] * len(STATUS)
+        ended = False
+        while events and not ended:
+            now, _, kind, payload = heapq.heappop(events)
+            if kind == "host":
+                host_send(now)
+            elif kind == "lines":
+                for line in payload:
+                    lib.replay_input_line(line.encode())
+            elif kind == "ack":
+                acked = max(acked, payload)
+                host_send(now)
+            elif kind == "tick":
+                status = lib.replay_input_next(ctypes.byref(frame))
+                status_counts[status] += 1
+                if STATUS[status] == "frame":
+                    played.append(frame_bits(frame))
+                    ack = lib.replay_input_ack_due()
+                    if ack:
+                        push(now + link_us, "ack", ack)
+                ended = STATUS[status] == "ended"
+                push(now + period_us, "tick")
+
+        stats = ReplayStats()
+        lib.replay_input_get_stats(ctypes.byref(stats))
+
+    mismatches = sum(1 for a, b in zip(played, frames) if a != b)
+    lost = len(frames) - len(played)
+    print(f"frames captured {len(frames)}, played {len(played)}, mismatched {mismatches}")
+    print(f"underruns {stats.underruns}, dropped {stats.dropped}, malformed {stats.malformed}")
+    print("device ticks: " + ", ".join(f"{STATUS[s]} {n}" for s, n in enumerate(status_counts) if n))
+    return 1 if mismatches or lost or stats.dropped or stats.malformed else 0
+
+
+def replay_device(args, groups, config):
+    """Stream the capture to a REPLAY_MODE device and collect what it prints."""
+    import serial
+
+    window = config["REPLAY_QUEUE_FRAMES"]
+    out = open(args.out, "w") if args.out else None
+    profiles = []
+    summary = None
+    sent = 0
+    acked = 0
+
+    with serial.Serial(args.port, args.baud, timeout=0.01) as port:
+        buf = b""
+        last_rx = time.monotonic()
+        while summary is None:
+            while sent < len(groups) and sent - acked < window:
+                port.write("".join(line + "\n" for line in groups[sent]).encode())
+                sent += 1
+
+            buf += port.read(4096)
+            while b"\n" in buf:
+                raw, buf = buf.split(b"\n", 1)
+                text = raw.decode(errors="replace").strip()
+                last_rx = time.monotonic()
+                if text.startswith("A,"):
+                    acked = int(text[2:])
+                elif text.startswith("P,"):
+                    profiles.append(text)
+                elif text.startswith("Y,"):
+                    summary = [int(v) for v in text[2:].split(",")]
+                elif out:
+                    out.write(text + "\n")
+            if time.monotonic() - last_rx > args.timeout:
+                print("device stopped responding", file=sys.stderr)
+                return 1
+
+    if out:
+        out.close()
+    for text in profiles:
+        fields = text.split(",")
+        n, unit = int(fields[1]), fields[2]
+        values = [int(v) for v in fields[3:]]
+        print(f"profile over {n} frames ({unit} per frame):")
+        for s, name in enumerate(STAGES):
+            print(f"  {name:<12}avg {values[2 * s]:>10}  max {values[2 * s + 1]:>10}")
+    frames, underruns, dropped, malformed = summary
+    print(f"replayed {frames} frames, underruns {underruns}, dropped {dropped}, malformed {malformed}")
+    return 1 if dropped or malformed else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("capture", help="serial log with \"O,\" and \"R,\" lines")
+    parser.add_argument("--port", help="serial port of a REPLAY_MODE device")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--out", help="write the device's output lines here")
+    parser.add_argument("--timeout", type=float, default=5.0, help="seconds of device silence to give up")
+    parser.add_argument("--simulate", action="store_true", help="run replay_input.c on the host")
+    parser.add_argument("--period-ms", type=int, default=10, help="simulated sample period")
+    parser.add_argument("--link-ms", type=int, default=2, help="simulated one-way link delay")
+    parser.add_argument("--stall-ms", type=float, default=30.0, help="mean simulated host stall")
+    parser.add_argument("--stall-prob", type=float, default=0.01, help="chance of a stall per frame sent")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--cc", default=os.environ.get("CC", "cc"), help="host C compiler")
+    args = parser.parse_args()
+
+    config = read_config()
+    groups, frames = load_capture(args.capture)
+    if not frames:
+        sys.exit(f"{args.capture}: no \"R,\" lines")
+
+    if args.simulate:
+        sys.exit(simulate(args, groups, frames, config))
+    if not args.port:
+        sys.exit("give --port, or --simulate")
+    sys.exit(replay_device(args, groups, config))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,282 @@
+#!/usr/bin/env python3
+"""Device-to-host clock mapping from NTP-style time sync exchanges.
+
+The host sends BLE_CTRL_TIME_SYNC with a token ("K,8,<token>" on serial,
+[0x08, token] on the control characteristic) at t1 and receives
+"U,<token>,<rx_us>,<tx_us>" at t4. rx_us (t2) and tx_us (t3) are the
+device's esp_timer when the command arrived and when the reply left, so the
+round trip without device processing is (t4 - t1) - (t3 - t2), and the
+exchange pairs device time (t2 + t3) / 2 with host time (t1 + t4) / 2.
+
+ClockSync keeps a window of exchanges and drops the slower half by round
+trip: a delayed request or reply (serial polling, a BLE connection event)
+shifts its pair by up to half the extra delay. A least-squares line through
+the rest gives the offset and the drift of the device clock, and its
+residuals the error of the mapping. to_host() is one multiply-add, so it
+can map every frame timestamp ("Q,", "L,", FRAME_OP_CODE) as it arrives.
+
+The classes work as a library too: call request() and response() from any
+transport, or add() with four timestamps, and to_host() for each frame.
+
+--simulate runs the estimator against a simulated drifting device clock and
+a link with random, asymmetric delays, and checks the mapping error.
+
+Usage:
+    clock_sync.py serial /dev/ttyACM0 [--baud 115200] [--seconds 60] [--interval 1.0]
+    clock_sync.py ble [PCAP-Sensor] [--seconds 60] [--interval 1.0]
+    clock_sync.py --simulate [--drift-ppm 40] [--seconds 600] [--seed 1]
+"""
+
+import argparse
+import asyncio
+import random
+import sys
+import time
+from collections import deque
+
+BLE_CTRL_TIME_SYNC = 0x08
+WINDOW = 64                 # Exchanges the mapping is fitted to
+KEEP_FRACTION = 0.5         # Fastest share of the window by round trip
+MIN_DRIFT_SPAN_US = 10_000_000  # Device time the kept exchanges must span to fit drift
+REPORT_INTERVAL_S = 10.0
+
+STATUS_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26a9"
+CONTROL_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26aa"
+
+
+def host_us():
+    return time.monotonic_ns() // 1000
+
+
+class Unwrap:
+    """Extend the device's wrapping 32-bit microsecond counter."""
+
+    def __init__(self, bits=32):
+        self.bits = bits
+        self.last = None
+
+    def __call__(self, value):
+        if self.last is None:
+            self.last = value
+            return value
+        delta = (value - self.last) & ((1 << self.bits) - 1)
+        if delta >= 1 << (self.bits - 1):
+            delta -= 1 << self.bits
+        self.last += delta
+        return self.last
+
+
+class ClockSync:
+    """Device-to-host clock mapping with drift, from time sync exchanges."""
+
+    def __init__(self, window=WINDOW, keep=KEEP_FRACTION, clock=host_us):
+        self.exchanges = deque(maxlen=window)     # (round trip, device mid, host mid)
+        self.keep = keep
+        self.clock = clock
+        self.unwrap = Unwrap()
+        self.pending = {}
+        self.token = 0
+        self.device_ref = 0
+        self.host_ref = 0
+        self.rate = 1.0
+        self.residual_us = None
+        self.bound_us = None
+        self.used = 0
+
+    def device_time(self, raw_us):
+        """Unwrap a 32-bit device timestamp (sync replies and frames alike)."""
+        return self.unwrap(raw_us)
+
+    def request(self):
+        """Start an exchange; returns the token to send."""
+        self.token = (self.token + 1) & 0xFF
+        self.pending[self.token] = self.clock()
+        return self.token
+
+    def response(self, token, rx_us, tx_us):
+        """Complete an exchange from a "U," reply; False if unknown."""
+        t4 = self.clock()
+        t1 = self.pending.pop(token, None)
+        if t1 is None:
+            return False
+        self.add(t1, self.device_time(rx_us), self.device_time(tx_us), t4)
+        return True
+
+    def add(self, t1, t2, t3, t4):
+        """Add an exchange: host send, device receive, device send, host receive."""
+        round_trip = (t4 - t1) - (t3 - t2)
+        self.exchanges.append((round_trip, (t2 + t3) / 2, (t1 + t4) / 2))
+        self._fit()
+
+    def _fit(self):
+        ordered = sorted(self.exchanges)
+        kept = ordered[:max(2, int(len(ordered) * self.keep))]
+        n = len(kept)
+        d_mean = sum(e[1] for e in kept) / n
+        h_mean = sum(e[2] for e in kept) / n
+        sdd = sum((e[1] - d_mean) ** 2 for e in kept)
+        sdh = sum((e[1] - d_mean) * (e[2] - h_mean) for e in kept)
+        span = max(e[1] for e in kept) - min(e[1] for e in kept)
+
+        self.rate = sdh / sdd if span >= MIN_DRIFT_SPAN_US and sdd > 0 else 1.0
+        self.device_ref = d_mean
+        self.host_ref = h_mean
+        residuals = [e[2] - self.to_host(e[1]) for e in kept]
+        self.residual_us = (sum(r * r for r in residuals) / n) ** 0.5
+        self.bound_us = ordered[0][0] / 2
+        self.used = n
+
+    def ready(self):
+        return bool(self.exchanges)
+
+    def to_host(self, device_us):
+        """Host time of an unwrapped device timestamp."""
+        return self.host_ref + (device_us - self.device_ref) * self.rate
+
+    def offset_us(self):
+        """host - device, at the mean device time of the kept exchanges."""
+        return self.host_ref - self.device_ref
+
+    def drift_ppm(self):
+        """How much faster the host clock runs than the device's."""
+        return (self.rate - 1.0) * 1e6
+
+    def status(self):
+        return (f"offset {self.offset_us():.0f} us, drift {self.drift_ppm():+.2f} ppm, "
+                f"residual rms {self.residual_us:.1f} us, best round trip/2 {self.bound_us:.0f} us, "
+                f"{self.used}/{len(self.exchanges)} exchanges")
+
+
+def handle_line(sync, text):
+    fields = text.strip().split(",")
+    if fields[0] == "U" and len(fields) == 4:
+        try:
+            return sync.response(int(fields[1]), int(fields[2]), int(fields[3]))
+        except ValueError:
+            pass
+    return False
+
+
+def run_serial(args, sync):
+    import serial
+
+    deadline = time.monotonic() + args.seconds
+    next_sync = 0.0
+    next_report = time.monotonic() + REPORT_INTERVAL_S
+    with serial.Serial(args.port, args.baud, timeout=0.01) as port:
+        while time.monotonic() < deadline:
+            if time.monotonic() >= next_sync:
+                port.write(f"K,{BLE_CTRL_TIME_SYNC},{sync.request()}\n".encode())
+                next_sync = time.monotonic() + args.interval
+            handle_line(sync, port.readline().decode(errors="replace"))
+            if time.monotonic() >= next_report and sync.ready():
+                print(sync.status())
+                next_report = time.monotonic() + REPORT_INTERVAL_S
+
+
+async def run_ble(args, sync):
+    from bleak import BleakClient, BleakScanner
+
+    device = await BleakScanner.find_device_by_name(args.name, timeout=10.0)
+    if device is None:
+        sys.exit(f"{args.name} not found")
+
+    def on_status(_, data):
+        handle_line(sync, data.decode(errors="replace"))
+
+    async with BleakClient(device) as client:
+        await client.start_notify(STATUS_UUID, on_status)
+        deadline = time.monotonic() + args.seconds
+        next_report = time.monotonic() + REPORT_INTERVAL_S
+        while time.monotonic() < deadline:
+            await client.write_gatt_char(CONTROL_UUID, bytes((BLE_CTRL_TIME_SYNC, sync.request())),
+                                         response=False)
+            await asyncio.sleep(args.interval)
+            if time.monotonic() >= next_report and sync.ready():
+                print(sync.status())
+                next_report = time.monotonic() + REPORT_INTERVAL_S
+
+
+def simulate(args):
+    """Sync against a drifting device clock over a jittery, asymmetric link."""
+    rng = random.Random(args.seed)
+    rate = 1.0 + args.drift_ppm * 1e-6      # Device microseconds per host microsecond
+    device_start = (1 << 32) - 30_000_000   # Wraps 30 s in
+    host_start = 1_000_000_000
+
+    def device_at(host):
+        return device_start + (host - host_start) * rate
+
+    def one_way():
+        # Base latency, jitter, and now and then a long stall (polling, connection events)
+        delay = 400 + rng.expovariate(1 / 300)
+        if rng.random() < 0.3:
+            delay += rng.uniform(0, 20_000)
+        return delay
+
+    sync = ClockSync(clock=None)
+    errors = []
+    host = host_start
+    interval = int(args.interval * 1e6)
+    while host < host_start + args.seconds * 1e6:
+        t1 = host
+        t2 = device_at(t1 + one_way())
+        t3 = t2 + rng.uniform(20, 200)
+        t4 = host_start + (t3 - device_start) / rate + one_way()
+        sync.add(t1, sync.device_time(int(t2) & 0xFFFFFFFF), sync.device_time(int(t3) & 0xFFFFFFFF), t4)
+
+        # Frames between exchanges, mapped with the current fit
+        for k in range(10):
+            frame_host = t4 + k * interval / 10
+            frame_device = sync.device_time(int(device_at(frame_host)) & 0xFFFFFFFF)
+            if host - host_start > args.settle * 1e6:
+                errors.append(abs(sync.to_host(frame_device) - frame_host))
+        host += interval
+
+    errors.sort()
+    true_ppm = (1 / rate - 1) * 1e6
+    print(sync.status())
+    print(f"true drift {true_ppm:+.2f} ppm, estimated {sync.drift_ppm():+.2f} ppm")
+    if not errors:
+        sys.exit("--seconds must exceed --settle")
+    print(f"frame mapping error over {len(errors)} frames: p50 {errors[len(errors) // 2]:.0f} us, "
+          f"p99 {errors[int(len(errors) * 0.99)]:.0f} us, max {errors[-1]:.0f} us")
+    return 1 if errors[-1] > args.max_error_us else 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--simulate", action="store_true", help="run against a simulated device")
+    parser.add_argument("--drift-ppm", type=float, default=40.0, help="simulated device clock drift")
+    parser.add_argument("--settle", type=float, default=60.0, help="simulated seconds before errors count")
+    parser.add_argument("--max-error-us", type=float, default=1000.0, help="simulated error that fails")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--seconds", type=float, help="run time (default 60, simulated 600)")
+    parser.add_argument("--interval", type=float, default=1.0, help="seconds between exchanges")
+    sub = parser.add_subparsers(dest="transport")
+    ser = sub.add_parser("serial")
+    ser.add_argument("port")
+    ser.add_argument("--baud", type=int, default=115200)
+    ble = sub.add_parser("ble")
+    ble.add_argument("name", nargs="?", default="PCAP-Sensor")
+    args = parser.parse_args()
+
+    if args.simulate:
+        args.seconds = args.seconds or 600.0
+        sys.exit(simulate(args))
+    args.seconds = args.seconds or 60.0
+    sync = ClockSync()
+    if args.transport == "serial":
+        run_serial(args, sync)
+    elif args.transport == "ble":
+        asyncio.run(run_ble(args, sync))
+    else:
+        sys.exit("give a transport, or --simulate")
+
+    if not sync.ready():
+        sys.exit("no time sync replies; does the device answer BLE_CTRL_TIME_SYNC?")
+    print(sync.status())
+
+
+if __name__ == "__main__":
+    main()
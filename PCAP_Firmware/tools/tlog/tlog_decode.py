@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+"""Decode the framed serial stream of a TOKEN_LOG_MODE build.
+
+Frames are 0x00-delimited COBS blocks holding channel, payload and CRC-8
+(see src/serial_stream.h). Data lines (channel 0) are written to stdout
+unchanged, so existing CSV parsers can read this tool's output. Tokenized
+log records (channel 1) are formatted with the format strings and tags
+recovered from the firmware ELF and written to stderr, as is plain text
+from other components (channel 2).
+
+Usage:
+    tlog_decode.py firmware.elf [capture.bin]    decode a capture (default stdin)
+    tlog_decode.py --dict firmware.elf [out.json]
+                                                 write the token dictionary
+    tlog_decode.py tokens.json [capture.bin]     decode with a saved dictionary
+
+A saved dictionary only knows the tags whose TAG variable survived in the
+symbol table; decoding with the ELF resolves every tag.
+
+With a serial port, e.g.: stty -F /dev/ttyACM0 raw 115200 &&
+    tlog_decode.py build/pcap_firmware.elf /dev/ttyACM0
+"""
+
+import json
+import re
+import struct
+import sys
+
+CH_DATA, CH_LOG, CH_TEXT = 0, 1, 2
+LEVELS = "NEWIDV"
+HEADER = struct.Struct("<BIII")
+SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(hh|h|ll|l|z|j|t|L)?([diuxXocpfFeEgGaAs%])")
+
+
+class Elf:
+    """Just enough of ELF32 to read strings and symbols."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            sys.exit(f"{path}: not an ELF32 file")
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            fields = struct.unpack_from("<IIIIIIIIII", self.data, shoff + i * shentsize)
+            self.sections.append(fields)
+        names = self.sections[shstrndx]
+        self.names = [self._cstr(names[4] + s[0]) for s in self.sections]
+
+    def _cstr(self, offset):
+        end = self.data.index(b"\0", offset)
+        return self.data[offset:end].decode(errors="replace")
+
+    def _file_offset(self, addr):
+        for sh_name, sh_type, flags, sh_addr, offset, size, *_ in self.sections:
+            if sh_type == 1 and flags & 0x2 and sh_addr <= addr < sh_addr + size:
+                return offset + addr - sh_addr
+        return None
+
+    def string_at(self, addr):
+        offset = self._file_offset(addr)
+        return None if offset is None else self._cstr(offset)
+
+    def word_at(self, addr):
+        offset = self._file_offset(addr)
+        return None if offset is None else struct.unpack_from("<I", self.data, offset)[0]
+
+    def symbols(self):
+        """Yield (name, value) for every symbol."""
+        for i, (_, sh_type, _, _, offset, size, link, _, _, entsize) in enumerate(self.sections):
+            if sh_type != 2:
+                continue
+            strtab = self.sections[link][4]
+            for j in range(size // entsize):
+                st_name, value = struct.unpack_from("<II", self.data, offset + j * entsize)
+                yield self._cstr(strtab + st_name), value
+
+
+def build_dictionary(elf):
+    """Map token addresses to format strings and tag addresses to tags."""
+    formats, tags = {}, {}
+    for name, value in elf.symbols():
+        if name.startswith("tlog_fmt_"):
+            text = elf.string_at(value)
+            if text is not None:
+                formats[value] = text
+        elif name == "TAG":
+            ptr = elf.word_at(value)
+            text = elf.string_at(ptr) if ptr is not None else None
+            if text is not None:
+                tags[ptr] = text
+    return formats, tags
+
+
+class Resolver:
+    def __init__(self, path):
+        self.elf = None
+        if path.endswith(".json"):
+            with open(path) as f:
+                saved = json.load(f)
+            self.formats = {int(k, 16): v for k, v in saved["formats"].items()}
+            self.tags = {int(k, 16): v for k, v in saved["tags"].items()}
+        else:
+            self.elf = Elf(path)
+            self.formats, self.tags = build_dictionary(self.elf)
+
+    def lookup(self, table, addr):
+        if addr not in table and self.elf is not None:
+            table[addr] = self.elf.string_at(addr)
+        return table.get(addr)
+
+
+def cobs_decode(block):
+    out = bytearray()
+    i = 0
+    while i < len(block):
+        code = block[i]
+        if code == 0 or i + code > len(block):
+            return None
+        out += block[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(block):
+            out.append(0)
+    return bytes(out)
+
+
+def crc8(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def format_record(payload, resolver):
+    if len(payload) < HEADER.size:
+        return "<short log record>"
+    level, fmt_addr, tag_addr, ms = HEADER.unpack_from(payload)
+    fmt = resolver.lookup(resolver.formats, fmt_addr)
+    tag = resolver.lookup(resolver.tags, tag_addr) or f"0x{tag_addr:08x}"
+    prefix = f"{LEVELS[level] if level < len(LEVELS) else '?'} ({ms}) {tag}: "
+    if fmt is None:
+        return prefix + f"<unknown token 0x{fmt_addr:08x}>"
+
+    pos = HEADER.size
+    out = []
+    last = 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        flags, width, prec, length, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        try:
+            if width == "*":
+                width = str(struct.unpack_from("<i", payload, pos)[0])
+                pos += 4
+            if prec == "*":
+                prec = str(struct.unpack_from("<i", payload, pos)[0])
+                pos += 4
+            spec = "%" + flags + (width or "") + ("." + prec if prec else "")
+            if conv == "s":
+                n = payload[pos]
+                value = payload[pos + 1:pos + 1 + n].decode(errors="replace")
+                pos += 1 + n
+                out.append((spec + "s") % value)
+            elif conv in "fFeEgGaA":
+                value = struct.unpack_from("<f", payload, pos)[0]
+                pos += 4
+                out.append((spec + ("f" if conv in "aA" else conv)) % value)
+            else:
+                wide = length in ("ll", "j")
+                signed = conv in "di"
+                code = ("<q" if signed else "<Q") if wide else ("<i" if signed else "<I")
+                value = struct.unpack_from(code, payload, pos)[0]
+                pos += 8 if wide else 4
+                if conv == "p":
+                    out.append(f"0x{value:08x}")
+                elif conv == "c":
+                    out.append(chr(value & 0xFF))
+                else:
+                    out.append((spec + ("d" if conv in "iu" else conv)) % value)
+        except (struct.error, IndexError):
+            out.append("<truncated>")
+            last = len(fmt)
+            break
+    out.append(fmt[last:])
+    return prefix + "".join(out).rstrip("\n")
+
+
+def decode(stream, resolver):
+    buf = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            break
+        buf += chunk
+        while True:
+            end = buf.find(0)
+            if end < 0:
+                break
+            block, buf = bytes(buf[:end]), buf[end + 1:]
+            if not block:
+                continue
+            raw = cobs_decode(block)
+            if raw is None or len(raw) < 2 or crc8(raw[:-1]) != raw[-1]:
+                continue    # unframed text or a damaged frame
+            channel, payload = raw[0], raw[1:-1]
+            if channel == CH_DATA:
+                sys.stdout.write(payload.decode(errors="replace"))
+                sys.stdout.flush()
+            elif channel == CH_LOG:
+                print(format_record(payload, resolver), file=sys.stderr)
+            elif channel == CH_TEXT:
+                sys.stderr.write(payload.decode(errors="replace"))
+
+
+def main(argv):
+    if len(argv) >= 3 and argv[1] == "--dict":
+        formats, tags = build_dictionary(Elf(argv[2]))
+        saved = {"formats": {f"{k:08x}": v for k, v in sorted(formats.items())},
+                 "tags": {f"{k:08x}": v for k, v in sorted(tags.items())}}
+        out = open(argv[3], "w") if len(argv) > 3 else sys.stdout
+        json.dump(saved, out, indent=1)
+        out.write("\n")
+        print(f"{len(formats)} format strings, {len(tags)} tags", file=sys.stderr)
+        return
+    if len(argv) not in (2, 3):
+        sys.exit(__doc__)
+
+    resolver = Resolver(argv[1])
+    if len(argv) == 3:
+        with open(argv[2], "rb", buffering=0) as f:
+            decode(f, resolver)
+    else:
+        decode(sys.stdin.buffer, resolver)
+
+
+if __name__ == "__main__":
+    main(sys.argv)